@@ -8,6 +8,7 @@
 #include "util/asio.h"
 #include "bucket/Bucket.h"
 #include "bucket/BucketApplicator.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketList.h"
 #include "bucket/BucketManager.h"
 #include "bucket/BucketOutputIterator.h"
@@ -18,14 +19,17 @@
 #include "database/Database.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include "medida/timer.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
 #include "util/TmpDir.h"
 #include "util/XDRStream.h"
 #include "xdrpp/message.h"
+#include <algorithm>
 #include <cassert>
 #include <future>
+#include <iterator>
 
 namespace stellar
 {
@@ -80,6 +84,78 @@ Bucket::containsBucketIdentity(BucketEntry const& id) const
     return false;
 }
 
+std::shared_ptr<BucketIndex const>
+Bucket::getIndex() const
+{
+    assert(!mFilename.empty());
+    std::lock_guard<std::mutex> lock(mIndexMutex);
+    if (!mIndex)
+    {
+        auto indexFilename = BucketIndex::indexFilename(mFilename);
+        mIndex = BucketIndex::load(indexFilename, mHash);
+        if (!mIndex)
+        {
+            mIndex = BucketIndex::build(mFilename, mHash);
+            try
+            {
+                mIndex->save(indexFilename);
+            }
+            catch (std::runtime_error& e)
+            {
+                // Not fatal: the index will just be rebuilt next time.
+                CLOG(WARNING, "Bucket") << e.what();
+            }
+        }
+    }
+    return mIndex;
+}
+
+std::shared_ptr<BucketEntry>
+Bucket::getBucketEntry(LedgerKey const& k) const
+{
+    if (mFilename.empty())
+    {
+        return nullptr;
+    }
+
+    uint64_t begin, end;
+    if (!getIndex()->lookup(k, begin, end))
+    {
+        return nullptr;
+    }
+
+    XDRInputFileStream in;
+    in.open(mFilename);
+    in.seek(begin);
+    LedgerEntryIdCmp cmp;
+    auto be = std::make_shared<BucketEntry>();
+    while (in.pos() < end && in.readOne(*be))
+    {
+        bool before;
+        bool after;
+        if (be->type() == DEADENTRY)
+        {
+            before = cmp(be->deadEntry(), k);
+            after = cmp(k, be->deadEntry());
+        }
+        else
+        {
+            before = cmp(be->liveEntry().data, k);
+            after = cmp(k, be->liveEntry().data);
+        }
+
+        if (after)
+        {
+            break;
+        }
+        else if (!before)
+        {
+            return be;
+        }
+    }
+    return nullptr;
+}
+
 void
 Bucket::apply(Application& app) const
 {
@@ -150,7 +226,11 @@ Bucket::fresh(BucketManager& bucketManager, uint32_t protocolVersion,
         convertToBucketEntry(useInit, initEntries, liveEntries, deadEntries);
 
     MergeCounters mc;
-    BucketOutputIterator out(bucketManager.getTmpDir(), true, meta, mc);
+    auto const& cfg = bucketManager.getConfig();
+    BucketOutputIterator out(bucketManager.getTmpDir(), true, meta, mc,
+                             !cfg.DISABLE_XDR_FSYNC,
+                             cfg.BUCKET_WRITE_BUFFER_SIZE,
+                             cfg.BUCKET_WRITE_DIRECT_IO);
     for (auto const& e : entries)
     {
         out.put(e);
@@ -560,6 +640,76 @@ mergeCasesWithEqualKeys(MergeCounters& mc, BucketInputIterator& oi,
     ++ni;
 }
 
+static void
+mergeRange(MergeCounters& mc, BucketInputIterator& oi,
+           BucketInputIterator& ni, BucketOutputIterator& out,
+           std::vector<BucketInputIterator>& shadowIterators,
+           uint32_t protocolVersion, bool keepShadowedLifecycleEntries)
+{
+    BucketEntryIdCmp cmp;
+    while (oi || ni)
+    {
+        if (!mergeCasesWithDefaultAcceptance(cmp, mc, oi, ni, out,
+                                             shadowIterators, protocolVersion,
+                                             keepShadowedLifecycleEntries))
+        {
+            mergeCasesWithEqualKeys(mc, oi, ni, out, shadowIterators,
+                                    protocolVersion,
+                                    keepShadowedLifecycleEntries);
+        }
+    }
+}
+
+// Large merges are split into key ranges holding similar numbers of entries,
+// which are merged concurrently. The ranges are chosen by sampling the first
+// key of every page of both inputs' indexes. Returns the boundaries between
+// ranges, as DEADENTRYs, or nothing to merge on a single thread.
+static std::vector<BucketEntry>
+chooseMergeShardBounds(Config const& cfg, Bucket const& oldBucket,
+                       Bucket const& newBucket)
+{
+    std::vector<BucketEntry> bounds;
+    size_t nShards = cfg.BUCKET_MERGE_SHARDS;
+    nShards = std::min(nShards, (oldBucket.getSize() + newBucket.getSize()) /
+                                    cfg.BUCKET_MERGE_SHARD_MIN_SIZE);
+    if (nShards < 2)
+    {
+        return bounds;
+    }
+
+    LedgerEntryIdCmp cmp;
+    std::vector<LedgerKey> samples;
+    for (auto b : {&oldBucket, &newBucket})
+    {
+        if (b->getFilename().empty())
+        {
+            continue;
+        }
+        auto index = b->getIndex();
+        auto const& keys = index->getPageKeys();
+        std::vector<LedgerKey> merged;
+        merged.reserve(samples.size() + keys.size());
+        std::merge(samples.begin(), samples.end(), keys.begin(), keys.end(),
+                   std::back_inserter(merged), cmp);
+        samples.swap(merged);
+    }
+    if (samples.empty())
+    {
+        return bounds;
+    }
+
+    for (size_t i = 1; i < nShards; ++i)
+    {
+        auto const& k = samples.at(i * samples.size() / nShards);
+        if (bounds.empty() || cmp(bounds.back().deadEntry(), k))
+        {
+            bounds.emplace_back(DEADENTRY);
+            bounds.back().deadEntry() = k;
+        }
+    }
+    return bounds;
+}
+
 std::shared_ptr<Bucket>
 Bucket::merge(BucketManager& bucketManager, uint32_t maxProtocolVersion,
               std::shared_ptr<Bucket> const& oldBucket,
@@ -589,19 +739,70 @@ Bucket::merge(BucketManager& bucketManager, uint32_t maxProtocolVersion,
     auto timer = bucketManager.getMergeTimer().TimeScope();
     BucketMetadata meta;
     meta.ledgerVersion = protocolVersion;
+    auto const& cfg = bucketManager.getConfig();
     BucketOutputIterator out(bucketManager.getTmpDir(), keepDeadEntries, meta,
-                             mc);
+                             mc, !cfg.DISABLE_XDR_FSYNC,
+                             cfg.BUCKET_WRITE_BUFFER_SIZE,
+                             cfg.BUCKET_WRITE_DIRECT_IO);
 
-    BucketEntryIdCmp cmp;
-    while (oi || ni)
+    auto bounds = chooseMergeShardBounds(cfg, *oldBucket, *newBucket);
+    if (bounds.empty())
     {
-        if (!mergeCasesWithDefaultAcceptance(cmp, mc, oi, ni, out,
-                                             shadowIterators, protocolVersion,
-                                             keepShadowedLifecycleEntries))
+        mergeRange(mc, oi, ni, out, shadowIterators, protocolVersion,
+                   keepShadowedLifecycleEntries);
+    }
+    else
+    {
+        // Each key range is merged, with iterators of its own over the inputs
+        // and shadows, into a file of its own. The files are then appended to
+        // `out` in order, which hashes them as one stream: the bucket is the
+        // same as if merged on this thread.
+        size_t nShards = bounds.size() + 1;
+        CLOG(DEBUG, "Bucket") << "Merging in " << nShards << " shards";
+        std::vector<MergeCounters> shardCounters(nShards);
+        std::vector<std::unique_ptr<BucketOutputIterator>> shardOuts;
+        std::vector<std::future<void>> shardMerges;
+        for (size_t i = 0; i < nShards; ++i)
         {
-            mergeCasesWithEqualKeys(mc, oi, ni, out, shadowIterators,
-                                    protocolVersion,
-                                    keepShadowedLifecycleEntries);
+            shardOuts.emplace_back(std::make_unique<BucketOutputIterator>(
+                bucketManager.getTmpDir(), out, shardCounters[i]));
+        }
+        auto mergeShard = [&](size_t i) {
+            BucketEntry const* begin = i == 0 ? nullptr : &bounds[i - 1];
+            BucketEntry const* end = i + 1 == nShards ? nullptr : &bounds[i];
+            BucketInputIterator soi(oldBucket);
+            BucketInputIterator sni(newBucket);
+            std::vector<BucketInputIterator> sShadowIterators(shadows.begin(),
+                                                              shadows.end());
+            soi.setRange(begin, end);
+            sni.setRange(begin, end);
+            for (auto& si : sShadowIterators)
+            {
+                si.setRange(begin, end);
+            }
+            mergeRange(shardCounters[i], soi, sni, *shardOuts[i],
+                       sShadowIterators, protocolVersion,
+                       keepShadowedLifecycleEntries);
+        };
+        for (size_t i = 0; i < nShards; ++i)
+        {
+            shardMerges.emplace_back(
+                std::async(std::launch::async, mergeShard, i));
+        }
+        // Let every shard finish before anything can unwind, since they
+        // refer to this frame; then rethrow the first failure, if any.
+        for (auto& f : shardMerges)
+        {
+            f.wait();
+        }
+        for (auto& f : shardMerges)
+        {
+            f.get();
+        }
+        for (size_t i = 0; i < nShards; ++i)
+        {
+            out.append(*shardOuts[i]);
+            mc += shardCounters[i];
         }
     }
     if (countMergeEvents)
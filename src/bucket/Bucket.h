@@ -9,6 +9,7 @@
 #include "overlay/StellarXDR.h"
 #include "util/NonCopyable.h"
 #include "util/XDRStream.h"
+#include <mutex>
 #include <string>
 
 namespace stellar
@@ -27,6 +28,7 @@ namespace stellar
 
 class Application;
 class BucketManager;
+class BucketIndex;
 class BucketList;
 class Database;
 
@@ -38,6 +40,11 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
     Hash const mHash;
     size_t mSize{0};
 
+    // The point-lookup index is derived entirely from the (immutable) file,
+    // and is loaded or rebuilt on first use.
+    mutable std::mutex mIndexMutex;
+    mutable std::shared_ptr<BucketIndex const> mIndex;
+
   public:
     // Create an empty bucket. The empty bucket has hash '000000...' and its
     // filename is the empty string.
@@ -56,6 +63,15 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
     // BucketEntry exists in the bucket. For testing.
     bool containsBucketIdentity(BucketEntry const& id) const;
 
+    // Return the point-lookup index of this bucket, loading it from the file
+    // next to the bucket or, failing that, rebuilding (and persisting) it by
+    // scanning the bucket. Must not be called on the empty bucket.
+    std::shared_ptr<BucketIndex const> getIndex() const;
+
+    // Return the entry (INIT, LIVE or DEAD) this bucket holds for `k`, or
+    // nullptr if the bucket does not mention `k`.
+    std::shared_ptr<BucketEntry> getBucketEntry(LedgerKey const& k) const;
+
     // At version 11, we added support for INITENTRY and METAENTRY. Before this
     // we were only supporting LIVEENTRY and DEADENTRY.
     static constexpr uint32_t
@@ -11,14 +11,43 @@
 #include "main/Application.h"
 #include "util/Logging.h"
 #include "util/types.h"
+#include "xdrpp/marshal.h"
+#include <algorithm>
+#include <cstring>
+#include <sodium.h>
 
 namespace stellar
 {
 
+namespace
+{
+// Enables parallel bulk writes on the root for as long as it lives, so that
+// they are turned off again whether or not the commit throws.
+class ParallelBulkWrites
+{
+    LedgerTxnRoot& mRoot;
+
+  public:
+    explicit ParallelBulkWrites(LedgerTxnRoot& root) : mRoot(root)
+    {
+        mRoot.setParallelBulkWrites(true);
+    }
+
+    ~ParallelBulkWrites()
+    {
+        mRoot.setParallelBulkWrites(false);
+    }
+};
+}
+
 BucketApplicator::BucketApplicator(Application& app,
                                    uint32_t maxProtocolVersion,
-                                   std::shared_ptr<const Bucket> bucket)
-    : mApp(app), mMaxProtocolVersion(maxProtocolVersion), mBucketIter(bucket)
+                                   std::shared_ptr<const Bucket> bucket,
+                                   ShadowSet* shadows)
+    : mApp(app)
+    , mMaxProtocolVersion(maxProtocolVersion)
+    , mBucketIter(bucket)
+    , mShadows(shadows)
 {
     auto protocolVersion = mBucketIter.getMetadata().ledgerVersion;
     if (protocolVersion > mMaxProtocolVersion)
@@ -51,15 +80,24 @@ BucketApplicator::advance(BucketApplicator::Counters& counters)
 {
     size_t count = 0;
 
-    LedgerTxn ltx(mApp.getLedgerTxnRoot(), false);
+    auto& root = mApp.getLedgerTxnRoot();
+    LedgerTxn ltx(root, false);
     for (; mBucketIter; ++mBucketIter)
     {
         BucketEntry const& e = *mBucketIter;
         Bucket::checkProtocolLegality(e, mMaxProtocolVersion);
-        counters.mark(e);
         if (e.type() == LIVEENTRY || e.type() == INITENTRY)
         {
-            ltx.createOrUpdateWithoutLoading(e.liveEntry());
+            if (mShadows &&
+                mShadows->checkAndRecord(LedgerEntryKey(e.liveEntry())))
+            {
+                counters.markShadowed();
+            }
+            else
+            {
+                counters.mark(e);
+                ltx.createOrUpdateWithoutLoading(e.liveEntry());
+            }
         }
         else
         {
@@ -68,7 +106,15 @@ BucketApplicator::advance(BucketApplicator::Counters& counters)
                 throw std::runtime_error(
                     "Malformed bucket: unexpected non-INIT/LIVE/DEAD entry.");
             }
-            ltx.eraseWithoutLoading(e.deadEntry());
+            if (mShadows && mShadows->checkAndRecord(e.deadEntry()))
+            {
+                counters.markShadowed();
+            }
+            else
+            {
+                counters.mark(e);
+                ltx.eraseWithoutLoading(e.deadEntry());
+            }
         }
 
         if ((++count > LEDGER_ENTRY_BATCH_COMMIT_SIZE))
@@ -76,12 +122,74 @@ BucketApplicator::advance(BucketApplicator::Counters& counters)
             break;
         }
     }
+
+    // Each commit holds at most one entry per key, and every table is written
+    // before the next commit starts, so nothing here depends on the tables
+    // being written atomically and they can be written in parallel.
+    ParallelBulkWrites parallel(root);
     ltx.commit();
 
     mCount += count;
     return count;
 }
 
+BucketApplicator::ShadowSet::ShadowSet()
+{
+    static_assert(sizeof(mHashKey) == crypto_shorthash_siphashx24_KEYBYTES,
+                  "unexpected key size");
+    crypto_shorthash_siphashx24_keygen(mHashKey.data());
+}
+
+BucketApplicator::ShadowSet::Digest
+BucketApplicator::ShadowSet::digest(LedgerKey const& k) const
+{
+    auto buf = xdr::xdr_to_opaque(k);
+    std::array<unsigned char, crypto_shorthash_siphashx24_BYTES> out;
+    crypto_shorthash_siphashx24(out.data(), buf.data(), buf.size(),
+                                mHashKey.data());
+    Digest res;
+    std::memcpy(&res.first, out.data(), sizeof(res.first));
+    std::memcpy(&res.second, out.data() + sizeof(res.first),
+                sizeof(res.second));
+    return res;
+}
+
+void
+BucketApplicator::ShadowSet::nextBucket(bool recordKeys)
+{
+    // A bucket holds each key at most once, so its own keys only need
+    // looking up once the next bucket starts.
+    std::sort(mCurrent.begin(), mCurrent.end());
+    auto mid = mShadowing.size();
+    mShadowing.insert(mShadowing.end(), mCurrent.begin(), mCurrent.end());
+    std::inplace_merge(mShadowing.begin(), mShadowing.begin() + mid,
+                       mShadowing.end());
+    std::vector<Digest>().swap(mCurrent);
+    mRecordKeys = recordKeys;
+}
+
+bool
+BucketApplicator::ShadowSet::checkAndRecord(LedgerKey const& k)
+{
+    auto d = digest(k);
+    if (std::binary_search(mShadowing.begin(), mShadowing.end(), d))
+    {
+        return true;
+    }
+    if (mRecordKeys)
+    {
+        mCurrent.emplace_back(d);
+    }
+    return false;
+}
+
+bool
+BucketApplicator::ShadowSet::isShadowed(LedgerKey const& k) const
+{
+    return std::binary_search(mShadowing.begin(), mShadowing.end(),
+                              digest(k));
+}
+
 BucketApplicator::Counters::Counters(VirtualClock::time_point now)
 {
     reset(now);
@@ -99,6 +207,7 @@ BucketApplicator::Counters::reset(VirtualClock::time_point now)
     mOfferDelete = 0;
     mDataUpsert = 0;
     mDataDelete = 0;
+    mShadowed = 0;
 }
 
 void
@@ -147,7 +256,7 @@ BucketApplicator::Counters::logInfo(std::string const& bucketName,
                          << " tu:" << mTrustLineUpsert
                          << " td:" << mTrustLineDelete << " ou:" << mOfferUpsert
                          << " od:" << mOfferDelete << " du:" << mDataUpsert
-                         << " dd:" << mDataDelete;
+                         << " dd:" << mDataDelete << " sh:" << mShadowed;
 }
 
 void
@@ -167,6 +276,12 @@ BucketApplicator::Counters::logDebug(std::string const& bucketName,
                           << " dd:" << dd_sec << " T:" << T_sec;
 }
 
+void
+BucketApplicator::Counters::markShadowed()
+{
+    ++mShadowed;
+}
+
 void
 BucketApplicator::Counters::mark(BucketEntry const& e)
 {
@@ -8,7 +8,10 @@
 #include "bucket/BucketInputIterator.h"
 #include "util/Timer.h"
 #include "util/XDRStream.h"
+#include <array>
 #include <memory>
+#include <utility>
+#include <vector>
 
 namespace stellar
 {
@@ -21,9 +24,52 @@ class Application;
 
 class BucketApplicator
 {
+  public:
+    // When buckets are applied newest-first, a ShadowSet shared by their
+    // applicators remembers every key written so far. Any entry for such a key
+    // in an older bucket is shadowed and is skipped, so each key (live or dead)
+    // reaches the database exactly once.
+    //
+    // Every key of every bucket but the oldest is held on to, so rather than
+    // the keys themselves it holds a 128-bit keyed hash of each: 16 bytes a
+    // key, in sorted vectors rather than a hash table. Two keys are only
+    // mistaken for one another if their hashes collide, which for the hash
+    // key chosen at random per ShadowSet has negligible odds.
+    class ShadowSet
+    {
+        using Digest = std::pair<uint64_t, uint64_t>;
+
+        std::array<unsigned char, 16> mHashKey;
+        // Digests of the keys of the newer buckets, sorted.
+        std::vector<Digest> mShadowing;
+        // Digests of the keys of the current bucket, as recorded.
+        std::vector<Digest> mCurrent;
+        bool mRecordKeys{true};
+
+        Digest digest(LedgerKey const& k) const;
+
+      public:
+        ShadowSet();
+
+        // Move on to the next (older) bucket. Pass `recordKeys` false for the
+        // oldest bucket being applied: nothing can be shadowed by its keys, so
+        // there is no point holding on to them.
+        void nextBucket(bool recordKeys);
+
+        // Returns true if `k` was written from a newer bucket than the current
+        // one; otherwise records it as written from the current bucket.
+        bool checkAndRecord(LedgerKey const& k);
+
+        // Returns true if `k` was written from a newer bucket than the current
+        // one.
+        bool isShadowed(LedgerKey const& k) const;
+    };
+
+  private:
     Application& mApp;
     uint32_t mMaxProtocolVersion;
     BucketInputIterator mBucketIter;
+    ShadowSet* mShadows;
     size_t mCount{0};
 
   public:
@@ -42,6 +88,7 @@ class BucketApplicator
         uint64_t mOfferDelete;
         uint64_t mDataUpsert;
         uint64_t mDataDelete;
+        uint64_t mShadowed;
         void getRates(VirtualClock::time_point now, uint64_t& au_sec,
                       uint64_t& ad_sec, uint64_t& tu_sec, uint64_t& td_sec,
                       uint64_t& ou_sec, uint64_t& od_sec, uint64_t& du_sec,
@@ -51,14 +98,18 @@ class BucketApplicator
         Counters(VirtualClock::time_point now);
         void reset(VirtualClock::time_point now);
         void mark(BucketEntry const& e);
+        void markShadowed();
         void logInfo(std::string const& bucketName, uint32_t level,
                      VirtualClock::time_point now);
         void logDebug(std::string const& bucketName, uint32_t level,
                       VirtualClock::time_point now);
     };
 
+    // If `shadows` is non-null, entries whose keys it reports as shadowed are
+    // skipped rather than written.
     BucketApplicator(Application& app, uint32_t maxProtocolVersion,
-                     std::shared_ptr<const Bucket> bucket);
+                     std::shared_ptr<const Bucket> bucket,
+                     ShadowSet* shadows = nullptr);
     operator bool() const;
     size_t advance(Counters& counters);
 
@@ -0,0 +1,300 @@
+// Copyright 2019 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "bucket/BucketIndex.h"
+#include "bucket/LedgerCmp.h"
+#include "crypto/Random.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+#include "util/XDRStream.h"
+#include "util/types.h"
+#include "xdrpp/marshal.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <sodium.h>
+
+namespace stellar
+{
+
+namespace
+{
+// Bumped whenever the on-disk layout of the index changes; an index file with
+// another version is ignored and rebuilt.
+uint32_t const INDEX_FORMAT_VERSION = 1;
+
+// Sizing the filter at 10 bits per key with 7 probes gives a false positive
+// rate just under 1%.
+size_t const BLOOM_BITS_PER_KEY = 10;
+uint32_t const BLOOM_PROBES = 7;
+
+// Probe `i` of a key with hash `h`, using the usual double-hashing scheme.
+uint64_t
+bloomProbe(uint64_t h, uint32_t i, uint64_t nBits)
+{
+    uint64_t h1 = h & 0xffffffff;
+    uint64_t h2 = h >> 32;
+    return (h1 + i * h2) % nBits;
+}
+
+LedgerKey const&
+bucketEntryKey(BucketEntry const& e, LedgerKey& storage)
+{
+    if (e.type() == DEADENTRY)
+    {
+        return e.deadEntry();
+    }
+    storage = LedgerEntryKey(e.liveEntry());
+    return storage;
+}
+}
+
+size_t const BucketIndex::kPageSize = 256;
+
+BucketIndex::Builder::Builder()
+{
+    auto key = randomBytes(mBloomKey.size());
+    std::copy(key.begin(), key.end(), mBloomKey.begin());
+}
+
+void
+BucketIndex::Builder::add(BucketEntry const& e, uint64_t offset)
+{
+    if (e.type() == METAENTRY)
+    {
+        return;
+    }
+
+    LedgerKey storage;
+    auto const& k = bucketEntryKey(e, storage);
+    if (mKeyHashes.size() % kPageSize == 0)
+    {
+        mPageKeys.emplace_back(k);
+        mPageOffsets.emplace_back(offset);
+    }
+    mKeyHashes.emplace_back(bloomHash(mBloomKey, k));
+}
+
+void
+BucketIndex::Builder::shareBloomKey(Builder const& whole)
+{
+    assert(mKeyHashes.empty());
+    mBloomKey = whole.mBloomKey;
+}
+
+void
+BucketIndex::Builder::append(Builder& shard, uint64_t offset)
+{
+    assert(shard.mBloomKey == mBloomKey);
+    for (size_t i = 0; i < shard.mPageKeys.size(); ++i)
+    {
+        mPageKeys.emplace_back(std::move(shard.mPageKeys[i]));
+        mPageOffsets.emplace_back(shard.mPageOffsets[i] + offset);
+    }
+    mKeyHashes.insert(mKeyHashes.end(), shard.mKeyHashes.begin(),
+                      shard.mKeyHashes.end());
+
+    shard.mPageKeys.clear();
+    shard.mPageOffsets.clear();
+    shard.mKeyHashes.clear();
+}
+
+std::shared_ptr<BucketIndex const>
+BucketIndex::Builder::finish(Hash const& bucketHash, uint64_t fileSize)
+{
+    std::shared_ptr<BucketIndex> index(new BucketIndex());
+    index->mBucketHash = bucketHash;
+    index->mFileSize = fileSize;
+    index->mBloomKey = mBloomKey;
+    index->mPageKeys = std::move(mPageKeys);
+    index->mPageOffsets = std::move(mPageOffsets);
+
+    // Round the filter up to whole words, and keep at least one so that
+    // probing an empty bucket's index is well defined.
+    size_t nWords = (mKeyHashes.size() * BLOOM_BITS_PER_KEY + 63) / 64 + 1;
+    index->mBloomBits.resize(nWords, 0);
+    uint64_t nBits = nWords * 64;
+    for (auto h : mKeyHashes)
+    {
+        for (uint32_t i = 0; i < BLOOM_PROBES; ++i)
+        {
+            auto bit = bloomProbe(h, i, nBits);
+            index->mBloomBits[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+    }
+
+    mPageKeys.clear();
+    mPageOffsets.clear();
+    mKeyHashes.clear();
+    return index;
+}
+
+std::string
+BucketIndex::indexFilename(std::string const& bucketFilename)
+{
+    return bucketFilename + ".index";
+}
+
+std::shared_ptr<BucketIndex const>
+BucketIndex::build(std::string const& bucketFilename, Hash const& bucketHash)
+{
+    CLOG(DEBUG, "Bucket") << "Building index for bucket " << bucketFilename;
+    Builder builder;
+    XDRMappedInputFileStream in;
+    in.open(bucketFilename);
+    BucketEntry e;
+    uint64_t offset = in.pos();
+    while (in.readOne(e))
+    {
+        builder.add(e, offset);
+        offset = in.pos();
+    }
+    return builder.finish(bucketHash, in.size());
+}
+
+std::shared_ptr<BucketIndex const>
+BucketIndex::load(std::string const& indexFilename, Hash const& bucketHash)
+{
+    if (!fs::exists(indexFilename))
+    {
+        return nullptr;
+    }
+
+    std::vector<uint8_t> buf;
+    {
+        std::ifstream in(indexFilename, std::ifstream::binary);
+        if (!in)
+        {
+            return nullptr;
+        }
+        buf.resize(fs::size(in));
+        if (!in.read(reinterpret_cast<char*>(buf.data()), buf.size()))
+        {
+            return nullptr;
+        }
+    }
+
+    uint32_t version = 0;
+    std::shared_ptr<BucketIndex> index(new BucketIndex());
+    try
+    {
+        xdr::xdr_from_opaque(buf, version, index->mBucketHash,
+                             index->mFileSize, index->mBloomKey,
+                             index->mBloomBits, index->mPageKeys,
+                             index->mPageOffsets);
+    }
+    catch (xdr::xdr_runtime_error& e)
+    {
+        CLOG(WARNING, "Bucket")
+            << "Ignoring malformed bucket index " << indexFilename << ": "
+            << e.what();
+        return nullptr;
+    }
+
+    if (version != INDEX_FORMAT_VERSION || index->mBucketHash != bucketHash ||
+        index->mBloomBits.empty() ||
+        index->mPageKeys.size() != index->mPageOffsets.size())
+    {
+        CLOG(WARNING, "Bucket")
+            << "Ignoring stale bucket index " << indexFilename;
+        return nullptr;
+    }
+    return index;
+}
+
+void
+BucketIndex::save(std::string const& indexFilename) const
+{
+    auto buf = xdr::xdr_to_opaque(INDEX_FORMAT_VERSION, mBucketHash,
+                                  mFileSize, mBloomKey, mBloomBits,
+                                  mPageKeys, mPageOffsets);
+    std::ofstream out(indexFilename,
+                      std::ofstream::binary | std::ofstream::trunc);
+    if (!out ||
+        !out.write(reinterpret_cast<char const*>(buf.data()), buf.size()))
+    {
+        throw std::runtime_error("failed to write bucket index: " +
+                                 indexFilename);
+    }
+}
+
+bool
+BucketIndex::lookup(LedgerKey const& k, uint64_t& begin, uint64_t& end) const
+{
+    if (mPageKeys.empty() || !bloomMayContain(bloomHash(mBloomKey, k)))
+    {
+        return false;
+    }
+
+    // Find the last page whose first key is not greater than k.
+    auto it = std::upper_bound(mPageKeys.begin(), mPageKeys.end(), k,
+                               LedgerEntryIdCmp{});
+    if (it == mPageKeys.begin())
+    {
+        return false;
+    }
+    size_t page = std::distance(mPageKeys.begin(), it) - 1;
+    begin = mPageOffsets[page];
+    end = page + 1 < mPageOffsets.size() ? mPageOffsets[page + 1] : mFileSize;
+    return true;
+}
+
+uint64_t
+BucketIndex::scanStartOffset(LedgerKey const& k) const
+{
+    if (mPageKeys.empty())
+    {
+        return mFileSize;
+    }
+    auto it = std::upper_bound(mPageKeys.begin(), mPageKeys.end(), k,
+                               LedgerEntryIdCmp{});
+    if (it == mPageKeys.begin())
+    {
+        return mPageOffsets.front();
+    }
+    return mPageOffsets[std::distance(mPageKeys.begin(), it) - 1];
+}
+
+xdr::xvector<LedgerKey> const&
+BucketIndex::getPageKeys() const
+{
+    return mPageKeys;
+}
+
+size_t
+BucketIndex::getPageCount() const
+{
+    return mPageKeys.size();
+}
+
+uint64_t
+BucketIndex::bloomHash(xdr::opaque_array<16> const& bloomKey,
+                       LedgerKey const& k)
+{
+    // The filter is persisted, so it is keyed with its own random key rather
+    // than the process-wide one used by shortHash.
+    static_assert(crypto_shorthash_KEYBYTES == 16, "unexpected key size");
+    auto bytes = xdr::xdr_to_opaque(k);
+    uint64_t res;
+    crypto_shorthash(reinterpret_cast<unsigned char*>(&res), bytes.data(),
+                     bytes.size(), bloomKey.data());
+    return res;
+}
+
+bool
+BucketIndex::bloomMayContain(uint64_t h) const
+{
+    uint64_t nBits = mBloomBits.size() * 64;
+    for (uint32_t i = 0; i < BLOOM_PROBES; ++i)
+    {
+        auto bit = bloomProbe(h, i, nBits);
+        if ((mBloomBits[bit / 64] & (uint64_t(1) << (bit % 64))) == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+// Copyright 2019 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+#include <memory>
+#include <string>
+
+namespace stellar
+{
+
+/**
+ * BucketIndex is an immutable side-structure supporting point lookups into a
+ * bucket file.
+ *
+ * Buckets are sorted by LedgerEntryIdCmp, so the index only records the key
+ * and file offset of the first entry of every page of kPageSize entries: a
+ * lookup binary-searches the page keys and then scans at most one page of the
+ * file. A bloom filter over every key in the bucket lets lookups for keys the
+ * bucket does not mention -- the common case for all but one bucket of the
+ * BucketList -- return without touching the file at all.
+ *
+ * Indexes are built by BucketOutputIterator while a bucket is written, and
+ * persisted next to the bucket file (see `indexFilename`). Buckets that arrive
+ * without one, for example from a history archive, have it rebuilt by a single
+ * sequential scan the first time they are searched.
+ */
+class BucketIndex : NonMovableOrCopyable
+{
+  public:
+    // Number of bucket entries covered by each page.
+    static size_t const kPageSize;
+
+    // Accumulates the keys and offsets of a bucket as it is written, in
+    // order, and produces the finished index.
+    class Builder : NonMovableOrCopyable
+    {
+        xdr::opaque_array<16> mBloomKey;
+        xdr::xvector<LedgerKey> mPageKeys;
+        xdr::xvector<uint64_t> mPageOffsets;
+        std::vector<uint64_t> mKeyHashes;
+
+      public:
+        Builder();
+
+        // Record that `e` was written to the bucket file at byte `offset`.
+        // Entries must be added in bucket order; METAENTRY is ignored.
+        void add(BucketEntry const& e, uint64_t offset);
+
+        // Make this (still empty) builder hash keys the way `whole` does, so
+        // that it can index a run of entries to be appended to `whole`.
+        void shareBloomKey(Builder const& whole);
+
+        // Add the entries indexed by `shard`, which shares this builder's
+        // bloom key and whose offsets are relative to byte `offset` of the
+        // bucket. They must follow every entry added so far. Leaves `shard`
+        // empty.
+        void append(Builder& shard, uint64_t offset);
+
+        // Produce the index of the bucket with hash `bucketHash` whose file is
+        // `fileSize` bytes long. The builder is left empty.
+        std::shared_ptr<BucketIndex const> finish(Hash const& bucketHash,
+                                                  uint64_t fileSize);
+    };
+
+    // Return the name of the file holding the index for `bucketFilename`.
+    static std::string indexFilename(std::string const& bucketFilename);
+
+    // Build an index by scanning `bucketFilename`, which must hold the bucket
+    // with hash `bucketHash`.
+    static std::shared_ptr<BucketIndex const>
+    build(std::string const& bucketFilename, Hash const& bucketHash);
+
+    // Load the index stored in `indexFilename`. Returns nullptr if the file is
+    // missing, malformed, or describes a bucket other than `bucketHash`.
+    static std::shared_ptr<BucketIndex const>
+    load(std::string const& indexFilename, Hash const& bucketHash);
+
+    // Write this index to `indexFilename`, replacing any existing file.
+    void save(std::string const& indexFilename) const;
+
+    // Returns false if `k` is definitely not in the bucket. Otherwise sets
+    // [`begin`, `end`) to the range of file offsets of the only page that can
+    // contain `k`, and returns true.
+    bool lookup(LedgerKey const& k, uint64_t& begin, uint64_t& end) const;
+
+    // Return the offset from which a scan of the bucket meets every entry
+    // with a key not less than `k`: the start of the last page whose first
+    // key is not greater than `k` (or of the first page).
+    uint64_t scanStartOffset(LedgerKey const& k) const;
+
+    // The first key of every page, in order: an evenly spaced sample of the
+    // bucket's keys.
+    xdr::xvector<LedgerKey> const& getPageKeys() const;
+
+    size_t getPageCount() const;
+
+  private:
+    Hash mBucketHash;
+    uint64_t mFileSize{0};
+    xdr::opaque_array<16> mBloomKey;
+    xdr::xvector<uint64_t> mBloomBits;
+    xdr::xvector<LedgerKey> mPageKeys;
+    xdr::xvector<uint64_t> mPageOffsets;
+
+    BucketIndex() = default;
+
+    static uint64_t bloomHash(xdr::opaque_array<16> const& bloomKey,
+                              LedgerKey const& k);
+    bool bloomMayContain(uint64_t h) const;
+};
+}
@@ -4,6 +4,8 @@
 
 #include "bucket/BucketInputIterator.h"
 #include "bucket/Bucket.h"
+#include "bucket/BucketIndex.h"
+#include "util/types.h"
 
 namespace stellar
 {
@@ -42,6 +44,10 @@ BucketInputIterator::loadEntry()
             {
                 Bucket::checkProtocolLegality(mEntry, mMetadata.ledgerVersion);
             }
+            if (mEnd && !BucketEntryIdCmp{}(mEntry, *mEnd))
+            {
+                mEntryPtr = nullptr;
+            }
         }
     }
     else
@@ -110,7 +116,7 @@ BucketInputIterator::~BucketInputIterator()
 
 BucketInputIterator& BucketInputIterator::operator++()
 {
-    if (mIn)
+    if (mIn && mEntryPtr)
     {
         loadEntry();
     }
@@ -120,4 +126,41 @@ BucketInputIterator& BucketInputIterator::operator++()
     }
     return *this;
 }
+
+void
+BucketInputIterator::setRange(BucketEntry const* begin, BucketEntry const* end)
+{
+    if (end)
+    {
+        mEnd = std::make_unique<BucketEntry const>(*end);
+    }
+    if (!mEntryPtr)
+    {
+        return;
+    }
+
+    BucketEntryIdCmp cmp;
+    if (begin && cmp(*mEntryPtr, *begin))
+    {
+        // Every entry before the page that may hold `begin` is less than it;
+        // so, being less than `begin`, is the current entry.
+        LedgerKey k = begin->type() == DEADENTRY
+                          ? begin->deadEntry()
+                          : LedgerEntryKey(begin->liveEntry());
+        auto offset = mBucket->getIndex()->scanStartOffset(k);
+        if (offset > mIn.pos())
+        {
+            mIn.seek(offset);
+        }
+        loadEntry();
+        while (mEntryPtr && cmp(*mEntryPtr, *begin))
+        {
+            loadEntry();
+        }
+    }
+    if (mEntryPtr && mEnd && !cmp(*mEntryPtr, *mEnd))
+    {
+        mEntryPtr = nullptr;
+    }
+}
 }
@@ -24,11 +24,12 @@ class BucketInputIterator
     // pointer. If
     // non-null, it points to mEntry.
     BucketEntry const* mEntryPtr{nullptr};
-    XDRInputFileStream mIn;
+    XDRMappedInputFileStream mIn;
     BucketEntry mEntry;
     bool mSeenMetadata{false};
     bool mSeenOtherEntries{false};
     BucketMetadata mMetadata;
+    std::unique_ptr<BucketEntry const> mEnd;
     void loadEntry();
 
   public:
@@ -52,6 +53,12 @@ class BucketInputIterator
 
     BucketInputIterator& operator++();
 
+    // Restrict the iterator to the entries not less than `begin` and less
+    // than `end` (by BucketEntryIdCmp); a null bound is left open. Skips to
+    // `begin` using the bucket's index. Must be called before advancing the
+    // iterator. Used to merge a bucket in several key ranges at once.
+    void setRange(BucketEntry const* begin, BucketEntry const* end);
+
     size_t pos();
     size_t size() const;
 };
@@ -360,6 +360,28 @@ BucketList::getHash() const
     return hsh->finish();
 }
 
+std::shared_ptr<LedgerEntry>
+BucketList::getLedgerEntry(LedgerKey const& k) const
+{
+    for (auto const& lev : mLevels)
+    {
+        for (auto const& b : {lev.getCurr(), lev.getSnap()})
+        {
+            auto be = b->getBucketEntry(k);
+            if (!be)
+            {
+                continue;
+            }
+            if (be->type() == DEADENTRY)
+            {
+                return nullptr;
+            }
+            return std::make_shared<LedgerEntry>(be->liveEntry());
+        }
+    }
+    return nullptr;
+}
+
 // levelShouldSpill is the set of boundaries at which each level should spill,
 // it's not-entirely obvious which numbers these are by inspection, so we list
 // the first 3 values it's true on each level here for reference:
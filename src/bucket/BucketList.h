@@ -400,6 +400,13 @@ class BucketList
     // of the concatenation of the hashes of the `curr` and `snap` buckets.
     Hash getHash() const;
 
+    // Resolve `k` against the state the BucketList represents, without going
+    // to the database. Buckets are searched newest-first (each level's curr
+    // then snap, from level 0 down) and the first one mentioning `k` decides:
+    // returns its entry if that is INIT or LIVE, nullptr if it is DEAD or if no
+    // bucket mentions `k`.
+    std::shared_ptr<LedgerEntry> getLedgerEntry(LedgerKey const& k) const;
+
     // Restart any merges that might be running on background worker threads,
     // merging buckets between levels. This needs to be called after forcing a
     // BucketList to adopt a new state, either at application restart or when
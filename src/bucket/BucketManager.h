@@ -5,8 +5,10 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "bucket/Bucket.h"
+#include "bucket/MergeKey.h"
 #include "overlay/StellarXDR.h"
 #include "util/NonCopyable.h"
+#include <future>
 #include <memory>
 
 #include "medida/timer_context.h"
@@ -16,6 +18,7 @@ namespace stellar
 
 class Application;
 class BucketList;
+class Config;
 class TmpDirManager;
 struct LedgerHeader;
 struct HistoryArchiveState;
@@ -54,6 +57,9 @@ struct MergeCounters
     uint64_t mOutputIteratorTombstoneElisions{0};
     uint64_t mOutputIteratorBufferUpdates{0};
     uint64_t mOutputIteratorActualWrites{0};
+
+    uint64_t mRunningMergeReattachments{0};
+    uint64_t mFinishedMergeReattachments{0};
     MergeCounters& operator+=(MergeCounters const& delta);
 };
 
@@ -93,6 +99,7 @@ class BucketManager : NonMovableOrCopyable
     virtual TmpDirManager& getTmpDirManager() = 0;
     virtual std::string const& getBucketDir() = 0;
     virtual BucketList& getBucketList() = 0;
+    virtual Config const& getConfig() const = 0;
 
     virtual medida::Timer& getMergeTimer() = 0;
 
@@ -119,6 +126,24 @@ class BucketManager : NonMovableOrCopyable
     // Return a bucket by hash if we have it, else return nullptr.
     virtual std::shared_ptr<Bucket> getBucketByHash(uint256 const& hash) = 0;
 
+    // Merges are run once per MergeKey. Before starting a merge, look for a
+    // future of its output: that of an identical merge still running, or an
+    // already-resolved one if an identical merge completed -- possibly in a
+    // previous run, as completed merges are recorded in the bucket directory
+    // for as long as their output is kept. Returns an invalid future if there
+    // is none, in which case the caller starts the merge, registers its
+    // future with putMergeFuture and reports its end with finishMerge.
+    //
+    // These methods are threadsafe.
+    virtual std::shared_future<std::shared_ptr<Bucket>>
+    getMergeFuture(MergeKey const& key) = 0;
+    virtual void
+    putMergeFuture(MergeKey const& key,
+                   std::shared_future<std::shared_ptr<Bucket>> future) = 0;
+    // Record that merge `key` produced `output`, or failed if it is null.
+    virtual void finishMerge(MergeKey const& key,
+                             std::shared_ptr<Bucket> const& output) = 0;
+
     // Forget any buckets not referenced by the current BucketList. This will
     // not immediately cause the buckets to delete themselves, if someone else
     // is using them via a shared_ptr<>, but the BucketManager will no longer
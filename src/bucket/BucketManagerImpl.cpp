@@ -4,6 +4,7 @@
 
 #include "bucket/BucketManagerImpl.h"
 #include "bucket/Bucket.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketList.h"
 #include "crypto/Hex.h"
 #include "history/HistoryManager.h"
@@ -16,6 +17,7 @@
 #include "util/Logging.h"
 #include "util/TmpDir.h"
 #include "util/types.h"
+#include <cereal/archives/json.hpp>
 #include <fstream>
 #include <map>
 #include <regex>
@@ -60,6 +62,7 @@ BucketManagerImpl::initialize()
 
     mLockedBucketDir = std::make_unique<std::string>(d);
     mTmpDirManager = std::make_unique<TmpDirManager>(d + "/tmp");
+    loadFinishedMerges();
 }
 
 void
@@ -74,6 +77,10 @@ BucketManagerImpl::dropAll()
         fs::deltree(d);
     }
 
+    {
+        std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+        mRunningMerges.clear();
+    }
     initialize();
 }
 
@@ -99,9 +106,24 @@ BucketManagerImpl::BucketManagerImpl(Application& app)
 }
 
 const std::string BucketManagerImpl::kLockFilename = "stellar-core.lock";
+const std::string BucketManagerImpl::kMergesFilename = "merges.json";
 
 namespace
 {
+// One record of kMergesFilename.
+struct FinishedMerge
+{
+    MergeKey input;
+    std::string output;
+
+    template <class Archive>
+    void
+    serialize(Archive& ar)
+    {
+        ar(CEREAL_NVP(input), CEREAL_NVP(output));
+    }
+};
+
 std::string
 bucketBasename(std::string const& bucketHexHash)
 {
@@ -111,7 +133,7 @@ bucketBasename(std::string const& bucketHexHash)
 bool
 isBucketFile(std::string const& name)
 {
-    static std::regex re("^bucket-[a-z0-9]{64}\\.xdr(\\.gz)?$");
+    static std::regex re("^bucket-[a-z0-9]{64}\\.xdr(\\.gz|\\.index)?$");
     return std::regex_match(name, re);
 };
 
@@ -179,6 +201,12 @@ BucketManagerImpl::getBucketList()
     return mBucketList;
 }
 
+Config const&
+BucketManagerImpl::getConfig() const
+{
+    return mApp.getConfig();
+}
+
 medida::Timer&
 BucketManagerImpl::getMergeTimer()
 {
@@ -224,6 +252,9 @@ MergeCounters::operator+=(MergeCounters const& delta)
     mOutputIteratorTombstoneElisions += delta.mOutputIteratorTombstoneElisions;
     mOutputIteratorBufferUpdates += delta.mOutputIteratorBufferUpdates;
     mOutputIteratorActualWrites += delta.mOutputIteratorActualWrites;
+
+    mRunningMergeReattachments += delta.mRunningMergeReattachments;
+    mFinishedMergeReattachments += delta.mFinishedMergeReattachments;
     return *this;
 }
 
@@ -240,6 +271,10 @@ BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
                                      size_t nBytes)
 {
     std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    // An index built alongside `filename` travels with it; buckets adopted
+    // without one get it rebuilt on first lookup.
+    auto indexFilename = BucketIndex::indexFilename(filename);
+
     // Check to see if we have an existing bucket (either in-memory or on-disk)
     std::shared_ptr<Bucket> b = getBucketByHash(hash);
     if (b)
@@ -249,6 +284,7 @@ BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
         {
             auto timer = LogSlowExecution("Delete redundant bucket");
             std::remove(filename.c_str());
+            std::remove(indexFilename.c_str());
         }
     }
     else
@@ -269,6 +305,18 @@ BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
                 throw std::runtime_error(err);
             }
         }
+        if (fs::exists(indexFilename))
+        {
+            auto canonicalIndexName = BucketIndex::indexFilename(canonicalName);
+            if (rename(indexFilename.c_str(), canonicalIndexName.c_str()) != 0)
+            {
+                // Losing the index only costs a rebuild, don't fail the adopt.
+                CLOG(WARNING, "Bucket")
+                    << "Failed to rename bucket index " << indexFilename
+                    << ": " << strerror(errno);
+                std::remove(indexFilename.c_str());
+            }
+        }
 
         b = std::make_shared<Bucket>(canonicalName, hash);
         {
@@ -310,6 +358,116 @@ BucketManagerImpl::getBucketByHash(uint256 const& hash)
     return std::shared_ptr<Bucket>();
 }
 
+std::shared_future<std::shared_ptr<Bucket>>
+BucketManagerImpl::getMergeFuture(MergeKey const& key)
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    auto running = mRunningMerges.find(key);
+    if (running != mRunningMerges.end())
+    {
+        CLOG(TRACE, "Bucket") << "Reattaching to running merge of curr="
+                              << key.curr << " with snap=" << key.snap;
+        ++mMergeCounters.mRunningMergeReattachments;
+        return running->second;
+    }
+
+    auto finished = mFinishedMerges.find(key);
+    if (finished != mFinishedMerges.end())
+    {
+        auto output = getBucketByHash(hexToBin256(finished->second));
+        if (output)
+        {
+            CLOG(TRACE, "Bucket")
+                << "Reattaching to finished merge of curr=" << key.curr
+                << " with snap=" << key.snap << ", output "
+                << finished->second;
+            ++mMergeCounters.mFinishedMergeReattachments;
+            std::promise<std::shared_ptr<Bucket>> promise;
+            promise.set_value(output);
+            return promise.get_future().share();
+        }
+        // The output has been removed since; merge again.
+        mFinishedMerges.erase(finished);
+        saveFinishedMerges();
+    }
+    return std::shared_future<std::shared_ptr<Bucket>>();
+}
+
+void
+BucketManagerImpl::putMergeFuture(
+    MergeKey const& key, std::shared_future<std::shared_ptr<Bucket>> future)
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    mRunningMerges[key] = future;
+}
+
+void
+BucketManagerImpl::finishMerge(MergeKey const& key,
+                               std::shared_ptr<Bucket> const& output)
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    mRunningMerges.erase(key);
+    if (output)
+    {
+        mFinishedMerges[key] = binToHex(output->getHash());
+        saveFinishedMerges();
+    }
+}
+
+void
+BucketManagerImpl::loadFinishedMerges()
+{
+    mFinishedMerges.clear();
+    auto filename = getBucketDir() + "/" + kMergesFilename;
+    if (!fs::exists(filename))
+    {
+        return;
+    }
+    try
+    {
+        std::vector<FinishedMerge> merges;
+        std::ifstream in(filename);
+        cereal::JSONInputArchive ar(in);
+        ar(cereal::make_nvp("merges", merges));
+        for (auto& m : merges)
+        {
+            mFinishedMerges[m.input] = m.output;
+        }
+    }
+    catch (std::exception& e)
+    {
+        // Only costs re-running merges.
+        CLOG(WARNING, "Bucket")
+            << "Ignoring malformed " << filename << ": " << e.what();
+        mFinishedMerges.clear();
+    }
+}
+
+void
+BucketManagerImpl::saveFinishedMerges()
+{
+    std::vector<FinishedMerge> merges;
+    for (auto const& m : mFinishedMerges)
+    {
+        merges.emplace_back(FinishedMerge{m.first, m.second});
+    }
+
+    // Written aside and renamed over the old file, so that a crash leaves one
+    // or the other intact.
+    auto filename = getBucketDir() + "/" + kMergesFilename;
+    auto tmpFilename = filename + ".tmp";
+    {
+        std::ofstream out(tmpFilename);
+        cereal::JSONOutputArchive ar(out);
+        ar(cereal::make_nvp("merges", merges));
+    }
+    if (rename(tmpFilename.c_str(), filename.c_str()) != 0)
+    {
+        CLOG(WARNING, "Bucket") << "Failed to save " << filename << ": "
+                                << strerror(errno);
+    }
+}
+
 std::set<Hash>
 BucketManagerImpl::getReferencedBuckets() const
 {
@@ -434,11 +592,35 @@ BucketManagerImpl::forgetUnreferencedBuckets()
                 std::remove(filename.c_str());
                 auto gzfilename = filename + ".gz";
                 std::remove(gzfilename.c_str());
+                auto indexFilename = BucketIndex::indexFilename(filename);
+                std::remove(indexFilename.c_str());
             }
             mSharedBuckets.erase(j);
         }
     }
     mSharedBucketsSize.set_count(mSharedBuckets.size());
+
+    // Forget merges whose output is gone, unless it is the empty bucket.
+    bool forgotMerges = false;
+    for (auto i = mFinishedMerges.begin(); i != mFinishedMerges.end();)
+    {
+        auto hash = hexToBin256(i->second);
+        if (!isZero(hash) &&
+            mSharedBuckets.find(hash) == mSharedBuckets.end() &&
+            !fs::exists(bucketFilename(hash)))
+        {
+            i = mFinishedMerges.erase(i);
+            forgotMerges = true;
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    if (forgotMerges)
+    {
+        saveFinishedMerges();
+    }
 }
 
 void
@@ -47,7 +47,16 @@ class BucketManagerImpl : public BucketManager
     medida::Counter& mSharedBucketsSize;
     MergeCounters mMergeCounters;
 
+    // Merges running, and the output (hex) hash of merges that completed.
+    // The latter is saved to kMergesFilename whenever it changes.
+    std::map<MergeKey, std::shared_future<std::shared_ptr<Bucket>>>
+        mRunningMerges;
+    std::map<MergeKey, std::string> mFinishedMerges;
+    static std::string const kMergesFilename;
+
     std::set<Hash> getReferencedBuckets() const;
+    void loadFinishedMerges();
+    void saveFinishedMerges();
     void cleanupStaleFiles();
     void cleanDir();
 
@@ -68,11 +77,19 @@ class BucketManagerImpl : public BucketManager
     MergeCounters readMergeCounters() override;
     void incrMergeCounters(MergeCounters const&) override;
     TmpDirManager& getTmpDirManager() override;
+    Config const& getConfig() const override;
     std::shared_ptr<Bucket> adoptFileAsBucket(std::string const& filename,
                                               uint256 const& hash,
                                               size_t nObjects,
                                               size_t nBytes) override;
     std::shared_ptr<Bucket> getBucketByHash(uint256 const& hash) override;
+    std::shared_future<std::shared_ptr<Bucket>>
+    getMergeFuture(MergeKey const& key) override;
+    void
+    putMergeFuture(MergeKey const& key,
+                   std::shared_future<std::shared_ptr<Bucket>> future) override;
+    void finishMerge(MergeKey const& key,
+                     std::shared_ptr<Bucket> const& output) override;
 
     void forgetUnreferencedBuckets() override;
     void addBatch(Application& app, uint32_t currLedger,
@@ -35,8 +35,11 @@ randomBucketName(std::string const& tmpDir)
 BucketOutputIterator::BucketOutputIterator(std::string const& tmpDir,
                                            bool keepDeadEntries,
                                            BucketMetadata const& meta,
-                                           MergeCounters& mc)
+                                           MergeCounters& mc, bool doFsync,
+                                           size_t writeBufferSize,
+                                           bool directIO)
     : mFilename(randomBucketName(tmpDir))
+    , mOut(doFsync, writeBufferSize, directIO)
     , mBuf(nullptr)
     , mHasher(SHA256::create())
     , mKeepDeadEntries(keepDeadEntries)
@@ -59,6 +62,32 @@ BucketOutputIterator::BucketOutputIterator(std::string const& tmpDir,
     }
 }
 
+BucketOutputIterator::BucketOutputIterator(std::string const& tmpDir,
+                                           BucketOutputIterator const& whole,
+                                           MergeCounters& mc)
+    : mFilename(randomBucketName(tmpDir))
+    , mBuf(nullptr)
+    , mKeepDeadEntries(whole.mKeepDeadEntries)
+    , mMeta(whole.mMeta)
+    , mPutMeta(true)
+    , mMergeCounters(mc)
+{
+    // The shard is read back as soon as it is complete, so leave it in the
+    // page cache, and there is no point in making it durable or hashing it.
+    CLOG(TRACE, "Bucket") << "BucketOutputIterator opening shard to write: "
+                          << mFilename;
+    mIndexBuilder.shareBloomKey(whole.mIndexBuilder);
+    mOut.open(mFilename);
+}
+
+void
+BucketOutputIterator::writeBuffered()
+{
+    mIndexBuilder.add(*mBuf, mBytesPut);
+    mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
+    mObjectsPut++;
+}
+
 void
 BucketOutputIterator::put(BucketEntry const& e)
 {
@@ -90,8 +119,7 @@ BucketOutputIterator::put(BucketEntry const& e)
         if (mCmp(*mBuf, e))
         {
             ++mMergeCounters.mOutputIteratorActualWrites;
-            mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
-            mObjectsPut++;
+            writeBuffered();
         }
     }
     else
@@ -104,13 +132,45 @@ BucketOutputIterator::put(BucketEntry const& e)
     *mBuf = e;
 }
 
+void
+BucketOutputIterator::append(BucketOutputIterator& shard)
+{
+    // The shard's last entry is still buffered, as it would be here, so that
+    // it is written (and counted) exactly as if put here.
+    shard.mOut.close();
+    if (shard.mObjectsPut != 0)
+    {
+        if (mBuf)
+        {
+            ++mMergeCounters.mOutputIteratorActualWrites;
+            writeBuffered();
+            mBuf.reset();
+        }
+        MappedFile in;
+        in.open(shard.mFilename);
+        mIndexBuilder.append(shard.mIndexBuilder, mBytesPut);
+        mOut.writeBytes(in.data(), in.size(), mHasher.get(), &mBytesPut);
+        mObjectsPut += shard.mObjectsPut;
+    }
+    std::remove(shard.mFilename.c_str());
+
+    if (shard.mBuf)
+    {
+        if (mBuf)
+        {
+            ++mMergeCounters.mOutputIteratorActualWrites;
+            writeBuffered();
+        }
+        mBuf = std::move(shard.mBuf);
+    }
+}
+
 std::shared_ptr<Bucket>
 BucketOutputIterator::getBucket(BucketManager& bucketManager)
 {
     if (mBuf)
     {
-        mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
-        mObjectsPut++;
+        writeBuffered();
         mBuf.reset();
     }
 
@@ -123,7 +183,13 @@ BucketOutputIterator::getBucket(BucketManager& bucketManager)
         std::remove(mFilename.c_str());
         return std::make_shared<Bucket>();
     }
-    return bucketManager.adoptFileAsBucket(mFilename, mHasher->finish(),
-                                           mObjectsPut, mBytesPut);
+
+    // The index is written next to the bucket file; adoptFileAsBucket moves
+    // (or discards) the two together.
+    auto hash = mHasher->finish();
+    mIndexBuilder.finish(hash, mBytesPut)
+        ->save(BucketIndex::indexFilename(mFilename));
+    return bucketManager.adoptFileAsBucket(mFilename, hash, mObjectsPut,
+                                           mBytesPut);
 }
 }
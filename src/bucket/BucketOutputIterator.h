@@ -4,6 +4,7 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketManager.h"
 #include "bucket/LedgerCmp.h"
 #include "util/XDRStream.h"
@@ -34,6 +35,9 @@ class BucketOutputIterator
     BucketMetadata mMeta;
     bool mPutMeta{false};
     MergeCounters& mMergeCounters;
+    BucketIndex::Builder mIndexBuilder;
+
+    void writeBuffered();
 
   public:
     // BucketOutputIterators must _always_ be constructed with BucketMetadata,
@@ -43,11 +47,30 @@ class BucketOutputIterator
     // version new enough that it should _write_ the metadata to the stream in
     // the form of a METAENTRY; but that's not a thing the caller gets to decide
     // (or forget to do), it's handled automatically.
-    BucketOutputIterator(std::string const& tmpDir, bool keepDeadEntries,
-                         BucketMetadata const& meta, MergeCounters& mc);
+    //
+    // The bucket file is written through a `writeBufferSize` byte buffer,
+    // with O_DIRECT if `directIO`, and if `doFsync` is durable once getBucket
+    // returns (see XDROutputFileStream).
+    BucketOutputIterator(
+        std::string const& tmpDir, bool keepDeadEntries,
+        BucketMetadata const& meta, MergeCounters& mc, bool doFsync = true,
+        size_t writeBufferSize = XDROutputFileStream::DEFAULT_BUFFER_SIZE,
+        bool directIO = false);
+
+    // Write one key range of a merge into a file of its own in `tmpDir`, to
+    // be appended to `whole` (see append). Writes no METAENTRY, and counts
+    // into `mc` so that it can run on another thread.
+    BucketOutputIterator(std::string const& tmpDir,
+                         BucketOutputIterator const& whole, MergeCounters& mc);
 
     void put(BucketEntry const& e);
 
+    // Add everything put into `shard`, which must have been constructed for
+    // this iterator and only hold entries greater than those put here so
+    // far. The result is exactly as if they had been put here directly.
+    // Removes the shard's file.
+    void append(BucketOutputIterator& shard);
+
     std::shared_ptr<Bucket> getBucket(BucketManager& bucketManager);
 };
 }
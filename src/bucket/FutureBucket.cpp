@@ -275,17 +275,42 @@ FutureBucket::startMerge(Application& app, uint32_t maxProtocolVersion,
 
     BucketManager& bm = app.getBucketManager();
 
+    // An identical merge may already be running, or have finished, on behalf
+    // of another FutureBucket (say, one restarted from a saved HAS); if so,
+    // share its output rather than merging the same inputs again.
+    MergeKey mk{keepDeadEntries, maxProtocolVersion, mInputCurrBucketHash,
+                mInputSnapBucketHash, mInputShadowBucketHashes};
+    auto existing = bm.getMergeFuture(mk);
+    if (existing.valid())
+    {
+        CLOG(TRACE, "Bucket") << "Reattaching to merge of curr="
+                              << hexAbbrev(curr->getHash())
+                              << " with snap=" << hexAbbrev(snap->getHash());
+        mOutputBucket = existing;
+        checkState();
+        return;
+    }
+
     using task_t = std::packaged_task<std::shared_ptr<Bucket>()>;
     std::shared_ptr<task_t> task =
         std::make_shared<task_t>([curr, snap, &bm, shadows, maxProtocolVersion,
-                                  keepDeadEntries, countMergeEvents]() {
+                                  keepDeadEntries, countMergeEvents, mk]() {
             CLOG(TRACE, "Bucket")
                 << "Worker merging curr=" << hexAbbrev(curr->getHash())
                 << " with snap=" << hexAbbrev(snap->getHash());
 
-            auto res =
-                Bucket::merge(bm, maxProtocolVersion, curr, snap, shadows,
-                              keepDeadEntries, countMergeEvents);
+            std::shared_ptr<Bucket> res;
+            try
+            {
+                res = Bucket::merge(bm, maxProtocolVersion, curr, snap, shadows,
+                                    keepDeadEntries, countMergeEvents);
+            }
+            catch (...)
+            {
+                bm.finishMerge(mk, nullptr);
+                throw;
+            }
+            bm.finishMerge(mk, res);
 
             CLOG(TRACE, "Bucket")
                 << "Worker finished merging curr=" << hexAbbrev(curr->getHash())
@@ -295,6 +320,7 @@ FutureBucket::startMerge(Application& app, uint32_t maxProtocolVersion,
         });
 
     mOutputBucket = task->get_future().share();
+    bm.putMergeFuture(mk, mOutputBucket);
     app.postOnBackgroundThread(bind(&task_t::operator(), task),
                                "FutureBucket: merge");
     checkState();
@@ -0,0 +1,48 @@
+#pragma once
+
+// Copyright 2019 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <cereal/cereal.hpp>
+#include <cereal/types/vector.hpp>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * Everything that determines the output of a bucket merge: the hashes (in hex,
+ * as FutureBucket holds them) of its inputs and shadows, and the parameters it
+ * runs with. Two merges with equal keys produce the same bucket, so the
+ * BucketManager uses these to run each merge only once.
+ */
+struct MergeKey
+{
+    bool keepDeadEntries{false};
+    uint32_t maxProtocolVersion{0};
+    std::string curr;
+    std::string snap;
+    std::vector<std::string> shadows;
+
+    bool
+    operator<(MergeKey const& other) const
+    {
+        return std::tie(keepDeadEntries, maxProtocolVersion, curr, snap,
+                        shadows) <
+               std::tie(other.keepDeadEntries, other.maxProtocolVersion,
+                        other.curr, other.snap, other.shadows);
+    }
+
+    template <class Archive>
+    void
+    serialize(Archive& ar)
+    {
+        ar(CEREAL_NVP(keepDeadEntries), CEREAL_NVP(maxProtocolVersion),
+           CEREAL_NVP(curr), CEREAL_NVP(snap), CEREAL_NVP(shadows));
+    }
+};
+}
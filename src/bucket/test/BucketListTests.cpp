@@ -23,9 +23,11 @@
 #include "test/test.h"
 #include "util/Math.h"
 #include "util/Timer.h"
+#include "util/types.h"
 #include "xdrpp/autocheck.h"
 
 #include <deque>
+#include <map>
 #include <sstream>
 
 using namespace stellar;
@@ -250,6 +252,76 @@ TEST_CASE("bucket list shadowing", "[bucket][bucketlist]")
     });
 }
 
+TEST_CASE("bucket list point lookups", "[bucket][bucketlist][bucketindex]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    for_versions_with_differing_bucket_logic(cfg, [&](Config const& cfg) {
+        Application::pointer app = createTestApplication(clock, cfg);
+        BucketList bl;
+
+        // Expected state: nullptr for entries that have been deleted.
+        std::map<LedgerKey, std::shared_ptr<LedgerEntry>, LedgerEntryIdCmp>
+            expected;
+        std::vector<LedgerKey> liveKeys;
+
+        for (uint32_t i = 1;
+             !app->getClock().getIOContext().stopped() && i < 300; ++i)
+        {
+            app->getClock().crank(false);
+            std::vector<LedgerEntry> liveBatch;
+            std::vector<LedgerKey> deadBatch;
+            for (auto& e : LedgerTestUtils::generateValidLedgerEntries(5))
+            {
+                auto k = LedgerEntryKey(e);
+                if (expected.emplace(k, std::make_shared<LedgerEntry>(e))
+                        .second)
+                {
+                    liveKeys.emplace_back(k);
+                    liveBatch.emplace_back(e);
+                }
+            }
+
+            // Modify the oldest live entry, so that older versions of it are
+            // shadowed in deeper levels, and delete the next oldest.
+            if (liveKeys.size() > liveBatch.size() + 2)
+            {
+                auto e = *expected.at(liveKeys[0]);
+                e.lastModifiedLedgerSeq = i;
+                liveBatch.emplace_back(e);
+                liveKeys.emplace_back(liveKeys[0]);
+                deadBatch.emplace_back(liveKeys[1]);
+                liveKeys.erase(liveKeys.begin(), liveKeys.begin() + 2);
+            }
+
+            bl.addBatch(*app, i, getAppLedgerVersion(app), {}, liveBatch,
+                        deadBatch);
+            for (auto const& e : liveBatch)
+            {
+                expected[LedgerEntryKey(e)] = std::make_shared<LedgerEntry>(e);
+            }
+            for (auto const& k : deadBatch)
+            {
+                expected[k] = nullptr;
+            }
+        }
+
+        for (auto const& kv : expected)
+        {
+            auto e = bl.getLedgerEntry(kv.first);
+            if (kv.second)
+            {
+                REQUIRE(e);
+                REQUIRE(*e == *kv.second);
+            }
+            else
+            {
+                REQUIRE(!e);
+            }
+        }
+    });
+}
+
 TEST_CASE("bucket tombstones expire at bottom level",
           "[bucket][bucketlist][tombstones]")
 {
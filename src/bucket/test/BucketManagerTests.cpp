@@ -15,6 +15,7 @@
 #include "bucket/BucketManager.h"
 #include "bucket/BucketManagerImpl.h"
 #include "bucket/BucketTests.h"
+#include "bucket/FutureBucket.h"
 #include "ledger/LedgerTxn.h"
 #include "ledger/test/LedgerTestUtils.h"
 #include "lib/catch.hpp"
@@ -24,6 +25,7 @@
 #include "test/test.h"
 #include "util/Math.h"
 #include "util/Timer.h"
+#include <thread>
 
 using namespace stellar;
 using namespace BucketTests;
@@ -334,6 +336,54 @@ TEST_CASE("bucketmanager ownership", "[bucket][bucketmanager]")
     });
 }
 
+TEST_CASE("bucketmanager reattaches identical merges",
+          "[bucket][bucketmanager]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    for_versions_with_differing_bucket_logic(cfg, [&](Config const& cfg) {
+        Application::pointer app = createTestApplication(clock, cfg);
+        auto& bm = app->getBucketManager();
+        auto vers = getAppLedgerVersion(app);
+
+        auto curr = Bucket::fresh(
+            bm, vers, {}, LedgerTestUtils::generateValidLedgerEntries(100), {},
+            /*countMergeEvents=*/true);
+        auto snap = Bucket::fresh(
+            bm, vers, {}, LedgerTestUtils::generateValidLedgerEntries(100), {},
+            /*countMergeEvents=*/true);
+        auto before = bm.readMergeCounters();
+
+        // Two identical merges started back to back share one output,
+        // whether the second finds the first still running or finished.
+        FutureBucket fb1(*app, curr, snap, {}, vers, true, true);
+        FutureBucket fb2(*app, curr, snap, {}, vers, true, true);
+        auto out = fb1.resolve();
+        REQUIRE(fb2.resolve() == out);
+
+        auto after = bm.readMergeCounters();
+        CHECK(after.mRunningMergeReattachments +
+                  after.mFinishedMergeReattachments ==
+              before.mRunningMergeReattachments +
+                  before.mFinishedMergeReattachments + 1);
+
+        // A third, started once both are done, is resolved from the record
+        // of finished merges, which is also saved to disk.
+        FutureBucket fb3(*app, curr, snap, {}, vers, true, true);
+        CHECK(fb3.mergeComplete());
+        CHECK(fb3.resolve() == out);
+        CHECK(bm.readMergeCounters().mFinishedMergeReattachments ==
+              after.mFinishedMergeReattachments + 1);
+        CHECK(fs::exists(bm.getBucketDir() + "/merges.json"));
+
+        // A merge with different parameters is not shared.
+        FutureBucket fb4(*app, curr, snap, {}, vers, false, true);
+        fb4.resolve();
+        CHECK(bm.readMergeCounters().mFinishedMergeReattachments ==
+              after.mFinishedMergeReattachments + 1);
+    });
+}
+
 // Running one of these tests involves comparing three timelines with different
 // application lifecycles for identical outcomes.
 //
@@ -382,6 +432,34 @@ class StopAndRestartBucketMergesTest
         }
     }
 
+    // Like resolveAllMerges, but leaves the merges live, as if still running.
+    static void
+    finishAllMerges(BucketList& bl)
+    {
+        for (uint32 i = 0; i < BucketList::kNumLevels; ++i)
+        {
+            auto& next = bl.getLevel(i).getNext();
+            while (next.isMerging() && !next.mergeComplete())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    static uint64_t
+    countMerging(BucketList& bl)
+    {
+        uint64_t n = 0;
+        for (uint32 i = 0; i < BucketList::kNumLevels; ++i)
+        {
+            if (bl.getLevel(i).getNext().isMerging())
+            {
+                ++n;
+            }
+        }
+        return n;
+    }
+
     struct Survey
     {
         Hash mCurrBucketHash;
@@ -901,10 +979,16 @@ class StopAndRestartBucketMergesTest
                     s.checkEqual(j->second);
                 }
 
-                // Stop the application.
+                // Stop the application. Its merges are let finish first, so
+                // that they all count in countersAtStop and are all recorded
+                // for reattachment; otherwise some would finish while it
+                // stops, and count in neither timeline.
                 CLOG(INFO, "Bucket")
                     << "Stopping application after closing ledger " << std::dec
                     << i;
+                finishAllMerges(app->getBucketManager().getBucketList());
+                auto countersAtStop =
+                    app->getBucketManager().readMergeCounters();
                 app.reset();
 
                 if (firstProtocol != secondProtocol &&
@@ -932,10 +1016,21 @@ class StopAndRestartBucketMergesTest
                     REQUIRE(blv.getNext().isMerging());
                 }
 
-                // If there are restarted merges, we need to reset the counters
-                // to the values they had _before_ the ledger-close so the
-                // restarted merges don't count twice.
-                app->getBucketManager().incrMergeCounters(countersBeforeClose);
+                // Every merge was recorded as finished before the stop, so
+                // each restarted merge reattaches to its output rather than
+                // running again; unless the protocol switched, in which case
+                // none match their record and all run again. A mix of the two
+                // would count some merges twice or not at all, so must not
+                // happen. When reattached, the counters carry on from the
+                // stop; when run again, from _before_ the ledger-close, so
+                // that the restarted merges don't count twice.
+                auto& bm = app->getBucketManager();
+                auto merging = countMerging(bm.getBucketList());
+                auto reattached =
+                    bm.readMergeCounters().mFinishedMergeReattachments;
+                REQUIRE((reattached == 0 || reattached == merging));
+                bm.incrMergeCounters(reattached != 0 ? countersAtStop
+                                                     : countersBeforeClose);
 
                 if (currProtocol == firstProtocol)
                 {
@@ -13,6 +13,7 @@
 #include "util/asio.h"
 #include "bucket/BucketTests.h"
 #include "bucket/Bucket.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketInputIterator.h"
 #include "ledger/LedgerTxn.h"
 #include "ledger/test/LedgerTestUtils.h"
@@ -732,6 +733,163 @@ TEST_CASE("merging bucket entries with initentry", "[bucket][initentry]")
     });
 }
 
+TEST_CASE("bucket point lookups", "[bucket][bucketindex]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    for_versions_with_differing_bucket_logic(cfg, [&](Config const& cfg) {
+        Application::pointer app = createTestApplication(clock, cfg);
+
+        // Enough entries to span several index pages.
+        autocheck::generator<LedgerKey> deadGen;
+        std::vector<LedgerEntry> live(1000);
+        std::vector<LedgerKey> dead(200);
+        for (auto& e : live)
+            e = LedgerTestUtils::generateValidLedgerEntry(3);
+        for (auto& e : dead)
+            e = deadGen(3);
+        std::shared_ptr<Bucket> b = Bucket::fresh(
+            app->getBucketManager(), getAppLedgerVersion(app), {}, live, dead,
+            /*countMergeEvents=*/true);
+
+        auto indexFilename = BucketIndex::indexFilename(b->getFilename());
+        REQUIRE(fs::exists(indexFilename));
+
+        auto checkLookups = [&](std::shared_ptr<Bucket> bucket) {
+            REQUIRE(bucket->getIndex()->getPageCount() > 1);
+            for (auto const& e : live)
+            {
+                auto be = bucket->getBucketEntry(LedgerEntryKey(e));
+                REQUIRE(be);
+                REQUIRE(be->type() == LIVEENTRY);
+                REQUIRE(be->liveEntry() == e);
+            }
+            for (auto const& k : dead)
+            {
+                auto be = bucket->getBucketEntry(k);
+                REQUIRE(be);
+                REQUIRE(be->type() == DEADENTRY);
+                REQUIRE(be->deadEntry() == k);
+            }
+            for (size_t i = 0; i < 100; ++i)
+            {
+                auto e = LedgerTestUtils::generateValidLedgerEntry(3);
+                REQUIRE(!bucket->getBucketEntry(LedgerEntryKey(e)));
+            }
+        };
+
+        SECTION("index built while writing")
+        {
+            checkLookups(b);
+        }
+
+        SECTION("index rebuilt when missing")
+        {
+            std::remove(indexFilename.c_str());
+            auto b2 = std::make_shared<Bucket>(b->getFilename(), b->getHash());
+            checkLookups(b2);
+            REQUIRE(fs::exists(indexFilename));
+        }
+
+        SECTION("index for another bucket is ignored")
+        {
+            std::shared_ptr<Bucket> other = Bucket::fresh(
+                app->getBucketManager(), getAppLedgerVersion(app), {},
+                LedgerTestUtils::generateValidLedgerEntries(10), {},
+                /*countMergeEvents=*/true);
+            REQUIRE(!BucketIndex::load(
+                BucketIndex::indexFilename(other->getFilename()),
+                b->getHash()));
+        }
+
+        SECTION("empty bucket")
+        {
+            auto empty = std::make_shared<Bucket>();
+            REQUIRE(!empty->getBucketEntry(LedgerEntryKey(live.front())));
+        }
+    });
+}
+
+TEST_CASE("sharded merges match single-threaded merges", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    for_versions_with_differing_bucket_logic(cfg, [&](Config const& cfg) {
+        Application::pointer app = createTestApplication(clock, cfg);
+        Config shardedCfg(getTestConfig(1));
+        shardedCfg.LEDGER_PROTOCOL_VERSION = cfg.LEDGER_PROTOCOL_VERSION;
+        shardedCfg.BUCKET_MERGE_SHARDS = 4;
+        shardedCfg.BUCKET_MERGE_SHARD_MIN_SIZE = 1;
+        Application::pointer shardedApp =
+            createTestApplication(clock, shardedCfg);
+        auto& bm = app->getBucketManager();
+        auto vers = getAppLedgerVersion(app);
+
+        // An old bucket, a new one updating, deleting and adding entries,
+        // and a shadow covering some of both, with enough entries for the
+        // shard boundaries to fall among them.
+        std::vector<LedgerEntry> old(2000), updated, created, shadowed;
+        std::vector<LedgerKey> deleted;
+        for (size_t i = 0; i < old.size(); ++i)
+        {
+            old[i] = LedgerTestUtils::generateValidLedgerEntry(3);
+            switch (i % 5)
+            {
+            case 0:
+                updated.emplace_back(old[i]);
+                updated.back().lastModifiedLedgerSeq++;
+                break;
+            case 1:
+                deleted.emplace_back(LedgerEntryKey(old[i]));
+                break;
+            case 2:
+                shadowed.emplace_back(old[i]);
+                break;
+            }
+        }
+        for (size_t i = 0; i < 500; ++i)
+        {
+            created.emplace_back(LedgerTestUtils::generateValidLedgerEntry(3));
+            if (i % 3 == 0)
+            {
+                shadowed.emplace_back(created.back());
+            }
+        }
+        auto bOld = Bucket::fresh(bm, vers, old, {}, {},
+                                  /*countMergeEvents=*/false);
+        auto bNew = Bucket::fresh(bm, vers, created, updated, deleted,
+                                  /*countMergeEvents=*/false);
+        auto bShadow = Bucket::fresh(bm, vers, {}, shadowed, {},
+                                     /*countMergeEvents=*/false);
+
+        for (bool keepDeadEntries : {true, false})
+        {
+            auto serial =
+                Bucket::merge(bm, vers, bOld, bNew, {bShadow}, keepDeadEntries,
+                              /*countMergeEvents=*/false);
+            auto sharded = Bucket::merge(
+                shardedApp->getBucketManager(), vers, bOld, bNew, {bShadow},
+                keepDeadEntries, /*countMergeEvents=*/false);
+            REQUIRE(sharded->getHash() == serial->getHash());
+            REQUIRE(sharded->getSize() == serial->getSize());
+
+            // The index assembled from the shards' indexes finds everything.
+            BucketInputIterator in(serial);
+            size_t n = 0;
+            for (; in; ++in, ++n)
+            {
+                auto const& e = *in;
+                auto k = e.type() == DEADENTRY ? e.deadEntry()
+                                               : LedgerEntryKey(e.liveEntry());
+                auto found = sharded->getBucketEntry(k);
+                REQUIRE(found);
+                REQUIRE(*found == e);
+            }
+            REQUIRE(n > 1000);
+        }
+    });
+}
+
 TEST_CASE("bucket apply", "[bucket]")
 {
     VirtualClock clock;
@@ -13,8 +13,10 @@
 #include "history/HistoryArchive.h"
 #include "historywork/Progress.h"
 #include "invariant/InvariantManager.h"
+#include "ledger/LedgerManager.h"
 #include "ledger/LedgerTxn.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include "util/format.h"
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
@@ -33,6 +35,9 @@ ApplyBucketsWork::ApplyBucketsWork(
     , mTotalSize(0)
     , mLevel(BucketList::kNumLevels - 1)
     , mMaxProtocolVersion(maxProtocolVersion)
+    , mNewestFirst(app.getConfig().CATCHUP_APPLY_BUCKETS_NEWEST_FIRST)
+    , mDeepestLevel(0)
+    , mDeepestSnap(false)
     , mBucketApplyStart(app.getMetrics().NewMeter(
           {"history", "bucket-apply", "start"}, "event"))
     , mBucketApplySuccess(app.getMetrics().NewMeter(
@@ -65,9 +70,29 @@ ApplyBucketsWork::getBucket(std::string const& hash)
     return b;
 }
 
+void
+ApplyBucketsWork::dropSecondaryIndexes()
+{
+    mApp.getLedgerTxnRoot().dropSecondaryIndexes();
+    mIndexesDropped = true;
+}
+
+void
+ApplyBucketsWork::endBulkLoad()
+{
+    mApp.getLedgerTxnRoot().setBulkInsertOnly(false);
+    if (mIndexesDropped)
+    {
+        mApp.getLedgerTxnRoot().createSecondaryIndexes();
+        mIndexesDropped = false;
+    }
+}
+
 void
 ApplyBucketsWork::onReset()
 {
+    endBulkLoad();
+
     mTotalBuckets = 0;
     mAppliedBuckets = 0;
     mAppliedEntries = 0;
@@ -96,11 +121,91 @@ ApplyBucketsWork::onReset()
     mCurrBucket.reset();
     mSnapApplicator.reset();
     mCurrApplicator.reset();
+
+    if (mNewestFirst)
+    {
+        // Everything above the deepest bucket that differs from the local
+        // BucketList gets applied, so find that bucket up front.
+        mLevel = 0;
+        mShadows = std::make_unique<BucketApplicator::ShadowSet>();
+        for (uint32_t i = BucketList::kNumLevels; i-- > 0;)
+        {
+            auto& level = getBucketLevel(i);
+            HistoryStateBucket const& hsb = mApplyState.currentBuckets.at(i);
+            bool applySnap = (hsb.snap != binToHex(level.getSnap()->getHash()));
+            bool applyCurr = (hsb.curr != binToHex(level.getCurr()->getHash()));
+            if (applySnap || applyCurr)
+            {
+                mDeepestLevel = i;
+                mDeepestSnap = applySnap;
+                mApplying = true;
+                break;
+            }
+        }
+    }
+}
+
+void
+ApplyBucketsWork::startNewestFirst()
+{
+    if (!mApplying)
+    {
+        return;
+    }
+
+    HistoryStateBucket const& i = mApplyState.currentBuckets.at(mLevel);
+    if (mLevel == 0)
+    {
+        // Every bucket being applied only holds entries modified at or after
+        // the oldest ledger of the deepest one.
+        uint32_t oldestLedger = mDeepestSnap
+                                    ? BucketList::oldestLedgerInSnap(
+                                          mApplyState.currentLedger,
+                                          mDeepestLevel)
+                                    : BucketList::oldestLedgerInCurr(
+                                          mApplyState.currentLedger,
+                                          mDeepestLevel);
+        auto& lsRoot = mApp.getLedgerTxnRoot();
+        lsRoot.deleteObjectsModifiedOnOrAfterLedger(oldestLedger);
+        dropSecondaryIndexes();
+        // When the buckets go back to genesis the tables are now empty, and
+        // the shadows keep any key from being written twice, so entries can
+        // be copied straight in rather than merged.
+        if (oldestLedger <= LedgerManager::GENESIS_LEDGER_SEQ)
+        {
+            lsRoot.setBulkInsertOnly(true);
+        }
+    }
+
+    bool deepest = (mLevel == mDeepestLevel);
+    mCurrBucket = getBucket(i.curr);
+    mCurrApplicator = std::make_unique<BucketApplicator>(
+        mApp, mMaxProtocolVersion, mCurrBucket, mShadows.get());
+    mShadows->nextBucket(!(deepest && !mDeepestSnap));
+    CLOG(DEBUG, "History") << "ApplyBuckets : starting level[" << mLevel
+                           << "].curr = " << i.curr;
+    mBucketApplyStart.Mark();
+
+    if (!deepest || mDeepestSnap)
+    {
+        mSnapBucket = getBucket(i.snap);
+        mSnapApplicator = std::make_unique<BucketApplicator>(
+            mApp, mMaxProtocolVersion, mSnapBucket, mShadows.get());
+        CLOG(DEBUG, "History") << "ApplyBuckets : starting level[" << mLevel
+                               << "].snap = " << i.snap;
+        mBucketApplyStart.Mark();
+    }
 }
 
 void
 ApplyBucketsWork::onStart()
 {
+    if (mNewestFirst)
+    {
+        startNewestFirst();
+        return;
+    }
+
     auto& level = getBucketLevel(mLevel);
     HistoryStateBucket const& i = mApplyState.currentBuckets.at(mLevel);
 
@@ -115,6 +220,7 @@ ApplyBucketsWork::onStart()
                                           mApplyState.currentLedger, mLevel);
         auto& lsRoot = mApp.getLedgerTxnRoot();
         lsRoot.deleteObjectsModifiedOnOrAfterLedger(oldestLedger);
+        dropSecondaryIndexes();
     }
 
     if (mApplying || applySnap)
@@ -148,7 +254,19 @@ ApplyBucketsWork::onRun()
     //    database when the invariants for snap are checked.
     // 2. There is no reason to advance mSnapApplicator or mCurrApplicator
     //    if there is nothing to be applied.
-    if (mSnapApplicator)
+    // When applying newest-first the same holds with snap and curr swapped.
+    if (mNewestFirst)
+    {
+        if (mCurrApplicator)
+        {
+            advance("curr", *mCurrApplicator);
+        }
+        else if (mSnapApplicator)
+        {
+            advance("snap", *mSnapApplicator);
+        }
+    }
+    else if (mSnapApplicator)
     {
         advance("snap", *mSnapApplicator);
     }
@@ -206,11 +324,71 @@ ApplyBucketsWork::advance(std::string const& bucketName,
     }
 }
 
+Work::State
+ApplyBucketsWork::onSuccessNewestFirst()
+{
+    auto isShadowed = [this](LedgerKey const& k) {
+        return mShadows->isShadowed(k);
+    };
+
+    if (mCurrApplicator)
+    {
+        if (*mCurrApplicator)
+        {
+            return WORK_RUNNING;
+        }
+        mApp.getInvariantManager().checkOnBucketApply(
+            mCurrBucket, mApplyState.currentLedger, mLevel, true, isShadowed);
+        mCurrApplicator.reset();
+        mCurrBucket.reset();
+        mBucketApplySuccess.Mark();
+
+        if (mSnapApplicator)
+        {
+            // The snap's keys are only worth remembering if there is a level
+            // below still to be applied.
+            mShadows->nextBucket(mLevel != mDeepestLevel);
+            return WORK_RUNNING;
+        }
+    }
+    if (mSnapApplicator)
+    {
+        if (*mSnapApplicator)
+        {
+            return WORK_RUNNING;
+        }
+        mApp.getInvariantManager().checkOnBucketApply(
+            mSnapBucket, mApplyState.currentLedger, mLevel, false, isShadowed);
+        mSnapApplicator.reset();
+        mSnapBucket.reset();
+        mBucketApplySuccess.Mark();
+    }
+
+    if (mApplying && mLevel < mDeepestLevel)
+    {
+        ++mLevel;
+        CLOG(DEBUG, "History")
+            << "ApplyBuckets : starting next level: " << mLevel;
+        return WORK_PENDING;
+    }
+
+    CLOG(DEBUG, "History") << "ApplyBuckets : done, restarting merges";
+    mShadows.reset();
+    endBulkLoad();
+    mApp.getBucketManager().assumeState(mApplyState, mMaxProtocolVersion);
+    return WORK_SUCCESS;
+}
+
 Work::State
 ApplyBucketsWork::onSuccess()
 {
     mApp.getCatchupManager().logAndUpdateCatchupStatus(true);
 
+    if (mNewestFirst)
+    {
+        return onSuccessNewestFirst();
+    }
+
     if (mSnapApplicator)
     {
         if (*mSnapApplicator)
@@ -218,7 +396,7 @@ ApplyBucketsWork::onSuccess()
             return WORK_RUNNING;
         }
         mApp.getInvariantManager().checkOnBucketApply(
-            mSnapBucket, mApplyState.currentLedger, mLevel, false);
+            mSnapBucket, mApplyState.currentLedger, mLevel, false, nullptr);
         mSnapApplicator.reset();
         mSnapBucket.reset();
         mBucketApplySuccess.Mark();
@@ -230,7 +408,7 @@ ApplyBucketsWork::onSuccess()
             return WORK_RUNNING;
         }
         mApp.getInvariantManager().checkOnBucketApply(
-            mCurrBucket, mApplyState.currentLedger, mLevel, true);
+            mCurrBucket, mApplyState.currentLedger, mLevel, true, nullptr);
         mCurrApplicator.reset();
         mCurrBucket.reset();
         mBucketApplySuccess.Mark();
@@ -245,6 +423,7 @@ ApplyBucketsWork::onSuccess()
     }
 
     CLOG(DEBUG, "History") << "ApplyBuckets : done, restarting merges";
+    endBulkLoad();
     mApp.getBucketManager().assumeState(mApplyState, mMaxProtocolVersion);
     return WORK_SUCCESS;
 }
@@ -260,6 +439,7 @@ void
 ApplyBucketsWork::onFailureRaise()
 {
     mBucketApplyFailure.Mark();
+    endBulkLoad();
     Work::onFailureRaise();
 }
 }
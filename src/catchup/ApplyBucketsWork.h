@@ -36,6 +36,19 @@ class ApplyBucketsWork : public Work
     size_t mLastPos;
     uint32_t mLevel;
     uint32_t mMaxProtocolVersion;
+
+    // When applying newest-first (CATCHUP_APPLY_BUCKETS_NEWEST_FIRST), mLevel
+    // counts up from 0 to mDeepestLevel, and mDeepestSnap says whether the
+    // snap bucket of that level needs applying or only its curr.
+    bool const mNewestFirst;
+    uint32_t mDeepestLevel;
+    bool mDeepestSnap;
+    std::unique_ptr<BucketApplicator::ShadowSet> mShadows;
+
+    // Whether the secondary indexes were dropped for this apply and still
+    // need creating again, on success, failure or reset alike.
+    bool mIndexesDropped{false};
+
     std::shared_ptr<Bucket const> mSnapBucket;
     std::shared_ptr<Bucket const> mCurrBucket;
     std::unique_ptr<BucketApplicator> mSnapApplicator;
@@ -50,6 +63,14 @@ class ApplyBucketsWork : public Work
     BucketLevel& getBucketLevel(uint32_t level);
     void advance(std::string const& name, BucketApplicator& applicator);
 
+    void dropSecondaryIndexes();
+    // Creates the secondary indexes again if they were dropped, and turns off
+    // LedgerTxnRoot::setBulkInsertOnly.
+    void endBulkLoad();
+
+    void startNewestFirst();
+    State onSuccessNewestFirst();
+
   public:
     ApplyBucketsWork(
         Application& app, WorkParent& parent,
@@ -47,8 +47,8 @@ class ApplyLedgerChainWork : public Work
     TmpDir const& mDownloadDir;
     LedgerRange mRange;
     uint32_t mCurrSeq;
-    XDRInputFileStream mHdrIn;
-    XDRInputFileStream mTxIn;
+    XDRMappedInputFileStream mHdrIn;
+    XDRMappedInputFileStream mTxIn;
     TransactionHistoryEntry mTxHistoryEntry;
     LedgerHeaderHistoryEntry& mLastApplied;
 
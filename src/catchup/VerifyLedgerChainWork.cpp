@@ -136,7 +136,7 @@ VerifyLedgerChainWork::verifyHistoryOfSingleCheckpoint()
 
     FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_LEDGER,
                         mCurrCheckpoint);
-    XDRInputFileStream hdrIn;
+    XDRMappedInputFileStream hdrIn;
     hdrIn.open(ft.localPath_nogz());
 
     bool beginCheckpoint = true;
@@ -97,6 +97,24 @@ hmacSha256(HmacSha256Key const& key, ByteSlice const& bin)
     return out;
 }
 
+HmacSha256Mac
+hmacSha256(HmacSha256Key const& key, ByteSlice const& prefix,
+           ByteSlice const& bin)
+{
+    HmacSha256Mac out;
+    crypto_auth_hmacsha256_state state;
+    if (crypto_auth_hmacsha256_init(&state, key.key.data(),
+                                    key.key.size()) != 0 ||
+        crypto_auth_hmacsha256_update(&state, prefix.data(), prefix.size()) !=
+            0 ||
+        crypto_auth_hmacsha256_update(&state, bin.data(), bin.size()) != 0 ||
+        crypto_auth_hmacsha256_final(&state, out.mac.data()) != 0)
+    {
+        throw std::runtime_error("error from crypto_auth_hmacsha256");
+    }
+    return out;
+}
+
 bool
 hmacSha256Verify(HmacSha256Mac const& hmac, HmacSha256Key const& key,
                  ByteSlice const& bin)
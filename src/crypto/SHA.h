@@ -28,6 +28,10 @@ class SHA256
 // HMAC-SHA256 (keyed)
 HmacSha256Mac hmacSha256(HmacSha256Key const& key, ByteSlice const& bin);
 
+// HMAC-SHA256 of `prefix` followed by `bin`, without copying them together.
+HmacSha256Mac hmacSha256(HmacSha256Key const& key, ByteSlice const& prefix,
+                         ByteSlice const& bin);
+
 // Use this rather than HMAC-output ==, to avoid timing leaks.
 bool hmacSha256Verify(HmacSha256Mac const& hmac, HmacSha256Key const& key,
                       ByteSlice const& bin);
@@ -12,6 +12,10 @@
 #include "util/HashOfHash.h"
 #include "util/Math.h"
 #include "util/RandomEvictionCache.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
 #include <memory>
 #include <mutex>
 #include <sodium.h>
@@ -31,23 +35,78 @@ namespace stellar
 // makes all signature-verification in the program faster and
 // has no effect on correctness.
 
-static std::mutex gVerifySigCacheMutex;
-static RandomEvictionCache<Hash, bool> gVerifySigCache(0xffff);
-static std::unique_ptr<SHA256> gHasher = SHA256::create();
-static uint64_t gVerifyCacheHit = 0;
-static uint64_t gVerifyCacheMiss = 0;
+// The cache is split into shards, each behind its own lock, so that the
+// threads verifying signatures in parallel rarely wait on one another. It is
+// keyed by a 128-bit SipHash of key, signature and message under a secret
+// random key: cheaper than SHA-256, and no more forgeable without the key.
+// The high half picks the shard and is stored alongside the result to be
+// checked on lookup; the low half keys the entry within the shard.
 
-static Hash
+static size_t const VERIFY_SIG_CACHE_SHARDS = 16;
+
+namespace
+{
+struct VerifySigCacheEntry
+{
+    uint64_t mCheck;
+    bool mValid;
+};
+
+struct VerifySigCacheShard
+{
+    std::mutex mMutex;
+    std::default_random_engine mRandom;
+    std::unique_ptr<RandomEvictionCache<uint64_t, VerifySigCacheEntry>>
+        mCache;
+    std::atomic<uint64_t> mHits{0};
+    std::atomic<uint64_t> mMisses{0};
+
+    VerifySigCacheShard()
+        : mCache(std::make_unique<
+                 RandomEvictionCache<uint64_t, VerifySigCacheEntry>>(
+              PubKeyUtils::DEFAULT_VERIFY_SIG_CACHE_SIZE /
+                  VERIFY_SIG_CACHE_SHARDS,
+              mRandom))
+    {
+    }
+};
+
+struct VerifySigCacheKey
+{
+    uint64_t mLow;
+    uint64_t mHigh;
+};
+}
+
+static std::array<VerifySigCacheShard, VERIFY_SIG_CACHE_SHARDS>
+    gVerifySigCache;
+
+static VerifySigCacheKey
 verifySigCacheKey(PublicKey const& key, Signature const& signature,
                   ByteSlice const& bin)
 {
     assert(key.type() == PUBLIC_KEY_TYPE_ED25519);
 
-    gHasher->reset();
-    gHasher->add(key.ed25519());
-    gHasher->add(signature);
-    gHasher->add(bin);
-    return gHasher->finish();
+    static auto const sipKey = []() {
+        std::array<unsigned char, crypto_shorthash_siphashx24_KEYBYTES> k;
+        crypto_shorthash_siphashx24_keygen(k.data());
+        return k;
+    }();
+
+    thread_local std::vector<unsigned char> buf;
+    auto const& pk = key.ed25519();
+    buf.assign(pk.begin(), pk.end());
+    buf.insert(buf.end(), signature.begin(), signature.end());
+    buf.insert(buf.end(), bin.begin(), bin.end());
+
+    std::array<unsigned char, crypto_shorthash_siphashx24_BYTES> out;
+    crypto_shorthash_siphashx24(out.data(), buf.data(), buf.size(),
+                                sipKey.data());
+    VerifySigCacheKey res;
+    static_assert(sizeof(res) == crypto_shorthash_siphashx24_BYTES,
+                  "unexpected size");
+    std::memcpy(&res, out.data(), sizeof(res));
+    return res;
 }
 
 SecretKey::SecretKey() : mKeyType(PUBLIC_KEY_TYPE_ED25519)
@@ -226,18 +285,51 @@ SecretKey::fromStrKeySeed(std::string const& strKeySeed)
 void
 PubKeyUtils::clearVerifySigCache()
 {
-    std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-    gVerifySigCache.clear();
+    for (auto& shard : gVerifySigCache)
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        shard.mCache->clear();
+    }
+}
+
+void
+PubKeyUtils::setVerifySigCacheSize(size_t size)
+{
+    auto shardSize = std::max<size_t>(size / VERIFY_SIG_CACHE_SHARDS, 1);
+    for (auto& shard : gVerifySigCache)
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        if (shard.mCache->maxSize() != shardSize)
+        {
+            shard.mCache = std::make_unique<
+                RandomEvictionCache<uint64_t, VerifySigCacheEntry>>(
+                shardSize, shard.mRandom);
+        }
+    }
+}
+
+size_t
+PubKeyUtils::getVerifySigCacheSize()
+{
+    size_t size = 0;
+    for (auto& shard : gVerifySigCache)
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        size += shard.mCache->maxSize();
+    }
+    return size;
 }
 
 void
 PubKeyUtils::flushVerifySigCacheCounts(uint64_t& hits, uint64_t& misses)
 {
-    std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-    hits = gVerifyCacheHit;
-    misses = gVerifyCacheMiss;
-    gVerifyCacheHit = 0;
-    gVerifyCacheMiss = 0;
+    hits = 0;
+    misses = 0;
+    for (auto& shard : gVerifySigCache)
+    {
+        hits += shard.mHits.exchange(0);
+        misses += shard.mMisses.exchange(0);
+    }
 }
 
 std::string
@@ -318,22 +410,27 @@ PubKeyUtils::verifySig(PublicKey const& key, Signature const& signature,
     }
 
     auto cacheKey = verifySigCacheKey(key, signature, bin);
+    auto& shard = gVerifySigCache[cacheKey.mHigh % VERIFY_SIG_CACHE_SHARDS];
 
     {
-        std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-        if (gVerifySigCache.exists(cacheKey))
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        if (shard.mCache->exists(cacheKey.mLow))
         {
-            ++gVerifyCacheHit;
-            return gVerifySigCache.get(cacheKey);
+            auto const& entry = shard.mCache->get(cacheKey.mLow);
+            if (entry.mCheck == cacheKey.mHigh)
+            {
+                ++shard.mHits;
+                return entry.mValid;
+            }
         }
     }
 
-    ++gVerifyCacheMiss;
+    ++shard.mMisses;
     bool ok =
         (crypto_sign_verify_detached(signature.data(), bin.data(), bin.size(),
                                      key.ed25519().data()) == 0);
-    std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-    gVerifySigCache.put(cacheKey, ok);
+    std::lock_guard<std::mutex> guard(shard.mMutex);
+    shard.mCache->put(cacheKey.mLow, {cacheKey.mHigh, ok});
     return ok;
 }
 
@@ -114,7 +114,16 @@ namespace PubKeyUtils
 bool verifySig(PublicKey const& key, Signature const& signature,
                ByteSlice const& bin);
 
+// The number of verification results cached until setVerifySigCacheSize is
+// called; also the default of Config::VERIFY_SIG_CACHE_SIZE.
+size_t const DEFAULT_VERIFY_SIG_CACHE_SIZE = 250000;
+
 void clearVerifySigCache();
+// Resize (and so clear) the cache, unless it has `size` entries already.
+void setVerifySigCacheSize(size_t size);
+// The number of entries the cache holds at most: the last size set, rounded
+// down to a multiple of the number of shards.
+size_t getVerifySigCacheSize();
 void flushVerifySigCacheCounts(uint64_t& hits, uint64_t& misses);
 
 PublicKey random();
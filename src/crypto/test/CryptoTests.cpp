@@ -11,10 +11,12 @@
 #include "lib/catch.hpp"
 #include "test/test.h"
 #include "util/Logging.h"
+#include <atomic>
 #include <autocheck/autocheck.hpp>
 #include <map>
 #include <regex>
 #include <sodium.h>
+#include <thread>
 
 using namespace stellar;
 
@@ -115,6 +117,8 @@ TEST_CASE("HMAC test vector", "[crypto]")
     auto v = hmacSha256(k, s);
     REQUIRE(h == v.mac);
     REQUIRE(hmacSha256Verify(v, k, s));
+    REQUIRE(hmacSha256(k, "The quick brown fox ", "jumps over the lazy dog")
+                .mac == h);
 }
 
 TEST_CASE("HKDF test vector", "[crypto]")
@@ -208,6 +212,88 @@ TEST_CASE("sign and verify benchmarking", "[crypto-bench][bench][!hide]")
     }
 }
 
+TEST_CASE("verify signature cache", "[crypto]")
+{
+    std::vector<SignVerifyTestcase> cases;
+    for (size_t i = 0; i < 64; ++i)
+    {
+        cases.push_back(SignVerifyTestcase::create());
+        cases.back().sign();
+    }
+
+    PubKeyUtils::clearVerifySigCache();
+    uint64_t hits, misses;
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+
+    for (auto& c : cases)
+    {
+        c.verify();
+    }
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+    REQUIRE(hits == 0);
+    REQUIRE(misses == cases.size());
+
+    SECTION("from several threads")
+    {
+        std::atomic<size_t> failed{0};
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&cases, &failed]() {
+                for (auto const& c : cases)
+                {
+                    if (!PubKeyUtils::verifySig(c.pub, c.sig, c.msg))
+                    {
+                        ++failed;
+                    }
+                }
+            });
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        REQUIRE(failed == 0);
+        PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+        REQUIRE(hits == 4 * cases.size());
+        REQUIRE(misses == 0);
+    }
+
+    SECTION("failures are cached too")
+    {
+        auto& c = cases.front();
+        c.sig[4] ^= 1;
+        CHECK(!PubKeyUtils::verifySig(c.pub, c.sig, c.msg));
+        CHECK(!PubKeyUtils::verifySig(c.pub, c.sig, c.msg));
+        PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+        REQUIRE(hits == 1);
+        REQUIRE(misses == 1);
+    }
+
+    SECTION("resized")
+    {
+        // Puts the cache back as it was, for the tests that run after.
+        struct RestoreVerifySigCacheSize
+        {
+            size_t const mSize{PubKeyUtils::getVerifySigCacheSize()};
+            ~RestoreVerifySigCacheSize()
+            {
+                PubKeyUtils::setVerifySigCacheSize(mSize);
+            }
+        } restore;
+
+        PubKeyUtils::setVerifySigCacheSize(16);
+        REQUIRE(PubKeyUtils::getVerifySigCacheSize() == 16);
+        for (auto& c : cases)
+        {
+            c.verify();
+        }
+        PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+        REQUIRE(hits == 0);
+        REQUIRE(misses == cases.size());
+    }
+}
+
 TEST_CASE("StrKey tests", "[crypto]")
 {
     std::regex b32("^([A-Z2-7])+$");
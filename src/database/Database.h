@@ -9,6 +9,7 @@
 #include "overlay/StellarXDR.h"
 #include "util/NonCopyable.h"
 #include "util/Timer.h"
+#include <mutex>
 #include <set>
 #include <soci.h>
 #include <string>
@@ -92,7 +93,9 @@ class Database : NonMovableOrCopyable
     medida::Counter& mStatementsSize;
 
     // Helpers for maintaining the total query time and calculating
-    // idle percentage.
+    // idle percentage. The set is guarded by a mutex as timers are also
+    // acquired by writers running on pool sessions.
+    mutable std::mutex mEntityTypesMutex;
     std::set<std::string> mEntityTypes;
     std::chrono::nanoseconds mExcludedQueryTime;
     std::chrono::nanoseconds mExcludedTotalTime;
@@ -138,6 +141,12 @@ class Database : NonMovableOrCopyable
     // when the statement context is destroyed.
     StatementContext getPreparedStatement(std::string const& query);
 
+    // As above, but prepares the statement on `session`. Only statements on
+    // the main session are cached; for any other session (such as one leased
+    // from the pool by a worker thread) a fresh statement is prepared.
+    StatementContext getPreparedStatement(std::string const& query,
+                                          soci::session& session);
+
     // Purge all cached prepared statements, closing their handles with the
     // database.
     void clearPreparedStatementCache();
@@ -163,6 +172,11 @@ class Database : NonMovableOrCopyable
     template <typename T>
     T doDatabaseTypeSpecificOperation(DatabaseTypeSpecificOperation<T>& op);
 
+    // As above, but with the backend of `session`.
+    template <typename T>
+    T doDatabaseTypeSpecificOperation(DatabaseTypeSpecificOperation<T>& op,
+                                      soci::session& session);
+
     // Return true if a connection pool is available for worker threads
     // to read from the database through, otherwise false.
     bool canUsePool() const;
@@ -195,7 +209,15 @@ template <typename T>
 T
 Database::doDatabaseTypeSpecificOperation(DatabaseTypeSpecificOperation<T>& op)
 {
-    auto b = mSession.get_backend();
+    return doDatabaseTypeSpecificOperation(op, mSession);
+}
+
+template <typename T>
+T
+Database::doDatabaseTypeSpecificOperation(DatabaseTypeSpecificOperation<T>& op,
+                                          soci::session& session)
+{
+    auto b = session.get_backend();
     if (auto sq = dynamic_cast<soci::sqlite3_session_backend*>(b))
     {
         return op.doSqliteSpecificOperation(sq);
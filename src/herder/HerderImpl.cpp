@@ -67,7 +67,8 @@ HerderImpl::SCPMetrics::SCPMetrics(Application& app)
 }
 
 HerderImpl::HerderImpl(Application& app)
-    : mTransactionQueue(app, TRANSACTION_QUEUE_SIZE, TRANSACTION_QUEUE_BAN_SIZE)
+    : mTransactionQueue(app, TRANSACTION_QUEUE_SIZE, TRANSACTION_QUEUE_BAN_SIZE,
+                        app.getConfig().TRANSACTION_QUEUE_SIZE_OPS)
     , mPendingEnvelopes(app, *this)
     , mHerderSCPDriver(app, *this, mUpgrades, mPendingEnvelopes)
     , mLastSlotSaved(0)
@@ -248,7 +249,7 @@ HerderImpl::broadcast(SCPEnvelope const& e)
                               << " i:" << e.statement.slotIndex;
 
         mSCPMetrics.mEnvelopeEmit.Mark();
-        mApp.getOverlayManager().broadcastMessage(m, true);
+        mApp.getOverlayManager().broadcastMessage(m);
     }
 }
 
@@ -482,6 +483,8 @@ HerderImpl::ledgerClosed()
 
     CLOG(TRACE, "Herder") << "HerderImpl::ledgerClosed";
 
+    mHerderSCPDriver.ledgerClosed();
+
     auto lastIndex = mHerderSCPDriver.lastConsensusLedgerIndex();
 
     mPendingEnvelopes.slotClosed(lastIndex);
@@ -610,13 +613,13 @@ HerderImpl::triggerNextLedger(uint32_t ledgerSeqToTrigger)
     // our first choice for this round's set is all the tx we have collected
     // during last few ledger closes
     auto const& lcl = mLedgerManager.getLastClosedLedgerHeader();
-    auto proposedSet = mTransactionQueue.toTxSet(lcl.hash);
+    auto proposedSet = mTransactionQueue.getTxSetForLedger(lcl);
     auto removed = proposedSet->trimInvalid(mApp);
     mTransactionQueue.remove(removed);
 
     proposedSet->surgePricingFilter(mApp);
 
-    if (!proposedSet->checkValid(mApp))
+    if (!mHerderSCPDriver.checkTxSetValid(*proposedSet))
     {
         throw std::runtime_error("wanting to emit an invalid txSet");
     }
@@ -944,6 +947,12 @@ HerderImpl::updateTransactionQueue(
 {
     // remove all these tx from mTransactionQueue
     mTransactionQueue.remove(applied);
+
+    // and those no longer valid
+    mTransactionQueue.ledgerClosed(
+        mLedgerManager.getLastClosedLedgerHeader().header,
+        mLedgerManager.getLastClosedModifiedAccounts());
+
     mTransactionQueue.shift();
 
     // rebroadcast entries, sorted in apply-order to maximize chances of
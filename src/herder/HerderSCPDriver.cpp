@@ -16,6 +16,7 @@
 #include "util/Logging.h"
 #include "xdr/Stellar-SCP.h"
 #include "xdr/Stellar-ledger-entries.h"
+#include <medida/histogram.h>
 #include <medida/metrics_registry.h>
 #include <util/format.h>
 #include <xdrpp/marshal.h>
@@ -35,6 +36,12 @@ HerderSCPDriver::SCPMetrics::SCPMetrics(Application& app)
           app.getMetrics().NewTimer({"scp", "timing", "nominated"}))
     , mPrepareToExternalize(
           app.getMetrics().NewTimer({"scp", "timing", "externalized"}))
+    , mTxSetChecked(
+          app.getMetrics().NewMeter({"herder", "txset", "check"}, "txset"))
+    , mTxSetCheckCached(app.getMetrics().NewMeter(
+          {"herder", "txset", "check-cached"}, "txset"))
+    , mTxSetChecksSaved(app.getMetrics().NewHistogram(
+          {"herder", "txset", "checks-saved"}))
 {
 }
 
@@ -49,6 +56,7 @@ HerderSCPDriver::HerderSCPDriver(Application& app, HerderImpl& herder,
     , mSCP(*this, mApp.getConfig().NODE_SEED.getPublicKey(),
            mApp.getConfig().NODE_IS_VALIDATOR, mApp.getConfig().QUORUM_SET)
     , mSCPMetrics{mApp}
+    , mTxSetValidity(TXSET_VALIDITY_CACHE_SIZE)
 {
 }
 
@@ -305,7 +313,7 @@ HerderSCPDriver::validateValueHelper(uint64_t slotIndex, StellarValue const& b,
 
         res = SCPDriver::kInvalidValue;
     }
-    else if (!txSet->checkValid(mApp))
+    else if (!checkTxSetValid(*txSet))
     {
         if (Logging::logDebug("Herder"))
             CLOG(DEBUG, "Herder") << "HerderSCPDriver::validateValue"
@@ -325,6 +333,36 @@ HerderSCPDriver::validateValueHelper(uint64_t slotIndex, StellarValue const& b,
     return res;
 }
 
+bool
+HerderSCPDriver::checkTxSetValid(TxSetFrame& txSet) const
+{
+    auto const& lclHash = mLedgerManager.getLastClosedLedgerHeader().hash;
+    auto txSetHash = txSet.getContentsHash();
+    if (mTxSetValidity.exists(txSetHash))
+    {
+        auto const& validity = mTxSetValidity.get(txSetHash);
+        if (validity.mLCLHash == lclHash)
+        {
+            mSCPMetrics.mTxSetCheckCached.Mark();
+            ++mTxSetChecksSaved;
+            return validity.mValid;
+        }
+    }
+
+    mSCPMetrics.mTxSetChecked.Mark();
+    bool valid = txSet.checkValid(mApp);
+    mTxSetValidity.put(txSetHash, {lclHash, valid});
+    return valid;
+}
+
+void
+HerderSCPDriver::ledgerClosed()
+{
+    mSCPMetrics.mTxSetChecksSaved.Update(mTxSetChecksSaved);
+    mTxSetChecksSaved = 0;
+    mTxSetValidity.clear();
+}
+
 SCPDriver::ValidationLevel
 HerderSCPDriver::validateValue(uint64_t slotIndex, Value const& value,
                                bool nomination)
@@ -652,8 +690,26 @@ HerderSCPDriver::combineCandidates(uint64_t slotIndex,
         comp.upgrades.emplace_back(v.begin(), v.end());
     }
 
-    // just to be sure
-    auto removed = bestTxSet->trimInvalid(mApp);
+    // just to be sure, unless it was found valid already (as candidates
+    // normally were, when they were nominated)
+    bool knownValid = false;
+    auto bestHash = bestTxSet->getContentsHash();
+    if (mTxSetValidity.exists(bestHash))
+    {
+        auto const& validity = mTxSetValidity.get(bestHash);
+        knownValid = validity.mValid && validity.mLCLHash == lcl.hash;
+    }
+    std::vector<TransactionFramePtr> removed;
+    if (knownValid)
+    {
+        mSCPMetrics.mTxSetCheckCached.Mark();
+        ++mTxSetChecksSaved;
+    }
+    else
+    {
+        mSCPMetrics.mTxSetChecked.Mark();
+        removed = bestTxSet->trimInvalid(mApp);
+    }
     comp.txSetHash = bestTxSet->getContentsHash();
 
     if (removed.size() != 0)
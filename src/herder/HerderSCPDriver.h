@@ -6,12 +6,14 @@
 
 #include "herder/Herder.h"
 #include "herder/TxSetFrame.h"
+#include "lib/util/lrucache.hpp"
 #include "scp/SCPDriver.h"
 #include "xdr/Stellar-ledger.h"
 
 namespace medida
 {
 class Counter;
+class Histogram;
 class Meter;
 class Timer;
 }
@@ -134,6 +136,15 @@ class HerderSCPDriver : public SCPDriver
 
     optional<VirtualClock::time_point> getPrepareStart(uint64_t slotIndex);
 
+    // Whether `txSet` is valid against the last closed ledger. The verdict
+    // is remembered, so that the same tx set coming up again in nomination
+    // and ballots for the slot is not validated again.
+    bool checkTxSetValid(TxSetFrame& txSet) const;
+
+    // Forget the verdicts of checkTxSetValid, now that they are about an
+    // older ledger.
+    void ledgerClosed();
+
   private:
     Application& mApp;
     HerderImpl& mHerder;
@@ -156,11 +167,29 @@ class HerderSCPDriver : public SCPDriver
         medida::Timer& mNominateToPrepare;
         medida::Timer& mPrepareToExternalize;
 
+        // Tx set validations done, and avoided thanks to mTxSetValidity
+        medida::Meter& mTxSetChecked;
+        medida::Meter& mTxSetCheckCached;
+        medida::Histogram& mTxSetChecksSaved;
+
         SCPMetrics(Application& app);
     };
 
     SCPMetrics mSCPMetrics;
 
+    struct TxSetValidity
+    {
+        // the last closed ledger the tx set was validated against
+        Hash mLCLHash;
+        bool mValid;
+    };
+
+    // Verdicts of checkTxSetValid by tx set hash, for the current ledger.
+    static size_t const TXSET_VALIDITY_CACHE_SIZE = 1000;
+    mutable cache::lru_cache<Hash, TxSetValidity> mTxSetValidity;
+    // validations avoided since the last ledger closed
+    mutable uint64_t mTxSetChecksSaved{0};
+
     struct SCPTiming
     {
         optional<VirtualClock::time_point> mNominationStart;
@@ -3,17 +3,23 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "herder/TransactionQueue.h"
+#include "crypto/Hex.h"
 #include "crypto/SecretKey.h"
 #include "ledger/LedgerTxn.h"
 #include "main/Application.h"
+#include "transactions/OperationFrame.h"
 #include "transactions/TransactionUtils.h"
 #include "util/HashOfHash.h"
+#include "util/Logging.h"
 #include "util/XDROperators.h"
+#include "util/numeric.h"
 
 #include <algorithm>
 #include <lib/util/format.h>
+#include <medida/counter.h>
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
+#include <queue>
 
 namespace stellar
 {
@@ -46,6 +52,43 @@ findOrAdd(TransactionQueue::AccountTxMap& acc, AccountID const& aid)
     return txmap;
 }
 
+static size_t
+countOps(TransactionFramePtr const& tx)
+{
+    return std::max<size_t>(tx->getOperations().size(), 1);
+}
+
+// The accounts tx needs to be checked against.
+static std::vector<AccountID>
+getDependencies(TransactionFramePtr const& tx)
+{
+    std::vector<AccountID> res{tx->getSourceID()};
+    for (auto const& op : tx->getOperations())
+    {
+        auto const& id = op->getSourceID();
+        if (std::find(res.begin(), res.end(), id) == res.end())
+        {
+            res.emplace_back(id);
+        }
+    }
+    return res;
+}
+
+bool
+TransactionQueue::FeeRateLess::operator()(TransactionFramePtr const& x,
+                                          TransactionFramePtr const& y) const
+{
+    auto vx = bigMultiply(static_cast<uint64_t>(x->getFeeBid()),
+                          static_cast<uint64_t>(countOps(y)));
+    auto vy = bigMultiply(static_cast<uint64_t>(y->getFeeBid()),
+                          static_cast<uint64_t>(countOps(x)));
+    if (vx != vy)
+    {
+        return vx < vy;
+    }
+    return x->getFullHash() < y->getFullHash();
+}
+
 bool
 TransactionQueue::isBanned(Hash const& hash) const
 {
@@ -83,10 +126,19 @@ TransactionQueue::TxMap::recalculate()
 }
 
 TransactionQueue::TransactionQueue(Application& app, int pendingDepth,
-                                   int banDepth)
+                                   int banDepth, size_t maxSizeOps)
     : mApp(app)
+    , mSizeOpsCounter(
+          app.getMetrics().NewCounter({"herder", "pending-txs", "ops"}))
+    , mEvicted(app.getMetrics().NewMeter({"herder", "pending-txs", "evicted"},
+                                         "transaction"))
+    , mRevalidated(app.getMetrics().NewMeter(
+          {"herder", "pending-txs", "revalidated"}, "chain"))
+    , mInvalidated(app.getMetrics().NewMeter(
+          {"herder", "pending-txs", "invalidated"}, "transaction"))
     , mPendingTransactions(pendingDepth)
     , mBannedTransactions(banDepth)
+    , mMaxSizeOps(maxSizeOps)
 {
     for (auto i = 0; i < pendingDepth; i++)
     {
@@ -123,8 +175,14 @@ TransactionQueue::tryAdd(TransactionFramePtr tx)
         return TransactionQueue::AddResult::ADD_STATUS_ERROR;
     }
 
+    if (!makeRoom(tx))
+    {
+        return TransactionQueue::AddResult::ADD_STATUS_TRY_AGAIN_LATER;
+    }
+
     auto map = findOrAdd(mPendingTransactions[0], tx->getSourceID());
     map->addTx(tx);
+    addToChain(tx);
 
     return TransactionQueue::AddResult::ADD_STATUS_PENDING;
 }
@@ -152,6 +210,7 @@ TransactionQueue::remove(std::vector<TransactionFramePtr> const& dropTxs)
                 auto j = txs.find(txID);
                 if (j != txs.end())
                 {
+                    removeFromChain(j->second);
                     txs.erase(j);
                     if (txs.empty())
                     {
@@ -222,6 +281,7 @@ TransactionQueue::shift()
         for (auto const& toBan : map.second->mTransactions)
         {
             bannedFront.insert(toBan.first);
+            removeFromChain(toBan.second);
         }
     }
 
@@ -232,6 +292,127 @@ TransactionQueue::shift()
     {
         mSizeByAge[i]->set_count(countTxs(mPendingTransactions[i]));
     }
+    mSizeOpsCounter.set_count(mSizeOps);
+}
+
+void
+TransactionQueue::addToChain(TransactionFramePtr const& tx)
+{
+    auto& chain = mChains[tx->getSourceID()];
+    if (!chain.mTransactions.empty())
+    {
+        mChainHeads.erase(chain.mTransactions.begin()->second);
+    }
+    if (chain.mTransactions.emplace(tx->getSeqNum(), tx).second)
+    {
+        chain.mSizeOps += countOps(tx);
+        mSizeOps += countOps(tx);
+        for (auto const& id : getDependencies(tx))
+        {
+            if (chain.mDependencies[id]++ == 0)
+            {
+                mDependents[id].insert(tx->getSourceID());
+            }
+        }
+    }
+    mChainHeads.insert(chain.mTransactions.begin()->second);
+}
+
+void
+TransactionQueue::removeFromChain(TransactionFramePtr const& tx)
+{
+    auto i = mChains.find(tx->getSourceID());
+    if (i == mChains.end())
+    {
+        return;
+    }
+    auto& chain = i->second;
+    auto j = chain.mTransactions.find(tx->getSeqNum());
+    if (j == chain.mTransactions.end() ||
+        j->second->getFullHash() != tx->getFullHash())
+    {
+        return;
+    }
+
+    mChainHeads.erase(chain.mTransactions.begin()->second);
+    chain.mTransactions.erase(j);
+    chain.mSizeOps -= countOps(tx);
+    mSizeOps -= countOps(tx);
+    for (auto const& id : getDependencies(tx))
+    {
+        auto dep = chain.mDependencies.find(id);
+        if (--dep->second == 0)
+        {
+            chain.mDependencies.erase(dep);
+            auto dependents = mDependents.find(id);
+            dependents->second.erase(tx->getSourceID());
+            if (dependents->second.empty())
+            {
+                mDependents.erase(dependents);
+            }
+        }
+    }
+    if (chain.mTransactions.empty())
+    {
+        mChains.erase(i);
+    }
+    else
+    {
+        mChainHeads.insert(chain.mTransactions.begin()->second);
+    }
+}
+
+bool
+TransactionQueue::makeRoom(TransactionFramePtr const& tx)
+{
+    auto ops = countOps(tx);
+    if (mSizeOps + ops <= mMaxSizeOps)
+    {
+        return true;
+    }
+    if (ops > mMaxSizeOps)
+    {
+        return false;
+    }
+
+    // tx is worth no more than the first transaction of its chain
+    auto worth = tx;
+    auto own = mChains.find(tx->getSourceID());
+    if (own != mChains.end())
+    {
+        worth = own->second.mTransactions.begin()->second;
+    }
+
+    std::vector<TransactionFramePtr> toEvict;
+    size_t freed = 0;
+    for (auto const& head : mChainHeads)
+    {
+        if (mSizeOps - freed + ops <= mMaxSizeOps)
+        {
+            break;
+        }
+        if (!FeeRateLess()(head, worth))
+        {
+            return false;
+        }
+        auto const& chain = mChains.find(head->getSourceID())->second;
+        for (auto const& seqTx : chain.mTransactions)
+        {
+            toEvict.emplace_back(seqTx.second);
+        }
+        freed += chain.mSizeOps;
+    }
+    if (mSizeOps - freed + ops > mMaxSizeOps)
+    {
+        return false;
+    }
+
+    CLOG(DEBUG, "Herder") << "Evicting " << toEvict.size()
+                          << " transactions to make room for "
+                          << hexAbbrev(tx->getFullHash());
+    mEvicted.Mark(toEvict.size());
+    remove(toEvict);
+    return true;
 }
 
 int
@@ -259,6 +440,153 @@ TransactionQueue::toTxSet(Hash const& lclHash) const
     return result;
 }
 
+void
+TransactionQueue::revalidate(std::unordered_set<AccountID> const& modified)
+{
+    std::unordered_set<AccountID> sources;
+    for (auto const& id : modified)
+    {
+        auto dependents = mDependents.find(id);
+        if (dependents != mDependents.end())
+        {
+            sources.insert(dependents->second.begin(),
+                           dependents->second.end());
+        }
+    }
+    revalidateChains(sources);
+}
+
+void
+TransactionQueue::revalidateAll()
+{
+    std::unordered_set<AccountID> sources;
+    for (auto const& chain : mChains)
+    {
+        sources.insert(chain.first);
+    }
+    revalidateChains(sources);
+}
+
+void
+TransactionQueue::ledgerClosed(LedgerHeader const& lcl,
+                               std::unordered_set<AccountID> const& modified)
+{
+    auto const& prev = mLastCheckedLedger;
+    if (lcl.ledgerSeq == prev.ledgerSeq + 1 && lcl.baseFee == prev.baseFee &&
+        lcl.baseReserve == prev.baseReserve &&
+        lcl.ledgerVersion == prev.ledgerVersion)
+    {
+        revalidate(modified);
+    }
+    else if (lcl.ledgerSeq != prev.ledgerSeq)
+    {
+        revalidateAll();
+    }
+    mLastCheckedLedger = lcl;
+}
+
+void
+TransactionQueue::revalidateChains(std::unordered_set<AccountID> const& sources)
+{
+    if (sources.empty())
+    {
+        return;
+    }
+
+    std::vector<TransactionFramePtr> invalid;
+    {
+        LedgerTxn ltx(mApp.getLedgerTxnRoot());
+        for (auto const& source : sources)
+        {
+            // same checks as tryAdd, for the whole chain in order
+            SequenceNumber lastSeq = 0;
+            int64_t totalFees = 0;
+            bool valid = true;
+            for (auto const& seqTx : mChains.find(source)->second.mTransactions)
+            {
+                auto const& tx = seqTx.second;
+                if (valid)
+                {
+                    valid = tx->checkValid(ltx, lastSeq);
+                }
+                if (valid)
+                {
+                    totalFees += tx->getFeeBid();
+                    auto account = stellar::loadAccount(ltx, source);
+                    valid = account && getAvailableBalance(ltx.loadHeader(),
+                                                           account) >=
+                                           totalFees;
+                }
+                if (!valid)
+                {
+                    invalid.emplace_back(tx);
+                }
+                lastSeq = tx->getSeqNum();
+            }
+        }
+    }
+
+    mRevalidated.Mark(sources.size());
+    mInvalidated.Mark(invalid.size());
+    remove(invalid);
+}
+
+std::shared_ptr<TxSetFrame>
+TransactionQueue::getTxSetForLedger(
+    LedgerHeaderHistoryEntry const& lcl) const
+{
+    auto result = std::make_shared<TxSetFrame>(lcl.hash);
+
+    bool maxIsOps = lcl.header.ledgerVersion >= 11;
+    size_t opsLeft = maxIsOps ? lcl.header.maxTxSetSize
+                              : (lcl.header.maxTxSetSize * MAX_OPS_PER_TX);
+
+    // Chains are taken up by their first transaction, best first from
+    // mChainHeads; each transaction taken puts the next one of its chain in
+    // `next`, to be weighed against the remaining heads.
+    std::priority_queue<TransactionFramePtr, std::vector<TransactionFramePtr>,
+                        FeeRateLess>
+        next;
+    auto head = mChainHeads.rbegin();
+    while (opsLeft > 0)
+    {
+        TransactionFramePtr tx;
+        if (head != mChainHeads.rend() &&
+            (next.empty() || FeeRateLess()(next.top(), *head)))
+        {
+            tx = *head++;
+        }
+        else if (!next.empty())
+        {
+            tx = next.top();
+            next.pop();
+        }
+        else
+        {
+            break;
+        }
+
+        size_t opsCount =
+            maxIsOps ? tx->getOperations().size() : MAX_OPS_PER_TX;
+        if (opsCount > opsLeft)
+        {
+            // the rest of the chain cannot go in without it
+            continue;
+        }
+        result->add(tx);
+        opsLeft -= opsCount;
+
+        auto const& txs = mChains.find(tx->getSourceID())->second.mTransactions;
+        auto following = txs.upper_bound(tx->getSeqNum());
+        if (following != txs.end())
+        {
+            next.push(following->second);
+        }
+    }
+
+    return result;
+}
+
 bool
 operator==(TransactionQueue::AccountTxQueueInfo const& x,
            TransactionQueue::AccountTxQueueInfo const& y)
@@ -12,7 +12,9 @@
 #include "xdr/Stellar-transaction.h"
 
 #include <deque>
+#include <map>
 #include <memory>
+#include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -20,6 +22,7 @@
 namespace medida
 {
 class Counter;
+class Meter;
 }
 
 namespace stellar
@@ -57,7 +60,11 @@ class TransactionQueue
     };
     typedef std::unordered_map<AccountID, std::shared_ptr<TxMap>> AccountTxMap;
 
-    explicit TransactionQueue(Application& app, int pendingDepth, int banDepth);
+    // The queue holds up to `maxSizeOps` operations; beyond that, a
+    // transaction is only let in by evicting chains paying less per
+    // operation than it does.
+    explicit TransactionQueue(Application& app, int pendingDepth, int banDepth,
+                              size_t maxSizeOps);
 
     AddResult tryAdd(TransactionFramePtr tx);
     // it is responsibility of the caller to always remove such sets of
@@ -68,20 +75,85 @@ class TransactionQueue
     // by one, this results in newest queue slot being empty
     void shift();
 
+    // Once a ledger has closed, remove the transactions it made invalid,
+    // along with those after them from the same account. Only the chains
+    // depending on one of `modified`, the accounts the ledger changed, are
+    // checked again.
+    void revalidate(std::unordered_set<AccountID> const& modified);
+    // The same, checking every chain again.
+    void revalidateAll();
+    // Call revalidate for the ledger closed as `lcl`, if it follows the one
+    // last checked against and upgraded none of the base fee, base reserve
+    // or protocol version, which any transaction may depend on; otherwise
+    // revalidateAll.
+    void ledgerClosed(LedgerHeader const& lcl,
+                      std::unordered_set<AccountID> const& modified);
+
     AccountTxQueueInfo
     getAccountTransactionQueueInfo(AccountID const& accountID) const;
 
     int countBanned(int index) const;
     bool isBanned(Hash const& hash) const;
+    // every transaction in the queue
     std::shared_ptr<TxSetFrame> toTxSet(Hash const& lclHash) const;
+    // the transactions to propose for the ledger after `lcl`: as many as fit
+    // in it, highest fee per operation first, as surge pricing would pick
+    std::shared_ptr<TxSetFrame>
+    getTxSetForLedger(LedgerHeaderHistoryEntry const& lcl) const;
+
+    size_t
+    getSizeOps() const
+    {
+        return mSizeOps;
+    }
 
   private:
+    // Lower fee per operation first, then lower hash.
+    struct FeeRateLess
+    {
+        bool operator()(TransactionFramePtr const& x,
+                        TransactionFramePtr const& y) const;
+    };
+
+    // The transactions of an account, whatever their age, by sequence
+    // number: those after the first can only be applied once it has been.
+    struct AccountChain
+    {
+        std::map<SequenceNumber, TransactionFramePtr> mTransactions;
+        size_t mSizeOps{0};
+        // The accounts whose state the chain's validity depends on (its
+        // own and the operation source accounts), with the number of its
+        // transactions depending on each.
+        std::unordered_map<AccountID, size_t> mDependencies;
+    };
+
     Application& mApp;
     std::vector<medida::Counter*> mSizeByAge;
+    medida::Counter& mSizeOpsCounter;
+    medida::Meter& mEvicted;
+    medida::Meter& mRevalidated;
+    medida::Meter& mInvalidated;
     std::deque<AccountTxMap> mPendingTransactions;
     std::deque<std::unordered_set<Hash>> mBannedTransactions;
 
+    std::unordered_map<AccountID, AccountChain> mChains;
+    // The first transaction of every chain; a chain is worth what its first
+    // transaction pays, as the rest wait on it.
+    std::set<TransactionFramePtr, FeeRateLess> mChainHeads;
+    // For each account, the source accounts of the chains depending on it.
+    std::unordered_map<AccountID, std::unordered_set<AccountID>> mDependents;
+    size_t const mMaxSizeOps;
+    size_t mSizeOps{0};
+    // The ledger the queue was last checked against by ledgerClosed.
+    LedgerHeader mLastCheckedLedger;
+
     bool contains(TransactionFramePtr tx) const;
+
+    void addToChain(TransactionFramePtr const& tx);
+    void removeFromChain(TransactionFramePtr const& tx);
+    // Evict what is needed to fit `tx`, if it pays more than all of it.
+    bool makeRoom(TransactionFramePtr const& tx);
+    void revalidateChains(std::unordered_set<AccountID> const& sources);
 };
 
 static const char* TX_STATUS_STRING[static_cast<int>(
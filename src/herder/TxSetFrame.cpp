@@ -7,6 +7,7 @@
 #include "crypto/Hex.h"
 #include "crypto/Random.h"
 #include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
 #include "database/Database.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerTxn.h"
@@ -14,12 +15,19 @@
 #include "ledger/LedgerTxnHeader.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "transactions/OperationFrame.h"
+#include "transactions/SignatureUtils.h"
 #include "transactions/TransactionUtils.h"
 #include "util/Logging.h"
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <list>
+#include <mutex>
 #include <numeric>
 
 #include "xdrpp/printer.h"
@@ -278,6 +286,112 @@ TxSetFrame::surgePricingFilter(Application& app)
     }
 }
 
+namespace
+{
+// Signatures are handed to the workers in chunks of this many.
+size_t const SIGNATURES_PER_CHUNK = 64;
+
+struct SignatureCheck
+{
+    PublicKey mKey;
+    Signature mSignature;
+    Hash mHash;
+};
+
+// The checks and how far the threads verifying them have got. Shared with
+// the workers, which may only get to run once the main thread is done.
+struct SignatureChecks
+{
+    std::vector<SignatureCheck> mChecks;
+    size_t mChunks{0};
+    std::atomic<size_t> mNextChunk{0};
+
+    std::mutex mMutex;
+    std::condition_variable mDone;
+    size_t mChunksDone{0};
+
+    // Verify chunks until there are none left; returns once all have been
+    // claimed, not necessarily finished.
+    void
+    work()
+    {
+        for (auto chunk = mNextChunk++; chunk < mChunks; chunk = mNextChunk++)
+        {
+            auto begin = chunk * SIGNATURES_PER_CHUNK;
+            auto end = std::min(begin + SIGNATURES_PER_CHUNK, mChecks.size());
+            for (auto i = begin; i < end; ++i)
+            {
+                auto const& c = mChecks[i];
+                PubKeyUtils::verifySig(c.mKey, c.mSignature, c.mHash);
+            }
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (++mChunksDone == mChunks)
+            {
+                mDone.notify_one();
+            }
+        }
+    }
+};
+}
+
+void
+TxSetFrame::preVerifySignatures(Application& app)
+{
+    auto checks = std::make_shared<SignatureChecks>();
+    for (auto const& tx : mTransactions)
+    {
+        // Other signers are only known from the ledger, so their
+        // signatures are left to checkValid.
+        std::vector<AccountID> keys{tx->getSourceID()};
+        for (auto const& op : tx->getOperations())
+        {
+            auto const& key = op->getSourceID();
+            if (std::find(keys.begin(), keys.end(), key) == keys.end())
+            {
+                keys.emplace_back(key);
+            }
+        }
+        for (auto const& sig : tx->getEnvelope().signatures)
+        {
+            for (auto const& key : keys)
+            {
+                if (SignatureUtils::doesHintMatch(key.ed25519(), sig.hint))
+                {
+                    checks->mChecks.push_back(
+                        {key, sig.signature, tx->getContentsHash()});
+                }
+            }
+        }
+    }
+
+    checks->mChunks = (checks->mChecks.size() + SIGNATURES_PER_CHUNK - 1) /
+                      SIGNATURES_PER_CHUNK;
+    if (checks->mChunks < 2)
+    {
+        // Not worth a trip to the workers.
+        return;
+    }
+
+    auto timer = app.getMetrics()
+                     .NewTimer({"herder", "txset", "verify-signatures"})
+                     .TimeScope();
+    auto workers = std::min<size_t>(
+        checks->mChunks - 1,
+        static_cast<size_t>(std::max(app.getConfig().WORKER_THREADS, 0)));
+    for (size_t i = 0; i < workers; ++i)
+    {
+        app.postOnBackgroundThread([checks]() { checks->work(); },
+                                   "TxSetFrame: verify signatures");
+    }
+    // The main thread takes its share too, so this finishes even if the
+    // workers are all busy with something else.
+    checks->work();
+    std::unique_lock<std::mutex> lock(checks->mMutex);
+    checks->mDone.wait(lock, [&checks]() {
+        return checks->mChunksDone == checks->mChunks;
+    });
+}
+
 bool
 TxSetFrame::checkOrTrim(
     Application& app,
@@ -303,6 +417,8 @@ TxSetFrame::checkOrTrim(
         lastHash = tx->getFullHash();
     }
 
+    preVerifySignatures(app);
+
     for (auto& item : accountTxMap)
     {
         TransactionFramePtr lastTx;
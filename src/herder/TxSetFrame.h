@@ -33,6 +33,12 @@ class TxSetFrame
                      std::function<bool(std::deque<TransactionFramePtr> const&)>
                          processLastInvalidTxLambda);
 
+    // Verify, across the worker threads, the signatures that the source
+    // accounts' master keys put on the transactions, so that checkValid
+    // finds them in the verification cache rather than verifying them one
+    // after the other.
+    void preVerifySignatures(Application& app);
+
     std::unordered_map<AccountID, AccountTransactionQueue>
     buildAccountTxQueues();
     friend struct SurgeCompare;
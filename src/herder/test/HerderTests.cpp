@@ -20,6 +20,9 @@
 #include "ledger/LedgerTxnHeader.h"
 #include "lib/catch.hpp"
 #include "main/CommandHandler.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "overlay/OverlayManager.h"
 #include "test/TxTests.h"
 #include "transactions/OperationFrame.h"
@@ -411,6 +414,98 @@ TEST_CASE("txset", "[herder][txset]")
     }
 }
 
+TEST_CASE("txset signatures verified on workers", "[herder][txset]")
+{
+    Config cfg(getTestConfig());
+    cfg.TESTING_UPGRADE_MAX_TX_SET_SIZE = 200;
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto const minBalance = app->getLedgerManager().getLastMinBalance(0);
+    auto const txFee = app->getLedgerManager().getLastTxFee();
+
+    TxSetFramePtr txSet = std::make_shared<TxSetFrame>(
+        app->getLedgerManager().getLastClosedLedgerHeader().hash);
+    for (int i = 0; i < 20; i++)
+    {
+        auto account = root.create(fmt::format("A{}", i).c_str(),
+                                   minBalance + 5 * txFee);
+        for (int j = 0; j < 5; j++)
+        {
+            txSet->add(account.tx({payment(account.getPublicKey(), 1)}));
+        }
+    }
+    txSet->sortForHash();
+
+    auto& timer = app->getMetrics().NewTimer(
+        {"herder", "txset", "verify-signatures"});
+    auto count = timer.count();
+
+    uint64_t hits, misses;
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+    REQUIRE(txSet->checkValid(*app));
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+
+    REQUIRE(timer.count() == count + 1);
+    // checkValid found every signature verified already
+    REQUIRE(hits >= txSet->sizeTx());
+
+    SECTION("bad signature")
+    {
+        auto tx = txSet->mTransactions[0];
+        tx->getEnvelope().tx.timeBounds.activate().maxTime = UINT64_MAX;
+        tx->clearCached();
+        txSet->sortForHash();
+        REQUIRE(!txSet->checkValid(*app));
+    }
+}
+
+TEST_CASE("txset validity remembered", "[herder][txset]")
+{
+    Config cfg(getTestConfig());
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto const& lcl = app->getLedgerManager().getLastClosedLedgerHeader();
+    TxSetFramePtr txSet = std::make_shared<TxSetFrame>(lcl.hash);
+    txSet->add(root.tx({payment(root, 1)}));
+    txSet->sortForHash();
+
+    auto& driver =
+        static_cast<HerderImpl&>(app->getHerder()).getHerderSCPDriver();
+    auto& checked =
+        app->getMetrics().NewMeter({"herder", "txset", "check"}, "txset");
+    auto& cached = app->getMetrics().NewMeter(
+        {"herder", "txset", "check-cached"}, "txset");
+    auto checkedCount = checked.count();
+    auto cachedCount = cached.count();
+
+    REQUIRE(driver.checkTxSetValid(*txSet));
+    REQUIRE(driver.checkTxSetValid(*txSet));
+    REQUIRE(checked.count() == checkedCount + 1);
+    REQUIRE(cached.count() == cachedCount + 1);
+
+    SECTION("validated again for a new ledger")
+    {
+        closeLedgerOn(*app, lcl.header.ledgerSeq + 1, 1, 1, 2020);
+        REQUIRE(!driver.checkTxSetValid(*txSet));
+        REQUIRE(checked.count() == checkedCount + 2);
+    }
+    SECTION("forgotten when the herder sees a ledger close")
+    {
+        driver.ledgerClosed();
+        REQUIRE(driver.checkTxSetValid(*txSet));
+        REQUIRE(checked.count() == checkedCount + 2);
+        REQUIRE(cached.count() == cachedCount + 1);
+    }
+}
+
 TEST_CASE("txset base fee", "[herder][txset]")
 {
     Config cfg(getTestConfig());
@@ -3,7 +3,12 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "crypto/SecretKey.h"
+#include "herder/LedgerCloseData.h"
 #include "herder/TransactionQueue.h"
+#include "herder/TxSetFrame.h"
+#include "ledger/LedgerManager.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include "test/TestAccount.h"
 #include "test/TestUtils.h"
 #include "test/TxTests.h"
@@ -11,6 +16,7 @@
 #include "util/Timer.h"
 
 #include <lib/catch.hpp>
+#include <set>
 
 using namespace stellar;
 using namespace stellar::txtest;
@@ -33,11 +39,22 @@ invalidTransaction(Application& app, TestAccount& account, int sequenceDelta)
         {payment(account.getPublicKey(), -1)});
 }
 
+TransactionFramePtr
+transactionWithFee(Application& app, TestAccount& account, int sequenceDelta,
+                   uint32_t fee)
+{
+    auto tx = transaction(app, account, sequenceDelta);
+    tx->getEnvelope().tx.fee = fee;
+    tx->getEnvelope().signatures.clear();
+    tx->addSignature(account);
+    return tx;
+}
+
 class TransactionQueueTest
 {
   public:
     explicit TransactionQueueTest(Application& app)
-        : mTransactionQueue{app, 4, 2}
+        : mTransactionQueue{app, 4, 2, 1000}
     {
     }
 
@@ -407,3 +424,201 @@ TEST_CASE("TransactionQueue", "[herder][TransactionQueue]")
         test.check();
     }
 }
+
+TEST_CASE("TransactionQueue limits", "[herder][TransactionQueue]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    auto const minBalance2 = app->getLedgerManager().getLastMinBalance(2);
+
+    auto root = TestAccount::createRoot(*app);
+    auto account1 = root.create("a1", minBalance2);
+    auto account2 = root.create("a2", minBalance2);
+    auto account3 = root.create("a3", minBalance2);
+
+    auto txA1T1 = transactionWithFee(*app, account1, 1, 100);
+    auto txA1T2 = transactionWithFee(*app, account1, 2, 500);
+    auto txA2T1 = transactionWithFee(*app, account2, 1, 200);
+    auto txA3T1 = transactionWithFee(*app, account3, 1, 300);
+
+    auto& evicted = app->getMetrics().NewMeter(
+        {"herder", "pending-txs", "evicted"}, "transaction");
+    auto evictedCount = evicted.count();
+
+    auto contents = [](std::shared_ptr<TxSetFrame> txSet) {
+        return std::set<TransactionFramePtr>(txSet->mTransactions.begin(),
+                                             txSet->mTransactions.end());
+    };
+
+    SECTION("full queue rejects lower fee")
+    {
+        TransactionQueue queue{*app, 4, 2, 2};
+        REQUIRE(queue.tryAdd(txA2T1) ==
+                TransactionQueue::AddResult::ADD_STATUS_PENDING);
+        REQUIRE(queue.tryAdd(txA3T1) ==
+                TransactionQueue::AddResult::ADD_STATUS_PENDING);
+        REQUIRE(queue.tryAdd(txA1T1) ==
+                TransactionQueue::AddResult::ADD_STATUS_TRY_AGAIN_LATER);
+        REQUIRE(queue.getSizeOps() == 2);
+        REQUIRE(evicted.count() == evictedCount);
+    }
+
+    SECTION("full queue evicts lowest fee chain")
+    {
+        TransactionQueue queue{*app, 4, 2, 2};
+        REQUIRE(queue.tryAdd(txA1T1) ==
+                TransactionQueue::AddResult::ADD_STATUS_PENDING);
+        REQUIRE(queue.tryAdd(txA2T1) ==
+                TransactionQueue::AddResult::ADD_STATUS_PENDING);
+        REQUIRE(queue.tryAdd(txA3T1) ==
+                TransactionQueue::AddResult::ADD_STATUS_PENDING);
+        REQUIRE(contents(queue.toTxSet({})) ==
+                std::set<TransactionFramePtr>{txA2T1, txA3T1});
+        REQUIRE(queue.getAccountTransactionQueueInfo(account1.getPublicKey())
+                    .mMaxSeq == 0);
+        REQUIRE(queue.getSizeOps() == 2);
+        REQUIRE(evicted.count() == evictedCount + 1);
+    }
+
+    SECTION("chain is worth its first transaction")
+    {
+        TransactionQueue queue{*app, 4, 2, 2};
+        REQUIRE(queue.tryAdd(txA1T1) ==
+                TransactionQueue::AddResult::ADD_STATUS_PENDING);
+        REQUIRE(queue.tryAdd(txA2T1) ==
+                TransactionQueue::AddResult::ADD_STATUS_PENDING);
+        REQUIRE(queue.tryAdd(txA1T2) ==
+                TransactionQueue::AddResult::ADD_STATUS_TRY_AGAIN_LATER);
+        REQUIRE(contents(queue.toTxSet({})) ==
+                std::set<TransactionFramePtr>{txA1T1, txA2T1});
+    }
+
+    SECTION("tx set by fee rate")
+    {
+        TransactionQueue queue{*app, 4, 2, 1000};
+        for (auto const& tx : {txA1T1, txA1T2, txA2T1, txA3T1})
+        {
+            REQUIRE(queue.tryAdd(tx) ==
+                    TransactionQueue::AddResult::ADD_STATUS_PENDING);
+        }
+
+        auto lcl = app->getLedgerManager().getLastClosedLedgerHeader();
+        lcl.header.maxTxSetSize = 2;
+        REQUIRE(contents(queue.getTxSetForLedger(lcl)) ==
+                std::set<TransactionFramePtr>{txA2T1, txA3T1});
+        lcl.header.maxTxSetSize = 3;
+        REQUIRE(contents(queue.getTxSetForLedger(lcl)) ==
+                std::set<TransactionFramePtr>{txA1T1, txA2T1, txA3T1});
+        lcl.header.maxTxSetSize = 4;
+        REQUIRE(contents(queue.getTxSetForLedger(lcl)) ==
+                std::set<TransactionFramePtr>{txA1T1, txA1T2, txA2T1,
+                                              txA3T1});
+        REQUIRE(queue.getTxSetForLedger(lcl)->previousLedgerHash() ==
+                lcl.hash);
+    }
+}
+
+TEST_CASE("TransactionQueue revalidation", "[herder][TransactionQueue]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    auto const minBalance2 = app->getLedgerManager().getLastMinBalance(2);
+
+    auto root = TestAccount::createRoot(*app);
+    auto account1 = root.create("a1", minBalance2);
+    auto account2 = root.create("a2", minBalance2);
+
+    auto txSeqA1T1 = transaction(*app, account1, 1);
+    auto txSeqA1T2 = transaction(*app, account1, 2);
+    auto txSeqA2T1 = transaction(*app, account2, 1);
+
+    TransactionQueue queue{*app, 4, 2, 1000};
+    for (auto const& tx : {txSeqA1T1, txSeqA1T2, txSeqA2T1})
+    {
+        REQUIRE(queue.tryAdd(tx) ==
+                TransactionQueue::AddResult::ADD_STATUS_PENDING);
+    }
+
+    auto& revalidated = app->getMetrics().NewMeter(
+        {"herder", "pending-txs", "revalidated"}, "chain");
+    auto& invalidated = app->getMetrics().NewMeter(
+        {"herder", "pending-txs", "invalidated"}, "transaction");
+    auto revalidatedCount = revalidated.count();
+    auto invalidatedCount = invalidated.count();
+
+    auto contents = [&queue]() {
+        auto txSet = queue.toTxSet({});
+        return std::set<TransactionFramePtr>(txSet->mTransactions.begin(),
+                                             txSet->mTransactions.end());
+    };
+
+    SECTION("nothing changed")
+    {
+        queue.revalidate({});
+        REQUIRE(revalidated.count() == revalidatedCount);
+        queue.revalidateAll();
+        REQUIRE(revalidated.count() == revalidatedCount + 2);
+        REQUIRE(invalidated.count() == invalidatedCount);
+        REQUIRE(contents() ==
+                std::set<TransactionFramePtr>{txSeqA1T1, txSeqA1T2, txSeqA2T1});
+    }
+
+    SECTION("sequence number used by another transaction")
+    {
+        auto other = transactionFromOperations(
+            *app, account1, account1.getLastSequenceNumber() + 1,
+            {payment(root, 1)});
+        auto ledgerSeq = app->getLedgerManager().getLastClosedLedgerNum() + 1;
+        closeLedgerOn(*app, ledgerSeq, 1, 1, 2020, {other});
+
+        auto const& modified =
+            app->getLedgerManager().getLastClosedModifiedAccounts();
+        REQUIRE(modified.count(account1.getPublicKey()) == 1);
+        REQUIRE(modified.count(account2.getPublicKey()) == 0);
+
+        queue.revalidate(modified);
+        // only the chain of account1 was checked, and dropped whole
+        REQUIRE(revalidated.count() == revalidatedCount + 1);
+        REQUIRE(invalidated.count() == invalidatedCount + 2);
+        REQUIRE(contents() == std::set<TransactionFramePtr>{txSeqA2T1});
+        REQUIRE(queue.getAccountTransactionQueueInfo(account1.getPublicKey())
+                    .mMaxSeq == 0);
+    }
+
+    SECTION("base reserve upgraded")
+    {
+        auto& lm = app->getLedgerManager();
+        auto closeEmptyLedger = [&](int day,
+                                    xdr::xvector<UpgradeType, 6> upgrades) {
+            auto txSet = std::make_shared<TxSetFrame>(
+                lm.getLastClosedLedgerHeader().hash);
+            StellarValue sv(txSet->getContentsHash(),
+                            getTestDate(day, 1, 2020), upgrades,
+                            STELLAR_VALUE_BASIC);
+            lm.closeLedger(
+                LedgerCloseData(lm.getLastClosedLedgerNum() + 1, txSet, sv));
+            REQUIRE(lm.getLastClosedModifiedAccounts().empty());
+            queue.ledgerClosed(lm.getLastClosedLedgerHeader().header,
+                               lm.getLastClosedModifiedAccounts());
+        };
+
+        // the first ledger the queue hears of is checked in full
+        queue.ledgerClosed(lm.getLastClosedLedgerHeader().header, {});
+        REQUIRE(revalidated.count() == revalidatedCount + 2);
+
+        closeEmptyLedger(1, emptyUpgradeSteps);
+        REQUIRE(revalidated.count() == revalidatedCount + 2);
+
+        auto upgrade = LedgerUpgrade{LEDGER_UPGRADE_BASE_RESERVE};
+        upgrade.newBaseReserve() =
+            lm.getLastClosedLedgerHeader().header.baseReserve * 2;
+        auto opaque = xdr::xdr_to_opaque(upgrade);
+        closeEmptyLedger(2, {UpgradeType{opaque.begin(), opaque.end()}});
+
+        // no account changed, yet every chain was checked again: neither
+        // account has anything left for fees over the new reserve
+        REQUIRE(revalidated.count() == revalidatedCount + 4);
+        REQUIRE(invalidated.count() == invalidatedCount + 3);
+        REQUIRE(contents().empty());
+    }
+}
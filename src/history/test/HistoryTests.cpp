@@ -520,6 +520,25 @@ TEST_CASE("History catchup with different modes", "[history][historycatchup]")
     }
 }
 
+TEST_CASE("History catchup applying buckets newest-first",
+          "[history][historycatchup]")
+{
+    CatchupSimulation catchupSimulation{};
+
+    auto checkpointLedger = catchupSimulation.getLastCheckpointLedger(3);
+    catchupSimulation.ensureOnlineCatchupPossible(checkpointLedger, 5);
+
+    for (auto count : {0u, 60u})
+    {
+        auto a = catchupSimulation.createCatchupApplication(
+            count, Config::TESTDB_IN_MEMORY_SQLITE,
+            std::string("newest-first, ") + resumeModeName(count),
+            Config::CURRENT_LEDGER_PROTOCOL_VERSION,
+            /*applyBucketsNewestFirst=*/true);
+        REQUIRE(catchupSimulation.catchupOnline(a, checkpointLedger, 5));
+    }
+}
+
 TEST_CASE("History prefix catchup", "[history][historycatchup][prefixcatchup]")
 {
     CatchupSimulation catchupSimulation{};
@@ -581,7 +581,8 @@ Application::pointer
 CatchupSimulation::createCatchupApplication(uint32_t count,
                                             Config::TestDbMode dbMode,
                                             std::string const& appName,
-                                            uint32_t protocolVersion)
+                                            uint32_t protocolVersion,
+                                            bool applyBucketsNewestFirst)
 {
     CLOG(INFO, "History") << "****";
     CLOG(INFO, "History") << "**** Create app for catchup: '" << appName << "'";
@@ -593,6 +594,7 @@ CatchupSimulation::createCatchupApplication(uint32_t count,
         count == std::numeric_limits<uint32_t>::max();
     mCfgs.back().CATCHUP_RECENT = count;
     mCfgs.back().LEDGER_PROTOCOL_VERSION = protocolVersion;
+    mCfgs.back().CATCHUP_APPLY_BUCKETS_NEWEST_FIRST = applyBucketsNewestFirst;
     return createTestApplication(
         mClock, mHistoryConfigurator->configure(mCfgs.back(), false));
 }
@@ -264,7 +264,8 @@ class CatchupSimulation
 
     Application::pointer createCatchupApplication(
         uint32_t count, Config::TestDbMode dbMode, std::string const& appName,
-        uint32_t protocol = Config::CURRENT_LEDGER_PROTOCOL_VERSION);
+        uint32_t protocol = Config::CURRENT_LEDGER_PROTOCOL_VERSION,
+        bool applyBucketsNewestFirst = false);
     bool catchupOffline(Application::pointer app, uint32_t toLedger);
     bool catchupOnline(Application::pointer app, uint32_t initLedger,
                        uint32_t bufferLedgers = 0, uint32_t gapLedger = 0);
@@ -68,7 +68,7 @@ FetchRecentQsetsWork::onSuccess()
     for (uint32_t i = firstSeq; i <= lastSeq; i += step)
     {
         CLOG(INFO, "History") << "Scanning for QSets in checkpoint: " << i;
-        XDRInputFileStream in;
+        XDRMappedInputFileStream in;
         FileTransferInfo fi(*mDownloadDir, HISTORY_FILE_TYPE_SCP, i);
         in.open(fi.localPath_nogz());
         SCPHistoryEntry tmp;
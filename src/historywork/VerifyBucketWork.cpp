@@ -10,11 +10,10 @@
 #include "main/ErrorMessages.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
+#include "util/MappedFile.h"
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
 
-#include <fstream>
-
 namespace stellar
 {
 
@@ -51,15 +50,19 @@ VerifyBucketWork::onStart()
         [&app, filename, handler, hash]() {
             auto hasher = SHA256::create();
             asio::error_code ec;
-            char buf[4096];
             {
-                // ensure that the stream gets its own scope to avoid race with
-                // main thread
-                std::ifstream in(filename, std::ifstream::binary);
-                while (in)
+                // ensure that the mapping gets its own scope to avoid race
+                // with main thread
+                MappedFile in;
+                try
+                {
+                    in.open(filename);
+                    hasher->add(ByteSlice(in.data(), in.size()));
+                }
+                catch (std::runtime_error&)
                 {
-                    in.read(buf, sizeof(buf));
-                    hasher->add(ByteSlice(buf, in.gcount()));
+                    // Hash whatever we have; a file that cannot be read fails
+                    // verification below, like any other mismatch.
                 }
                 uint256 vHash = hasher->finish();
                 if (vHash == hash)
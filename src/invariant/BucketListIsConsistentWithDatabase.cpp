@@ -78,7 +78,8 @@ BucketListIsConsistentWithDatabase::getName() const
 std::string
 BucketListIsConsistentWithDatabase::checkOnBucketApply(
     std::shared_ptr<Bucket const> bucket, uint32_t oldestLedger,
-    uint32_t newestLedger)
+    uint32_t newestLedger,
+    std::function<bool(LedgerKey const&)> const& isShadowed)
 {
     uint64_t nAccounts = 0, nTrustLines = 0, nOffers = 0, nData = 0;
     {
@@ -99,6 +100,17 @@ BucketListIsConsistentWithDatabase::checkOnBucketApply(
             previousEntry = e;
             hasPreviousEntry = true;
 
+            if (isShadowed)
+            {
+                auto key = e.type() == DEADENTRY
+                               ? e.deadEntry()
+                               : LedgerEntryKey(e.liveEntry());
+                if (isShadowed(key))
+                {
+                    continue;
+                }
+            }
+
             if (e.type() == LIVEENTRY || e.type() == INITENTRY)
             {
                 if (e.liveEntry().lastModifiedLedgerSeq < oldestLedger)
@@ -23,7 +23,8 @@ class Application;
 // The first two conditions show that every entry in the bucket matches the
 // database, while the third condition shows that the database does not
 // contain any entry in the appropriate ledger range other than those in
-// the bucket.
+// the bucket. Entries shadowed by a newer bucket that was applied first are
+// skipped: the database holds the newer bucket's version of them.
 class BucketListIsConsistentWithDatabase : public Invariant
 {
   public:
@@ -33,9 +34,10 @@ class BucketListIsConsistentWithDatabase : public Invariant
 
     virtual std::string getName() const override;
 
-    virtual std::string checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
-                                           uint32_t oldestLedger,
-                                           uint32_t newestLedger) override;
+    virtual std::string checkOnBucketApply(
+        std::shared_ptr<Bucket const> bucket, uint32_t oldestLedger,
+        uint32_t newestLedger,
+        std::function<bool(LedgerKey const&)> const& isShadowed) override;
 
   private:
     Application& mApp;
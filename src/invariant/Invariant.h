@@ -4,6 +4,7 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include <functional>
 #include <memory>
 #include <string>
 
@@ -11,6 +12,7 @@ namespace stellar
 {
 
 class Bucket;
+struct LedgerKey;
 struct LedgerTxnDelta;
 struct Operation;
 struct OperationResult;
@@ -39,9 +41,13 @@ class Invariant
         return mStrict;
     }
 
+    // When buckets are applied newest-first, `isShadowed` (if set) returns
+    // true for keys a newer bucket has already written to the database; the
+    // bucket being checked no longer determines those entries.
     virtual std::string
     checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
-                       uint32_t oldestLedger, uint32_t newestLedger)
+                       uint32_t oldestLedger, uint32_t newestLedger,
+                       std::function<bool(LedgerKey const&)> const& isShadowed)
     {
         return std::string{};
     }
@@ -6,6 +6,7 @@
 
 #include "herder/TxSetFrame.h"
 #include "lib/json/json.h"
+#include <functional>
 #include <memory>
 
 namespace stellar
@@ -36,9 +37,10 @@ class InvariantManager
     virtual Json::Value getJsonInfo() = 0;
     virtual std::vector<std::string> getEnabledInvariants() const = 0;
 
-    virtual void checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
-                                    uint32_t ledger, uint32_t level,
-                                    bool isCurr) = 0;
+    virtual void checkOnBucketApply(
+        std::shared_ptr<Bucket const> bucket, uint32_t ledger, uint32_t level,
+        bool isCurr,
+        std::function<bool(LedgerKey const&)> const& isShadowed) = 0;
 
     virtual void checkOnOperationApply(Operation const& operation,
                                        OperationResult const& opres,
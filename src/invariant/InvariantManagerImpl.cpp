@@ -69,9 +69,9 @@ InvariantManagerImpl::getEnabledInvariants() const
 }
 
 void
-InvariantManagerImpl::checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
-                                         uint32_t ledger, uint32_t level,
-                                         bool isCurr)
+InvariantManagerImpl::checkOnBucketApply(
+    std::shared_ptr<Bucket const> bucket, uint32_t ledger, uint32_t level,
+    bool isCurr, std::function<bool(LedgerKey const&)> const& isShadowed)
 {
     uint32_t oldestLedger = isCurr
                                 ? BucketList::oldestLedgerInCurr(ledger, level)
@@ -82,7 +82,8 @@ InvariantManagerImpl::checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
     for (auto invariant : mEnabled)
     {
         auto result =
-            invariant->checkOnBucketApply(bucket, oldestLedger, newestLedger);
+            invariant->checkOnBucketApply(bucket, oldestLedger, newestLedger,
+                                          isShadowed);
         if (result.empty())
         {
             continue;
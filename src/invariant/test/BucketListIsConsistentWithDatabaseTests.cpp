@@ -35,10 +35,20 @@ struct BucketListGenerator
     uint32_t mLedgerSeq;
     std::unordered_set<LedgerKey> mLiveKeys;
 
+  private:
+    static Config
+    getApplyConfig(bool applyNewestFirst)
+    {
+        Config cfg = getTestConfig(1);
+        cfg.CATCHUP_APPLY_BUCKETS_NEWEST_FIRST = applyNewestFirst;
+        return cfg;
+    }
+
   public:
-    BucketListGenerator()
+    BucketListGenerator(bool applyNewestFirst = false)
         : mAppGenerate(createTestApplication(mClock, getTestConfig(0)))
-        , mAppApply(createTestApplication(mClock, getTestConfig(1)))
+        , mAppApply(
+              createTestApplication(mClock, getApplyConfig(applyNewestFirst)))
         , mLedgerSeq(1)
     {
         auto skey = SecretKey::fromSeed(mAppGenerate->getNetworkID());
@@ -469,6 +479,16 @@ TEST_CASE("BucketListIsConsistentWithDatabase succeed",
     REQUIRE_NOTHROW(blg.applyBuckets());
 }
 
+TEST_CASE("BucketListIsConsistentWithDatabase succeed newest-first",
+          "[invariant][bucketlistconsistent]")
+{
+    BucketListGenerator blg(/*applyNewestFirst=*/true);
+    blg.generateLedgers(100);
+    REQUIRE_NOTHROW(blg.applyBuckets());
+    blg.generateLedgers(100);
+    REQUIRE_NOTHROW(blg.applyBuckets());
+}
+
 TEST_CASE("BucketListIsConsistentWithDatabase empty ledgers",
           "[invariant][bucketlistconsistent]")
 {
@@ -54,8 +54,10 @@ class TestInvariant : public Invariant
     }
 
     virtual std::string
-    checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
-                       uint32_t oldestLedger, uint32_t newestLedger) override
+    checkOnBucketApply(
+        std::shared_ptr<Bucket const> bucket, uint32_t oldestLedger,
+        uint32_t newestLedger,
+        std::function<bool(LedgerKey const&)> const& isShadowed) override
     {
         return mShouldFail ? "fail" : "";
     }
@@ -162,7 +164,7 @@ TEST_CASE("onBucketApply fail succeed", "[invariant]")
         uint32_t level = 0;
         bool isCurr = true;
         REQUIRE_THROWS_AS(app->getInvariantManager().checkOnBucketApply(
-                              bucket, ledger, level, isCurr),
+                              bucket, ledger, level, isCurr, nullptr),
                           InvariantDoesNotHold);
     }
 
@@ -181,7 +183,7 @@ TEST_CASE("onBucketApply fail succeed", "[invariant]")
         uint32_t level = 0;
         bool isCurr = true;
         REQUIRE_NOTHROW(app->getInvariantManager().checkOnBucketApply(
-            bucket, ledger, level, isCurr));
+            bucket, ledger, level, isCurr, nullptr));
     }
 }
 
@@ -11,6 +11,42 @@
 // implements a default hasher for "LedgerKey"
 namespace std
 {
+template <> class hash<stellar::Asset>
+{
+  public:
+    size_t
+    operator()(stellar::Asset const& asset) const
+    {
+        size_t res = asset.type();
+        switch (asset.type())
+        {
+        case stellar::ASSET_TYPE_NATIVE:
+            break;
+        case stellar::ASSET_TYPE_CREDIT_ALPHANUM4:
+        {
+            auto& a4 = asset.alphaNum4();
+            res ^= stellar::shortHash::computeHash(
+                stellar::ByteSlice(a4.issuer.ed25519().data(), 8));
+            res ^= stellar::shortHash::computeHash(
+                stellar::ByteSlice(a4.assetCode.data(), a4.assetCode.size()));
+            break;
+        }
+        case stellar::ASSET_TYPE_CREDIT_ALPHANUM12:
+        {
+            auto& a12 = asset.alphaNum12();
+            res ^= stellar::shortHash::computeHash(
+                stellar::ByteSlice(a12.issuer.ed25519().data(), 8));
+            res ^= stellar::shortHash::computeHash(stellar::ByteSlice(
+                a12.assetCode.data(), a12.assetCode.size()));
+            break;
+        }
+        default:
+            abort();
+        }
+        return res;
+    }
+};
+
 template <> class hash<stellar::LedgerKey>
 {
   public:
@@ -5,8 +5,10 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "catchup/CatchupManager.h"
+#include "crypto/SecretKey.h"
 #include "history/HistoryManager.h"
 #include <memory>
+#include <unordered_set>
 
 namespace stellar
 {
@@ -111,6 +113,11 @@ class LedgerManager
     // Return the sequence number of the LCL.
     virtual uint32_t getLastClosedLedgerNum() const = 0;
 
+    // Return the accounts created, modified or deleted by the ledger closed
+    // last (the LCL, unless it was loaded or caught up to instead).
+    virtual std::unordered_set<AccountID> const&
+    getLastClosedModifiedAccounts() const = 0;
+
     // Return the minimum balance required to establish, in the current ledger,
     // a new ledger entry with `ownerCount` owned objects.  Derived from the
     // current ledger's `baseReserve` value.
@@ -124,6 +124,8 @@ LedgerManagerImpl::LedgerManagerImpl(Application& app)
           app.getMetrics().NewCounter({"ledger", "age", "current-seconds"}))
     , mPrefetchHitRate(
           app.getMetrics().NewCounter({"ledger", "prefetch", "hit-rate"}))
+    , mOrderBookMemory(
+          app.getMetrics().NewCounter({"ledger", "memory", "order-book"}))
     , mLastClose(mApp.getClock().now())
     , mSyncingLedgersSize(
           app.getMetrics().NewCounter({"ledger", "memory", "queued-ledgers"}))
@@ -271,6 +273,12 @@ LedgerManagerImpl::loadLastKnownLedger(
             ltx.commit();
         }
 
+        // In case we stopped during bucket apply with them dropped
+        mApp.getLedgerTxnRoot().createSecondaryIndexes();
+
+        // Does nothing unless IN_MEMORY_ORDER_BOOK is set
+        mApp.getLedgerTxnRoot().loadInMemoryOrderBook();
+
         if (handler)
         {
             HistoryArchiveState has = getLastClosedLedgerHAS();
@@ -380,6 +388,12 @@ LedgerManagerImpl::getLastClosedLedgerNum() const
     return mLastClosedLedger.header.ledgerSeq;
 }
 
+std::unordered_set<AccountID> const&
+LedgerManagerImpl::getLastClosedModifiedAccounts() const
+{
+    return mLastClosedModifiedAccounts;
+}
+
 uint32_t
 getCatchupCount(Application& app)
 {
@@ -758,6 +772,8 @@ LedgerManagerImpl::syncMetrics()
     mLedgerAge.set_count(secondsSinceLastLedgerClose());
     mPrefetchHitRate.set_count(
         std::llround(mApp.getLedgerTxnRoot().getPrefetchHitRate() * 100));
+    mOrderBookMemory.set_count(
+        mApp.getLedgerTxnRoot().getInMemoryOrderBookMemoryUsage());
     mApp.syncOwnMetrics();
 }
 
@@ -1097,6 +1113,8 @@ LedgerManagerImpl::logTxApplyMetrics(AbstractLedgerTxn& ltx, size_t numTxs,
 
     // We lose a bit of precision here, as medida only accepts int64_t
     mPrefetchHitRate.set_count(std::llround(hitRate));
+    mOrderBookMemory.set_count(
+        mApp.getLedgerTxnRoot().getInMemoryOrderBookMemoryUsage());
 }
 
 void
@@ -1137,6 +1155,25 @@ LedgerManagerImpl::transferLedgerEntriesToBucketList(AbstractLedgerTxn& ltx,
     std::vector<LedgerEntry> initEntries, liveEntries;
     std::vector<LedgerKey> deadEntries;
     ltx.getAllEntries(initEntries, liveEntries, deadEntries);
+
+    for (auto const& entries : {&initEntries, &liveEntries})
+    {
+        for (auto const& entry : *entries)
+        {
+            if (entry.data.type() == ACCOUNT)
+            {
+                mLastClosedModifiedAccounts.insert(
+                    entry.data.account().accountID);
+            }
+        }
+    }
+    for (auto const& key : deadEntries)
+    {
+        if (key.type() == ACCOUNT)
+        {
+            mLastClosedModifiedAccounts.insert(key.account().accountID);
+        }
+    }
     mApp.getBucketManager().addBatch(mApp, ledgerSeq, ledgerVers, initEntries,
                                      liveEntries, deadEntries);
 }
@@ -1150,6 +1187,7 @@ LedgerManagerImpl::ledgerClosed(AbstractLedgerTxn& ltx)
         "sealing ledger {} with version {}, sending to bucket list", ledgerSeq,
         ledgerVers);
 
+    mLastClosedModifiedAccounts.clear();
     transferLedgerEntriesToBucketList(ltx, ledgerSeq, ledgerVers);
 
     ltx.unsealHeader([this](LedgerHeader& lh) {
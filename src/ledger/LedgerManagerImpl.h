@@ -36,6 +36,7 @@ class LedgerTxnHeader;
 class LedgerManagerImpl : public LedgerManager
 {
     LedgerHeaderHistoryEntry mLastClosedLedger;
+    std::unordered_set<AccountID> mLastClosedModifiedAccounts;
 
   protected:
     Application& mApp;
@@ -49,6 +50,7 @@ class LedgerManagerImpl : public LedgerManager
     medida::Timer& mLedgerAgeClosed;
     medida::Counter& mLedgerAge;
     medida::Counter& mPrefetchHitRate;
+    medida::Counter& mOrderBookMemory;
     VirtualClock::time_point mLastClose;
 
     medida::Counter& mSyncingLedgersSize;
@@ -121,6 +123,8 @@ class LedgerManagerImpl : public LedgerManager
     uint32_t getLastTxFee() const override;
 
     uint32_t getLastClosedLedgerNum() const override;
+    std::unordered_set<AccountID> const&
+    getLastClosedModifiedAccounts() const override;
     uint64_t secondsSinceLastLedgerClose() const override;
     void syncMetrics() override;
 
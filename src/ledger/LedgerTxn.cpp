@@ -12,10 +12,13 @@
 #include "ledger/LedgerTxnHeader.h"
 #include "ledger/LedgerTxnImpl.h"
 #include "util/GlobalChecks.h"
+#include "util/Logging.h"
 #include "util/XDROperators.h"
 #include "util/types.h"
 #include "xdr/Stellar-ledger-entries.h"
 #include "xdrpp/marshal.h"
+#include <functional>
+#include <future>
 #include <soci.h>
 
 namespace stellar
@@ -52,6 +55,19 @@ populateLoadedEntries(std::unordered_set<LedgerKey> const& keys,
     return res;
 }
 
+bool
+operator==(AssetPair const& lhs, AssetPair const& rhs)
+{
+    return lhs.buying == rhs.buying && lhs.selling == rhs.selling;
+}
+
+size_t
+AssetPairHash::operator()(AssetPair const& key) const
+{
+    std::hash<Asset> hashAsset;
+    return hashAsset(key.buying) ^ (hashAsset(key.selling) << 1);
+}
+
 // Implementation of AbstractLedgerTxnParent --------------------------------
 AbstractLedgerTxnParent::~AbstractLedgerTxnParent()
 {
@@ -134,6 +150,7 @@ LedgerTxn::Impl::Impl(LedgerTxn& self, AbstractLedgerTxnParent& parent,
     : mParent(parent)
     , mChild(nullptr)
     , mHeader(std::make_unique<LedgerHeader>(mParent.getHeader()))
+    , mOrderBookIsValid(true)
     , mShouldUpdateLastModified(shouldUpdateLastModified)
     , mIsSealed(false)
     , mConsistency(LedgerTxnConsistency::EXACT)
@@ -171,6 +188,10 @@ LedgerTxn::Impl::addChild(AbstractLedgerTxn& child)
     throwIfSealed();
     throwIfChild();
 
+    // Active entries may have been modified, and will not be deactivated
+    // individually after this point
+    updateOrderBookForActiveEntries();
+
     mChild = &child;
 
     // std::set<...>::clear is noexcept
@@ -270,6 +291,7 @@ LedgerTxn::Impl::commitChild(EntryIterator iter, LedgerTxnConsistency cons)
             { // Existed in a previous LedgerTxn
                 mEntry[key] = nullptr;
             }
+            updateOrderBook(key);
         }
     }
     catch (std::exception& e)
@@ -343,6 +365,9 @@ LedgerTxn::Impl::createOrUpdateWithoutLoading(LedgerTxn& self,
     // std::shared_ptr assignment is noexcept, and map
     // index on a single key is strong-guarantee.
     mEntry[key] = std::make_shared<LedgerEntry>(entry);
+
+    // updateOrderBook does not throw
+    updateOrderBook(key);
 }
 
 void
@@ -360,6 +385,10 @@ LedgerTxn::Impl::deactivate(LedgerKey const& key)
         throw std::runtime_error("Key is not active");
     }
     mActive.erase(iter);
+
+    // The entry may have been modified while it was active. updateOrderBook
+    // does not throw.
+    updateOrderBook(key);
 }
 
 void
@@ -421,6 +450,9 @@ LedgerTxn::Impl::erase(LedgerKey const& key)
     // Note: Cannot throw after this point because the entry will not be
     // deactivated in that case
 
+    // updateOrderBook does not throw
+    updateOrderBook(key);
+
     if (isActive)
     {
         // C++14 requirements for exception safety of containers guarantee that
@@ -459,6 +491,9 @@ LedgerTxn::Impl::eraseWithoutLoading(LedgerKey const& key)
     // Note: Cannot throw after this point because the entry will not be
     // deactivated in that case
 
+    // updateOrderBook does not throw
+    updateOrderBook(key);
+
     if (isActive)
     {
         // C++14 requirements for exception safety of containers guarantee that
@@ -507,60 +542,149 @@ std::shared_ptr<LedgerEntry const>
 LedgerTxn::Impl::getBestOffer(Asset const& buying, Asset const& selling,
                               std::unordered_set<LedgerKey>& exclude)
 {
-    auto end = mEntry.cend();
-    auto bestOfferIter = end;
-    if (exclude.size() + mEntry.size() > exclude.bucket_count())
-    {
-        // taking a best guess as a starting point for how big exclude can get
-        // this avoids rehashing when processing transactions after a lot of
-        // changes already occured
-        exclude.reserve(exclude.size() + mEntry.size());
-    }
-    for (auto iter = mEntry.cbegin(); iter != end; ++iter)
+    updateOrderBookForActiveEntries();
+
+    AssetPair const assets{buying, selling};
+    auto bestOffer = getBestOfferFromOrderBook(assets, exclude);
+
+    // Any offer returned by the parent that also appears in mEntry is shadowed
+    // by this LedgerTxn, so it is excluded and the parent is queried again.
+    // Shadowed offers are remembered per asset pair so that repeated queries
+    // (for example, while crossing offers) do not rediscover them one by one.
+    auto& shadowed = mShadowedParentOffers[assets];
+    exclude.insert(shadowed.begin(), shadowed.end());
+
+    auto parentBestOffer = mParent.getBestOffer(buying, selling, exclude);
+    while (parentBestOffer)
     {
-        auto const& key = iter->first;
-        auto const& entry = iter->second;
-        if (key.type() != OFFER)
+        auto key = LedgerEntryKey(*parentBestOffer);
+        if (mEntry.find(key) == mEntry.end())
         {
-            continue;
+            break;
         }
+        shadowed.insert(key);
+        exclude.insert(key);
+        parentBestOffer = mParent.getBestOffer(buying, selling, exclude);
+    }
+
+    if (bestOffer && parentBestOffer)
+    {
+        return isBetterOffer(*bestOffer, *parentBestOffer) ? bestOffer
+                                                           : parentBestOffer;
+    }
+    else
+    {
+        return bestOffer ? bestOffer : parentBestOffer;
+    }
+}
 
-        if (!exclude.insert(key).second)
+std::shared_ptr<LedgerEntry const>
+LedgerTxn::Impl::getBestOfferFromOrderBook(
+    AssetPair const& assets, std::unordered_set<LedgerKey> const& exclude)
+{
+    if (!mOrderBookIsValid)
+    {
+        try
         {
-            continue;
-        }
+            for (auto const& kv : mEntry)
+            {
+                auto const& entry = kv.second;
+                if (!entry || kv.first.type() != OFFER)
+                {
+                    continue;
+                }
 
-        if (!(entry && entry->data.offer().buying == buying &&
-              entry->data.offer().selling == selling))
+                auto const& oe = entry->data.offer();
+                AssetPair pair{oe.buying, oe.selling};
+                OfferDescriptor desc{oe.price, oe.offerID};
+                mMultiOrderBook[pair].emplace(desc, kv.first);
+                mOrderBookPositions.emplace(kv.first,
+                                            std::make_pair(pair, desc));
+            }
+            mOrderBookIsValid = true;
+        }
+        catch (...)
         {
-            continue;
+            invalidateOrderBook();
+            throw;
         }
+    }
+
+    auto bookIter = mMultiOrderBook.find(assets);
+    if (bookIter == mMultiOrderBook.end())
+    {
+        return {};
+    }
 
-        if ((bestOfferIter == end) ||
-            isBetterOffer(*entry, *bestOfferIter->second))
+    for (auto const& kv : bookIter->second)
+    {
+        auto const& key = kv.second;
+        if (exclude.find(key) == exclude.end())
         {
-            bestOfferIter = iter;
+            return std::make_shared<LedgerEntry const>(*mEntry.at(key));
         }
     }
+    return {};
+}
 
-    std::shared_ptr<LedgerEntry const> bestOffer;
-    if (bestOfferIter != end)
+void
+LedgerTxn::Impl::updateOrderBook(LedgerKey const& key) noexcept
+{
+    if (key.type() != OFFER || !mOrderBookIsValid)
     {
-        bestOffer = std::make_shared<LedgerEntry const>(*bestOfferIter->second);
+        return;
     }
 
-    auto parentBestOffer = mParent.getBestOffer(buying, selling, exclude);
-    if (bestOffer && parentBestOffer)
+    try
     {
-        return isBetterOffer(*bestOffer, *parentBestOffer) ? bestOffer
-                                                           : parentBestOffer;
+        auto posIter = mOrderBookPositions.find(key);
+        if (posIter != mOrderBookPositions.end())
+        {
+            auto const& pos = posIter->second;
+            auto bookIter = mMultiOrderBook.find(pos.first);
+            assert(bookIter != mMultiOrderBook.end());
+            bookIter->second.erase(pos.second);
+            if (bookIter->second.empty())
+            {
+                mMultiOrderBook.erase(bookIter);
+            }
+            mOrderBookPositions.erase(posIter);
+        }
+
+        auto iter = mEntry.find(key);
+        if (iter != mEntry.end() && iter->second)
+        {
+            auto const& oe = iter->second->data.offer();
+            AssetPair pair{oe.buying, oe.selling};
+            OfferDescriptor desc{oe.price, oe.offerID};
+            mMultiOrderBook[pair].emplace(desc, key);
+            mOrderBookPositions.emplace(key, std::make_pair(pair, desc));
+        }
     }
-    else
+    catch (...)
     {
-        return bestOffer ? bestOffer : parentBestOffer;
+        invalidateOrderBook();
     }
 }
 
+void
+LedgerTxn::Impl::updateOrderBookForActiveEntries() noexcept
+{
+    for (auto const& kv : mActive)
+    {
+        updateOrderBook(kv.first);
+    }
+}
+
+void
+LedgerTxn::Impl::invalidateOrderBook() noexcept
+{
+    // std::unordered_map<...>::clear does not throw
+    mMultiOrderBook.clear();
+    mOrderBookPositions.clear();
+    mOrderBookIsValid = false;
+}
+
 LedgerEntryChanges
 LedgerTxn::getChanges()
 {
@@ -984,6 +1108,7 @@ LedgerTxn::Impl::loadAllOffers(LedgerTxn& self)
         // is thrown by the swap of the Compare object (which is of type
         // std::less<LedgerKey>, so this should not throw when swapped)
         mEntry.swap(previousEntries);
+        invalidateOrderBook();
         throw;
     }
 }
@@ -1064,6 +1189,7 @@ LedgerTxn::Impl::loadOffersByAccountAndAsset(LedgerTxn& self,
         // is thrown by the swap of the Compare object (which is of type
         // std::less<LedgerKey>, so this should not throw when swapped)
         mEntry.swap(previousEntries);
+        invalidateOrderBook();
         throw;
     }
 }
@@ -1205,6 +1331,10 @@ LedgerTxn::Impl::maybeUpdateLastModifiedThenInvokeThenSeal(
         mActive.clear();
         mActiveHeader.reset();
         mIsSealed = true;
+
+        // Entries were replaced and may have been modified while active, so
+        // the order book will be rebuilt if it is ever needed again
+        invalidateOrderBook();
     }
     else // Note: can't have child if sealed
     {
@@ -1258,18 +1388,22 @@ LedgerTxn::Impl::EntryIteratorImpl::clone() const
 // Implementation of LedgerTxnRoot ------------------------------------------
 LedgerTxnRoot::LedgerTxnRoot(Database& db, size_t entryCacheSize,
                              size_t bestOfferCacheSize,
-                             size_t prefetchBatchSize)
+                             size_t prefetchBatchSize,
+                             bool useInMemoryOrderBook)
     : mImpl(std::make_unique<Impl>(db, entryCacheSize, bestOfferCacheSize,
-                                   prefetchBatchSize))
+                                   prefetchBatchSize, useInMemoryOrderBook))
 {
 }
 
 LedgerTxnRoot::Impl::Impl(Database& db, size_t entryCacheSize,
-                          size_t bestOfferCacheSize, size_t prefetchBatchSize)
+                          size_t bestOfferCacheSize, size_t prefetchBatchSize,
+                          bool useInMemoryOrderBook)
     : mDatabase(db)
     , mHeader(std::make_unique<LedgerHeader>())
     , mEntryCache(entryCacheSize)
     , mBestOffersCache(bestOfferCacheSize)
+    , mUseInMemoryOrderBook(useInMemoryOrderBook)
+    , mInMemoryOrderBookLoaded(false)
     , mMaxCacheSize(entryCacheSize)
     , mBulkLoadBatchSize(prefetchBatchSize)
     , mChild(nullptr)
@@ -1286,6 +1420,18 @@ LedgerTxnRoot::Impl::~Impl()
     {
         mChild->rollback();
     }
+    if (mSecondaryIndexesDropped)
+    {
+        try
+        {
+            createSecondaryIndexes();
+        }
+        catch (std::exception& e)
+        {
+            CLOG(ERROR, "Ledger")
+                << "Failed to create secondary indexes: " << e.what();
+        }
+    }
 }
 
 void
@@ -1357,56 +1503,182 @@ LedgerTxnRoot::Impl::bulkApply(BulkLedgerEntryChangeAccumulator& bleca,
                                size_t bufferThreshold,
                                LedgerTxnConsistency cons)
 {
+    auto& session = mDatabase.getSession();
     auto& upsertAccounts = bleca.getAccountsToUpsert();
     if (upsertAccounts.size() > bufferThreshold)
     {
-        bulkUpsertAccounts(upsertAccounts);
+        bulkUpsertAccounts(upsertAccounts, session, PGCopyMode::NONE);
         upsertAccounts.clear();
     }
     auto& deleteAccounts = bleca.getAccountsToDelete();
     if (deleteAccounts.size() > bufferThreshold)
     {
-        bulkDeleteAccounts(deleteAccounts, cons);
+        bulkDeleteAccounts(deleteAccounts, session, cons);
         deleteAccounts.clear();
     }
     auto& upsertTrustLines = bleca.getTrustLinesToUpsert();
     if (upsertTrustLines.size() > bufferThreshold)
     {
-        bulkUpsertTrustLines(upsertTrustLines);
+        bulkUpsertTrustLines(upsertTrustLines, session, PGCopyMode::NONE);
         upsertTrustLines.clear();
     }
     auto& deleteTrustLines = bleca.getTrustLinesToDelete();
     if (deleteTrustLines.size() > bufferThreshold)
     {
-        bulkDeleteTrustLines(deleteTrustLines, cons);
+        bulkDeleteTrustLines(deleteTrustLines, session, cons);
         deleteTrustLines.clear();
     }
     auto& upsertOffers = bleca.getOffersToUpsert();
     if (upsertOffers.size() > bufferThreshold)
     {
-        bulkUpsertOffers(upsertOffers);
+        bulkUpsertOffers(upsertOffers, session, PGCopyMode::NONE);
         upsertOffers.clear();
     }
     auto& deleteOffers = bleca.getOffersToDelete();
     if (deleteOffers.size() > bufferThreshold)
     {
-        bulkDeleteOffers(deleteOffers, cons);
+        bulkDeleteOffers(deleteOffers, session, cons);
         deleteOffers.clear();
     }
     auto& upsertAccountData = bleca.getAccountDataToUpsert();
     if (upsertAccountData.size() > bufferThreshold)
     {
-        bulkUpsertAccountData(upsertAccountData);
+        bulkUpsertAccountData(upsertAccountData, session, PGCopyMode::NONE);
         upsertAccountData.clear();
     }
     auto& deleteAccountData = bleca.getAccountDataToDelete();
     if (deleteAccountData.size() > bufferThreshold)
     {
-        bulkDeleteAccountData(deleteAccountData, cons);
+        bulkDeleteAccountData(deleteAccountData, session, cons);
         deleteAccountData.clear();
     }
 }
 
+void
+LedgerTxnRoot::Impl::bulkApplyInParallel(
+    BulkLedgerEntryChangeAccumulator& bleca, LedgerTxnConsistency cons)
+{
+    auto& upsertAccounts = bleca.getAccountsToUpsert();
+    auto& deleteAccounts = bleca.getAccountsToDelete();
+    auto& upsertTrustLines = bleca.getTrustLinesToUpsert();
+    auto& deleteTrustLines = bleca.getTrustLinesToDelete();
+    auto& upsertOffers = bleca.getOffersToUpsert();
+    auto& deleteOffers = bleca.getOffersToDelete();
+    auto& upsertAccountData = bleca.getAccountDataToUpsert();
+    auto& deleteAccountData = bleca.getAccountDataToDelete();
+
+    // Each entry type is stored in its own table, so there is one writer per
+    // entry type and writers never touch the same rows. Each writer upserts
+    // into its table once, in its own SQL transaction, so may use COPY.
+    auto copyMode = mBulkInsertOnly ? PGCopyMode::INSERT : PGCopyMode::MERGE;
+    std::vector<std::function<void(soci::session&)>> writers;
+    if (!upsertAccounts.empty() || !deleteAccounts.empty())
+    {
+        writers.emplace_back([&](soci::session& session) {
+            if (!upsertAccounts.empty())
+            {
+                bulkUpsertAccounts(upsertAccounts, session, copyMode);
+            }
+            if (!deleteAccounts.empty())
+            {
+                bulkDeleteAccounts(deleteAccounts, session, cons);
+            }
+        });
+    }
+    if (!upsertTrustLines.empty() || !deleteTrustLines.empty())
+    {
+        writers.emplace_back([&](soci::session& session) {
+            if (!upsertTrustLines.empty())
+            {
+                bulkUpsertTrustLines(upsertTrustLines, session, copyMode);
+            }
+            if (!deleteTrustLines.empty())
+            {
+                bulkDeleteTrustLines(deleteTrustLines, session, cons);
+            }
+        });
+    }
+    if (!upsertOffers.empty() || !deleteOffers.empty())
+    {
+        writers.emplace_back([&](soci::session& session) {
+            if (!upsertOffers.empty())
+            {
+                bulkUpsertOffers(upsertOffers, session, copyMode);
+            }
+            if (!deleteOffers.empty())
+            {
+                bulkDeleteOffers(deleteOffers, session, cons);
+            }
+        });
+    }
+    if (!upsertAccountData.empty() || !deleteAccountData.empty())
+    {
+        writers.emplace_back([&](soci::session& session) {
+            if (!upsertAccountData.empty())
+            {
+                bulkUpsertAccountData(upsertAccountData, session, copyMode);
+            }
+            if (!deleteAccountData.empty())
+            {
+                bulkDeleteAccountData(deleteAccountData, session, cons);
+            }
+        });
+    }
+
+    auto& pool = mDatabase.getPool();
+    std::vector<std::future<void>> results;
+    for (auto const& writer : writers)
+    {
+        results.emplace_back(std::async(std::launch::async, [&pool, &writer]() {
+            soci::session session(pool);
+            soci::transaction tx(session);
+            writer(session);
+            tx.commit();
+        }));
+    }
+
+    // Consistency barrier: every writer has committed before the commit to
+    // LedgerTxnRoot returns, so anything reading the database afterwards (such
+    // as the invariants checked after each bucket is applied) sees all of the
+    // changes. All writers are waited for before any error is rethrown, as
+    // they reference the contents of bleca.
+    for (auto& r : results)
+    {
+        r.wait();
+    }
+    for (auto& r : results)
+    {
+        r.get();
+    }
+}
+
+void
+LedgerTxnRoot::setParallelBulkWrites(bool enabled)
+{
+    mImpl->setParallelBulkWrites(enabled);
+}
+
+void
+LedgerTxnRoot::Impl::setParallelBulkWrites(bool enabled) noexcept
+{
+    // Concurrent writers on SQLite would only contend for the database lock,
+    // and there is no pool at all for an in-memory SQLite database.
+    mParallelBulkWrites =
+        enabled && !mDatabase.isSqlite() && mDatabase.canUsePool();
+}
+
+void
+LedgerTxnRoot::setBulkInsertOnly(bool enabled)
+{
+    mImpl->setBulkInsertOnly(enabled);
+}
+
+void
+LedgerTxnRoot::Impl::setBulkInsertOnly(bool enabled) noexcept
+{
+    mBulkInsertOnly = enabled;
+}
+
 void
 LedgerTxnRoot::Impl::commitChild(EntryIterator iter, LedgerTxnConsistency cons)
 {
@@ -1414,16 +1686,36 @@ LedgerTxnRoot::Impl::commitChild(EntryIterator iter, LedgerTxnConsistency cons)
     // guarantee, so use std::unique_ptr<...>::swap to achieve it
     auto childHeader = std::make_unique<LedgerHeader>(mChild->getHeader());
 
+    // Offer changes are only applied to the in-memory order book after the
+    // database transaction commits successfully
+    std::vector<std::pair<LedgerKey, std::shared_ptr<LedgerEntry const>>>
+        offerChanges;
+
     auto bleca = BulkLedgerEntryChangeAccumulator();
     try
     {
         while ((bool)iter)
         {
+            if (mInMemoryOrderBookLoaded && iter.key().type() == OFFER)
+            {
+                offerChanges.emplace_back(
+                    iter.key(), iter.entryExists()
+                                    ? std::make_shared<LedgerEntry const>(
+                                          iter.entry())
+                                    : nullptr);
+            }
             bleca.accumulate(iter);
             ++iter;
-            size_t bufferThreshold =
-                (bool)iter ? LEDGER_ENTRY_BATCH_COMMIT_SIZE : 0;
-            bulkApply(bleca, bufferThreshold, cons);
+            if (!mParallelBulkWrites)
+            {
+                size_t bufferThreshold =
+                    (bool)iter ? LEDGER_ENTRY_BATCH_COMMIT_SIZE : 0;
+                bulkApply(bleca, bufferThreshold, cons);
+            }
+        }
+        if (mParallelBulkWrites)
+        {
+            bulkApplyInParallel(bleca, cons);
         }
         // NB: we want to clear the prepared statement cache _before_
         // committing; on postgres this doesn't matter but on SQLite the passive
@@ -1448,6 +1740,19 @@ LedgerTxnRoot::Impl::commitChild(EntryIterator iter, LedgerTxnConsistency cons)
     mEntryCache.clear();
     mPrefetchMetrics.clear();
 
+    try
+    {
+        for (auto const& change : offerChanges)
+        {
+            updateInMemoryOrderBook(change.first, change.second);
+        }
+    }
+    catch (...)
+    {
+        // The in-memory order book will be loaded again on next use
+        clearInMemoryOrderBook();
+    }
+
     // std::unique_ptr<...>::reset does not throw
     mTransaction.reset();
 
@@ -1530,6 +1835,7 @@ LedgerTxnRoot::Impl::deleteObjectsModifiedOnOrAfterLedger(uint32_t ledger) const
     throwIfChild();
     mEntryCache.clear();
     mBestOffersCache.clear();
+    clearInMemoryOrderBook();
 
     for (auto let : {ACCOUNT, DATA, TRUSTLINE, OFFER})
     {
@@ -1539,6 +1845,45 @@ LedgerTxnRoot::Impl::deleteObjectsModifiedOnOrAfterLedger(uint32_t ledger) const
     }
 }
 
+void
+LedgerTxnRoot::dropSecondaryIndexes()
+{
+    mImpl->dropSecondaryIndexes();
+}
+
+void
+LedgerTxnRoot::Impl::dropSecondaryIndexes()
+{
+    throwIfChild();
+    if (mDatabase.isSqlite())
+    {
+        return;
+    }
+    mSecondaryIndexesDropped = true;
+    mDatabase.getSession() << "DROP INDEX IF EXISTS accountbalances";
+    mDatabase.getSession() << "DROP INDEX IF EXISTS bestofferindex";
+}
+
+void
+LedgerTxnRoot::createSecondaryIndexes()
+{
+    mImpl->createSecondaryIndexes();
+}
+
+void
+LedgerTxnRoot::Impl::createSecondaryIndexes()
+{
+    // These must match the indexes created by dropAccounts and
+    // writeOffersIntoSimplifiedOffersTable.
+    throwIfChild();
+    mDatabase.getSession()
+        << "CREATE INDEX IF NOT EXISTS accountbalances ON accounts (balance) "
+           "WHERE balance >= 1000000000";
+    mDatabase.getSession() << "CREATE INDEX IF NOT EXISTS bestofferindex ON "
+                              "offers (sellingasset,buyingasset,price)";
+    mSecondaryIndexesDropped = false;
+}
+
 void
 LedgerTxnRoot::dropAccounts()
 {
@@ -1730,6 +2075,46 @@ std::shared_ptr<LedgerEntry const>
 LedgerTxnRoot::Impl::getBestOffer(Asset const& buying, Asset const& selling,
                                   std::unordered_set<LedgerKey>& exclude)
 {
+    if (mUseInMemoryOrderBook)
+    {
+        try
+        {
+            loadInMemoryOrderBook();
+        }
+        catch (std::exception& e)
+        {
+            printErrorAndAbort("fatal error when loading in-memory order book "
+                               "in LedgerTxnRoot: ",
+                               e.what());
+        }
+        catch (...)
+        {
+            printErrorAndAbort("unknown fatal error when loading in-memory "
+                               "order book in LedgerTxnRoot");
+        }
+
+        std::shared_ptr<LedgerEntry const> res;
+        auto bookIter = mInMemoryOrderBook.find(AssetPair{buying, selling});
+        if (bookIter != mInMemoryOrderBook.end())
+        {
+            for (auto const& kv : bookIter->second)
+            {
+                auto const& entry = kv.second;
+                if (exclude.find(LedgerEntryKey(*entry)) == exclude.end())
+                {
+                    res = entry;
+                    break;
+                }
+            }
+        }
+
+        if (res)
+        {
+            putInEntryCache(LedgerEntryKey(*res), res, LoadType::IMMEDIATE);
+        }
+        return res;
+    }
+
     // Note: Elements of mBestOffersCache are properly sorted lists of the best
     // offers for a certain asset pair. This function maintaints the invariant
     // that the lists of best offers remain properly sorted. The sort order is
@@ -2009,6 +2394,132 @@ LedgerTxnRoot::Impl::getFromBestOffersCache(
     }
 }
 
+void
+LedgerTxnRoot::loadInMemoryOrderBook()
+{
+    mImpl->loadInMemoryOrderBook();
+}
+
+void
+LedgerTxnRoot::Impl::loadInMemoryOrderBook()
+{
+    if (!mUseInMemoryOrderBook || mInMemoryOrderBookLoaded)
+    {
+        return;
+    }
+
+    CLOG(INFO, "Ledger") << "Loading all offers into in-memory order book";
+    try
+    {
+        for (auto const& offer : loadAllOffers())
+        {
+            updateInMemoryOrderBook(LedgerEntryKey(offer),
+                                    std::make_shared<LedgerEntry const>(offer));
+        }
+    }
+    catch (...)
+    {
+        clearInMemoryOrderBook();
+        throw;
+    }
+    mInMemoryOrderBookLoaded = true;
+    CLOG(INFO, "Ledger") << "Loaded " << mInMemoryOrderBookPositions.size()
+                         << " offers into in-memory order book";
+}
+
+void
+LedgerTxnRoot::Impl::updateInMemoryOrderBook(
+    LedgerKey const& key, std::shared_ptr<LedgerEntry const> entry)
+{
+    auto posIter = mInMemoryOrderBookPositions.find(key);
+    if (entry)
+    {
+        auto const& oe = entry->data.offer();
+        AssetPair pair{oe.buying, oe.selling};
+        OfferDescriptor desc{oe.price, oe.offerID};
+
+        // Insert the new position before removing the old one, so that an
+        // exception leaves the in-memory order book unchanged
+        auto& book = mInMemoryOrderBook[pair];
+        auto res = book.emplace(desc, entry);
+        auto inserted = res.second;
+        if (!inserted)
+        {
+            // Same position as before, so only the entry changed
+            res.first->second = entry;
+            return;
+        }
+
+        try
+        {
+            if (posIter != mInMemoryOrderBookPositions.end())
+            {
+                auto const& pos = posIter->second;
+                auto oldBookIter = mInMemoryOrderBook.find(pos.first);
+                oldBookIter->second.erase(pos.second);
+                if (oldBookIter->second.empty())
+                {
+                    mInMemoryOrderBook.erase(oldBookIter);
+                }
+                posIter->second = std::make_pair(pair, desc);
+            }
+            else
+            {
+                mInMemoryOrderBookPositions.emplace(key,
+                                                    std::make_pair(pair, desc));
+            }
+        }
+        catch (...)
+        {
+            book.erase(res.first);
+            throw;
+        }
+    }
+    else if (posIter != mInMemoryOrderBookPositions.end())
+    {
+        auto const& pos = posIter->second;
+        auto bookIter = mInMemoryOrderBook.find(pos.first);
+        bookIter->second.erase(pos.second);
+        if (bookIter->second.empty())
+        {
+            mInMemoryOrderBook.erase(bookIter);
+        }
+        mInMemoryOrderBookPositions.erase(posIter);
+    }
+}
+
+void
+LedgerTxnRoot::Impl::clearInMemoryOrderBook() const noexcept
+{
+    // std::unordered_map<...>::clear does not throw
+    mInMemoryOrderBook.clear();
+    mInMemoryOrderBookPositions.clear();
+    mInMemoryOrderBookLoaded = false;
+}
+
+size_t
+LedgerTxnRoot::getInMemoryOrderBookMemoryUsage() const
+{
+    return mImpl->getInMemoryOrderBookMemoryUsage();
+}
+
+size_t
+LedgerTxnRoot::Impl::getInMemoryOrderBookMemoryUsage() const
+{
+    // Each offer is stored once, and referenced by one node of the order book
+    // for its asset pair and one node of the position index. Node sizes are
+    // estimated as the payload plus three pointers of bookkeeping.
+    size_t const NODE_OVERHEAD = 3 * sizeof(void*);
+    size_t const PER_OFFER =
+        sizeof(LedgerEntry) + 2 * sizeof(std::shared_ptr<LedgerEntry const>) +
+        sizeof(LedgerKey) + 2 * sizeof(OfferDescriptor) + sizeof(AssetPair) +
+        2 * NODE_OVERHEAD;
+    size_t const PER_ASSET_PAIR =
+        sizeof(AssetPair) + sizeof(InMemoryOrderBook) + NODE_OVERHEAD;
+    return mInMemoryOrderBookPositions.size() * PER_OFFER +
+           mInMemoryOrderBook.size() * PER_ASSET_PAIR;
+}
+
 void
 LedgerTxnRoot::writeSignersTableIntoAccountsTable()
 {
@@ -2032,4 +2543,92 @@ LedgerTxnRoot::writeOffersIntoSimplifiedOffersTable()
 {
     mImpl->writeOffersIntoSimplifiedOffersTable();
 }
+#ifdef USE_POSTGRES
+void
+PGBinaryCopy::copyInto(PGconn* conn, std::string const& table,
+                       std::string const& columns) const
+{
+    // Header: signature, then 32-bit flags and header extension length.
+    static char const signature[] = "PGCOPY\n\377\r\n";
+    std::string buf(signature, sizeof(signature));
+    marshalToPGCopyInt(buf, 0, 4);
+    marshalToPGCopyInt(buf, 0, 4);
+    for (size_t row = 0; row < mRows; ++row)
+    {
+        marshalToPGCopyInt(buf, mColumns.size(), 2);
+        for (auto const& column : mColumns)
+        {
+            column(buf, row);
+        }
+    }
+    // Trailer: a field count of -1.
+    marshalToPGCopyInt(buf, 0xffff, 2);
+
+    std::string sql =
+        "COPY " + table + " (" + columns + ") FROM STDIN (FORMAT binary)";
+    PGresult* res = PQexec(conn, sql.c_str());
+    bool started = (PQresultStatus(res) == PGRES_COPY_IN);
+    PQclear(res);
+    if (!started)
+    {
+        throw std::runtime_error(std::string("Could not start COPY in SQL: ") +
+                                 PQerrorMessage(conn));
+    }
+
+    auto size = static_cast<int>(buf.size());
+    bool ok = (PQputCopyData(conn, buf.data(), size) == 1);
+    PQputCopyEnd(conn, ok ? nullptr : "failed to send COPY data");
+    while ((res = PQgetResult(conn)) != nullptr)
+    {
+        ok = ok && (PQresultStatus(res) == PGRES_COMMAND_OK);
+        PQclear(res);
+    }
+    if (!ok)
+    {
+        throw std::runtime_error(std::string("Could not COPY data in SQL: ") +
+                                 PQerrorMessage(conn));
+    }
+}
+
+size_t
+upsertWithPGCopy(soci::session& session, PGconn* conn,
+                 PGBinaryCopy const& copy, PGCopyMode mode,
+                 std::string const& table, std::string const& columns,
+                 std::string const& conflictColumns,
+                 std::string const& updates)
+{
+    assert(mode != PGCopyMode::NONE);
+    if (mode == PGCopyMode::INSERT)
+    {
+        copy.copyInto(conn, table, columns);
+        return copy.size();
+    }
+
+    // The staging table only has the columns being written, with no
+    // constraints, so nothing is checked twice. It is private to the session
+    // and kept for as long as the session is, so that the catalog is only
+    // touched the first time; its rows go on commit, or on rollback if
+    // anything fails.
+    std::string staging = table + "_copy";
+    std::string existing;
+    soci::indicator existingInd;
+    session << "SELECT to_regclass('pg_temp." + staging + "')::TEXT",
+        soci::into(existing, existingInd);
+    if (existingInd != soci::i_ok)
+    {
+        session << "CREATE TEMPORARY TABLE " + staging +
+                       " ON COMMIT DELETE ROWS AS SELECT " + columns +
+                       " FROM " + table + " WITH NO DATA";
+    }
+    copy.copyInto(conn, staging, columns);
+
+    soci::statement st =
+        (session.prepare << "INSERT INTO " + table + " (" + columns +
+                                ") SELECT " + columns + " FROM " + staging +
+                                " ON CONFLICT (" + conflictColumns +
+                                ") DO UPDATE SET " + updates);
+    st.execute(true);
+    return static_cast<size_t>(st.get_affected_rows());
+}
+#endif
 }
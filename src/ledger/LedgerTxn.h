@@ -216,6 +216,36 @@ class LedgerRange;
 
 bool isBetterOffer(LedgerEntry const& lhsEntry, LedgerEntry const& rhsEntry);
 
+// OfferDescriptor is the part of an offer that determines its position in the
+// order book for its asset pair. The order induced by IsBetterOfferComparator
+// is the same as the order induced by isBetterOffer.
+struct OfferDescriptor
+{
+    Price price;
+    int64_t offerID;
+};
+
+bool isBetterOffer(OfferDescriptor const& lhs, OfferDescriptor const& rhs);
+
+struct IsBetterOfferComparator
+{
+    bool operator()(OfferDescriptor const& lhs,
+                    OfferDescriptor const& rhs) const;
+};
+
+struct AssetPair
+{
+    Asset buying;
+    Asset selling;
+};
+
+bool operator==(AssetPair const& lhs, AssetPair const& rhs);
+
+struct AssetPairHash
+{
+    size_t operator()(AssetPair const& key) const;
+};
+
 class AbstractLedgerTxn;
 
 struct InflationWinner
@@ -558,7 +588,8 @@ class LedgerTxnRoot : public AbstractLedgerTxnParent
 
   public:
     explicit LedgerTxnRoot(Database& db, size_t entryCacheSize,
-                           size_t bestOfferCacheSize, size_t prefetchBatchSize);
+                           size_t bestOfferCacheSize, size_t prefetchBatchSize,
+                           bool useInMemoryOrderBook = false);
 
     virtual ~LedgerTxnRoot();
 
@@ -566,12 +597,33 @@ class LedgerTxnRoot : public AbstractLedgerTxnParent
 
     void commitChild(EntryIterator iter, LedgerTxnConsistency cons) override;
 
+    // While enabled, commitChild writes the changes to each table in parallel,
+    // each on its own connection from Database::getPool() and in its own SQL
+    // transaction, and waits for all of them before returning. A commit is
+    // then no longer atomic across tables, so this is only meant for bucket
+    // apply. It has no effect unless the database is PostgreSQL.
+    void setParallelBulkWrites(bool enabled);
+
+    // Promises that none of the entries committed from now on exist in the
+    // database, so that bulk writes can skip looking for conflicts; only
+    // bucket apply into emptied tables can. Committing an entry that does
+    // exist fails. It has no effect without parallel bulk writes.
+    void setBulkInsertOnly(bool enabled);
+
     uint64_t countObjects(LedgerEntryType let) const;
     uint64_t countObjects(LedgerEntryType let,
                           LedgerRange const& ledgers) const;
 
     void deleteObjectsModifiedOnOrAfterLedger(uint32_t ledger) const;
 
+    // Secondary indexes only serve queries made while closing ledgers. Bulk
+    // loads such as bucket apply drop them first and create them again once
+    // done, rather than maintaining them row by row. Dropping only does
+    // anything on PostgreSQL; creating is a no-op for indexes that exist,
+    // and is also done on startup in case a node stopped between the two.
+    void dropSecondaryIndexes();
+    void createSecondaryIndexes();
+
     void dropAccounts();
     void dropData();
     void dropOffers();
@@ -604,5 +656,12 @@ class LedgerTxnRoot : public AbstractLedgerTxnParent
     void writeOffersIntoSimplifiedOffersTable();
     uint32_t prefetch(std::unordered_set<LedgerKey> const& keys);
     double getPrefetchHitRate() const;
+
+    // Loads every offer into the in-memory order book, if it is enabled and
+    // not already loaded. Otherwise this does nothing.
+    void loadInMemoryOrderBook();
+
+    // Approximate number of bytes used by the in-memory order book.
+    size_t getInMemoryOrderBookMemoryUsage() const;
 };
 }
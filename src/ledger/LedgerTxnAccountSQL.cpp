@@ -199,6 +199,8 @@ LedgerTxnRoot::Impl::writeSignersTableIntoAccountsTable()
 class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
+    PGCopyMode mCopyMode{PGCopyMode::NONE};
     std::vector<std::string> mAccountIDs;
     std::vector<int64_t> mBalances;
     std::vector<int64_t> mSeqNums;
@@ -216,9 +218,10 @@ class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
     std::vector<soci::indicator> mLiabilitiesInds;
 
   public:
-    BulkUpsertAccountsOperation(Database& DB,
-                                std::vector<EntryIterator> const& entries)
-        : mDB(DB)
+    BulkUpsertAccountsOperation(Database& DB, soci::session& session,
+                                std::vector<EntryIterator> const& entries,
+                                PGCopyMode copyMode)
+        : mDB(DB), mSession(session), mCopyMode(copyMode)
     {
         mAccountIDs.reserve(entries.size());
         mBalances.reserve(entries.size());
@@ -313,7 +316,7 @@ class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
             "lastmodified = excluded.lastmodified, "
             "buyingliabilities = excluded.buyingliabilities, "
             "sellingliabilities = excluded.sellingliabilities";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.exchange(soci::use(mBalances));
@@ -345,9 +348,59 @@ class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
     }
 
 #ifdef USE_POSTGRES
+    void
+    doPostgresCopyOperation(PGconn* conn)
+    {
+        PGBinaryCopy copy(mAccountIDs.size());
+        copy.addColumn(mAccountIDs);
+        copy.addColumn(mBalances);
+        copy.addColumn(mSeqNums);
+        copy.addColumn(mSubEntryNums);
+        copy.addColumn(mInflationDests, &mInflationDestInds);
+        copy.addColumn(mHomeDomains);
+        copy.addColumn(mThresholds);
+        copy.addColumn(mSigners, &mSignerInds);
+        copy.addColumn(mFlags);
+        copy.addColumn(mLastModifieds);
+        copy.addColumn(mBuyingLiabilities, &mLiabilitiesInds);
+        copy.addColumn(mSellingLiabilities, &mLiabilitiesInds);
+
+        std::string columns =
+            "accountid, balance, seqnum, numsubentries, inflationdest, "
+            "homedomain, thresholds, signers, flags, lastmodified, "
+            "buyingliabilities, sellingliabilities";
+        std::string updates =
+            "balance = excluded.balance, seqnum = excluded.seqnum, "
+            "numsubentries = excluded.numsubentries, "
+            "inflationdest = excluded.inflationdest, "
+            "homedomain = excluded.homedomain, "
+            "thresholds = excluded.thresholds, signers = excluded.signers, "
+            "flags = excluded.flags, lastmodified = excluded.lastmodified, "
+            "buyingliabilities = excluded.buyingliabilities, "
+            "sellingliabilities = excluded.sellingliabilities";
+        size_t affected;
+        {
+            auto timer = mDB.getUpsertTimer("account");
+            affected =
+                upsertWithPGCopy(mSession, conn, copy, mCopyMode, "accounts",
+                                 columns, "accountid", updates);
+        }
+        if (affected != mAccountIDs.size())
+        {
+            throw std::runtime_error("Could not update data in SQL");
+        }
+    }
+
     void
     doPostgresSpecificOperation(soci::postgresql_session_backend* pg) override
     {
+        if (mCopyMode != PGCopyMode::NONE &&
+            mAccountIDs.size() >= PG_COPY_MIN_ROWS)
+        {
+            doPostgresCopyOperation(pg->conn_);
+            return;
+        }
+
         std::string strAccountIDs, strBalances, strSeqNums, strSubEntryNums,
             strInflationDests, strFlags, strHomeDomains, strThresholds,
             strSigners, strLastModifieds, strBuyingLiabilities,
@@ -402,7 +455,7 @@ class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
             "lastmodified = excluded.lastmodified, "
             "buyingliabilities = excluded.buyingliabilities, "
             "sellingliabilities = excluded.sellingliabilities";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strBalances));
@@ -432,13 +485,15 @@ class BulkUpsertAccountsOperation : public DatabaseTypeSpecificOperation<void>
 class BulkDeleteAccountsOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     LedgerTxnConsistency mCons;
     std::vector<std::string> mAccountIDs;
 
   public:
-    BulkDeleteAccountsOperation(Database& DB, LedgerTxnConsistency cons,
+    BulkDeleteAccountsOperation(Database& DB, soci::session& session,
+                                LedgerTxnConsistency cons,
                                 std::vector<EntryIterator> const& entries)
-        : mDB(DB), mCons(cons)
+        : mDB(DB), mSession(session), mCons(cons)
     {
         for (auto const& e : entries)
         {
@@ -453,7 +508,7 @@ class BulkDeleteAccountsOperation : public DatabaseTypeSpecificOperation<void>
     doSociGenericOperation()
     {
         std::string sql = "DELETE FROM accounts WHERE accountid = :id";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.define_and_bind();
@@ -484,7 +539,7 @@ class BulkDeleteAccountsOperation : public DatabaseTypeSpecificOperation<void>
         std::string sql =
             "WITH r AS (SELECT unnest(:ids::TEXT[])) "
             "DELETE FROM accounts WHERE accountid IN (SELECT * FROM r)";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.define_and_bind();
@@ -503,18 +558,20 @@ class BulkDeleteAccountsOperation : public DatabaseTypeSpecificOperation<void>
 
 void
 LedgerTxnRoot::Impl::bulkUpsertAccounts(
-    std::vector<EntryIterator> const& entries)
+    std::vector<EntryIterator> const& entries, soci::session& session,
+    PGCopyMode copyMode)
 {
-    BulkUpsertAccountsOperation op(mDatabase, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkUpsertAccountsOperation op(mDatabase, session, entries, copyMode);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::bulkDeleteAccounts(
-    std::vector<EntryIterator> const& entries, LedgerTxnConsistency cons)
+    std::vector<EntryIterator> const& entries, soci::session& session,
+    LedgerTxnConsistency cons)
 {
-    BulkDeleteAccountsOperation op(mDatabase, cons, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkDeleteAccountsOperation op(mDatabase, session, cons, entries);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
@@ -58,6 +58,8 @@ LedgerTxnRoot::Impl::loadData(LedgerKey const& key) const
 class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
+    PGCopyMode mCopyMode{PGCopyMode::NONE};
     std::vector<std::string> mAccountIDs;
     std::vector<std::string> mDataNames;
     std::vector<std::string> mDataValues;
@@ -76,9 +78,9 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
     }
 
   public:
-    BulkUpsertDataOperation(Database& DB,
+    BulkUpsertDataOperation(Database& DB, soci::session& session,
                             std::vector<LedgerEntry> const& entries)
-        : mDB(DB)
+        : mDB(DB), mSession(session)
     {
         for (auto const& e : entries)
         {
@@ -86,9 +88,10 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
         }
     }
 
-    BulkUpsertDataOperation(Database& DB,
-                            std::vector<EntryIterator> const& entryIter)
-        : mDB(DB)
+    BulkUpsertDataOperation(Database& DB, soci::session& session,
+                            std::vector<EntryIterator> const& entryIter,
+                            PGCopyMode copyMode)
+        : mDB(DB), mSession(session), mCopyMode(copyMode)
     {
         for (auto const& e : entryIter)
         {
@@ -107,7 +110,7 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
                           ") ON CONFLICT (accountid, dataname) DO UPDATE SET "
                           "datavalue = excluded.datavalue, "
                           "lastmodified = excluded.lastmodified ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.exchange(soci::use(mDataNames));
@@ -130,9 +133,44 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
         doSociGenericOperation();
     }
 #ifdef USE_POSTGRES
+    void
+    doPostgresCopyOperation(PGconn* conn)
+    {
+        PGBinaryCopy copy(mAccountIDs.size());
+        copy.addColumn(mAccountIDs);
+        copy.addColumn(mDataNames);
+        copy.addColumn(mDataValues);
+        copy.addColumn(mLastModifieds);
+
+        std::string columns =
+            "accountid, dataname, datavalue, lastmodified";
+        std::string conflictColumns = "accountid, dataname";
+        std::string updates =
+            "datavalue = excluded.datavalue, "
+            "lastmodified = excluded.lastmodified";
+        size_t affected;
+        {
+            auto timer = mDB.getUpsertTimer("data");
+            affected =
+                upsertWithPGCopy(mSession, conn, copy, mCopyMode, "accountdata",
+                                 columns, conflictColumns, updates);
+        }
+        if (affected != mAccountIDs.size())
+        {
+            throw std::runtime_error("Could not update data in SQL");
+        }
+    }
+
     void
     doPostgresSpecificOperation(soci::postgresql_session_backend* pg) override
     {
+        if (mCopyMode != PGCopyMode::NONE &&
+            mAccountIDs.size() >= PG_COPY_MIN_ROWS)
+        {
+            doPostgresCopyOperation(pg->conn_);
+            return;
+        }
+
         std::string strAccountIDs, strDataNames, strDataValues,
             strLastModifieds;
 
@@ -153,7 +191,7 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
                           "ON CONFLICT (accountid, dataname) DO UPDATE SET "
                           "datavalue = excluded.datavalue, "
                           "lastmodified = excluded.lastmodified ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strDataNames));
@@ -175,14 +213,16 @@ class BulkUpsertDataOperation : public DatabaseTypeSpecificOperation<void>
 class BulkDeleteDataOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     LedgerTxnConsistency mCons;
     std::vector<std::string> mAccountIDs;
     std::vector<std::string> mDataNames;
 
   public:
-    BulkDeleteDataOperation(Database& DB, LedgerTxnConsistency cons,
+    BulkDeleteDataOperation(Database& DB, soci::session& session,
+                            LedgerTxnConsistency cons,
                             std::vector<EntryIterator> const& entries)
-        : mDB(DB), mCons(cons)
+        : mDB(DB), mSession(session), mCons(cons)
     {
         for (auto const& e : entries)
         {
@@ -199,7 +239,7 @@ class BulkDeleteDataOperation : public DatabaseTypeSpecificOperation<void>
     {
         std::string sql = "DELETE FROM accountdata WHERE accountid = :id AND "
                           " dataname = :v1 ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.exchange(soci::use(mDataNames));
@@ -237,7 +277,7 @@ class BulkDeleteDataOperation : public DatabaseTypeSpecificOperation<void>
             " ) "
             "DELETE FROM accountdata WHERE (accountid, dataname) IN "
             "(SELECT * FROM r)";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strDataNames));
@@ -257,18 +297,20 @@ class BulkDeleteDataOperation : public DatabaseTypeSpecificOperation<void>
 
 void
 LedgerTxnRoot::Impl::bulkUpsertAccountData(
-    std::vector<EntryIterator> const& entries)
+    std::vector<EntryIterator> const& entries, soci::session& session,
+    PGCopyMode copyMode)
 {
-    BulkUpsertDataOperation op(mDatabase, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkUpsertDataOperation op(mDatabase, session, entries, copyMode);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::bulkDeleteAccountData(
-    std::vector<EntryIterator> const& entries, LedgerTxnConsistency cons)
+    std::vector<EntryIterator> const& entries, soci::session& session,
+    LedgerTxnConsistency cons)
 {
-    BulkDeleteDataOperation op(mDatabase, cons, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkDeleteDataOperation op(mDatabase, session, cons, entries);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
@@ -347,7 +389,8 @@ LedgerTxnRoot::Impl::encodeDataNamesBase64()
     }
     if (!dataToEncode.empty())
     {
-        BulkUpsertDataOperation op(mDatabase, dataToEncode);
+        BulkUpsertDataOperation op(mDatabase, mDatabase.getSession(),
+                                   dataToEncode);
         mDatabase.doDatabaseTypeSpecificOperation(op);
         CLOG(INFO, "Ledger")
             << "Wrote " << dataToEncode.size() << " data entries";
@@ -6,7 +6,10 @@
 #include "ledger/LedgerTxn.h"
 #include "util/RandomEvictionCache.h"
 #include <list>
+#include <map>
 #ifdef USE_POSTGRES
+#include <cstring>
+#include <functional>
 #include <iomanip>
 #include <libpq-fe.h>
 #include <limits>
@@ -26,6 +29,18 @@ populateLoadedEntries(std::unordered_set<LedgerKey> const& keys,
 // up.
 static const double ENTRY_CACHE_FILL_RATIO = 0.5;
 
+// Whether, and how, bulk upserts of at least PG_COPY_MIN_ROWS rows are
+// streamed in with COPY on PostgreSQL (see upsertWithPGCopy). Only bucket
+// apply does so; ledger closes keep the unnest() path.
+enum class PGCopyMode
+{
+    NONE,
+    // Merged into the table through a staging table, as rows may exist.
+    MERGE,
+    // Copied straight into the table, none of the rows existing already.
+    INSERT
+};
+
 class EntryIterator::AbstractImpl
 {
   public:
@@ -135,12 +150,36 @@ class LedgerTxn::Impl
     typedef std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry>>
         EntryMap;
 
+    // The order book of a LedgerTxn indexes the live offers in mEntry by asset
+    // pair, in the order induced by isBetterOffer, so that getBestOffer does
+    // not need to scan every entry. mOrderBookPositions records where each
+    // indexed offer currently lives, since active entries can be modified in
+    // place and their previous value is then no longer available.
+    typedef std::map<OfferDescriptor, LedgerKey, IsBetterOfferComparator>
+        OrderBook;
+    typedef std::unordered_map<AssetPair, OrderBook, AssetPairHash>
+        MultiOrderBook;
+    typedef std::unordered_map<LedgerKey, std::pair<AssetPair, OfferDescriptor>>
+        OrderBookPositions;
+
+    // Offers in the parent that have been returned by mParent.getBestOffer for
+    // some asset pair but which are shadowed by an entry in mEntry. Keys never
+    // leave mEntry while they can be returned by the parent, so this only
+    // grows until the LedgerTxn is committed or rolled back.
+    typedef std::unordered_map<AssetPair, std::unordered_set<LedgerKey>,
+                               AssetPairHash>
+        ShadowedOffers;
+
     AbstractLedgerTxnParent& mParent;
     AbstractLedgerTxn* mChild;
     std::unique_ptr<LedgerHeader> mHeader;
     std::shared_ptr<LedgerTxnHeader::Impl> mActiveHeader;
     EntryMap mEntry;
     std::unordered_map<LedgerKey, std::shared_ptr<EntryImplBase>> mActive;
+    MultiOrderBook mMultiOrderBook;
+    OrderBookPositions mOrderBookPositions;
+    bool mOrderBookIsValid;
+    ShadowedOffers mShadowedParentOffers;
     bool const mShouldUpdateLastModified;
     bool mIsSealed;
     LedgerTxnConsistency mConsistency;
@@ -149,6 +188,26 @@ class LedgerTxn::Impl
     void throwIfSealed() const;
     void throwIfNotExactConsistency() const;
 
+    // updateOrderBook makes the order book agree with the current state of
+    // key in mEntry. updateOrderBook does not throw: if the order book cannot
+    // be updated then it is invalidated, and rebuilt on next use.
+    void updateOrderBook(LedgerKey const& key) noexcept;
+
+    // updateOrderBookForActiveEntries calls updateOrderBook for every active
+    // offer, since those may have been modified through a LedgerTxnEntry. It
+    // does not throw.
+    void updateOrderBookForActiveEntries() noexcept;
+
+    // invalidateOrderBook does not throw
+    void invalidateOrderBook() noexcept;
+
+    // getBestOfferFromOrderBook has the basic exception safety guarantee. If
+    // it throws an exception, then
+    // - the order book may be, but is not guaranteed to be, invalidated.
+    std::shared_ptr<LedgerEntry const>
+    getBestOfferFromOrderBook(AssetPair const& assets,
+                              std::unordered_set<LedgerKey> const& exclude);
+
     // getDeltaVotes has the basic exception safety guarantee. If it throws an
     // exception, then
     // - the prepared statement cache may be, but is not guaranteed to be,
@@ -226,6 +285,7 @@ class LedgerTxn::Impl
     //   cleared
     // - the best offers cache may be, but is not guaranteed to be, modified or
     //   even cleared
+    // - the order book may be, but is not guaranteed to be, invalidated
     std::shared_ptr<LedgerEntry const>
     getBestOffer(Asset const& buying, Asset const& selling,
                  std::unordered_set<LedgerKey>& exclude);
@@ -409,15 +469,34 @@ class LedgerTxnRoot::Impl
     typedef RandomEvictionCache<std::string, BestOffersCacheEntry>
         BestOffersCache;
 
+    // The in-memory order book holds every offer in the database, indexed by
+    // asset pair in the order induced by isBetterOffer. It is only used if
+    // enabled at construction (see Config::IN_MEMORY_ORDER_BOOK), in which
+    // case best offer queries never touch the database once it is loaded.
+    typedef std::map<OfferDescriptor, std::shared_ptr<LedgerEntry const>,
+                     IsBetterOfferComparator>
+        InMemoryOrderBook;
+    typedef std::unordered_map<AssetPair, InMemoryOrderBook, AssetPairHash>
+        InMemoryMultiOrderBook;
+    typedef std::unordered_map<LedgerKey, std::pair<AssetPair, OfferDescriptor>>
+        InMemoryOrderBookPositions;
+
     Database& mDatabase;
     std::unique_ptr<LedgerHeader> mHeader;
     mutable EntryCache mEntryCache;
     mutable BestOffersCache mBestOffersCache;
+    bool const mUseInMemoryOrderBook;
+    mutable bool mInMemoryOrderBookLoaded;
+    mutable InMemoryMultiOrderBook mInMemoryOrderBook;
+    mutable InMemoryOrderBookPositions mInMemoryOrderBookPositions;
     mutable std::unordered_map<LedgerKey, KeyAccesses> mPrefetchMetrics;
     mutable uint64_t mTotalPrefetchHits{0};
 
     size_t mMaxCacheSize;
     size_t mBulkLoadBatchSize;
+    bool mParallelBulkWrites{false};
+    bool mBulkInsertOnly{false};
+    bool mSecondaryIndexesDropped{false};
     std::unique_ptr<soci::transaction> mTransaction;
     AbstractLedgerTxn* mChild;
 
@@ -443,17 +522,25 @@ class LedgerTxnRoot::Impl
 
     void bulkApply(BulkLedgerEntryChangeAccumulator& bleca,
                    size_t bufferThreshold, LedgerTxnConsistency cons);
-    void bulkUpsertAccounts(std::vector<EntryIterator> const& entries);
+    void bulkApplyInParallel(BulkLedgerEntryChangeAccumulator& bleca,
+                             LedgerTxnConsistency cons);
+    void bulkUpsertAccounts(std::vector<EntryIterator> const& entries,
+                            soci::session& session, PGCopyMode copyMode);
     void bulkDeleteAccounts(std::vector<EntryIterator> const& entries,
-                            LedgerTxnConsistency cons);
-    void bulkUpsertTrustLines(std::vector<EntryIterator> const& entries);
+                            soci::session& session, LedgerTxnConsistency cons);
+    void bulkUpsertTrustLines(std::vector<EntryIterator> const& entries,
+                              soci::session& session, PGCopyMode copyMode);
     void bulkDeleteTrustLines(std::vector<EntryIterator> const& entries,
+                              soci::session& session,
                               LedgerTxnConsistency cons);
-    void bulkUpsertOffers(std::vector<EntryIterator> const& entries);
+    void bulkUpsertOffers(std::vector<EntryIterator> const& entries,
+                          soci::session& session, PGCopyMode copyMode);
     void bulkDeleteOffers(std::vector<EntryIterator> const& entries,
-                          LedgerTxnConsistency cons);
-    void bulkUpsertAccountData(std::vector<EntryIterator> const& entries);
+                          soci::session& session, LedgerTxnConsistency cons);
+    void bulkUpsertAccountData(std::vector<EntryIterator> const& entries,
+                               soci::session& session, PGCopyMode copyMode);
     void bulkDeleteAccountData(std::vector<EntryIterator> const& entries,
+                               soci::session& session,
                                LedgerTxnConsistency cons);
 
     static std::string tableFromLedgerEntryType(LedgerEntryType let);
@@ -481,6 +568,14 @@ class LedgerTxnRoot::Impl
     getFromBestOffersCache(Asset const& buying, Asset const& selling,
                            BestOffersCacheEntry& defaultValue) const;
 
+    // The in-memory order book is only modified through these functions.
+    // - updateInMemoryOrderBook has the strong exception safety guarantee
+    // - clearInMemoryOrderBook does not throw, and causes the in-memory
+    //   order book to be loaded again on next use
+    void updateInMemoryOrderBook(LedgerKey const& key,
+                                 std::shared_ptr<LedgerEntry const> entry);
+    void clearInMemoryOrderBook() const noexcept;
+
     std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
     bulkLoadAccounts(std::unordered_set<LedgerKey> const& keys) const;
     std::unordered_map<LedgerKey, std::shared_ptr<LedgerEntry const>>
@@ -493,16 +588,23 @@ class LedgerTxnRoot::Impl
   public:
     // Constructor has the strong exception safety guarantee
     Impl(Database& db, size_t entryCacheSize, size_t bestOfferCacheSize,
-         size_t prefetchBatchSize);
+         size_t prefetchBatchSize, bool useInMemoryOrderBook);
 
     ~Impl();
 
     // addChild has the strong exception safety guarantee.
     void addChild(AbstractLedgerTxn& child);
 
-    // commitChild has the strong exception safety guarantee.
+    // commitChild has the strong exception safety guarantee, unless parallel
+    // bulk writes are enabled. Each table is then written and committed in
+    // its own SQL transaction, so a failure can leave some tables written and
+    // others not. Either way a failure to write aborts the process.
     void commitChild(EntryIterator iter, LedgerTxnConsistency cons);
 
+    // setParallelBulkWrites and setBulkInsertOnly do not throw.
+    void setParallelBulkWrites(bool enabled) noexcept;
+    void setBulkInsertOnly(bool enabled) noexcept;
+
     // countObjects has the strong exception safety guarantee.
     uint64_t countObjects(LedgerEntryType let) const;
     uint64_t countObjects(LedgerEntryType let,
@@ -511,6 +613,11 @@ class LedgerTxnRoot::Impl
     // deleteObjectsModifiedOnOrAfterLedger has no exception safety guarantees.
     void deleteObjectsModifiedOnOrAfterLedger(uint32_t ledger) const;
 
+    // dropSecondaryIndexes and createSecondaryIndexes have no exception safety
+    // guarantees. Indexes still dropped are created again on destruction.
+    void dropSecondaryIndexes();
+    void createSecondaryIndexes();
+
     // dropAccounts, dropData, dropOffers, and dropTrustLines have no exception
     // safety guarantees.
     void dropAccounts();
@@ -594,6 +701,16 @@ class LedgerTxnRoot::Impl
     uint32_t prefetch(std::unordered_set<LedgerKey> const& keys);
 
     double getPrefetchHitRate() const;
+
+    // loadInMemoryOrderBook has the basic exception safety guarantee. If it
+    // throws an exception, then
+    // - the prepared statement cache may be, but is not guaranteed to be,
+    //   modified
+    // - the in-memory order book is cleared
+    void loadInMemoryOrderBook();
+
+    // getInMemoryOrderBookMemoryUsage does not throw
+    size_t getInMemoryOrderBookMemoryUsage() const;
 };
 
 #ifdef USE_POSTGRES
@@ -651,5 +768,118 @@ marshalToPGArray(PGconn* conn, std::string& out, const std::vector<T>& v,
     oss << '}';
     out = oss.str();
 }
+
+// During bucket apply (see PGCopyMode), bulk upserts of at least this many
+// rows go through PGBinaryCopy and upsertWithPGCopy, rather than
+// marshalToPGArray and unnest().
+static const size_t PG_COPY_MIN_ROWS = 256;
+
+inline void
+marshalToPGCopyInt(std::string& out, uint64_t v, size_t bytes)
+{
+    // Binary COPY fields are in network byte order.
+    for (size_t i = bytes; i-- > 0;)
+    {
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+}
+
+template <typename T>
+inline void marshalToPGCopyField(std::string& out, const T& item);
+
+template <>
+inline void
+marshalToPGCopyField<int32_t>(std::string& out, const int32_t& item)
+{
+    marshalToPGCopyInt(out, 4, 4);
+    marshalToPGCopyInt(out, static_cast<uint32_t>(item), 4);
+}
+
+template <>
+inline void
+marshalToPGCopyField<int64_t>(std::string& out, const int64_t& item)
+{
+    marshalToPGCopyInt(out, 8, 4);
+    marshalToPGCopyInt(out, static_cast<uint64_t>(item), 8);
+}
+
+template <>
+inline void
+marshalToPGCopyField<double>(std::string& out, const double& item)
+{
+    static_assert(sizeof(double) == sizeof(uint64_t), "unexpected double");
+    uint64_t bits;
+    std::memcpy(&bits, &item, sizeof(bits));
+    marshalToPGCopyInt(out, 8, 4);
+    marshalToPGCopyInt(out, bits, 8);
+}
+
+template <>
+inline void
+marshalToPGCopyField<std::string>(std::string& out, const std::string& item)
+{
+    marshalToPGCopyInt(out, item.size(), 4);
+    out.append(item);
+}
+
+// Helper that streams rows into a table with COPY ... FROM STDIN in the
+// binary format. The rows are built column by column from the same vectors
+// (and null indicators) that are otherwise passed to marshalToPGArray, which
+// spares the server from parsing array literals and us from escaping them.
+class PGBinaryCopy
+{
+    size_t const mRows;
+    std::vector<std::function<void(std::string&, size_t)>> mColumns;
+
+  public:
+    explicit PGBinaryCopy(size_t rows) : mRows(rows)
+    {
+    }
+
+    size_t
+    size() const
+    {
+        return mRows;
+    }
+
+    // Append a column. `v` and `ind` are referenced, not copied, so they must
+    // outlive this object.
+    template <typename T>
+    void
+    addColumn(const std::vector<T>& v,
+              const std::vector<soci::indicator>* ind = nullptr)
+    {
+        assert(v.size() == mRows);
+        mColumns.emplace_back([&v, ind](std::string& out, size_t row) {
+            if (ind && (*ind)[row] == soci::i_null)
+            {
+                // A field length of -1 denotes NULL.
+                marshalToPGCopyInt(out, 0xffffffff, 4);
+            }
+            else
+            {
+                marshalToPGCopyField(out, v[row]);
+            }
+        });
+    }
+
+    // Copy the rows into `table`, whose columns `columns` (comma-separated)
+    // must match the columns added, in order.
+    void copyInto(PGconn* conn, std::string const& table,
+                  std::string const& columns) const;
+};
+
+// Upsert the rows of `copy` into `table`, returning the number of rows
+// inserted or updated. With PGCopyMode::INSERT they are copied straight into
+// `table`. With PGCopyMode::MERGE they are copied into a temporary staging
+// table, created once per session and emptied on commit, and merged into
+// `table` with a single INSERT ... ON CONFLICT (`conflictColumns`) DO UPDATE
+// SET `updates` statement; so each table can only be upserted into once per
+// SQL transaction, as the parallel bulk writers do.
+size_t upsertWithPGCopy(soci::session& session, PGconn* conn,
+                        PGBinaryCopy const& copy, PGCopyMode mode,
+                        std::string const& table, std::string const& columns,
+                        std::string const& conflictColumns,
+                        std::string const& updates);
 #endif
 }
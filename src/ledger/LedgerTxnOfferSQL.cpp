@@ -104,6 +104,15 @@ isBetterOffer(LedgerEntry const& lhsEntry, LedgerEntry const& rhsEntry)
     assert(lhs.buying == rhs.buying);
     assert(lhs.selling == rhs.selling);
 
+    return isBetterOffer(OfferDescriptor{lhs.price, lhs.offerID},
+                         OfferDescriptor{rhs.price, rhs.offerID});
+}
+
+// Note: The order induced by this function must match the order used in the
+// SQL query for loadBestOffers above.
+bool
+isBetterOffer(OfferDescriptor const& lhs, OfferDescriptor const& rhs)
+{
     double lhsPrice = double(lhs.price.n) / double(lhs.price.d);
     double rhsPrice = double(rhs.price.n) / double(rhs.price.d);
     if (lhsPrice < rhsPrice)
@@ -120,6 +129,13 @@ isBetterOffer(LedgerEntry const& lhsEntry, LedgerEntry const& rhsEntry)
     }
 }
 
+bool
+IsBetterOfferComparator::operator()(OfferDescriptor const& lhs,
+                                    OfferDescriptor const& rhs) const
+{
+    return isBetterOffer(lhs, rhs);
+}
+
 // Note: This function is currently only used in AllowTrustOpFrame, which means
 // the asset parameter will never satisfy asset.type() == ASSET_TYPE_NATIVE. As
 // a consequence, this function throws in that case.
@@ -251,6 +267,8 @@ LedgerTxnRoot::Impl::loadOffers(StatementContext& prep) const
 class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
+    PGCopyMode mCopyMode{PGCopyMode::NONE};
     std::vector<std::string> mSellerIDs;
     std::vector<int64_t> mOfferIDs;
     std::vector<std::string> mSellingAssets;
@@ -288,9 +306,9 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
     }
 
   public:
-    BulkUpsertOffersOperation(Database& DB,
+    BulkUpsertOffersOperation(Database& DB, soci::session& session,
                               std::vector<LedgerEntry> const& entries)
-        : mDB(DB)
+        : mDB(DB), mSession(session)
     {
         mSellerIDs.reserve(entries.size());
         mOfferIDs.reserve(entries.size());
@@ -309,9 +327,10 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
         }
     }
 
-    BulkUpsertOffersOperation(Database& DB,
-                              std::vector<EntryIterator> const& entries)
-        : mDB(DB)
+    BulkUpsertOffersOperation(Database& DB, soci::session& session,
+                              std::vector<EntryIterator> const& entries,
+                              PGCopyMode copyMode)
+        : mDB(DB), mSession(session), mCopyMode(copyMode)
     {
         mSellerIDs.reserve(entries.size());
         mOfferIDs.reserve(entries.size());
@@ -349,7 +368,7 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
                           "price = excluded.price, "
                           "flags = excluded.flags, "
                           "lastmodified = excluded.lastmodified ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mSellerIDs));
         st.exchange(soci::use(mOfferIDs));
@@ -379,9 +398,53 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
     }
 
 #ifdef USE_POSTGRES
+    void
+    doPostgresCopyOperation(PGconn* conn)
+    {
+        PGBinaryCopy copy(mOfferIDs.size());
+        copy.addColumn(mSellerIDs);
+        copy.addColumn(mOfferIDs);
+        copy.addColumn(mSellingAssets);
+        copy.addColumn(mBuyingAssets);
+        copy.addColumn(mAmounts);
+        copy.addColumn(mPriceNs);
+        copy.addColumn(mPriceDs);
+        copy.addColumn(mPrices);
+        copy.addColumn(mFlags);
+        copy.addColumn(mLastModifieds);
+
+        std::string columns =
+            "sellerid, offerid, sellingasset, buyingasset, amount, pricen, "
+            "priced, price, flags, lastmodified";
+        std::string updates =
+            "sellerid = excluded.sellerid, "
+            "sellingasset = excluded.sellingasset, "
+            "buyingasset = excluded.buyingasset, amount = excluded.amount, "
+            "pricen = excluded.pricen, priced = excluded.priced, "
+            "price = excluded.price, flags = excluded.flags, "
+            "lastmodified = excluded.lastmodified";
+        size_t affected;
+        {
+            auto timer = mDB.getUpsertTimer("offer");
+            affected =
+                upsertWithPGCopy(mSession, conn, copy, mCopyMode, "offers",
+                                 columns, "offerid", updates);
+        }
+        if (affected != mOfferIDs.size())
+        {
+            throw std::runtime_error("Could not update data in SQL");
+        }
+    }
+
     void
     doPostgresSpecificOperation(soci::postgresql_session_backend* pg) override
     {
+        if (mCopyMode != PGCopyMode::NONE &&
+            mOfferIDs.size() >= PG_COPY_MIN_ROWS)
+        {
+            doPostgresCopyOperation(pg->conn_);
+            return;
+        }
 
         std::string strSellerIDs, strOfferIDs, strSellingAssets,
             strBuyingAssets, strAmounts, strPriceNs, strPriceDs, strPrices,
@@ -427,7 +490,7 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
                           "price = excluded.price, "
                           "flags = excluded.flags, "
                           "lastmodified = excluded.lastmodified ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strSellerIDs));
         st.exchange(soci::use(strOfferIDs));
@@ -455,13 +518,15 @@ class BulkUpsertOffersOperation : public DatabaseTypeSpecificOperation<void>
 class BulkDeleteOffersOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     LedgerTxnConsistency mCons;
     std::vector<int64_t> mOfferIDs;
 
   public:
-    BulkDeleteOffersOperation(Database& DB, LedgerTxnConsistency cons,
+    BulkDeleteOffersOperation(Database& DB, soci::session& session,
+                              LedgerTxnConsistency cons,
                               std::vector<EntryIterator> const& entries)
-        : mDB(DB), mCons(cons)
+        : mDB(DB), mSession(session), mCons(cons)
     {
         for (auto const& e : entries)
         {
@@ -476,7 +541,7 @@ class BulkDeleteOffersOperation : public DatabaseTypeSpecificOperation<void>
     doSociGenericOperation()
     {
         std::string sql = "DELETE FROM offers WHERE offerid = :id";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mOfferIDs));
         st.define_and_bind();
@@ -509,7 +574,7 @@ class BulkDeleteOffersOperation : public DatabaseTypeSpecificOperation<void>
                           ") "
                           "DELETE FROM offers WHERE "
                           "offerid IN (SELECT * FROM r)";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strOfferIDs));
         st.define_and_bind();
@@ -527,18 +592,21 @@ class BulkDeleteOffersOperation : public DatabaseTypeSpecificOperation<void>
 };
 
 void
-LedgerTxnRoot::Impl::bulkUpsertOffers(std::vector<EntryIterator> const& entries)
+LedgerTxnRoot::Impl::bulkUpsertOffers(
+    std::vector<EntryIterator> const& entries, soci::session& session,
+    PGCopyMode copyMode)
 {
-    BulkUpsertOffersOperation op(mDatabase, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkUpsertOffersOperation op(mDatabase, session, entries, copyMode);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::bulkDeleteOffers(std::vector<EntryIterator> const& entries,
+                                      soci::session& session,
                                       LedgerTxnConsistency cons)
 {
-    BulkDeleteOffersOperation op(mDatabase, cons, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkDeleteOffersOperation op(mDatabase, session, cons, entries);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
@@ -547,6 +615,7 @@ LedgerTxnRoot::Impl::dropOffers()
     throwIfChild();
     mEntryCache.clear();
     mBestOffersCache.clear();
+    clearInMemoryOrderBook();
 
     mDatabase.getSession() << "DROP TABLE IF EXISTS offers;";
     mDatabase.getSession()
@@ -807,6 +876,7 @@ LedgerTxnRoot::Impl::writeOffersIntoSimplifiedOffersTable()
     throwIfChild();
     mEntryCache.clear();
     mBestOffersCache.clear();
+    clearInMemoryOrderBook();
 
     CLOG(INFO, "Ledger") << "Loading all offers";
     auto const offers = stellar::loadAllOffersForSchemaUpgrade(mDatabase);
@@ -832,7 +902,8 @@ LedgerTxnRoot::Impl::writeOffersIntoSimplifiedOffersTable()
 
     if (!offers.empty())
     {
-        BulkUpsertOffersOperation op(mDatabase, offers);
+        BulkUpsertOffersOperation op(mDatabase, mDatabase.getSession(),
+                                     offers);
         mDatabase.doDatabaseTypeSpecificOperation(op);
         CLOG(INFO, "Ledger") << "Wrote " << offers.size() << " offer entries";
     }
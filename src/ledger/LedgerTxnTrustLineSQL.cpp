@@ -98,6 +98,8 @@ LedgerTxnRoot::Impl::loadTrustLine(LedgerKey const& key) const
 class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
+    PGCopyMode mCopyMode{PGCopyMode::NONE};
     std::vector<std::string> mAccountIDs;
     std::vector<int32_t> mAssetTypes;
     std::vector<std::string> mIssuers;
@@ -111,9 +113,10 @@ class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
     std::vector<soci::indicator> mLiabilitiesInds;
 
   public:
-    BulkUpsertTrustLinesOperation(Database& DB,
-                                  std::vector<EntryIterator> const& entries)
-        : mDB(DB)
+    BulkUpsertTrustLinesOperation(Database& DB, soci::session& session,
+                                  std::vector<EntryIterator> const& entries,
+                                  PGCopyMode copyMode)
+        : mDB(DB), mSession(session), mCopyMode(copyMode)
     {
         mAccountIDs.reserve(entries.size());
         mAssetTypes.reserve(entries.size());
@@ -181,7 +184,7 @@ class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
             "lastmodified = excluded.lastmodified, "
             "buyingliabilities = excluded.buyingliabilities, "
             "sellingliabilities = excluded.sellingliabilities ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.exchange(soci::use(mAssetTypes));
@@ -211,9 +214,54 @@ class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
     }
 
 #ifdef USE_POSTGRES
+    void
+    doPostgresCopyOperation(PGconn* conn)
+    {
+        PGBinaryCopy copy(mAccountIDs.size());
+        copy.addColumn(mAccountIDs);
+        copy.addColumn(mAssetTypes);
+        copy.addColumn(mIssuers);
+        copy.addColumn(mAssetCodes);
+        copy.addColumn(mTlimits);
+        copy.addColumn(mBalances);
+        copy.addColumn(mFlags);
+        copy.addColumn(mLastModifieds);
+        copy.addColumn(mBuyingLiabilities, &mLiabilitiesInds);
+        copy.addColumn(mSellingLiabilities, &mLiabilitiesInds);
+
+        std::string columns =
+            "accountid, assettype, issuer, assetcode, tlimit, balance, "
+            "flags, lastmodified, buyingliabilities, sellingliabilities";
+        std::string conflictColumns = "accountid, issuer, assetcode";
+        std::string updates =
+            "assettype = excluded.assettype, tlimit = excluded.tlimit, "
+            "balance = excluded.balance, flags = excluded.flags, "
+            "lastmodified = excluded.lastmodified, "
+            "buyingliabilities = excluded.buyingliabilities, "
+            "sellingliabilities = excluded.sellingliabilities";
+        size_t affected;
+        {
+            auto timer = mDB.getUpsertTimer("trustline");
+            affected =
+                upsertWithPGCopy(mSession, conn, copy, mCopyMode, "trustlines",
+                                 columns, conflictColumns, updates);
+        }
+        if (affected != mAccountIDs.size())
+        {
+            throw std::runtime_error("Could not update data in SQL");
+        }
+    }
+
     void
     doPostgresSpecificOperation(soci::postgresql_session_backend* pg) override
     {
+        if (mCopyMode != PGCopyMode::NONE &&
+            mAccountIDs.size() >= PG_COPY_MIN_ROWS)
+        {
+            doPostgresCopyOperation(pg->conn_);
+            return;
+        }
+
         PGconn* conn = pg->conn_;
 
         std::string strAccountIDs, strAssetTypes, strIssuers, strAssetCodes,
@@ -259,7 +307,7 @@ class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
             "lastmodified = excluded.lastmodified, "
             "buyingliabilities = excluded.buyingliabilities, "
             "sellingliabilities = excluded.sellingliabilities ";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strAssetTypes));
@@ -287,15 +335,17 @@ class BulkUpsertTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
 class BulkDeleteTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
 {
     Database& mDB;
+    soci::session& mSession;
     LedgerTxnConsistency mCons;
     std::vector<std::string> mAccountIDs;
     std::vector<std::string> mIssuers;
     std::vector<std::string> mAssetCodes;
 
   public:
-    BulkDeleteTrustLinesOperation(Database& DB, LedgerTxnConsistency cons,
+    BulkDeleteTrustLinesOperation(Database& DB, soci::session& session,
+                                  LedgerTxnConsistency cons,
                                   std::vector<EntryIterator> const& entries)
-        : mDB(DB), mCons(cons)
+        : mDB(DB), mSession(session), mCons(cons)
     {
         mAccountIDs.reserve(entries.size());
         mIssuers.reserve(entries.size());
@@ -319,7 +369,7 @@ class BulkDeleteTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
     {
         std::string sql = "DELETE FROM trustlines WHERE accountid = :id "
                           "AND issuer = :v1 AND assetcode = :v2";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(mAccountIDs));
         st.exchange(soci::use(mIssuers));
@@ -358,7 +408,7 @@ class BulkDeleteTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
                           ") "
                           "DELETE FROM trustlines WHERE "
                           "(accountid, issuer, assetcode) IN (SELECT * FROM r)";
-        auto prep = mDB.getPreparedStatement(sql);
+        auto prep = mDB.getPreparedStatement(sql, mSession);
         soci::statement& st = prep.statement();
         st.exchange(soci::use(strAccountIDs));
         st.exchange(soci::use(strIssuers));
@@ -379,18 +429,20 @@ class BulkDeleteTrustLinesOperation : public DatabaseTypeSpecificOperation<void>
 
 void
 LedgerTxnRoot::Impl::bulkUpsertTrustLines(
-    std::vector<EntryIterator> const& entries)
+    std::vector<EntryIterator> const& entries, soci::session& session,
+    PGCopyMode copyMode)
 {
-    BulkUpsertTrustLinesOperation op(mDatabase, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkUpsertTrustLinesOperation op(mDatabase, session, entries, copyMode);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
 LedgerTxnRoot::Impl::bulkDeleteTrustLines(
-    std::vector<EntryIterator> const& entries, LedgerTxnConsistency cons)
+    std::vector<EntryIterator> const& entries, soci::session& session,
+    LedgerTxnConsistency cons)
 {
-    BulkDeleteTrustLinesOperation op(mDatabase, cons, entries);
-    mDatabase.doDatabaseTypeSpecificOperation(op);
+    BulkDeleteTrustLinesOperation op(mDatabase, session, cons, entries);
+    mDatabase.doDatabaseTypeSpecificOperation(op, session);
 }
 
 void
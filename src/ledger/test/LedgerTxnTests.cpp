@@ -2,6 +2,8 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "database/Database.h"
+#include "ledger/LedgerManager.h"
 #include "ledger/LedgerTxn.h"
 #include "ledger/LedgerTxnEntry.h"
 #include "ledger/LedgerTxnHeader.h"
@@ -1648,6 +1650,19 @@ testBestOffer(
         testAtRoot(*app);
     }
 
+    // first changes are in LedgerTxnRoot with in-memory order book, which is
+    // loaded before the changes are committed
+    if (updates.size() > 1)
+    {
+        VirtualClock clock;
+        auto cfg = getTestConfig();
+        cfg.IN_MEMORY_ORDER_BOOK = true;
+        auto app = createTestApplication(clock, cfg);
+        app->start();
+        app->getLedgerTxnRoot().loadInMemoryOrderBook();
+        testAtRoot(*app);
+    }
+
     // first changes are in LedgerTxnRoot without cache
     if (updates.size() > 1)
     {
@@ -1822,6 +1837,90 @@ TEST_CASE("LedgerTxn loadBestOffer", "[ledgerstate]")
     }
 }
 
+TEST_CASE("LedgerTxn loadBestOffer order book", "[ledgerstate]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto a1 = LedgerTestUtils::generateValidAccountEntry().accountID;
+    Asset buying = LedgerTestUtils::generateValidOfferEntry().buying;
+    Asset selling = LedgerTestUtils::generateValidOfferEntry().selling;
+    REQUIRE(!(buying == selling));
+
+    auto makeOffer = [&](int64_t offerID, Price const& price) {
+        LedgerEntry le;
+        le.lastModifiedLedgerSeq = 1;
+        le.data.type(OFFER);
+        auto& oe = le.data.offer();
+        oe = LedgerTestUtils::generateValidOfferEntry();
+        oe.sellerID = a1;
+        oe.offerID = offerID;
+        oe.buying = buying;
+        oe.selling = selling;
+        oe.price = price;
+        oe.amount = 1;
+        return le;
+    };
+
+    SECTION("price modified while active")
+    {
+        LedgerTxn ltx(app->getLedgerTxnRoot());
+        auto ltxe1 = ltx.create(makeOffer(1, Price{1, 1}));
+        ltx.create(makeOffer(2, Price{2, 1}));
+
+        ltxe1.current().data.offer().price = Price{3, 1};
+        auto best = ltx.loadBestOffer(buying, selling);
+        REQUIRE(best);
+        REQUIRE(best.current().data.offer().offerID == 2);
+    }
+
+    SECTION("price modified before adding child")
+    {
+        LedgerTxn ltx1(app->getLedgerTxnRoot());
+        auto ltxe1 = ltx1.create(makeOffer(1, Price{1, 1}));
+        ltx1.create(makeOffer(2, Price{2, 1}));
+        ltxe1.current().data.offer().price = Price{3, 1};
+
+        LedgerTxn ltx2(ltx1);
+        auto best = ltx2.loadBestOffer(buying, selling);
+        REQUIRE(best);
+        REQUIRE(best.current().data.offer().offerID == 2);
+    }
+
+    SECTION("crossing offers in nested LedgerTxn")
+    {
+        int32_t const NUM_OFFERS = 50;
+        {
+            LedgerTxn ltx(app->getLedgerTxnRoot());
+            for (int32_t i = 1; i <= NUM_OFFERS; ++i)
+            {
+                ltx.create(makeOffer(i, Price{NUM_OFFERS - i + 1, 1}));
+            }
+            ltx.commit();
+        }
+
+        LedgerTxn ltx1(app->getLedgerTxnRoot());
+        for (int32_t i = NUM_OFFERS; i > NUM_OFFERS / 2; --i)
+        {
+            auto best = ltx1.loadBestOffer(buying, selling);
+            REQUIRE(best);
+            REQUIRE(best.current().data.offer().offerID == i);
+            best.erase();
+        }
+
+        LedgerTxn ltx2(ltx1);
+        for (int32_t i = NUM_OFFERS / 2; i > 0; --i)
+        {
+            auto best = ltx2.loadBestOffer(buying, selling);
+            REQUIRE(best);
+            REQUIRE(best.current().data.offer().offerID == i);
+            best.erase();
+        }
+        REQUIRE(!ltx2.loadBestOffer(buying, selling));
+    }
+}
+
 static void
 testOffersByAccountAndAsset(
     AbstractLedgerTxnParent& ltxParent, AccountID const& accountID,
@@ -2205,6 +2304,180 @@ TEST_CASE("LedgerTxnRoot prefetch", "[ledgerstate]")
     }
 }
 
+TEST_CASE("LedgerTxnRoot parallel bulk writes", "[ledgerstate]")
+{
+    auto runTest = [&](Config::TestDbMode mode) {
+        VirtualClock clock;
+        Config cfg(getTestConfig(0, mode));
+        Application::pointer app = createTestApplication(clock, cfg);
+        app->start();
+        auto& root = app->getLedgerTxnRoot();
+
+        auto entries = LedgerTestUtils::generateValidLedgerEntries(1000);
+        root.setParallelBulkWrites(true);
+        {
+            LedgerTxn ltx(root);
+            for (auto const& e : entries)
+            {
+                ltx.createOrUpdateWithoutLoading(e);
+            }
+            ltx.commit();
+        }
+
+        // Erase every other entry, and update the rest.
+        std::map<LedgerKey, LedgerEntry> expected;
+        {
+            LedgerTxn ltx(root);
+            for (size_t i = 0; i < entries.size(); ++i)
+            {
+                auto const& e = entries[i];
+                if (i % 2 == 0)
+                {
+                    ltx.eraseWithoutLoading(LedgerEntryKey(e));
+                    expected.erase(LedgerEntryKey(e));
+                }
+                else
+                {
+                    auto updated = e;
+                    ++updated.lastModifiedLedgerSeq;
+                    ltx.createOrUpdateWithoutLoading(updated);
+                    expected[LedgerEntryKey(e)] = updated;
+                }
+            }
+            ltx.commit();
+        }
+        root.setParallelBulkWrites(false);
+
+        LedgerTxn ltx(root);
+        for (auto const& e : entries)
+        {
+            auto key = LedgerEntryKey(e);
+            auto entry = ltx.loadWithoutRecord(key);
+            auto iter = expected.find(key);
+            if (iter == expected.end())
+            {
+                REQUIRE(!entry);
+            }
+            else
+            {
+                REQUIRE(entry);
+                REQUIRE(entry.current() == iter->second);
+            }
+        }
+    };
+
+    SECTION("sqlite")
+    {
+        runTest(Config::TESTDB_ON_DISK_SQLITE);
+    }
+
+#ifdef USE_POSTGRES
+    SECTION("postgresql")
+    {
+        runTest(Config::TESTDB_POSTGRESQL);
+    }
+#endif
+}
+
+TEST_CASE("LedgerTxnRoot bulk load", "[ledgerstate]")
+{
+    auto runTest = [&](Config::TestDbMode mode) {
+        VirtualClock clock;
+        Config cfg(getTestConfig(0, mode));
+        Application::pointer app = createTestApplication(clock, cfg);
+        app->start();
+        auto& root = app->getLedgerTxnRoot();
+
+        // Large enough that every entry type is upserted through COPY on
+        // PostgreSQL.
+        auto entries = LedgerTestUtils::generateValidLedgerEntries(4000);
+        root.dropSecondaryIndexes();
+        for (uint32_t pass = 0; pass < 2; ++pass)
+        {
+            LedgerTxn ltx(root);
+            for (auto& e : entries)
+            {
+                e.lastModifiedLedgerSeq = pass + 1;
+                ltx.createOrUpdateWithoutLoading(e);
+            }
+            ltx.commit();
+        }
+        root.createSecondaryIndexes();
+        // Creating indexes that already exist does nothing.
+        root.createSecondaryIndexes();
+
+        LedgerTxn ltx(root);
+        for (auto const& e : entries)
+        {
+            auto entry = ltx.loadWithoutRecord(LedgerEntryKey(e));
+            REQUIRE(entry);
+            REQUIRE(entry.current() == e);
+        }
+    };
+
+    SECTION("sqlite")
+    {
+        runTest(Config::TESTDB_ON_DISK_SQLITE);
+    }
+
+#ifdef USE_POSTGRES
+    SECTION("postgresql")
+    {
+        runTest(Config::TESTDB_POSTGRESQL);
+    }
+#endif
+}
+
+TEST_CASE("LedgerTxnRoot secondary indexes", "[ledgerstate]")
+{
+    auto runTest = [&](Config::TestDbMode mode) {
+        VirtualClock clock;
+        Config cfg(getTestConfig(0, mode));
+        Application::pointer app = createTestApplication(clock, cfg);
+        app->start();
+        auto& db = app->getDatabase();
+
+        auto hasIndex = [&](std::string const& name) {
+            int count = 0;
+            if (db.isSqlite())
+            {
+                db.getSession() << "SELECT COUNT(*) FROM sqlite_master WHERE "
+                                   "type = 'index' AND name = :n",
+                    soci::into(count), soci::use(name);
+            }
+            else
+            {
+                db.getSession()
+                    << "SELECT COUNT(*) FROM pg_indexes WHERE indexname = :n",
+                    soci::into(count), soci::use(name);
+            }
+            return count != 0;
+        };
+
+        app->getLedgerTxnRoot().dropSecondaryIndexes();
+        // Only dropped on PostgreSQL
+        REQUIRE(hasIndex("accountbalances") == db.isSqlite());
+        REQUIRE(hasIndex("bestofferindex") == db.isSqlite());
+
+        // As if restarted before they were created again
+        app->getLedgerManager().loadLastKnownLedger(nullptr);
+        REQUIRE(hasIndex("accountbalances"));
+        REQUIRE(hasIndex("bestofferindex"));
+    };
+
+    SECTION("sqlite")
+    {
+        runTest(Config::TESTDB_ON_DISK_SQLITE);
+    }
+
+#ifdef USE_POSTGRES
+    SECTION("postgresql")
+    {
+        runTest(Config::TESTDB_POSTGRESQL);
+    }
+#endif
+}
+
 TEST_CASE("Create performance benchmark", "[!hide][createbench]")
 {
     auto runTest = [&](Config::TestDbMode mode, bool loading) {
@@ -2663,11 +2936,13 @@ TEST_CASE("Load best offers benchmark", "[!hide][bestoffersbench]")
     };
 
     auto runTest = [&](Config::TestDbMode mode, size_t numAssets,
-                       size_t numIssuers, size_t numOffers) {
+                       size_t numIssuers, size_t numOffers,
+                       bool inMemoryOrderBook = false) {
         VirtualClock clock;
         Config cfg(getTestConfig(0, mode));
         cfg.ENTRY_CACHE_SIZE = 100000;
         cfg.BEST_OFFERS_CACHE_SIZE = 1000;
+        cfg.IN_MEMORY_ORDER_BOOK = inMemoryOrderBook;
         Application::pointer app = createTestApplication(clock, cfg);
 
         CLOG(WARNING, "Ledger")
@@ -2721,4 +2996,80 @@ TEST_CASE("Load best offers benchmark", "[!hide][bestoffersbench]")
     {
         runTest(Config::TESTDB_ON_DISK_SQLITE, 10, 5, 25000);
     }
+
+    SECTION("in-memory order book")
+    {
+        runTest(Config::TESTDB_ON_DISK_SQLITE, 10, 5, 25000, true);
+    }
+}
+
+TEST_CASE("Load best offers from modified LedgerTxn benchmark",
+          "[!hide][bestoffersltxbench]")
+{
+    // Models a busy ledger: many offers have already been modified in the
+    // ledger-level LedgerTxn, and each transaction then crosses a few offers
+    // in a nested LedgerTxn.
+    auto runTest = [&](size_t numPairs, size_t numOffersPerPair,
+                       size_t numTxs, size_t numCrossedPerTx) {
+        VirtualClock clock;
+        Application::pointer app =
+            createTestApplication(clock, getTestConfig());
+        app->start();
+
+        std::vector<Asset> assets;
+        assets.emplace_back(ASSET_TYPE_NATIVE);
+        auto issuer = LedgerTestUtils::generateValidAccountEntry().accountID;
+        for (size_t i = 0; i < numPairs; ++i)
+        {
+            Asset a(ASSET_TYPE_CREDIT_ALPHANUM4);
+            strToAssetCode(a.alphaNum4().assetCode, "A" + std::to_string(i));
+            a.alphaNum4().issuer = issuer;
+            assets.emplace_back(a);
+        }
+
+        LedgerTxn ltxLedger(app->getLedgerTxnRoot());
+        int64_t offerID = 0;
+        for (size_t i = 1; i < assets.size(); ++i)
+        {
+            for (size_t j = 0; j < numOffersPerPair; ++j)
+            {
+                LedgerEntry le;
+                le.lastModifiedLedgerSeq = 1;
+                le.data.type(OFFER);
+                auto& oe = le.data.offer();
+                oe = LedgerTestUtils::generateValidOfferEntry();
+                oe.offerID = ++offerID;
+                oe.buying = assets[0];
+                oe.selling = assets[i];
+                ltxLedger.create(le);
+            }
+        }
+
+        auto& timer = app->getMetrics().NewTimer(
+            {"bestoffers", "benchmark", "ltx-load"});
+        size_t numLoaded = 0;
+        for (size_t tx = 0; tx < numTxs; ++tx)
+        {
+            auto const& selling = assets[1 + tx % numPairs];
+            LedgerTxn ltxTx(ltxLedger);
+            auto scope = timer.TimeScope();
+            for (size_t i = 0; i < numCrossedPerTx; ++i)
+            {
+                auto best = ltxTx.loadBestOffer(assets[0], selling);
+                if (!best)
+                {
+                    break;
+                }
+                ++numLoaded;
+                best.erase();
+            }
+            ltxTx.commit();
+        }
+
+        CLOG(WARNING, "Ledger")
+            << "Loaded " << numLoaded << " best offers from " << offerID
+            << " modified offers in " << timer.sum() << " ms";
+    };
+
+    runTest(10, 10000, 1000, 10);
 }
@@ -83,6 +83,7 @@ CommandHandler::CommandHandler(Application& app) : mApp(app)
     addRoute("metrics", &CommandHandler::metrics);
     addRoute("clearmetrics", &CommandHandler::clearMetrics);
     addRoute("peers", &CommandHandler::peers);
+    addRoute("peerstats", &CommandHandler::peerStats);
     addRoute("quorum", &CommandHandler::quorum);
     addRoute("setcursor", &CommandHandler::setcursor);
     addRoute("scp", &CommandHandler::scpInfo);
@@ -243,6 +244,38 @@ CommandHandler::peers(std::string const&, std::string& retStr)
     retStr = root.toStyledString();
 }
 
+void
+CommandHandler::peerStats(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+
+    NodeID n;
+    auto node = retMap.find("node");
+    if (node != retMap.end() &&
+        !mApp.getHerder().resolveNodeID(node->second, n))
+    {
+        throw std::invalid_argument("unknown name");
+    }
+
+    Json::Value root;
+    auto& peers = root["peers"];
+    auto counter = 0;
+    for (auto const& peer : mApp.getOverlayManager().getAuthenticatedPeers())
+    {
+        if (node != retMap.end() && peer.first != n)
+        {
+            continue;
+        }
+        auto& peerNode = peers[counter++];
+        peerNode["id"] = mApp.getConfig().toStrKey(peer.first);
+        peerNode["address"] = peer.second->toString();
+        peerNode["stats"] = peer.second->getStats().toJson();
+    }
+
+    retStr = root.toStyledString();
+}
+
 void
 CommandHandler::info(std::string const&, std::string& retStr)
 {
@@ -45,7 +45,7 @@ Config::Config() : NODE_SEED(SecretKey::random())
     LEDGER_PROTOCOL_VERSION = CURRENT_LEDGER_PROTOCOL_VERSION;
 
     OVERLAY_PROTOCOL_MIN_VERSION = 7;
-    OVERLAY_PROTOCOL_VERSION = 9;
+    OVERLAY_PROTOCOL_VERSION = 10;
 
     VERSION_STR = STELLAR_CORE_VERSION;
 
@@ -54,6 +54,7 @@ Config::Config() : NODE_SEED(SecretKey::random())
     MANUAL_CLOSE = false;
     CATCHUP_COMPLETE = false;
     CATCHUP_RECENT = 0;
+    CATCHUP_APPLY_BUCKETS_NEWEST_FIRST = false;
     AUTOMATIC_MAINTENANCE_PERIOD = std::chrono::seconds{14400};
     AUTOMATIC_MAINTENANCE_COUNT = 50000;
     ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING = false;
@@ -69,6 +70,11 @@ Config::Config() : NODE_SEED(SecretKey::random())
 
     LOG_FILE_PATH = "stellar-core.%datetime{%Y.%M.%d-%H:%m:%s}.log";
     BUCKET_DIR_PATH = "buckets";
+    BUCKET_WRITE_BUFFER_SIZE = 1024 * 1024;
+    BUCKET_WRITE_DIRECT_IO = false;
+    BUCKET_MERGE_SHARDS = 4;
+    BUCKET_MERGE_SHARD_MIN_SIZE = 64 * 1024 * 1024;
+    DISABLE_XDR_FSYNC = false;
 
     TESTING_UPGRADE_DESIRED_FEE = LedgerManager::GENESIS_LEDGER_BASE_FEE;
     TESTING_UPGRADE_RESERVE = LedgerManager::GENESIS_LEDGER_BASE_RESERVE;
@@ -86,11 +92,19 @@ Config::Config() : NODE_SEED(SecretKey::random())
     PEER_AUTHENTICATION_TIMEOUT = 2;
     PEER_TIMEOUT = 30;
     PEER_STRAGGLER_TIMEOUT = 120;
+    PEER_MESSAGES_PER_CRANK = 16;
+    PEER_SEND_QUEUE_SCP_BYTES = 4 * 1024 * 1024;
+    PEER_SEND_QUEUE_FETCH_BYTES = 16 * 1024 * 1024;
+    PEER_SEND_QUEUE_FLOOD_BYTES = 2 * 1024 * 1024;
+    FLOOD_PULL_MODE = false;
+    FLOOD_ADVERT_PERIOD_MS = 100;
+    FLOOD_DEMAND_TIMEOUT_MS = 500;
     PREFERRED_PEERS_ONLY = false;
 
     MINIMUM_IDLE_PERCENT = 0;
 
     WORKER_THREADS = 10;
+    TRANSACTION_QUEUE_SIZE_OPS = 100000;
     MAX_CONCURRENT_SUBPROCESSES = 16;
     NODE_IS_VALIDATOR = false;
 
@@ -98,6 +112,8 @@ Config::Config() : NODE_SEED(SecretKey::random())
 
     ENTRY_CACHE_SIZE = 100000;
     BEST_OFFERS_CACHE_SIZE = 64;
+    VERIFY_SIG_CACHE_SIZE = PubKeyUtils::DEFAULT_VERIFY_SIG_CACHE_SIZE;
+    IN_MEMORY_ORDER_BOOK = false;
     PREFETCH_BATCH_SIZE = 1000;
 }
 
@@ -350,6 +366,10 @@ Config::load(std::string const& filename)
             {
                 CATCHUP_RECENT = readInt<uint32_t>(item, 0, UINT32_MAX - 1);
             }
+            else if (item.first == "CATCHUP_APPLY_BUCKETS_NEWEST_FIRST")
+            {
+                CATCHUP_APPLY_BUCKETS_NEWEST_FIRST = readBool(item);
+            }
             else if (item.first == "ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING")
             {
                 ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING = readBool(item);
@@ -394,6 +414,27 @@ Config::load(std::string const& filename)
             {
                 BUCKET_DIR_PATH = readString(item);
             }
+            else if (item.first == "BUCKET_WRITE_BUFFER_SIZE")
+            {
+                BUCKET_WRITE_BUFFER_SIZE =
+                    readInt<uint32_t>(item, 4096, 64 * 1024 * 1024);
+            }
+            else if (item.first == "BUCKET_WRITE_DIRECT_IO")
+            {
+                BUCKET_WRITE_DIRECT_IO = readBool(item);
+            }
+            else if (item.first == "BUCKET_MERGE_SHARDS")
+            {
+                BUCKET_MERGE_SHARDS = readInt<uint32_t>(item, 1, 64);
+            }
+            else if (item.first == "BUCKET_MERGE_SHARD_MIN_SIZE")
+            {
+                BUCKET_MERGE_SHARD_MIN_SIZE = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "DISABLE_XDR_FSYNC")
+            {
+                DISABLE_XDR_FSYNC = readBool(item);
+            }
             else if (item.first == "NODE_NAMES")
             {
                 auto names = readStringArray(item);
@@ -441,6 +482,35 @@ Config::load(std::string const& filename)
                 PEER_STRAGGLER_TIMEOUT = readInt<unsigned short>(
                     item, 1, std::numeric_limits<unsigned short>::max());
             }
+            else if (item.first == "PEER_MESSAGES_PER_CRANK")
+            {
+                PEER_MESSAGES_PER_CRANK = readInt<unsigned short>(
+                    item, 1, std::numeric_limits<unsigned short>::max());
+            }
+            else if (item.first == "PEER_SEND_QUEUE_SCP_BYTES")
+            {
+                PEER_SEND_QUEUE_SCP_BYTES = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "PEER_SEND_QUEUE_FETCH_BYTES")
+            {
+                PEER_SEND_QUEUE_FETCH_BYTES = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "PEER_SEND_QUEUE_FLOOD_BYTES")
+            {
+                PEER_SEND_QUEUE_FLOOD_BYTES = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "FLOOD_PULL_MODE")
+            {
+                FLOOD_PULL_MODE = readBool(item);
+            }
+            else if (item.first == "FLOOD_ADVERT_PERIOD_MS")
+            {
+                FLOOD_ADVERT_PERIOD_MS = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "FLOOD_DEMAND_TIMEOUT_MS")
+            {
+                FLOOD_DEMAND_TIMEOUT_MS = readInt<uint32_t>(item, 1);
+            }
             else if (item.first == "PREFERRED_PEERS")
             {
                 PREFERRED_PEERS = readStringArray(item);
@@ -469,6 +539,10 @@ Config::load(std::string const& filename)
             {
                 WORKER_THREADS = readInt<int>(item, 1, 1000);
             }
+            else if (item.first == "TRANSACTION_QUEUE_SIZE_OPS")
+            {
+                TRANSACTION_QUEUE_SIZE_OPS = readInt<uint32_t>(item, 1);
+            }
             else if (item.first == "MAX_CONCURRENT_SUBPROCESSES")
             {
                 MAX_CONCURRENT_SUBPROCESSES = readInt<int>(item, 1);
@@ -545,6 +619,14 @@ Config::load(std::string const& filename)
             {
                 BEST_OFFERS_CACHE_SIZE = readInt<uint32_t>(item);
             }
+            else if (item.first == "VERIFY_SIG_CACHE_SIZE")
+            {
+                VERIFY_SIG_CACHE_SIZE = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "IN_MEMORY_ORDER_BOOK")
+            {
+                IN_MEMORY_ORDER_BOOK = readBool(item);
+            }
             else if (item.first == "PREFETCH_BATCH_SIZE")
             {
                 PREFETCH_BATCH_SIZE = readInt<uint32_t>(item);
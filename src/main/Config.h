@@ -85,6 +85,11 @@ class Config : public std::enable_shared_from_this<Config>
     // If you want, say, a week of history, set this to 120000.
     uint32_t CATCHUP_RECENT;
 
+    // Whether "minimal" catchup applies buckets newest-first, writing each
+    // ledger entry to the database once instead of once per bucket holding a
+    // version of it. Costs memory for the set of keys applied so far.
+    bool CATCHUP_APPLY_BUCKETS_NEWEST_FIRST;
+
     // Interval between automatic maintenance executions
     std::chrono::seconds AUTOMATIC_MAINTENANCE_PERIOD;
 
@@ -156,6 +161,27 @@ class Config : public std::enable_shared_from_this<Config>
     std::string VERSION_STR;
     std::string LOG_FILE_PATH;
     std::string BUCKET_DIR_PATH;
+
+    // Bytes of each bucket being written that are buffered before being
+    // handed to the kernel, and whether bucket files are written with
+    // O_DIRECT (where supported) so merges do not flush the page cache.
+    uint32_t BUCKET_WRITE_BUFFER_SIZE;
+    bool BUCKET_WRITE_DIRECT_IO;
+
+    // Merges of buckets adding up to at least BUCKET_MERGE_SHARD_MIN_SIZE
+    // bytes per shard are split into up to BUCKET_MERGE_SHARDS key ranges
+    // merged concurrently. 1 disables sharding.
+    uint32_t BUCKET_MERGE_SHARDS;
+    uint32_t BUCKET_MERGE_SHARD_MIN_SIZE;
+
+    // If set to true, bucket files are not synced to disk once written. Only
+    // safe if losing buckets on a crash is acceptable, as in tests.
+    bool DISABLE_XDR_FSYNC;
+
+    // Maximum number of operations of the transactions waiting to go into a
+    // ledger; when full, the lowest fee transactions make way for new ones.
+    uint32_t TRANSACTION_QUEUE_SIZE_OPS;
+
     uint32_t TESTING_UPGRADE_DESIRED_FEE; // in stroops
     uint32_t TESTING_UPGRADE_RESERVE;     // in stroops
     uint32_t TESTING_UPGRADE_MAX_TX_SET_SIZE;
@@ -174,6 +200,16 @@ class Config : public std::enable_shared_from_this<Config>
     unsigned short PEER_AUTHENTICATION_TIMEOUT;
     unsigned short PEER_TIMEOUT;
     unsigned short PEER_STRAGGLER_TIMEOUT;
+    unsigned short PEER_MESSAGES_PER_CRANK;
+    uint32_t PEER_SEND_QUEUE_SCP_BYTES;
+    uint32_t PEER_SEND_QUEUE_FETCH_BYTES;
+    uint32_t PEER_SEND_QUEUE_FLOOD_BYTES;
+
+    // Advertise transactions to peers that support it, and send them only
+    // on demand, rather than sending every transaction to every peer.
+    bool FLOOD_PULL_MODE;
+    uint32_t FLOOD_ADVERT_PERIOD_MS;
+    uint32_t FLOOD_DEMAND_TIMEOUT_MS;
     static constexpr auto const POSSIBLY_PREFERRED_EXTRA = 2;
     static constexpr auto const REALLY_DEAD_NUM_FAILURES_CUTOFF = 120;
 
@@ -229,6 +265,16 @@ class Config : public std::enable_shared_from_this<Config>
     size_t ENTRY_CACHE_SIZE;
     size_t BEST_OFFERS_CACHE_SIZE;
 
+    // - VERIFY_SIG_CACHE_SIZE controls the number of signature verification
+    //   results kept. The cache is shared by the whole process, so the last
+    //   Application constructed sets its size.
+    size_t VERIFY_SIG_CACHE_SIZE;
+
+    // - IN_MEMORY_ORDER_BOOK keeps every offer resident in memory, ordered by
+    //   asset pair and price, so that best offer queries never touch the
+    //   database. BEST_OFFERS_CACHE_SIZE is ignored when this is enabled.
+    bool IN_MEMORY_ORDER_BOOK;
+
     // Data layer prefetcher configuration
     // - PREFETCH_BATCH_SIZE determines how many records we'll prefetch per
     // SQL load. Note that it should be significantly smaller than size of
@@ -0,0 +1,44 @@
+// Copyright 2019 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/FloodFilter.h"
+
+namespace stellar
+{
+
+void
+FloodFilter::add(Hash const& h)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mHashes.insert(h);
+}
+
+std::vector<bool>
+FloodFilter::contains(std::vector<Hash> const& hashes) const
+{
+    std::vector<bool> res;
+    res.reserve(hashes.size());
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto const& h : hashes)
+    {
+        res.push_back(mHashes.find(h) != mHashes.end());
+    }
+    return res;
+}
+
+void
+FloodFilter::reset(std::vector<Hash> const& hashes)
+{
+    std::unordered_set<Hash> fresh(hashes.begin(), hashes.end());
+    std::lock_guard<std::mutex> lock(mMutex);
+    mHashes.swap(fresh);
+}
+
+size_t
+FloodFilter::size() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mHashes.size();
+}
+}
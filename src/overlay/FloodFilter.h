@@ -0,0 +1,43 @@
+#pragma once
+
+// Copyright 2019 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/HashOfHash.h"
+#include "xdr/Stellar-types.h"
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * The hashes of the flooded messages Floodgate has records for, which
+ * (unlike Floodgate) may be consulted from any thread. Peers that decode on
+ * worker threads check each flooded message against it before decoding, and
+ * do not decode those Floodgate has seen already: most flooded messages
+ * arrive from several peers.
+ *
+ * Floodgate keeps it in step with its records; a message that arrives while
+ * its first copy is still on the way to the main thread is not caught here,
+ * but by Floodgate as before.
+ */
+class FloodFilter
+{
+    mutable std::mutex mMutex;
+    std::unordered_set<Hash> mHashes;
+
+  public:
+    void add(Hash const& h);
+
+    // For each of `hashes`, whether it is in the filter.
+    std::vector<bool> contains(std::vector<Hash> const& hashes) const;
+
+    // Replace the contents with `hashes`.
+    void reset(std::vector<Hash> const& hashes);
+
+    size_t size() const;
+};
+}
@@ -9,48 +9,152 @@
 #include "main/Application.h"
 #include "medida/counter.h"
 #include "medida/metrics_registry.h"
+#include "overlay/FloodFilter.h"
 #include "overlay/OverlayManager.h"
+#include "overlay/TxDemandsManager.h"
 #include "util/Logging.h"
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
 
 namespace stellar
 {
-Floodgate::FloodRecord::FloodRecord(StellarMessage const& msg, uint32_t ledger,
-                                    Peer::pointer peer)
-    : mLedgerSeq(ledger), mMessage(msg)
+namespace
 {
-    if (peer)
-        mPeersTold.insert(peer->toString());
+// Entries the flood map starts with, and never shrinks below.
+size_t const MIN_FLOOD_MAP_CAPACITY = 1024;
+
+size_t
+floodMapIndex(Hash const& h, size_t capacity)
+{
+    uint64_t x;
+    std::memcpy(&x, h.data(), sizeof(x));
+    return static_cast<size_t>(x) & (capacity - 1);
+}
 }
 
 Floodgate::Floodgate(Application& app)
-    : mApp(app)
+    : mFloodMap(MIN_FLOOD_MAP_CAPACITY)
+    , mFilter(std::make_shared<FloodFilter>())
+    , mApp(app)
     , mFloodMapSize(
           app.getMetrics().NewCounter({"overlay", "memory", "flood-known"}))
     , mSendFromBroadcast(app.getMetrics().NewMeter(
           {"overlay", "flood", "broadcast"}, "message"))
+    , mAdvertFromBroadcast(app.getMetrics().NewMeter(
+          {"overlay", "flood", "advertise"}, "message"))
     , mShuttingDown(false)
 {
 }
 
+Floodgate::FloodRecord*
+Floodgate::findRecord(Hash const& h)
+{
+    auto mask = mFloodMap.size() - 1;
+    for (auto i = floodMapIndex(h, mFloodMap.size());; i = (i + 1) & mask)
+    {
+        auto& entry = mFloodMap[i];
+        if (!entry.mUsed)
+        {
+            return nullptr;
+        }
+        if (entry.mHash == h)
+        {
+            return &entry.mRecord;
+        }
+    }
+}
+
+Floodgate::FloodRecord*
+Floodgate::insertRecord(Hash const& h)
+{
+    if ((mFloodMapCount + 1) * 2 > mFloodMap.size())
+    {
+        rebuildFloodMap(mFloodMap.size() * 2);
+    }
+    auto mask = mFloodMap.size() - 1;
+    for (auto i = floodMapIndex(h, mFloodMap.size());; i = (i + 1) & mask)
+    {
+        auto& entry = mFloodMap[i];
+        if (!entry.mUsed)
+        {
+            entry.mUsed = true;
+            entry.mHash = h;
+            entry.mRecord = FloodRecord{};
+            mFilter->add(h);
+            ++mFloodMapCount;
+            mFloodMapSize.set_count(mFloodMapCount);
+            return &entry.mRecord;
+        }
+        assert(entry.mHash != h);
+    }
+}
+
+void
+Floodgate::rebuildFloodMap(size_t capacity)
+{
+    std::vector<FloodEntry> old(capacity);
+    old.swap(mFloodMap);
+    auto mask = capacity - 1;
+    for (auto const& entry : old)
+    {
+        if (entry.mUsed)
+        {
+            auto i = floodMapIndex(entry.mHash, capacity);
+            while (mFloodMap[i].mUsed)
+            {
+                i = (i + 1) & mask;
+            }
+            mFloodMap[i] = entry;
+        }
+    }
+}
+
+bool
+Floodgate::told(FloodRecord const& record, size_t slot)
+{
+    return slot < MAX_PEER_SLOTS && record.mPeersTold.test(slot);
+}
+
+void
+Floodgate::setTold(FloodRecord& record, Peer::pointer const& peer)
+{
+    if (peer && peer->getFloodSlot() < MAX_PEER_SLOTS)
+    {
+        record.mPeersTold.set(peer->getFloodSlot());
+    }
+}
+
 // remove old flood records
 void
 Floodgate::clearBelow(uint32_t currentLedger)
 {
-    for (auto it = mFloodMap.cbegin(); it != mFloodMap.cend();)
+    // Removing entries one by one would break probe sequences, so the
+    // survivors are moved to a new table instead, sized for them.
+    std::vector<Hash> kept;
+    for (auto& entry : mFloodMap)
     {
         // give one ledger of leeway
-        if (it->second->mLedgerSeq + 10 < currentLedger)
+        if (entry.mUsed && entry.mRecord.mLedgerSeq + 10 < currentLedger)
         {
-            mFloodMap.erase(it++);
+            entry.mUsed = false;
         }
-        else
+        else if (entry.mUsed)
         {
-            ++it;
+            kept.emplace_back(entry.mHash);
         }
     }
-    mFloodMapSize.set_count(mFloodMap.size());
+    mFilter->reset(kept);
+    auto capacity = MIN_FLOOD_MAP_CAPACITY;
+    while (kept.size() * 4 > capacity)
+    {
+        capacity *= 2;
+    }
+    rebuildFloodMap(capacity);
+    mFloodMapCount = kept.size();
+    mFloodMapSize.set_count(mFloodMapCount);
 }
 
 bool
@@ -60,85 +164,161 @@ Floodgate::addRecord(StellarMessage const& msg, Peer::pointer peer)
     {
         return false;
     }
-    Hash index = sha256(xdr::xdr_to_opaque(msg));
-    auto result = mFloodMap.find(index);
-    if (result == mFloodMap.end())
+    return addRecord(sha256(xdr::xdr_to_opaque(msg)), peer);
+}
+
+bool
+Floodgate::addRecord(Hash const& index, Peer::pointer peer)
+{
+    if (mShuttingDown)
+    {
+        return false;
+    }
+    auto record = findRecord(index);
+    if (!record)
     { // we have never seen this message
-        mFloodMap[index] = std::make_shared<FloodRecord>(
-            msg, mApp.getHerder().getCurrentLedgerSeq(), peer);
-        mFloodMapSize.set_count(mFloodMap.size());
+        record = insertRecord(index);
+        record->mLedgerSeq = mApp.getHerder().getCurrentLedgerSeq();
+        setTold(*record, peer);
         return true;
     }
     else
     {
-        result->second->mPeersTold.insert(peer->toString());
+        setTold(*record, peer);
         return false;
     }
 }
 
 // send message to anyone you haven't gotten it from
 void
-Floodgate::broadcast(StellarMessage const& msg, bool force)
+Floodgate::broadcast(StellarMessage const& msg)
 {
     if (mShuttingDown)
     {
         return;
     }
-    Hash index = sha256(xdr::xdr_to_opaque(msg));
+    // Encoded once, here, for all the peers it goes to.
+    auto encoded =
+        std::make_shared<xdr::opaque_vec<> const>(xdr::xdr_to_opaque(msg));
+    Hash index = sha256(*encoded);
     CLOG(TRACE, "Overlay") << "broadcast " << hexAbbrev(index);
 
-    auto result = mFloodMap.find(index);
-    if (result == mFloodMap.end() || force)
+    auto record = findRecord(index);
+    if (!record)
     { // no one has sent us this message
-        FloodRecord::pointer record = std::make_shared<FloodRecord>(
-            msg, mApp.getHerder().getCurrentLedgerSeq(), Peer::pointer());
-        result = mFloodMap.insert(std::make_pair(index, record)).first;
-        mFloodMapSize.set_count(mFloodMap.size());
+        record = insertRecord(index);
+        record->mLedgerSeq = mApp.getHerder().getCurrentLedgerSeq();
     }
-    // send it to people that haven't sent it to us
-    auto& peersTold = result->second->mPeersTold;
 
-    // make a copy, in case peers gets modified
-    auto peers = mApp.getOverlayManager().getAuthenticatedPeers();
-
-    for (auto peer : peers)
+    // send it to people that haven't sent it to us; by slot, as sending may
+    // drop a peer, and so free its slot. Transactions are only advertised to
+    // peers in pull mode, which demand them if they need them.
+    bool advertised = false;
+    for (size_t slot = 0; slot < mPeers.size(); ++slot)
     {
-        assert(peer.second->isAuthenticated());
-        if (peersTold.find(peer.second->toString()) == peersTold.end())
+        auto peer = mPeers[slot];
+        if (peer && !told(*record, slot))
         {
-            mSendFromBroadcast.Mark();
-            peer.second->sendMessage(msg);
-            peersTold.insert(peer.second->toString());
+            assert(peer->isAuthenticated());
+            if (msg.type() == TRANSACTION && peer->usesPullMode())
+            {
+                if (!advertised)
+                {
+                    mApp.getOverlayManager().getTxDemandsManager().advertised(
+                        index, msg, encoded);
+                    advertised = true;
+                }
+                mAdvertFromBroadcast.Mark();
+                peer->advertiseTx(index);
+            }
+            else
+            {
+                mSendFromBroadcast.Mark();
+                peer->sendMessage(msg, encoded);
+            }
+            setTold(*record, peer);
         }
     }
     CLOG(TRACE, "Overlay") << "broadcast " << hexAbbrev(index) << " told "
-                           << peersTold.size();
+                           << record->mPeersTold.count();
+}
+
+bool
+Floodgate::peerKnows(Hash const& h, Peer::pointer const& peer)
+{
+    auto record = findRecord(h);
+    if (record)
+    {
+        setTold(*record, peer);
+    }
+    return record != nullptr;
 }
 
 std::set<Peer::pointer>
 Floodgate::getPeersKnows(Hash const& h)
 {
     std::set<Peer::pointer> res;
-    auto record = mFloodMap.find(h);
-    if (record != mFloodMap.end())
+    auto record = findRecord(h);
+    if (record)
     {
-        auto& ids = record->second->mPeersTold;
-        auto const& peers = mApp.getOverlayManager().getAuthenticatedPeers();
-        for (auto& p : peers)
+        for (size_t slot = 0; slot < mPeers.size(); ++slot)
         {
-            if (ids.find(p.second->toString()) != ids.end())
+            if (mPeers[slot] && told(*record, slot))
             {
-                res.insert(p.second);
+                res.insert(mPeers[slot]);
             }
         }
     }
     return res;
 }
 
+void
+Floodgate::addPeer(Peer::pointer peer)
+{
+    auto slot = std::find(mPeers.begin(), mPeers.end(), nullptr);
+    peer->setFloodSlot(slot - mPeers.begin());
+    if (slot == mPeers.end())
+    {
+        mPeers.emplace_back(peer);
+    }
+    else
+    {
+        *slot = peer;
+    }
+}
+
+void
+Floodgate::removePeer(Peer* peer)
+{
+    auto slot = peer->getFloodSlot();
+    if (slot >= mPeers.size() || mPeers[slot].get() != peer)
+    {
+        return;
+    }
+    mPeers[slot].reset();
+    peer->setFloodSlot(std::numeric_limits<size_t>::max());
+    while (!mPeers.empty() && !mPeers.back())
+    {
+        mPeers.pop_back();
+    }
+    // Whichever peer takes the slot next has been told nothing.
+    if (slot < MAX_PEER_SLOTS)
+    {
+        for (auto& entry : mFloodMap)
+        {
+            entry.mRecord.mPeersTold.reset(slot);
+        }
+    }
+}
+
 void
 Floodgate::shutdown()
 {
     mShuttingDown = true;
-    mFloodMap.clear();
+    mFloodMap = std::vector<FloodEntry>(MIN_FLOOD_MAP_CAPACITY);
+    mFloodMapCount = 0;
+    mFloodMapSize.set_count(mFloodMapCount);
+    mFilter->reset({});
+    mPeers.clear();
 }
 }
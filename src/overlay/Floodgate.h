@@ -6,7 +6,10 @@
 
 #include "overlay/Peer.h"
 #include "overlay/StellarXDR.h"
-#include <map>
+#include <bitset>
+#include <memory>
+#include <set>
+#include <vector>
 
 /**
  * FloodGate keeps track of which peers have sent us which broadcast messages,
@@ -29,39 +32,85 @@ class Counter;
 namespace stellar
 {
 
+class FloodFilter;
+
 class Floodgate
 {
-    class FloodRecord
-    {
-      public:
-        typedef std::shared_ptr<FloodRecord> pointer;
+  public:
+    // Authenticated peers are kept in numbered slots, so that each record can
+    // note the peers it has been sent to or from in a bitset. Peers in slots
+    // past these (only with a great many connections configured) are not
+    // noted, and so are sent every message.
+    static size_t const MAX_PEER_SLOTS = 256;
 
+  private:
+    struct FloodRecord
+    {
         uint32_t mLedgerSeq;
-        StellarMessage mMessage;
-        std::set<std::string> mPeersTold;
+        std::bitset<MAX_PEER_SLOTS> mPeersTold;
+    };
 
-        FloodRecord(StellarMessage const& msg, uint32_t ledger,
-                    Peer::pointer peer);
+    // The records, by message hash, in an open-addressing table with linear
+    // probing: a power-of-two number of entries, at most half of them used.
+    // Hashes are uniformly distributed, so their leading bytes serve as the
+    // table's hash function.
+    struct FloodEntry
+    {
+        Hash mHash;
+        FloodRecord mRecord;
+        bool mUsed{false};
     };
 
-    std::map<uint256, FloodRecord::pointer> mFloodMap;
+    std::vector<FloodEntry> mFloodMap;
+    size_t mFloodMapCount{0};
+    // The keys of mFloodMap, for worker threads.
+    std::shared_ptr<FloodFilter> mFilter;
+    // Indexed by slot; null for a free slot.
+    std::vector<Peer::pointer> mPeers;
     Application& mApp;
     medida::Counter& mFloodMapSize;
     medida::Meter& mSendFromBroadcast;
+    medida::Meter& mAdvertFromBroadcast;
     bool mShuttingDown;
 
+    friend class OverlayManagerTests;
+
+    // The record for `h`, or nullptr if there is none.
+    FloodRecord* findRecord(Hash const& h);
+    // Adds a record for `h`, which must not have one yet.
+    FloodRecord* insertRecord(Hash const& h);
+    void rebuildFloodMap(size_t capacity);
+    static bool told(FloodRecord const& record, size_t slot);
+    static void setTold(FloodRecord& record, Peer::pointer const& peer);
+
   public:
     Floodgate(Application& app);
     // Floodgate will be cleared after every ledger close
     void clearBelow(uint32_t currentLedger);
     // returns true if this is a new record
     bool addRecord(StellarMessage const& msg, Peer::pointer fromPeer);
+    // The same, for the message with hash `index`.
+    bool addRecord(Hash const& index, Peer::pointer fromPeer);
+
+    void broadcast(StellarMessage const& msg);
 
-    void broadcast(StellarMessage const& msg, bool force);
+    // If we have the item with hash `h`, notes that `peer` has it too and
+    // returns true.
+    bool peerKnows(Hash const& h, Peer::pointer const& peer);
 
     // returns the list of peers that sent us the item with hash `h`
     std::set<Peer::pointer> getPeersKnows(Hash const& h);
 
+    // Called as peers become, and stop being, authenticated.
+    void addPeer(Peer::pointer peer);
+    void removePeer(Peer* peer);
+
+    std::shared_ptr<FloodFilter>
+    getFilter() const
+    {
+        return mFilter;
+    }
+
     void shutdown();
 };
 }
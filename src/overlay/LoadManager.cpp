@@ -59,20 +59,23 @@ LoadManager::reportLoads(std::map<NodeID, Peer::pointer> const& peers,
     CLOG(INFO, "Overlay") << "";
     CLOG(INFO, "Overlay") << "Cumulative peer-load costs:";
     CLOG(INFO, "Overlay")
-        << "------------------------------------------------------";
+        << "------------------------------------------------------------"
+           "-----------------------";
     CLOG(INFO, "Overlay") << fmt::format(
-        "{:>10s} {:>10s} {:>10s} {:>10s} {:>10s}", "peer", "time", "send",
-        "recv", "query");
+        "{:>10s} {:>10s} {:>10s} {:>10s} {:>10s} {:>10s} {:>10s}", "peer",
+        "time", "send", "recv", "query", "queued", "shed");
     for (auto const& peer : peers)
     {
         auto cost = getPeerCosts(peer.first);
         CLOG(INFO, "Overlay") << fmt::format(
-            "{:>10s} {:>10s} {:>10s} {:>10s} {:>10d}",
+            "{:>10s} {:>10s} {:>10s} {:>10s} {:>10d} {:>10s} {:>10d}",
             app.getConfig().toShortString(peer.first),
             timeMag(static_cast<uint64_t>(cost->mTimeSpent.one_minute_rate())),
             byteMag(static_cast<uint64_t>(cost->mBytesSend.one_minute_rate())),
             byteMag(static_cast<uint64_t>(cost->mBytesRecv.one_minute_rate())),
-            cost->mSQLQueries.count());
+            cost->mSQLQueries.count(),
+            byteMag(peer.second->getSendQueueBytes()),
+            cost->mMessagesShed.count());
     }
     CLOG(INFO, "Overlay") << "";
 }
@@ -137,6 +140,7 @@ LoadManager::PeerCosts::PeerCosts()
     , mBytesSend("byte")
     , mBytesRecv("byte")
     , mSQLQueries("query")
+    , mMessagesShed("message")
 {
 }
 
@@ -52,6 +52,10 @@ class LoadManager
         medida::Meter mBytesSend;
         medida::Meter mBytesRecv;
         medida::Meter mSQLQueries;
+        // Messages to the peer dropped for want of room in its send queues;
+        // a sign of a peer that cannot keep up rather than of load it causes,
+        // so not counted against it by isLessThan.
+        medida::Meter mMessagesShed;
     };
 
     std::shared_ptr<PeerCosts> getPeerCosts(NodeID const& peer);
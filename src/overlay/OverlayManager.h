@@ -46,10 +46,12 @@
 namespace stellar
 {
 
+class FloodFilter;
 class LoadManager;
 class PeerAuth;
 class PeerBareAddress;
 class PeerManager;
+class TxDemandsManager;
 
 class OverlayManager
 {
@@ -66,15 +68,17 @@ class OverlayManager
 
     // Send a given message to all peers, via the FloodGate. This is called by
     // Herder.
-    virtual void broadcastMessage(StellarMessage const& msg,
-                                  bool force = false) = 0;
+    virtual void broadcastMessage(StellarMessage const& msg) = 0;
 
     // Make a note in the FloodGate that a given peer has provided us with a
     // given broadcast message, so that it is inhibited from being resent to
     // that peer. This does _not_ cause the message to be broadcast anew; to do
-    // that, call broadcastMessage, above.
-    virtual void recvFloodedMsg(StellarMessage const& msg,
+    // that, call broadcastMessage, above. Returns whether the message had
+    // not been seen before.
+    virtual bool recvFloodedMsg(StellarMessage const& msg,
                                 Peer::pointer peer) = 0;
+    // The same, for the message whose encoding hashes to `index`.
+    virtual bool recvFloodedMsg(Hash const& index, Peer::pointer peer) = 0;
 
     // Return a list of random peers from the set of authenticated peers.
     virtual std::vector<Peer::pointer> getRandomAuthenticatedPeers() = 0;
@@ -146,6 +150,13 @@ class OverlayManager
     // Return the persistent peer manager
     virtual PeerManager& getPeerManager() = 0;
 
+    // Return the pull-mode transaction flooding state.
+    virtual TxDemandsManager& getTxDemandsManager() = 0;
+
+    // Return the hashes of flooded messages already seen, for checking
+    // from worker threads.
+    virtual std::shared_ptr<FloodFilter> getFloodFilter() = 0;
+
     // start up all background tasks for overlay
     virtual void start() = 0;
     // drops all connections
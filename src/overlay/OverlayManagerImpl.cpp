@@ -122,6 +122,7 @@ OverlayManagerImpl::PeersList::removePeer(Peer* peer)
         CLOG(DEBUG, "Overlay") << "Dropping authenticated " << mDirectionString
                                << " peer: " << peer->toString();
         mAuthenticated.erase(authentiatedIt);
+        mOverlayManager.mFloodGate.removePeer(peer);
         mConnectionsDropped.Mark();
         return;
     }
@@ -158,6 +159,7 @@ OverlayManagerImpl::PeersList::moveToAuthenticated(Peer::pointer peer)
 
     mPending.erase(pendingIt);
     mAuthenticated[peer->getPeerID()] = peer;
+    mOverlayManager.mFloodGate.addPeer(peer);
 
     CLOG(INFO, "Overlay") << "Connected to " << peer->toString();
 
@@ -248,6 +250,7 @@ OverlayManagerImpl::OverlayManagerImpl(Application& app)
     , mTimer(app)
     , mPeerIPTimer(app)
     , mFloodGate(app)
+    , mTxDemands(app, mFloodGate)
 {
     mPeerSources[PeerType::INBOUND] = std::make_unique<RandomPeerSource>(
         mPeerManager, RandomPeerSource::nextAttemptCutoff(PeerType::INBOUND));
@@ -584,6 +587,7 @@ void
 OverlayManagerImpl::ledgerClosed(uint32_t lastClosedledgerSeq)
 {
     mFloodGate.clearBelow(lastClosedledgerSeq);
+    mTxDemands.clearBelow(lastClosedledgerSeq);
 }
 
 void
@@ -806,18 +810,24 @@ OverlayManagerImpl::getRandomAuthenticatedPeers()
     return goodPeers;
 }
 
-void
+bool
 OverlayManagerImpl::recvFloodedMsg(StellarMessage const& msg,
                                    Peer::pointer peer)
 {
-    mFloodGate.addRecord(msg, peer);
+    return mFloodGate.addRecord(msg, peer);
+}
+
+bool
+OverlayManagerImpl::recvFloodedMsg(Hash const& index, Peer::pointer peer)
+{
+    return mFloodGate.addRecord(index, peer);
 }
 
 void
-OverlayManagerImpl::broadcastMessage(StellarMessage const& msg, bool force)
+OverlayManagerImpl::broadcastMessage(StellarMessage const& msg)
 {
     mMessagesBroadcast.Mark();
-    mFloodGate.broadcast(msg, force);
+    mFloodGate.broadcast(msg);
 }
 
 void
@@ -850,6 +860,18 @@ OverlayManagerImpl::getPeerManager()
     return mPeerManager;
 }
 
+TxDemandsManager&
+OverlayManagerImpl::getTxDemandsManager()
+{
+    return mTxDemands;
+}
+
+std::shared_ptr<FloodFilter>
+OverlayManagerImpl::getFloodFilter()
+{
+    return mFloodGate.getFilter();
+}
+
 void
 OverlayManagerImpl::shutdown()
 {
@@ -860,6 +882,7 @@ OverlayManagerImpl::shutdown()
     mShuttingDown = true;
     mDoor.close();
     mFloodGate.shutdown();
+    mTxDemands.shutdown();
     mInboundPeers.shutdown();
     mOutboundPeers.shutdown();
 
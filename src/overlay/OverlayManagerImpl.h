@@ -14,6 +14,7 @@
 #include "overlay/ItemFetcher.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/StellarXDR.h"
+#include "overlay/TxDemandsManager.h"
 #include "util/Timer.h"
 
 #include <future>
@@ -87,15 +88,16 @@ class OverlayManagerImpl : public OverlayManager
     friend class OverlayManagerTests;
 
     Floodgate mFloodGate;
+    TxDemandsManager mTxDemands;
 
   public:
     OverlayManagerImpl(Application& app);
     ~OverlayManagerImpl();
 
     void ledgerClosed(uint32_t lastClosedledgerSeq) override;
-    void recvFloodedMsg(StellarMessage const& msg, Peer::pointer peer) override;
-    void broadcastMessage(StellarMessage const& msg,
-                          bool force = false) override;
+    bool recvFloodedMsg(StellarMessage const& msg, Peer::pointer peer) override;
+    bool recvFloodedMsg(Hash const& index, Peer::pointer peer) override;
+    void broadcastMessage(StellarMessage const& msg) override;
     void connectTo(PeerBareAddress const& address) override;
 
     void addInboundConnection(Peer::pointer peer) override;
@@ -128,6 +130,8 @@ class OverlayManagerImpl : public OverlayManager
 
     LoadManager& getLoadManager() override;
     PeerManager& getPeerManager() override;
+    TxDemandsManager& getTxDemandsManager() override;
+    std::shared_ptr<FloodFilter> getFloodFilter() override;
 
     void start() override;
     void shutdown() override;
@@ -19,6 +19,7 @@
 #include "overlay/PeerAuth.h"
 #include "overlay/PeerManager.h"
 #include "overlay/StellarXDR.h"
+#include "overlay/TxDemandsManager.h"
 #include "util/Logging.h"
 #include "util/XDROperators.h"
 
@@ -58,6 +59,7 @@ Peer::Peer(Application& app, PeerRole role)
     , mState(role == WE_CALLED_REMOTE ? CONNECTING : CONNECTED)
     , mRemoteOverlayVersion(0)
     , mIdleTimer(app)
+    , mAdvertTimer(app)
     , mLastRead(app.getClock().now())
     , mLastWrite(app.getClock().now())
     , mLastEmpty(app.getClock().now())
@@ -98,6 +100,10 @@ Peer::Peer(Application& app, PeerRole role)
           app.getMetrics().NewTimer({"overlay", "recv", "scp-message"}))
     , mRecvGetSCPStateTimer(
           app.getMetrics().NewTimer({"overlay", "recv", "get-scp-state"}))
+    , mRecvFloodAdvertTimer(
+          app.getMetrics().NewTimer({"overlay", "recv", "flood-advert"}))
+    , mRecvFloodDemandTimer(
+          app.getMetrics().NewTimer({"overlay", "recv", "flood-demand"}))
 
     , mRecvSCPPrepareTimer(
           app.getMetrics().NewTimer({"overlay", "recv", "scp-prepare"}))
@@ -134,6 +140,10 @@ Peer::Peer(Application& app, PeerRole role)
           {"overlay", "send", "scp-message"}, "message"))
     , mSendGetSCPStateMeter(app.getMetrics().NewMeter(
           {"overlay", "send", "get-scp-state"}, "message"))
+    , mSendFloodAdvertMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "flood-advert"}, "message"))
+    , mSendFloodDemandMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "flood-demand"}, "message"))
 {
     auto bytes = randomBytes(mSendNonce.size());
     std::copy(bytes.begin(), bytes.end(), mSendNonce.begin());
@@ -422,12 +432,17 @@ msgSummary(StellarMessage const& msg)
         }
     case GET_SCP_STATE:
         return "GET_SCP_STATE";
+
+    case FLOOD_ADVERT:
+        return "FLOODADVERT";
+    case FLOOD_DEMAND:
+        return "FLOODDEMAND";
     }
     return "UNKNOWN";
 }
 
 void
-Peer::sendMessage(StellarMessage const& msg)
+Peer::recordSend(StellarMessage const& msg)
 {
     if (Logging::logTrace("Overlay"))
         CLOG(TRACE, "Overlay")
@@ -478,19 +493,65 @@ Peer::sendMessage(StellarMessage const& msg)
     case GET_SCP_STATE:
         mSendGetSCPStateMeter.Mark();
         break;
+    case FLOOD_ADVERT:
+        mSendFloodAdvertMeter.Mark();
+        break;
+    case FLOOD_DEMAND:
+        mSendFloodDemandMeter.Mark();
+        break;
     };
+}
+
+void
+Peer::sendMessage(StellarMessage const& msg)
+{
+    sendMessage(msg, std::make_shared<xdr::opaque_vec<> const>(
+                         xdr::xdr_to_opaque(msg)));
+}
+
+void
+Peer::sendMessage(StellarMessage const& msg, EncodedMessagePtr const& encoded)
+{
+    recordSend(msg);
+    queueMessage(msg.type(), encoded);
+}
 
-    AuthenticatedMessage amsg;
-    amsg.v0().message = msg;
-    if (msg.type() != HELLO && msg.type() != ERROR_MSG)
+FramedMessage
+Peer::frameMessage(MessageType type, EncodedMessagePtr const& encoded)
+{
+    // Lay out the bytes of xdr_to_msg(AuthenticatedMessage) around the
+    // encoding of the message: record mark (with the last-fragment bit set),
+    // v == 0, sequence, message and mac; the last two stay zero for messages
+    // sent before keys are agreed.
+    FramedMessage framed;
+    uint32_t bodySize =
+        static_cast<uint32_t>(FramedMessage::sizeFor(encoded) - 4);
+    assert(bodySize < 0x80000000);
+    auto header = xdr::xdr_to_opaque(bodySize | 0x80000000, uint32_t(0));
+    auto seq = xdr::xdr_to_opaque(uint64_t(0));
+    if (type != HELLO && type != ERROR_MSG)
     {
-        amsg.v0().sequence = mSendMacSeq;
-        amsg.v0().mac =
-            hmacSha256(mSendMacKey, xdr::xdr_to_opaque(mSendMacSeq, msg));
+        seq = xdr::xdr_to_opaque(mSendMacSeq);
+        framed.mMac = hmacSha256(mSendMacKey, seq, *encoded);
         ++mSendMacSeq;
     }
-    xdr::msg_ptr xdrBytes(xdr::xdr_to_msg(amsg));
-    this->sendMessage(std::move(xdrBytes));
+    assert(header.size() + seq.size() == FramedMessage::PREFIX_SIZE);
+    std::copy(header.begin(), header.end(), framed.mPrefix.begin());
+    std::copy(seq.begin(), seq.end(), framed.mPrefix.begin() + header.size());
+    framed.mBody = encoded;
+    mStats.recordSend(type, framed.size());
+    return framed;
+}
+
+xdr::msg_ptr
+FramedMessage::toMsg() const
+{
+    xdr::msg_ptr xdrBytes(xdr::message_t::alloc(size() - 4));
+    auto out = xdrBytes->raw_data();
+    out = std::copy(mPrefix.begin(), mPrefix.end(), out);
+    out = std::copy(mBody->begin(), mBody->end(), out);
+    std::copy(mMac.mac.begin(), mMac.mac.end(), out);
+    return xdrBytes;
 }
 
 void
@@ -508,7 +569,7 @@ Peer::recvMessage(xdr::msg_ptr const& msg)
     {
         AuthenticatedMessage am;
         xdr::xdr_from_msg(msg, am);
-        recvMessage(am);
+        recvMessage(am, msg->size());
     }
     catch (xdr::xdr_runtime_error& e)
     {
@@ -539,13 +600,26 @@ Peer::shouldAbort() const
 }
 
 void
-Peer::recvMessage(AuthenticatedMessage const& msg)
+Peer::recvMessage(AuthenticatedMessage const& msg, size_t size)
 {
     if (shouldAbort())
     {
         return;
     }
 
+    if (mAuthenticating)
+    {
+        if (mHeldMessages.size() >= MAX_HELD_MESSAGES)
+        {
+            drop("too many messages during handshake",
+                 Peer::DropDirection::WE_DROPPED_REMOTE,
+                 Peer::DropMode::IGNORE_WRITE_QUEUE);
+            return;
+        }
+        mHeldMessages.emplace_back(msg, size);
+        return;
+    }
+
     if (mState >= GOT_HELLO && msg.v0().message.type() != ERROR_MSG)
     {
         if (msg.v0().sequence != mRecvMacSeq)
@@ -567,17 +641,34 @@ Peer::recvMessage(AuthenticatedMessage const& msg)
         }
         ++mRecvMacSeq;
     }
-    recvMessage(msg.v0().message);
+    recvMessage(msg.v0().message, size);
+}
+
+void
+Peer::recvDuplicateFlood(MessageType type, Hash const& index, size_t size)
+{
+    if (shouldAbort())
+    {
+        return;
+    }
+    // All there is to do for a duplicate is what recvTransaction and
+    // recvSCPMessage do for one: note that this peer has it.
+    mStats.recordRecv(type, size);
+    mStats.recordFlooded(
+        !mApp.getOverlayManager().recvFloodedMsg(index, shared_from_this()));
 }
 
 void
-Peer::recvMessage(StellarMessage const& stellarMsg)
+Peer::recvMessage(StellarMessage const& stellarMsg, size_t size,
+                  Hash const* floodHash)
 {
     if (shouldAbort())
     {
         return;
     }
 
+    mStats.recordRecv(stellarMsg.type(), size);
+
     if (Logging::logTrace("Overlay"))
         CLOG(TRACE, "Overlay")
             << "("
@@ -660,7 +751,7 @@ Peer::recvMessage(StellarMessage const& stellarMsg)
     case TRANSACTION:
     {
         auto t = mRecvTransactionTimer.TimeScope();
-        recvTransaction(stellarMsg);
+        recvTransaction(stellarMsg, floodHash);
     }
     break;
 
@@ -681,7 +772,7 @@ Peer::recvMessage(StellarMessage const& stellarMsg)
     case SCP_MESSAGE:
     {
         auto t = mRecvSCPMessageTimer.TimeScope();
-        recvSCPMessage(stellarMsg);
+        recvSCPMessage(stellarMsg, floodHash);
     }
     break;
 
@@ -691,6 +782,20 @@ Peer::recvMessage(StellarMessage const& stellarMsg)
         recvGetSCPState(stellarMsg);
     }
     break;
+
+    case FLOOD_ADVERT:
+    {
+        auto t = mRecvFloodAdvertTimer.TimeScope();
+        recvFloodAdvert(stellarMsg);
+    }
+    break;
+
+    case FLOOD_DEMAND:
+    {
+        auto t = mRecvFloodDemandTimer.TimeScope();
+        recvFloodDemand(stellarMsg);
+    }
+    break;
     }
 }
 
@@ -727,10 +832,14 @@ Peer::recvTxSet(StellarMessage const& msg)
 }
 
 void
-Peer::recvTransaction(StellarMessage const& msg)
+Peer::recvTransaction(StellarMessage const& msg, Hash const* floodHash)
 {
+    auto index = floodHash ? *floodHash : sha256(xdr::xdr_to_opaque(msg));
     TransactionFramePtr transaction = TransactionFrame::makeTransactionFromWire(
         mApp.getNetworkID(), msg.transaction());
+    // stop demanding it, if we were
+    auto advertisers =
+        mApp.getOverlayManager().getTxDemandsManager().recvTransaction(index);
     if (transaction)
     {
         // add it to our current set
@@ -741,7 +850,13 @@ Peer::recvTransaction(StellarMessage const& msg)
             recvRes == TransactionQueue::AddResult::ADD_STATUS_DUPLICATE)
         {
             // record that this peer sent us this transaction
-            mApp.getOverlayManager().recvFloodedMsg(msg, shared_from_this());
+            mStats.recordFlooded(!mApp.getOverlayManager().recvFloodedMsg(
+                index, shared_from_this()));
+            // and that any that advertised it have it
+            for (auto const& peer : advertisers)
+            {
+                mApp.getOverlayManager().recvFloodedMsg(index, peer);
+            }
 
             if (recvRes == TransactionQueue::AddResult::ADD_STATUS_PENDING)
             {
@@ -752,6 +867,67 @@ Peer::recvTransaction(StellarMessage const& msg)
     }
 }
 
+void
+Peer::recvFloodAdvert(StellarMessage const& msg)
+{
+    mApp.getOverlayManager().getTxDemandsManager().recvFloodAdvert(
+        msg.floodAdvert(), shared_from_this());
+}
+
+void
+Peer::recvFloodDemand(StellarMessage const& msg)
+{
+    mApp.getOverlayManager().getTxDemandsManager().recvFloodDemand(
+        msg.floodDemand(), shared_from_this());
+}
+
+bool
+Peer::usesPullMode() const
+{
+    return mApp.getConfig().FLOOD_PULL_MODE &&
+           mRemoteOverlayVersion >= FIRST_VERSION_SUPPORTING_FLOOD_ADVERTS;
+}
+
+void
+Peer::advertiseTx(Hash const& hash)
+{
+    mTxHashesToAdvertise.emplace_back(hash);
+    if (mTxHashesToAdvertise.size() == TX_ADVERT_VECTOR_MAX_SIZE)
+    {
+        sendTxAdvert();
+    }
+    else if (mTxHashesToAdvertise.size() == 1)
+    {
+        std::weak_ptr<Peer> weak = shared_from_this();
+        mAdvertTimer.expires_from_now(
+            std::chrono::milliseconds(mApp.getConfig().FLOOD_ADVERT_PERIOD_MS));
+        mAdvertTimer.async_wait(
+            [weak]() {
+                if (auto self = weak.lock())
+                {
+                    self->sendTxAdvert();
+                }
+            },
+            VirtualTimer::onFailureNoop);
+    }
+}
+
+void
+Peer::sendTxAdvert()
+{
+    mAdvertTimer.cancel();
+    if (mTxHashesToAdvertise.empty() || shouldAbort())
+    {
+        return;
+    }
+    StellarMessage msg;
+    msg.type(FLOOD_ADVERT);
+    msg.floodAdvert().txHashes.assign(mTxHashesToAdvertise.begin(),
+                                      mTxHashesToAdvertise.end());
+    mTxHashesToAdvertise.clear();
+    sendMessage(msg);
+}
+
 void
 Peer::recvGetSCPQuorumSet(StellarMessage const& msg)
 {
@@ -778,7 +954,7 @@ Peer::recvSCPQuorumSet(StellarMessage const& msg)
 }
 
 void
-Peer::recvSCPMessage(StellarMessage const& msg)
+Peer::recvSCPMessage(StellarMessage const& msg, Hash const* floodHash)
 {
     SCPEnvelope const& envelope = msg.envelope();
     if (Logging::logTrace("Overlay"))
@@ -798,7 +974,10 @@ Peer::recvSCPMessage(StellarMessage const& msg)
     auto res = mApp.getHerder().recvSCPEnvelope(envelope);
     if (res != Herder::ENVELOPE_STATUS_DISCARDED)
     {
-        mApp.getOverlayManager().recvFloodedMsg(msg, shared_from_this());
+        auto self = shared_from_this();
+        auto& om = mApp.getOverlayManager();
+        mStats.recordFlooded(floodHash ? !om.recvFloodedMsg(*floodHash, self)
+                                       : !om.recvFloodedMsg(msg, self));
     }
 }
 
@@ -880,7 +1059,7 @@ Peer::recvHello(Hello const& elo)
     }
 
     auto& peerAuth = mApp.getOverlayManager().getPeerAuth();
-    if (!peerAuth.verifyRemoteAuthCert(elo.peerID, elo.cert))
+    if (!peerAuth.isRemoteAuthCertCurrent(elo.cert))
     {
         drop("failed to verify auth cert",
              Peer::DropDirection::WE_DROPPED_REMOTE,
@@ -895,6 +1074,76 @@ Peer::recvHello(Hello const& elo)
         return;
     }
 
+    HmacSha256Key sharedKey;
+    if (peerAuth.resumeSession(elo.peerID, elo.cert, mRole, sharedKey))
+    {
+        helloAuthenticated(elo, sharedKey);
+        return;
+    }
+
+    if (!authenticatesOnWorker())
+    {
+        if (!peerAuth.authenticate(elo.peerID, elo.cert, mRole, sharedKey))
+        {
+            drop("failed to verify auth cert",
+                 Peer::DropDirection::WE_DROPPED_REMOTE,
+                 Peer::DropMode::IGNORE_WRITE_QUEUE);
+            return;
+        }
+        peerAuth.rememberSession(elo.peerID, elo.cert, mRole, sharedKey);
+        helloAuthenticated(elo, sharedKey);
+        return;
+    }
+
+    // The signature check and ECDH are the expensive part of a handshake;
+    // do them on a worker, and carry on back on the main thread.
+    mAuthenticating = true;
+    std::weak_ptr<Peer> weak = shared_from_this();
+    auto role = mRole;
+    auto& app = mApp;
+    mApp.postOnBackgroundThread(
+        [&app, &peerAuth, weak, elo, role]() {
+            HmacSha256Key sharedKey;
+            bool ok = peerAuth.authenticate(elo.peerID, elo.cert, role,
+                                            sharedKey);
+            app.postOnMainThread(
+                [&peerAuth, weak, elo, role, ok, sharedKey]() {
+                    auto self = weak.lock();
+                    if (!self || self->shouldAbort())
+                    {
+                        return;
+                    }
+                    self->mAuthenticating = false;
+                    if (!ok)
+                    {
+                        self->drop("failed to verify auth cert",
+                                   Peer::DropDirection::WE_DROPPED_REMOTE,
+                                   Peer::DropMode::IGNORE_WRITE_QUEUE);
+                        return;
+                    }
+                    peerAuth.rememberSession(elo.peerID, elo.cert, role,
+                                             sharedKey);
+                    self->helloAuthenticated(elo, sharedKey);
+
+                    // Then whatever arrived meanwhile, in order.
+                    auto held = std::move(self->mHeldMessages);
+                    self->mHeldMessages.clear();
+                    LoadManager::PeerContext loadCtx(self->getApp(),
+                                                     self->mPeerID);
+                    for (auto const& msg : held)
+                    {
+                        self->recvMessage(msg.first, msg.second);
+                    }
+                },
+                "Peer: authenticated");
+        },
+        "Peer: authenticate");
+}
+
+void
+Peer::helloAuthenticated(Hello const& elo, HmacSha256Key const& sharedKey)
+{
+    auto& peerAuth = mApp.getOverlayManager().getPeerAuth();
     mRemoteOverlayMinVersion = elo.overlayMinVersion;
     mRemoteOverlayVersion = elo.overlayVersion;
     mRemoteVersion = elo.versionStr;
@@ -902,10 +1151,10 @@ Peer::recvHello(Hello const& elo)
     mRecvNonce = elo.nonce;
     mSendMacSeq = 0;
     mRecvMacSeq = 0;
-    mSendMacKey = peerAuth.getSendingMacKey(elo.cert.pubkey, mSendNonce,
-                                            mRecvNonce, mRole);
-    mRecvMacKey = peerAuth.getReceivingMacKey(elo.cert.pubkey, mSendNonce,
-                                              mRecvNonce, mRole);
+    mSendMacKey =
+        peerAuth.getSendingMacKey(sharedKey, mSendNonce, mRecvNonce, mRole);
+    mRecvMacKey =
+        peerAuth.getReceivingMacKey(sharedKey, mSendNonce, mRecvNonce, mRole);
 
     mState = GOT_HELLO;
     CLOG(DEBUG, "Overlay") << "recvHello from " << toString();
@@ -7,10 +7,13 @@
 #include "util/asio.h"
 #include "database/Database.h"
 #include "overlay/PeerBareAddress.h"
+#include "overlay/PeerStats.h"
 #include "overlay/StellarXDR.h"
 #include "util/NonCopyable.h"
 #include "util/Timer.h"
 #include "xdrpp/message.h"
+#include <array>
+#include <limits>
 
 namespace medida
 {
@@ -26,6 +29,42 @@ typedef std::shared_ptr<SCPQuorumSet> SCPQuorumSetPtr;
 class Application;
 class LoopbackPeer;
 
+// The XDR encoding of a StellarMessage: made once, and shared, immutable, by
+// every peer it is sent to when it is flooded.
+typedef std::shared_ptr<xdr::opaque_vec<> const> EncodedMessagePtr;
+
+/*
+ * An AuthenticatedMessage ready for the wire, held as the pieces it is written
+ * out from rather than as one buffer, so that its (large) message body can be
+ * shared between peers: only the short prefix -- record mark, union
+ * discriminant and sequence number -- and the MAC are particular to a peer.
+ */
+struct FramedMessage
+{
+    static size_t const PREFIX_SIZE = 16;
+
+    std::array<uint8_t, PREFIX_SIZE> mPrefix;
+    EncodedMessagePtr mBody;
+    HmacSha256Mac mMac;
+
+    // Size on the wire of a message with the given body, record mark
+    // included.
+    static size_t
+    sizeFor(EncodedMessagePtr const& body)
+    {
+        return PREFIX_SIZE + body->size() + sizeof(HmacSha256Mac);
+    }
+
+    size_t
+    size() const
+    {
+        return sizeFor(mBody);
+    }
+
+    // The pieces copied together into one buffer.
+    xdr::msg_ptr toMsg() const;
+};
+
 /*
  * Another peer out there that we are connected to
  */
@@ -66,6 +105,14 @@ class Peer : public std::enable_shared_from_this<Peer>,
     static medida::Meter& getByteReadMeter(Application& app);
     static medida::Meter& getByteWriteMeter(Application& app);
 
+    // Peers from this overlay version on understand FLOOD_ADVERT and
+    // FLOOD_DEMAND.
+    static uint32_t const FIRST_VERSION_SUPPORTING_FLOOD_ADVERTS = 10;
+
+    // No more than a HELLO and an ERROR should arrive before the remote
+    // HELLO is authenticated.
+    static size_t const MAX_HELD_MESSAGES = 4;
+
   protected:
     Application& mApp;
 
@@ -79,13 +126,24 @@ class Peer : public std::enable_shared_from_this<Peer>,
     HmacSha256Key mRecvMacKey;
     uint64_t mSendMacSeq{0};
     uint64_t mRecvMacSeq{0};
+    // While a worker authenticates the remote HELLO, anything else received
+    // waits here, as it cannot be checked without the MAC keys.
+    bool mAuthenticating{false};
+    std::vector<std::pair<AuthenticatedMessage, size_t>> mHeldMessages;
 
     std::string mRemoteVersion;
     uint32_t mRemoteOverlayMinVersion;
     uint32_t mRemoteOverlayVersion;
     PeerBareAddress mAddress;
+    // Where Floodgate keeps this peer, while it is authenticated.
+    size_t mFloodSlot{std::numeric_limits<size_t>::max()};
+    PeerStats mStats;
 
     VirtualTimer mIdleTimer;
+    // Hashes of transactions to advertise, sent once FLOOD_ADVERT_PERIOD_MS
+    // has passed since the first of them, or once there are enough of them.
+    std::vector<Hash> mTxHashesToAdvertise;
+    VirtualTimer mAdvertTimer;
     VirtualClock::time_point mLastRead;
     VirtualClock::time_point mLastWrite;
     VirtualClock::time_point mLastEmpty;
@@ -112,6 +170,8 @@ class Peer : public std::enable_shared_from_this<Peer>,
     medida::Timer& mRecvSCPQuorumSetTimer;
     medida::Timer& mRecvSCPMessageTimer;
     medida::Timer& mRecvGetSCPStateTimer;
+    medida::Timer& mRecvFloodAdvertTimer;
+    medida::Timer& mRecvFloodDemandTimer;
 
     medida::Timer& mRecvSCPPrepareTimer;
     medida::Timer& mRecvSCPConfirmTimer;
@@ -131,10 +191,19 @@ class Peer : public std::enable_shared_from_this<Peer>,
     medida::Meter& mSendSCPQuorumSetMeter;
     medida::Meter& mSendSCPMessageSetMeter;
     medida::Meter& mSendGetSCPStateMeter;
+    medida::Meter& mSendFloodAdvertMeter;
+    medida::Meter& mSendFloodDemandMeter;
 
     bool shouldAbort() const;
-    void recvMessage(StellarMessage const& msg);
-    void recvMessage(AuthenticatedMessage const& msg);
+    // `size` is that of the AuthenticatedMessage the message came in, as
+    // counted in the peer's stats. `floodHash`, if given, is the hash of the
+    // encoding of a flooded message, worked out from the bytes it came in.
+    void recvMessage(StellarMessage const& msg, size_t size,
+                     Hash const* floodHash = nullptr);
+    void recvMessage(AuthenticatedMessage const& msg, size_t size);
+    // A flooded message whose encoding hashes to `index`, which Floodgate
+    // had already seen, so was not decoded; `size` is as for recvMessage.
+    void recvDuplicateFlood(MessageType type, Hash const& index, size_t size);
     void recvMessage(xdr::msg_ptr const& xdrBytes);
 
     virtual void recvError(StellarMessage const& msg);
@@ -144,15 +213,18 @@ class Peer : public std::enable_shared_from_this<Peer>,
     void recvDontHave(StellarMessage const& msg);
     void recvGetPeers(StellarMessage const& msg);
     void recvHello(Hello const& elo);
+    void helloAuthenticated(Hello const& elo, HmacSha256Key const& sharedKey);
     void recvPeers(StellarMessage const& msg);
 
     void recvGetTxSet(StellarMessage const& msg);
     void recvTxSet(StellarMessage const& msg);
-    void recvTransaction(StellarMessage const& msg);
+    void recvTransaction(StellarMessage const& msg, Hash const* floodHash);
     void recvGetSCPQuorumSet(StellarMessage const& msg);
     void recvSCPQuorumSet(StellarMessage const& msg);
-    void recvSCPMessage(StellarMessage const& msg);
+    void recvSCPMessage(StellarMessage const& msg, Hash const* floodHash);
     void recvGetSCPState(StellarMessage const& msg);
+    void recvFloodAdvert(StellarMessage const& msg);
+    void recvFloodDemand(StellarMessage const& msg);
 
     void sendHello();
     void sendAuth();
@@ -160,15 +232,18 @@ class Peer : public std::enable_shared_from_this<Peer>,
     void sendDontHave(MessageType type, uint256 const& itemID);
     void sendPeers();
     void sendError(ErrorCode error, std::string const& message);
-
-    // NB: This is a move-argument because the write-buffer has to travel
-    // with the write-request through the async IO system, and we might have
-    // several queued at once. We have carefully arranged this to not copy
-    // data more than the once necessary into this buffer, but it can't be
-    // put in a reused/non-owned buffer without having to buffer/queue
-    // messages somewhere else. The async write request will point _into_
-    // this owned buffer. This is really the best we can do.
-    virtual void sendMessage(xdr::msg_ptr&& xdrBytes) = 0;
+    void sendTxAdvert();
+    void recordSend(StellarMessage const& msg);
+
+    // Send the encoding of a message of type `type`. Each message must be
+    // framed with frameMessage before it goes on the wire, which gives it its
+    // sequence number: peers may hold messages back, and even send them in a
+    // different order than they were queued in, but must frame them in the
+    // order they send them.
+    virtual void queueMessage(MessageType type,
+                              EncodedMessagePtr const& encoded) = 0;
+    FramedMessage frameMessage(MessageType type,
+                               EncodedMessagePtr const& encoded);
     virtual void
     connected()
     {
@@ -176,6 +251,14 @@ class Peer : public std::enable_shared_from_this<Peer>,
 
     virtual AuthCert getAuthCert();
 
+    // Whether handshakes that cannot be resumed are done on a worker thread
+    // rather than inline.
+    virtual bool
+    authenticatesOnWorker() const
+    {
+        return false;
+    }
+
     void startIdleTimer();
     void idleTimerExpired(asio::error_code const& error);
     std::chrono::seconds getIOTimeout() const;
@@ -200,6 +283,24 @@ class Peer : public std::enable_shared_from_this<Peer>,
                           DropMode dropMode);
 
     void sendMessage(StellarMessage const& msg);
+    // Send `msg`, of which `encoded` is the XDR encoding. For flooding: the
+    // encoding is shared between peers, and only the sequence number and MAC
+    // are computed for each.
+    void sendMessage(StellarMessage const& msg,
+                     EncodedMessagePtr const& encoded);
+
+    // Whether transactions are flooded to this peer by advertising them.
+    bool usesPullMode() const;
+    // Advertise the transaction whose TRANSACTION message hashes to `hash`,
+    // in a batch with others.
+    void advertiseTx(Hash const& hash);
+
+    // Bytes of messages waiting to be sent, if the peer queues them.
+    virtual size_t
+    getSendQueueBytes() const
+    {
+        return 0;
+    }
 
     PeerRole
     getRole() const
@@ -246,6 +347,24 @@ class Peer : public std::enable_shared_from_this<Peer>,
         return mPeerID;
     }
 
+    size_t
+    getFloodSlot() const
+    {
+        return mFloodSlot;
+    }
+
+    void
+    setFloodSlot(size_t slot)
+    {
+        mFloodSlot = slot;
+    }
+
+    PeerStats const&
+    getStats() const
+    {
+        return mStats;
+    }
+
     std::string toString();
     virtual std::string getIP() const = 0;
 
@@ -259,12 +378,7 @@ class Peer : public std::enable_shared_from_this<Peer>,
     }
 
     virtual void
-    readHeaderHandler(asio::error_code const& error, size_t bytes_transferred)
-    {
-    }
-
-    virtual void
-    readBodyHandler(asio::error_code const& error, size_t bytes_transferred)
+    readHandler(asio::error_code const& error, size_t bytes_transferred)
     {
     }
 
@@ -9,6 +9,9 @@
 #include "crypto/SecretKey.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "util/Logging.h"
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
@@ -36,10 +39,17 @@ makeAuthCert(Application& app, Curve25519Public const& pub)
 
 PeerAuth::PeerAuth(Application& app)
     : mApp(app)
+    , mNetworkID(app.getNetworkID())
     , mECDHSecretKey(EcdhRandomSecret())
     , mECDHPublicKey(EcdhDerivePublic(mECDHSecretKey))
     , mCert(makeAuthCert(app, mECDHPublicKey))
-    , mSharedKeyCache(0xffff)
+    , mSessionCache(0xffff)
+    , mSessionsResumed(app.getMetrics().NewMeter(
+          {"overlay", "handshake", "resumed"}, "session"))
+    , mSessionsFull(app.getMetrics().NewMeter({"overlay", "handshake", "full"},
+                                              "session"))
+    , mFullHandshakeTimer(
+          app.getMetrics().NewTimer({"overlay", "handshake", "derive"}))
 {
 }
 
@@ -54,7 +64,7 @@ PeerAuth::getAuthCert()
 }
 
 bool
-PeerAuth::verifyRemoteAuthCert(NodeID const& remoteNode, AuthCert const& cert)
+PeerAuth::isRemoteAuthCertCurrent(AuthCert const& cert)
 {
     if (cert.expiration < mApp.timeNow())
     {
@@ -63,32 +73,62 @@ PeerAuth::verifyRemoteAuthCert(NodeID const& remoteNode, AuthCert const& cert)
             << "expired= " << cert.expiration << ", now=" << mApp.timeNow();
         return false;
     }
-    auto hash = sha256(xdr::xdr_to_opaque(
-        mApp.getNetworkID(), ENVELOPE_TYPE_AUTH, cert.expiration, cert.pubkey));
+    return true;
+}
 
-    CLOG(DEBUG, "Overlay") << "PeerAuth verifying cert hash: "
-                           << hexAbbrev(hash);
-    return PubKeyUtils::verifySig(remoteNode, cert.sig, hash);
+bool
+PeerAuth::resumeSession(NodeID const& remoteNode, AuthCert const& cert,
+                        Peer::PeerRole role, HmacSha256Key& sharedKey)
+{
+    auto key = PeerSharedKeyId{remoteNode, cert.pubkey, cert.expiration, role};
+    if (!mSessionCache.exists(key))
+    {
+        return false;
+    }
+    // The signature is a function of the rest, so anything else is a
+    // forgery; it gets the full handshake, and fails it.
+    auto const& session = mSessionCache.get(key);
+    if (session.mCertSig != cert.sig)
+    {
+        return false;
+    }
+    mSessionsResumed.Mark();
+    sharedKey = session.mSharedKey;
+    return true;
 }
 
-HmacSha256Key
-PeerAuth::getSharedKey(Curve25519Public const& remotePublic,
-                       Peer::PeerRole role)
+bool
+PeerAuth::authenticate(NodeID const& remoteNode, AuthCert const& cert,
+                       Peer::PeerRole role, HmacSha256Key& sharedKey) const
 {
-    auto key = PeerSharedKeyId{remotePublic, role};
-    if (mSharedKeyCache.exists(key))
+    mSessionsFull.Mark();
+    auto t = mFullHandshakeTimer.TimeScope();
+    auto hash = sha256(xdr::xdr_to_opaque(mNetworkID, ENVELOPE_TYPE_AUTH,
+                                          cert.expiration, cert.pubkey));
+
+    CLOG(DEBUG, "Overlay") << "PeerAuth verifying cert hash: "
+                           << hexAbbrev(hash);
+    if (!PubKeyUtils::verifySig(remoteNode, cert.sig, hash))
     {
-        return mSharedKeyCache.get(key);
+        return false;
     }
-    auto value =
-        EcdhDeriveSharedKey(mECDHSecretKey, mECDHPublicKey, remotePublic,
-                            role == Peer::WE_CALLED_REMOTE);
-    mSharedKeyCache.put(key, value);
-    return value;
+    sharedKey = EcdhDeriveSharedKey(mECDHSecretKey, mECDHPublicKey,
+                                    cert.pubkey,
+                                    role == Peer::WE_CALLED_REMOTE);
+    return true;
+}
+
+void
+PeerAuth::rememberSession(NodeID const& remoteNode, AuthCert const& cert,
+                          Peer::PeerRole role, HmacSha256Key const& sharedKey)
+{
+    mSessionCache.put(
+        PeerSharedKeyId{remoteNode, cert.pubkey, cert.expiration, role},
+        PeerSession{cert.sig, sharedKey});
 }
 
 HmacSha256Key
-PeerAuth::getSendingMacKey(Curve25519Public const& remotePublic,
+PeerAuth::getSendingMacKey(HmacSha256Key const& sharedKey,
                            uint256 const& localNonce,
                            uint256 const& remoteNonce, Peer::PeerRole role)
 {
@@ -109,12 +149,11 @@ PeerAuth::getSendingMacKey(Curve25519Public const& remotePublic,
         buf.insert(buf.end(), localNonce.begin(), localNonce.end());
         buf.insert(buf.end(), remoteNonce.begin(), remoteNonce.end());
     }
-    auto k = getSharedKey(remotePublic, role);
-    return hkdfExpand(k, buf);
+    return hkdfExpand(sharedKey, buf);
 }
 
 HmacSha256Key
-PeerAuth::getReceivingMacKey(Curve25519Public const& remotePublic,
+PeerAuth::getReceivingMacKey(HmacSha256Key const& sharedKey,
                              uint256 const& localNonce,
                              uint256 const& remoteNonce, Peer::PeerRole role)
 {
@@ -135,7 +174,6 @@ PeerAuth::getReceivingMacKey(Curve25519Public const& remotePublic,
         buf.insert(buf.end(), remoteNonce.begin(), remoteNonce.end());
         buf.insert(buf.end(), localNonce.begin(), localNonce.end());
     }
-    auto k = getSharedKey(remotePublic, role);
-    return hkdfExpand(k, buf);
+    return hkdfExpand(sharedKey, buf);
 }
 }
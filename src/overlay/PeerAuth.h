@@ -6,6 +6,12 @@
 #include "util/lrucache.hpp"
 #include "xdr/Stellar-types.h"
 
+namespace medida
+{
+class Meter;
+class Timer;
+}
+
 // Copyright 2015 Stellar Development Foundation and contributors. Licensed
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
@@ -24,28 +30,59 @@ class PeerAuth
     // HKDF_expand(K{us,them}, 0 || nonce_A || nonce_B) and
     // HKDF_expand(K{us,them}, 1 || nonce_B || nonce_A) for
     // use in a particular A-called-B p2p session.
+    //
+    // A node hands out the same cert until it is reissued, so a node that
+    // reconnects within that time (as every node does in a reconnect storm)
+    // sends the cert it sent before. Its session is then resumed: the shared
+    // key derived last time is used again, and neither the cert signature
+    // nor ECDH is computed again. Only the cheap per-session HKDF_expand is.
+
+    struct PeerSession
+    {
+        Signature mCertSig;
+        HmacSha256Key mSharedKey;
+    };
 
     Application& mApp;
-    Curve25519Secret mECDHSecretKey;
-    Curve25519Public mECDHPublicKey;
+    Hash const mNetworkID;
+    Curve25519Secret const mECDHSecretKey;
+    Curve25519Public const mECDHPublicKey;
     AuthCert mCert;
 
-    cache::lru_cache<PeerSharedKeyId, HmacSha256Key> mSharedKeyCache;
+    cache::lru_cache<PeerSharedKeyId, PeerSession> mSessionCache;
 
-    HmacSha256Key getSharedKey(Curve25519Public const& remotePublic,
-                               Peer::PeerRole role);
+    medida::Meter& mSessionsResumed;
+    medida::Meter& mSessionsFull;
+    medida::Timer& mFullHandshakeTimer;
 
   public:
     PeerAuth(Application& app);
 
     AuthCert getAuthCert();
-    bool verifyRemoteAuthCert(NodeID const& remoteNode, AuthCert const& cert);
 
-    HmacSha256Key getSendingMacKey(Curve25519Public const& remotePublic,
+    // Whether `cert` is still good for a handshake at all.
+    bool isRemoteAuthCertCurrent(AuthCert const& cert);
+
+    // If `remoteNode` has authenticated with `cert` in `role` before, set
+    // `sharedKey` to the key derived then and return true.
+    bool resumeSession(NodeID const& remoteNode, AuthCert const& cert,
+                       Peer::PeerRole role, HmacSha256Key& sharedKey);
+
+    // The full handshake: verify that `remoteNode` signed `cert` and, if so,
+    // set `sharedKey` to the key derived from it and return true. Touches
+    // nothing that changes, so may be called from any thread.
+    bool authenticate(NodeID const& remoteNode, AuthCert const& cert,
+                      Peer::PeerRole role, HmacSha256Key& sharedKey) const;
+
+    // Keep what authenticate derived, for resumeSession.
+    void rememberSession(NodeID const& remoteNode, AuthCert const& cert,
+                         Peer::PeerRole role, HmacSha256Key const& sharedKey);
+
+    HmacSha256Key getSendingMacKey(HmacSha256Key const& sharedKey,
                                    uint256 const& localNonce,
                                    uint256 const& remoteNonce,
                                    Peer::PeerRole role);
-    HmacSha256Key getReceivingMacKey(Curve25519Public const& remotePublic,
+    HmacSha256Key getReceivingMacKey(HmacSha256Key const& sharedKey,
                                      uint256 const& localNonce,
                                      uint256 const& remoteNonce,
                                      Peer::PeerRole role);
@@ -3,6 +3,8 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "overlay/PeerSharedKeyId.h"
+#include "crypto/SecretKey.h"
+#include "util/XDROperators.h"
 
 namespace stellar
 {
@@ -10,7 +12,9 @@ namespace stellar
 bool
 operator==(PeerSharedKeyId const& x, PeerSharedKeyId const& y)
 {
-    return (x.mECDHPublicKey == y.mECDHPublicKey) && (x.mRole == y.mRole);
+    return (x.mNodeID == y.mNodeID) &&
+           (x.mECDHPublicKey == y.mECDHPublicKey) &&
+           (x.mExpiration == y.mExpiration) && (x.mRole == y.mRole);
 }
 
 bool
@@ -27,7 +31,9 @@ size_t
 hash<stellar::PeerSharedKeyId>::
 operator()(stellar::PeerSharedKeyId const& x) const noexcept
 {
-    return std::hash<stellar::Curve25519Public>{}(x.mECDHPublicKey) ^
+    return std::hash<stellar::PublicKey>{}(x.mNodeID) ^
+           std::hash<stellar::Curve25519Public>{}(x.mECDHPublicKey) ^
+           std::hash<uint64_t>{}(x.mExpiration) ^
            std::hash<int>{}(static_cast<int>(x.mRole));
 }
 }
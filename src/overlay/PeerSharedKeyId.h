@@ -6,12 +6,17 @@
 
 #include "crypto/ECDH.h"
 #include "overlay/Peer.h"
+#include "xdr/Stellar-types.h"
 
 namespace stellar
 {
+// Identifies a session with a remote node: the node, the cert it sent (its
+// ECDH public key and expiration) and which side called.
 struct PeerSharedKeyId
 {
+    NodeID mNodeID;
     Curve25519Public mECDHPublicKey;
+    uint64 mExpiration;
     Peer::PeerRole mRole;
 
     friend bool operator==(PeerSharedKeyId const& x, PeerSharedKeyId const& y);
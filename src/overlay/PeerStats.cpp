@@ -0,0 +1,111 @@
+// Copyright 2019 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/PeerStats.h"
+#include "lib/json/json.h"
+#include <algorithm>
+
+namespace stellar
+{
+
+void
+PeerStats::recordQueueWait(MessageType type, std::chrono::nanoseconds wait)
+{
+    if (!isTracked(type))
+    {
+        return;
+    }
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(wait);
+    auto ms = static_cast<uint64_t>(std::max<int64_t>(us.count(), 0) / 1000);
+    size_t bucket = 0;
+    while (ms != 0 && bucket + 1 < WAIT_BUCKETS)
+    {
+        ms >>= 1;
+        ++bucket;
+    }
+    auto& waits = mQueueWaits[type];
+    ++waits.mBuckets[bucket];
+    ++waits.mCount;
+    waits.mTotal += us;
+    waits.mMax = std::max(waits.mMax, us);
+}
+
+Json::Value
+PeerStats::toJson() const
+{
+    Json::Value res;
+
+    auto& messages = res["messages"];
+    for (size_t i = 0; i < MESSAGE_TYPES; ++i)
+    {
+        auto const& recv = mRecv[i];
+        auto const& send = mSend[i];
+        auto const& waits = mQueueWaits[i];
+        if (recv.mMessages == 0 && send.mMessages == 0)
+        {
+            continue;
+        }
+        auto name = xdr::xdr_traits<MessageType>::enum_name(
+            static_cast<MessageType>(i));
+        if (!name)
+        {
+            continue;
+        }
+        auto& node = messages[name];
+        node["recv_messages"] = static_cast<Json::UInt64>(recv.mMessages);
+        node["recv_bytes"] = static_cast<Json::UInt64>(recv.mBytes);
+        node["send_messages"] = static_cast<Json::UInt64>(send.mMessages);
+        node["send_bytes"] = static_cast<Json::UInt64>(send.mBytes);
+        if (waits.mCount != 0)
+        {
+            auto& wait = node["queue_wait"];
+            wait["count"] = static_cast<Json::UInt64>(waits.mCount);
+            wait["mean_us"] =
+                static_cast<Json::UInt64>(waits.mTotal.count() / waits.mCount);
+            wait["max_us"] = static_cast<Json::UInt64>(waits.mMax.count());
+            // Bucket i holds waits under 2^i ms (the last, all the rest).
+            auto& buckets = wait["buckets_ms"];
+            for (size_t b = 0; b < WAIT_BUCKETS; ++b)
+            {
+                buckets[static_cast<Json::ArrayIndex>(b)] =
+                    static_cast<Json::UInt64>(waits.mBuckets[b]);
+            }
+        }
+    }
+
+    auto& flood = res["flood"];
+    flood["recv"] = static_cast<Json::UInt64>(mFloodedRecv);
+    flood["duplicate"] = static_cast<Json::UInt64>(mFloodedDuplicate);
+    flood["duplicate_ratio"] =
+        mFloodedRecv == 0 ? 0.0
+                          : static_cast<double>(mFloodedDuplicate) /
+                                static_cast<double>(mFloodedRecv);
+
+    // What we fetched from the peer, and how often it had it; then the
+    // same for what it fetched from us.
+    auto fetchJson = [](Json::Value& node, uint64_t asked, uint64_t found,
+                        uint64_t missing) {
+        node["requested"] = static_cast<Json::UInt64>(asked);
+        node["found"] = static_cast<Json::UInt64>(found);
+        node["dont_have"] = static_cast<Json::UInt64>(missing);
+        node["hit_rate"] =
+            found + missing == 0
+                ? 0.0
+                : static_cast<double>(found) /
+                      static_cast<double>(found + missing);
+    };
+    fetchJson(res["fetch"],
+              mSend[GET_TX_SET].mMessages +
+                  mSend[GET_SCP_QUORUMSET].mMessages,
+              mRecv[TX_SET].mMessages + mRecv[SCP_QUORUMSET].mMessages,
+              mRecv[DONT_HAVE].mMessages);
+    fetchJson(res["served"],
+              mRecv[GET_TX_SET].mMessages +
+                  mRecv[GET_SCP_QUORUMSET].mMessages,
+              mSend[TX_SET].mMessages + mSend[SCP_QUORUMSET].mMessages,
+              mSend[DONT_HAVE].mMessages);
+
+    return res;
+}
+}
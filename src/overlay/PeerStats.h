@@ -0,0 +1,103 @@
+#pragma once
+
+// Copyright 2019 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "xdr/Stellar-overlay.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace Json
+{
+class Value;
+}
+
+namespace stellar
+{
+
+/**
+ * Traffic with a single peer, broken down by message type, for the
+ * "peerstats" command. The medida metrics in Peer add up all peers; these
+ * are kept per peer instead, and so are plain counters, only touched from
+ * the main thread, rather than metrics in the registry.
+ */
+class PeerStats
+{
+  public:
+    // Message types are small enough to index an array with.
+    static size_t const MESSAGE_TYPES = FLOOD_DEMAND + 1;
+    // Queue waits are counted in power-of-two buckets of milliseconds:
+    // under 1ms, under 2ms, under 4ms and so on, the last bucket taking
+    // everything longer.
+    static size_t const WAIT_BUCKETS = 12;
+
+  private:
+    struct Counts
+    {
+        uint64_t mMessages{0};
+        uint64_t mBytes{0};
+    };
+
+    struct Waits
+    {
+        std::array<uint64_t, WAIT_BUCKETS> mBuckets{};
+        uint64_t mCount{0};
+        std::chrono::microseconds mTotal{0};
+        std::chrono::microseconds mMax{0};
+    };
+
+    std::array<Counts, MESSAGE_TYPES> mRecv;
+    std::array<Counts, MESSAGE_TYPES> mSend;
+    std::array<Waits, MESSAGE_TYPES> mQueueWaits;
+    uint64_t mFloodedRecv{0};
+    uint64_t mFloodedDuplicate{0};
+
+    static bool
+    isTracked(MessageType type)
+    {
+        return type >= 0 && static_cast<size_t>(type) < MESSAGE_TYPES;
+    }
+
+  public:
+    // A message received, `bytes` being the size of its encoding.
+    void
+    recordRecv(MessageType type, size_t bytes)
+    {
+        if (isTracked(type))
+        {
+            ++mRecv[type].mMessages;
+            mRecv[type].mBytes += bytes;
+        }
+    }
+
+    // A message written, `bytes` being its size on the wire.
+    void
+    recordSend(MessageType type, size_t bytes)
+    {
+        if (isTracked(type))
+        {
+            ++mSend[type].mMessages;
+            mSend[type].mBytes += bytes;
+        }
+    }
+
+    // A message spent `wait` in our queues before being written.
+    void recordQueueWait(MessageType type, std::chrono::nanoseconds wait);
+
+    // A flooded message received, which Floodgate had seen already if
+    // `duplicate`.
+    void
+    recordFlooded(bool duplicate)
+    {
+        ++mFloodedRecv;
+        if (duplicate)
+        {
+            ++mFloodedDuplicate;
+        }
+    }
+
+    Json::Value toJson() const;
+};
+}
@@ -6,9 +6,13 @@
 #include "database/Database.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "crypto/SHA.h"
 #include "main/ErrorMessages.h"
+#include "medida/histogram.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "overlay/FloodFilter.h"
 #include "overlay/LoadManager.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/PeerManager.h"
@@ -16,6 +20,8 @@
 #include "util/GlobalChecks.h"
 #include "util/Logging.h"
 #include "xdrpp/marshal.h"
+#include <algorithm>
+#include <chrono>
 
 using namespace soci;
 
@@ -24,13 +30,56 @@ namespace stellar
 
 using namespace std;
 
+namespace
+{
+// Big-endian, as in XDR.
+uint32_t
+readUint32(uint8_t const* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) |
+           (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+uint64_t
+readUint64(uint8_t const* p)
+{
+    return (static_cast<uint64_t>(readUint32(p)) << 32) | readUint32(p + 4);
+}
+}
+
 ///////////////////////////////////////////////////////////////////////
 // TCPPeer
 ///////////////////////////////////////////////////////////////////////
 
 TCPPeer::TCPPeer(Application& app, Peer::PeerRole role,
                  std::shared_ptr<TCPPeer::SocketType> socket)
-    : Peer(app, role), mSocket(socket)
+    : Peer(app, role)
+    , mSocket(socket)
+    , mSendQueueLimits{{app.getConfig().PEER_SEND_QUEUE_SCP_BYTES,
+                        app.getConfig().PEER_SEND_QUEUE_FETCH_BYTES,
+                        app.getConfig().PEER_SEND_QUEUE_FLOOD_BYTES}}
+    , mWriteBatchMessages(
+          app.getMetrics().NewHistogram({"overlay", "write", "batch-messages"}))
+    , mWriteBatchBytes(
+          app.getMetrics().NewHistogram({"overlay", "write", "batch-bytes"}))
+    , mWriteQueueDepth(
+          app.getMetrics().NewHistogram({"overlay", "write", "queue-depth"}))
+    , mWriteQueueSize(
+          app.getMetrics().NewHistogram({"overlay", "write", "queue-bytes"}))
+    , mSendShedMeter(
+          app.getMetrics().NewMeter({"overlay", "send", "shed"}, "message"))
+    , mDropQueueOverflowMeter(app.getMetrics().NewMeter(
+          {"overlay", "drop", "queue-overflow"}, "drop"))
+    , mDecodeBatchMessages(
+          app.getMetrics().NewHistogram({"overlay", "decode", "batch"}))
+    , mDecodeTimer(app.getMetrics().NewTimer({"overlay", "decode", "decode"}))
+    , mDecodeWaitTimer(
+          app.getMetrics().NewTimer({"overlay", "decode", "wait"}))
+    , mDeliverTimer(
+          app.getMetrics().NewTimer({"overlay", "decode", "deliver"}))
+    , mFloodPrefilteredMeter(app.getMetrics().NewMeter(
+          {"overlay", "flood", "prefiltered"}, "message"))
 {
 }
 
@@ -128,8 +177,31 @@ TCPPeer::getIP() const
     return result;
 }
 
+TCPPeer::SendQueue
+TCPPeer::getSendQueue(MessageType type)
+{
+    switch (type)
+    {
+    case TRANSACTION:
+    case FLOOD_ADVERT:
+        return SEND_QUEUE_FLOOD;
+    case FLOOD_DEMAND:
+    case GET_TX_SET:
+    case TX_SET:
+    case GET_SCP_QUORUMSET:
+    case SCP_QUORUMSET:
+    case DONT_HAVE:
+    case GET_PEERS:
+    case PEERS:
+        return SEND_QUEUE_FETCH;
+    default:
+        // HELLO, AUTH, ERROR_MSG and the consensus messages themselves.
+        return SEND_QUEUE_SCP;
+    }
+}
+
 void
-TCPPeer::sendMessage(xdr::msg_ptr&& xdrBytes)
+TCPPeer::queueMessage(MessageType type, EncodedMessagePtr const& encoded)
 {
     if (mState == CLOSING)
     {
@@ -143,18 +215,62 @@ TCPPeer::sendMessage(xdr::msg_ptr&& xdrBytes)
         CLOG(TRACE, "Overlay") << "TCPPeer:sendMessage to " << toString();
     assertThreadIsMain();
 
-    // places the buffer to write into the write queue
-    auto buf = std::make_shared<xdr::msg_ptr>(std::move(xdrBytes));
-
-    auto self = static_pointer_cast<TCPPeer>(shared_from_this());
+    auto queue = getSendQueue(type);
+    auto size = FramedMessage::sizeFor(encoded);
+    if (!mSendQueues[queue].empty() &&
+        mSendQueueBytes[queue] + size > mSendQueueLimits[queue])
+    {
+        if (queue != SEND_QUEUE_SCP)
+        {
+            // Cheaper for the peer to ask again, or hear of the transaction
+            // from someone else, than for us to hold on to it.
+            mSendShedMeter.Mark();
+            if (isAuthenticated())
+            {
+                mApp.getOverlayManager()
+                    .getLoadManager()
+                    .getPeerCosts(mPeerID)
+                    ->mMessagesShed.Mark();
+            }
+            return;
+        }
+        // The peer has all but stopped reading what we send, and could not
+        // follow consensus if it had not. Dropped once the caller is done
+        // sending to it, which it is entitled to carry on with meanwhile.
+        if (!mSendQueueOverflow)
+        {
+            mSendQueueOverflow = true;
+            mDropQueueOverflowMeter.Mark();
+            auto self = shared_from_this();
+            mApp.postOnMainThread(
+                [self]() {
+                    self->drop("send queue overflow",
+                               Peer::DropDirection::WE_DROPPED_REMOTE,
+                               Peer::DropMode::IGNORE_WRITE_QUEUE);
+                },
+                "TCPPeer: send queue overflow");
+        }
+        return;
+    }
 
-    self->mWriteQueue.emplace(buf);
+    // places the message to write into its queue
+    mSendQueues[queue].emplace_back(
+        QueuedMessage{type, encoded, mApp.getClock().now()});
+    mSendQueueBytes[queue] += size;
+    mWriteQueueBytes += size;
+    size_t depth = mWriteBatch.size();
+    for (auto const& q : mSendQueues)
+    {
+        depth += q.size();
+    }
+    mWriteQueueDepth.Update(depth);
+    mWriteQueueSize.Update(mWriteQueueBytes);
 
-    if (!self->mWriting)
+    if (!mWriting)
     {
-        self->mWriting = true;
+        mWriting = true;
         // kick off the async write chain if we're the first one
-        self->messageSender();
+        messageSender();
     }
 }
 
@@ -229,55 +345,96 @@ TCPPeer::messageSender()
 
     auto self = static_pointer_cast<TCPPeer>(shared_from_this());
 
-    // if nothing to do, flush and return
-    if (mWriteQueue.empty())
+    // if nothing to do, return
+    if (mWriteQueueBytes == 0)
     {
         mLastEmpty = mApp.getClock().now();
-        mSocket->async_flush([self](asio::error_code const& ec, std::size_t) {
-            self->writeHandler(ec, 0);
-            if (!ec)
-            {
-                if (!self->mWriteQueue.empty())
-                {
-                    self->messageSender();
-                }
-                else
-                {
-                    self->mWriting = false;
-                    // there is nothing to send and delayed shutdown was
-                    // requested - time to perform it
-                    if (self->mDelayedShutdown)
-                    {
-                        self->shutdown();
-                    }
-                }
-            }
-        });
+        mWriting = false;
+        // there is nothing to send and delayed shutdown was requested - time
+        // to perform it
+        if (mDelayedShutdown)
+        {
+            shutdown();
+        }
         return;
     }
 
-    // peek the buffer from the queue
-    // do not remove it yet as we need the buffer for the duration of the
-    // write operation
-    auto buf = mWriteQueue.front();
-
-    asio::async_write(*(mSocket.get()),
-                      asio::buffer((*buf)->raw_data(), (*buf)->raw_size()),
-                      [self](asio::error_code const& ec, std::size_t length) {
-                          self->writeHandler(ec, length);
-                          self->mWriteQueue.pop(); // done with front element
+    // Take queued messages, most urgent first and up to MAX_WRITE_BATCH_SIZE
+    // bytes of them, and frame them for a single (vectored) write straight
+    // to the socket: the socket's own write buffer would only copy them
+    // about in small pieces. They are kept in mWriteBatch, so that their
+    // buffers outlive the write.
+    assert(mWriteBatch.empty());
+    size_t batchBytes = 0;
+    auto now = mApp.getClock().now();
+    for (size_t queue = 0; queue < SEND_QUEUE_COUNT; ++queue)
+    {
+        auto& messages = mSendQueues[queue];
+        while (!messages.empty())
+        {
+            auto size = FramedMessage::sizeFor(messages.front().mBody);
+            if (!mWriteBatch.empty() &&
+                batchBytes + size > MAX_WRITE_BATCH_SIZE)
+            {
+                break;
+            }
+            mStats.recordQueueWait(messages.front().mType,
+                                   now - messages.front().mQueuedAt);
+            mWriteBatch.emplace_back(
+                frameMessage(messages.front().mType, messages.front().mBody));
+            messages.pop_front();
+            mSendQueueBytes[queue] -= size;
+            batchBytes += size;
+        }
+        if (!messages.empty())
+        {
+            break;
+        }
+    }
 
-                          // continue processing the queue/flush
-                          if (!ec)
-                          {
-                              self->messageSender();
-                          }
-                      });
+    std::vector<asio::const_buffer> buffers;
+    buffers.reserve(mWriteBatch.size() * 3);
+    for (auto const& framed : mWriteBatch)
+    {
+        buffers.emplace_back(
+            asio::buffer(framed.mPrefix.data(), framed.mPrefix.size()));
+        buffers.emplace_back(
+            asio::buffer(framed.mBody->data(), framed.mBody->size()));
+        buffers.emplace_back(
+            asio::buffer(framed.mMac.mac.data(), framed.mMac.mac.size()));
+    }
+    size_t batchMessages = mWriteBatch.size();
+    mWriteBatchMessages.Update(batchMessages);
+    mWriteBatchBytes.Update(batchBytes);
+
+    asio::async_write(
+        mSocket->next_layer(), buffers,
+        [self, batchMessages, batchBytes](asio::error_code const& ec,
+                                          std::size_t length) {
+            self->writeHandler(ec, length, batchMessages);
+            // done with the batch
+            self->mWriteBatch.clear();
+            self->mWriteQueueBytes -= batchBytes;
+
+            // continue processing the queue
+            if (!ec)
+            {
+                self->messageSender();
+            }
+        });
 }
 
 void
 TCPPeer::writeHandler(asio::error_code const& error,
                       std::size_t bytes_transferred)
+{
+    writeHandler(error, bytes_transferred, bytes_transferred != 0 ? 1 : 0);
+}
+
+void
+TCPPeer::writeHandler(asio::error_code const& error,
+                      std::size_t bytes_transferred,
+                      std::size_t messages_transferred)
 {
     assertThreadIsMain();
     mLastWrite = mApp.getClock().now();
@@ -307,7 +464,7 @@ TCPPeer::writeHandler(asio::error_code const& error,
     else if (bytes_transferred != 0)
     {
         LoadManager::PeerContext loadCtx(mApp, mPeerID);
-        mMessageWrite.Mark();
+        mMessageWrite.Mark(messages_transferred);
         mByteWrite.Mark(bytes_transferred);
     }
 }
@@ -316,41 +473,62 @@ void
 TCPPeer::startRead()
 {
     assertThreadIsMain();
-    if (shouldAbort())
+    if (shouldAbort() || mReading)
     {
         return;
     }
 
     auto self = static_pointer_cast<TCPPeer>(shared_from_this());
 
-    assert(self->mIncomingHeader.size() == 0);
-
     if (Logging::logTrace("Overlay"))
         CLOG(TRACE, "Overlay") << "TCPPeer::startRead to " << self->toString();
 
-    self->mIncomingHeader.resize(4);
-    asio::async_read(*(self->mSocket.get()),
-                     asio::buffer(self->mIncomingHeader),
-                     [self](asio::error_code ec, std::size_t length) {
-                         if (Logging::logTrace("Overlay"))
-                             CLOG(TRACE, "Overlay")
-                                 << "TCPPeer::startRead calledback " << ec
-                                 << " length:" << length;
-                         self->readHeaderHandler(ec, length);
-                     });
+    // Move what is left of a partly-read message to the front, to read the
+    // rest in after it.
+    if (mReadStart != 0)
+    {
+        std::copy(mReadBuffer.begin() + mReadStart,
+                  mReadBuffer.begin() + mReadEnd, mReadBuffer.begin());
+        mReadEnd -= mReadStart;
+        mReadStart = 0;
+    }
+    if (mReadBuffer.size() < READ_BUFFER_SIZE)
+    {
+        mReadBuffer.resize(READ_BUFFER_SIZE);
+    }
+    if (mReadEnd == mReadBuffer.size())
+    {
+        // Full of messages waiting to be decoded; reading resumes once they
+        // have been.
+        assert(mDecoding || !mDecodedMessages.empty());
+        return;
+    }
+    mReading = true;
+
+    // Straight from the socket, rather than through its read buffer: there
+    // is no point in copying large reads twice.
+    mSocket->next_layer().async_read_some(
+        asio::buffer(mReadBuffer.data() + mReadEnd,
+                     mReadBuffer.size() - mReadEnd),
+        [self](asio::error_code ec, std::size_t length) {
+            if (Logging::logTrace("Overlay"))
+                CLOG(TRACE, "Overlay") << "TCPPeer::startRead calledback "
+                                       << ec << " length:" << length;
+            self->readHandler(ec, length);
+        });
 }
 
 int
-TCPPeer::getIncomingMsgLength()
+TCPPeer::getIncomingMsgLength(uint8_t const* header)
 {
-    int length = mIncomingHeader[0];
+    int length = header[0];
     length &= 0x7f; // clear the XDR 'continuation' bit
     length <<= 8;
-    length |= mIncomingHeader[1];
+    length |= header[1];
     length <<= 8;
-    length |= mIncomingHeader[2];
+    length |= header[2];
     length <<= 8;
-    length |= mIncomingHeader[3];
+    length |= header[3];
     if (length <= 0 ||
         (!isAuthenticated() && (length > MAX_UNAUTH_MESSAGE_SIZE)) ||
         length > MAX_MESSAGE_SIZE)
@@ -373,28 +551,17 @@ TCPPeer::connected()
 }
 
 void
-TCPPeer::readHeaderHandler(asio::error_code const& error,
-                           std::size_t bytes_transferred)
+TCPPeer::readHandler(asio::error_code const& error,
+                     std::size_t bytes_transferred)
 {
     assertThreadIsMain();
-    // LOG(DEBUG) << "TCPPeer::readHeaderHandler "
-    //     << "@" << mApp.getConfig().PEER_PORT
-    //     << " to " << mRemoteListeningPort
-    //     << (error ? "error " : "") << " bytes:" << bytes_transferred;
+    mReading = false;
 
     if (!error)
     {
         receivedBytes(bytes_transferred, false);
-        int length = getIncomingMsgLength();
-        if (length != 0)
-        {
-            mIncomingBody.resize(length);
-            auto self = static_pointer_cast<TCPPeer>(shared_from_this());
-            asio::async_read(*mSocket.get(), asio::buffer(mIncomingBody),
-                             [self](asio::error_code ec, std::size_t length) {
-                                 self->readBodyHandler(ec, length);
-                             });
-        }
+        mReadEnd += bytes_transferred;
+        processReadBuffer();
     }
     else
     {
@@ -403,9 +570,8 @@ TCPPeer::readHeaderHandler(asio::error_code const& error,
             // Only emit a warning if we have an error while connected;
             // errors during shutdown or connection are common/expected.
             mErrorRead.Mark();
-            CLOG(DEBUG, "Overlay")
-                << "readHeaderHandler error: " << error.message() << ": "
-                << toString();
+            CLOG(DEBUG, "Overlay") << "readHandler error: " << error.message()
+                                   << ": " << toString();
         }
         drop("error during read", Peer::DropDirection::WE_DROPPED_REMOTE,
              Peer::DropMode::IGNORE_WRITE_QUEUE);
@@ -413,49 +579,377 @@ TCPPeer::readHeaderHandler(asio::error_code const& error,
 }
 
 void
-TCPPeer::readBodyHandler(asio::error_code const& error,
-                         std::size_t bytes_transferred)
+TCPPeer::processReadBuffer()
 {
     assertThreadIsMain();
-    // LOG(DEBUG) << "TCPPeer::readBodyHandler "
-    //     << "@" << mApp.getConfig().PEER_PORT
-    //     << " to " << mRemoteListeningPort
-    //     << (error ? "error " : "") << " bytes:" << bytes_transferred;
 
-    if (!error)
+    // Handle the whole messages read so far, decoding each where it lies in
+    // the buffer. After PEER_MESSAGES_PER_CRANK of them, the rest wait for a
+    // later crank, so that a busy peer does not hold up everything else.
+    auto const maxMessages = mApp.getConfig().PEER_MESSAGES_PER_CRANK;
+    size_t handled = 0;
+    while (!shouldAbort() && mReadEnd - mReadStart >= 4)
+    {
+        if (isAuthenticated())
+        {
+            // Hand the rest to a worker thread, unless it is busy with (or
+            // the main thread is still delivering) the previous batch.
+            if (!mDecoding && !mDelivering)
+            {
+                decodeMessages();
+            }
+            break;
+        }
+
+        int length = getIncomingMsgLength(mReadBuffer.data() + mReadStart);
+        if (length == 0)
+        {
+            // dropped
+            return;
+        }
+        size_t messageSize = 4 + static_cast<size_t>(length);
+        if (mReadEnd - mReadStart < messageSize)
+        {
+            // Read the rest first, making room for it if it is big (it is
+            // moved to the front of the buffer before reading).
+            if (mReadBuffer.size() < messageSize)
+            {
+                mReadBuffer.resize(messageSize);
+            }
+            break;
+        }
+        if (handled == maxMessages)
+        {
+            auto self = static_pointer_cast<TCPPeer>(shared_from_this());
+            mApp.postOnMainThread([self]() { self->processReadBuffer(); },
+                                  "TCPPeer: read");
+            return;
+        }
+
+        receivedBytes(0, true);
+        recvMessage(mReadBuffer.data() + mReadStart + 4, length);
+        mReadStart += messageSize;
+        ++handled;
+    }
+
+    if (shouldAbort())
     {
-        receivedBytes(bytes_transferred, true);
-        recvMessage();
-        mIncomingHeader.clear();
-        startRead();
+        return;
     }
-    else
+    if (mReadStart == mReadEnd)
     {
-        if (isConnected())
+        mReadStart = 0;
+        mReadEnd = 0;
+        if (mReadBuffer.size() > READ_BUFFER_SIZE)
+        {
+            // Done with a big message.
+            mReadBuffer.resize(READ_BUFFER_SIZE);
+            mReadBuffer.shrink_to_fit();
+        }
+    }
+    startRead();
+}
+
+void
+TCPPeer::decodeMessages()
+{
+    assertThreadIsMain();
+    assert(isAuthenticated() && !mDecoding && !mDelivering);
+
+    // Take all the whole messages read so far.
+    size_t end = mReadStart;
+    size_t nMessages = 0;
+    while (mReadEnd - end >= 4)
+    {
+        int length = getIncomingMsgLength(mReadBuffer.data() + end);
+        if (length == 0)
+        {
+            // dropped
+            return;
+        }
+        size_t messageSize = 4 + static_cast<size_t>(length);
+        if (mReadEnd - end < messageSize)
+        {
+            if (mReadBuffer.size() < messageSize)
+            {
+                mReadBuffer.resize(messageSize);
+            }
+            break;
+        }
+        receivedBytes(0, true);
+        end += messageSize;
+        ++nMessages;
+    }
+    if (nMessages == 0)
+    {
+        return;
+    }
+
+    auto frames = std::make_shared<std::vector<uint8_t>>(
+        mReadBuffer.begin() + mReadStart, mReadBuffer.begin() + end);
+    mReadStart = end;
+    mDecoding = true;
+    mDecodeBatchMessages.Update(nMessages);
+
+    // The worker only gets what it needs by value, and a weak pointer for
+    // getting back to the peer on the main thread, so that the peer is never
+    // destroyed on the worker.
+    std::weak_ptr<TCPPeer> weak =
+        static_pointer_cast<TCPPeer>(shared_from_this());
+    auto& app = mApp;
+    auto& decodeTimer = mDecodeTimer;
+    auto macKey = mRecvMacKey;
+    auto macSequence = mRecvMacSeq;
+    auto floodFilter = mApp.getOverlayManager().getFloodFilter();
+    auto start = std::chrono::steady_clock::now();
+    mApp.postOnBackgroundThread(
+        [&app, &decodeTimer, weak, frames, macKey, macSequence, floodFilter,
+         start]() {
+            auto batch = std::make_shared<DecodedBatch>();
+            {
+                auto timer = decodeTimer.TimeScope();
+                decodeBatch(*frames, macKey, macSequence, *floodFilter,
+                            *batch);
+            }
+            app.postOnMainThread(
+                [weak, batch, start]() {
+                    auto self = weak.lock();
+                    if (self)
+                    {
+                        self->mDecodeWaitTimer.Update(
+                            std::chrono::steady_clock::now() - start);
+                        self->decoded(*batch);
+                    }
+                },
+                "TCPPeer: decoded");
+        },
+        "TCPPeer: decode");
+}
+
+void
+TCPPeer::decodeBatch(std::vector<uint8_t> const& frames,
+                     HmacSha256Key const& macKey, uint64_t macSequence,
+                     FloodFilter const& floodFilter, DecodedBatch& batch)
+{
+    // Runs on a worker thread: the same checks as
+    // Peer::recvMessage(AuthenticatedMessage), less those that only apply
+    // before authentication, stopping at the first message that fails.
+    //
+    // An AuthenticatedMessage (v0) is laid out as v, sequence, message and
+    // mac, so the encoding of the message, and of the sequence and message
+    // that the MAC covers, can be found without decoding it.
+    size_t const V_SIZE = 4;
+    size_t const SEQUENCE_SIZE = 8;
+    size_t const MAC_SIZE = sizeof(HmacSha256Mac);
+    size_t const MIN_SIZE = V_SIZE + SEQUENCE_SIZE + 4 + MAC_SIZE;
+
+    // First hash the flooded messages, to look them all up at once.
+    struct Frame
+    {
+        uint8_t const* mBody;
+        size_t mLength;
+        size_t mFloodIndex;
+    };
+    std::vector<Frame> frameList;
+    std::vector<Hash> floodHashes;
+    size_t pos = 0;
+    while (pos < frames.size())
+    {
+        auto header = frames.data() + pos;
+        size_t length = readUint32(header) & 0x7fffffff;
+        auto body = header + 4;
+        pos += 4 + length;
+        assert(pos <= frames.size());
+
+        Frame frame{body, length, std::numeric_limits<size_t>::max()};
+        if (length >= MIN_SIZE && readUint32(body) == 0)
+        {
+            auto type = readUint32(body + V_SIZE + SEQUENCE_SIZE);
+            if (type == static_cast<uint32_t>(TRANSACTION) ||
+                type == static_cast<uint32_t>(SCP_MESSAGE))
+            {
+                frame.mFloodIndex = floodHashes.size();
+                floodHashes.emplace_back(sha256(
+                    ByteSlice(body + V_SIZE + SEQUENCE_SIZE,
+                              length - V_SIZE - SEQUENCE_SIZE - MAC_SIZE)));
+            }
+        }
+        frameList.emplace_back(frame);
+    }
+    std::vector<bool> seen;
+    if (!floodHashes.empty())
+    {
+        seen = floodFilter.contains(floodHashes);
+    }
+
+    for (auto const& frame : frameList)
+    {
+        auto body = frame.mBody;
+        auto length = frame.mLength;
+        DecodedMessage decoded;
+        decoded.mSize = length;
+        if (frame.mFloodIndex < floodHashes.size())
+        {
+            decoded.mFlooded = true;
+            decoded.mFloodHash = floodHashes[frame.mFloodIndex];
+            decoded.mDuplicate = seen[frame.mFloodIndex];
+        }
+
+        if (decoded.mDuplicate)
+        {
+            // The same bytes as a message already handled, so well formed;
+            // all that is left to check is where it falls in the sequence,
+            // and that it was sent by the peer.
+            decoded.mType = static_cast<MessageType>(
+                readUint32(body + V_SIZE + SEQUENCE_SIZE));
+            if (readUint64(body + V_SIZE) != macSequence)
+            {
+                batch.mError = ERR_AUTH;
+                batch.mErrorMessage = "unexpected auth sequence";
+                return;
+            }
+            HmacSha256Mac mac;
+            std::copy(body + length - MAC_SIZE, body + length,
+                      mac.mac.begin());
+            if (!hmacSha256Verify(
+                    mac, macKey,
+                    ByteSlice(body + V_SIZE, length - V_SIZE - MAC_SIZE)))
+            {
+                batch.mError = ERR_AUTH;
+                batch.mErrorMessage = "unexpected MAC";
+                return;
+            }
+            ++macSequence;
+            ++batch.mMacSequences;
+            ++batch.mDuplicates;
+            batch.mMessages.emplace_back(std::move(decoded));
+            continue;
+        }
+
+        AuthenticatedMessage am;
+        try
+        {
+            xdr::xdr_get g(body, body + length);
+            xdr::xdr_argpack_archive(g, am);
+        }
+        catch (xdr::xdr_runtime_error& e)
         {
-            // Only emit a warning if we have an error while connected;
-            // errors during shutdown or connection are common/expected.
-            mErrorRead.Mark();
             CLOG(ERROR, "Overlay")
-                << "readBodyHandler error: " << error.message() << " :"
-                << toString();
+                << "recvMessage got a corrupt xdr: " << e.what();
+            batch.mError = ERR_DATA;
+            batch.mErrorMessage = "received corrupt XDR";
+            return;
         }
-        drop("error during read", Peer::DropDirection::WE_DROPPED_REMOTE,
-             Peer::DropMode::IGNORE_WRITE_QUEUE);
+
+        auto& msg = am.v0();
+        if (msg.message.type() != ERROR_MSG)
+        {
+            if (msg.sequence != macSequence)
+            {
+                batch.mError = ERR_AUTH;
+                batch.mErrorMessage = "unexpected auth sequence";
+                return;
+            }
+            if (!hmacSha256Verify(
+                    msg.mac, macKey,
+                    xdr::xdr_to_opaque(msg.sequence, msg.message)))
+            {
+                batch.mError = ERR_AUTH;
+                batch.mErrorMessage = "unexpected MAC";
+                return;
+            }
+            ++macSequence;
+            ++batch.mMacSequences;
+        }
+        decoded.mType = msg.message.type();
+        decoded.mMessage = std::move(msg.message);
+        batch.mMessages.emplace_back(std::move(decoded));
+    }
+}
+
+void
+TCPPeer::decoded(DecodedBatch& batch)
+{
+    assertThreadIsMain();
+    assert(mDecoding && mDecodedMessages.empty());
+    mDecoding = false;
+    if (shouldAbort())
+    {
+        return;
+    }
+
+    mRecvMacSeq += batch.mMacSequences;
+    mFloodPrefilteredMeter.Mark(batch.mDuplicates);
+    for (auto& msg : batch.mMessages)
+    {
+        mDecodedMessages.emplace_back(std::move(msg));
+    }
+    mDecodeError = batch.mError;
+    mDecodeErrorMessage = std::move(batch.mErrorMessage);
+    mDelivering = true;
+    deliverMessages();
+}
+
+void
+TCPPeer::deliverMessages()
+{
+    assertThreadIsMain();
+
+    // As in processReadBuffer, a limited number per crank.
+    auto const maxMessages = mApp.getConfig().PEER_MESSAGES_PER_CRANK;
+    size_t handled = 0;
+    {
+        auto timer = mDeliverTimer.TimeScope();
+        while (!shouldAbort() && !mDecodedMessages.empty())
+        {
+            if (handled == maxMessages)
+            {
+                auto self = static_pointer_cast<TCPPeer>(shared_from_this());
+                mApp.postOnMainThread([self]() { self->deliverMessages(); },
+                                      "TCPPeer: deliver");
+                return;
+            }
+            auto msg = std::move(mDecodedMessages.front());
+            mDecodedMessages.pop_front();
+            if (msg.mDuplicate)
+            {
+                recvDuplicateFlood(msg.mType, msg.mFloodHash, msg.mSize);
+            }
+            else
+            {
+                Peer::recvMessage(msg.mMessage, msg.mSize,
+                                  msg.mFlooded ? &msg.mFloodHash : nullptr);
+            }
+            ++handled;
+        }
+    }
+    mDelivering = false;
+    if (shouldAbort())
+    {
+        return;
+    }
+
+    if (!mDecodeErrorMessage.empty())
+    {
+        sendErrorAndDrop(mDecodeError, mDecodeErrorMessage,
+                         Peer::DropMode::IGNORE_WRITE_QUEUE);
+        return;
     }
+    // On to the next batch, if there is one, and back to reading if the
+    // buffer was too full to go on.
+    processReadBuffer();
 }
 
 void
-TCPPeer::recvMessage()
+TCPPeer::recvMessage(uint8_t const* data, size_t size)
 {
     assertThreadIsMain();
     try
     {
-        xdr::xdr_get g(mIncomingBody.data(),
-                       mIncomingBody.data() + mIncomingBody.size());
+        xdr::xdr_get g(data, data + size);
         AuthenticatedMessage am;
         xdr::xdr_argpack_archive(g, am);
-        Peer::recvMessage(am);
+        Peer::recvMessage(am, size);
     }
     catch (xdr::xdr_runtime_error& e)
     {
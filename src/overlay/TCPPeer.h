@@ -6,18 +6,29 @@
 
 #include "overlay/Peer.h"
 #include "util/Timer.h"
-#include <queue>
+#include <array>
+#include <deque>
 
 namespace medida
 {
+class Histogram;
 class Meter;
+class Timer;
 }
 
 namespace stellar
 {
 
+class FloodFilter;
+
 static auto const MAX_UNAUTH_MESSAGE_SIZE = 0x1000;
 static auto const MAX_MESSAGE_SIZE = 0x1000000;
+// Queued messages are written out together, up to this many bytes at a time
+// (but at least one message).
+static auto const MAX_WRITE_BATCH_SIZE = 0x40000;
+// Bytes read from the socket at a time; the read buffer only grows beyond
+// this for a message that does not fit in it.
+static auto const READ_BUFFER_SIZE = 0x10000;
 
 // Peer that communicates via a TCP socket.
 class TCPPeer : public Peer
@@ -27,31 +38,128 @@ class TCPPeer : public Peer
 
   private:
     std::shared_ptr<SocketType> mSocket;
-    std::vector<uint8_t> mIncomingHeader;
-    std::vector<uint8_t> mIncomingBody;
-
-    std::queue<std::shared_ptr<xdr::msg_ptr>> mWriteQueue;
+    // Bytes read from the socket and not yet handled are those in
+    // [mReadStart, mReadEnd): whole messages, then the start of the next.
+    std::vector<uint8_t> mReadBuffer;
+    size_t mReadStart{0};
+    size_t mReadEnd{0};
+    bool mReading{false};
+
+    // Once authenticated, messages are decoded and their MACs checked on a
+    // worker thread, a batch at a time so that they stay in order. Only
+    // those that pass come back to the main thread, into mDecodedMessages,
+    // followed by the reason the next one failed (if one did).
+    //
+    // Flooded messages are hashed from the bytes they came in, and those
+    // that Floodgate has seen already (per the FloodFilter) are not decoded
+    // at all: only their sequence numbers and MACs are checked, and the main
+    // thread only notes that the peer has them.
+    struct DecodedMessage
+    {
+        StellarMessage mMessage;
+        MessageType mType{ERROR_MSG};
+        size_t mSize{0};
+        Hash mFloodHash;
+        bool mFlooded{false};
+        bool mDuplicate{false};
+    };
+
+    struct DecodedBatch
+    {
+        std::vector<DecodedMessage> mMessages;
+        uint64_t mMacSequences{0};
+        size_t mDuplicates{0};
+        ErrorCode mError{ERR_MISC};
+        std::string mErrorMessage;
+    };
+
+    bool mDecoding{false};
+    bool mDelivering{false};
+    std::deque<DecodedMessage> mDecodedMessages;
+    ErrorCode mDecodeError{ERR_MISC};
+    std::string mDecodeErrorMessage;
+
+    // Messages waiting to be written are queued by priority, so that a peer
+    // that falls behind still gets consensus messages first. Each queue
+    // holds a bounded number of bytes (but always takes one message when
+    // empty): past that, replies and flooded transactions are shed, while a
+    // peer that falls behind on consensus messages is dropped. Messages are
+    // only framed, and so given their sequence numbers, as they are taken
+    // for writing.
+    enum SendQueue
+    {
+        SEND_QUEUE_SCP,
+        SEND_QUEUE_FETCH,
+        SEND_QUEUE_FLOOD,
+        SEND_QUEUE_COUNT
+    };
+    static SendQueue getSendQueue(MessageType type);
+
+    struct QueuedMessage
+    {
+        MessageType mType;
+        EncodedMessagePtr mBody;
+        VirtualClock::time_point mQueuedAt;
+    };
+
+    std::array<std::deque<QueuedMessage>, SEND_QUEUE_COUNT> mSendQueues;
+    std::array<size_t, SEND_QUEUE_COUNT> mSendQueueBytes{};
+    std::array<size_t, SEND_QUEUE_COUNT> const mSendQueueLimits;
+    // The messages being written, which must outlive the write.
+    std::vector<FramedMessage> mWriteBatch;
+    // Bytes in mSendQueues and mWriteBatch.
+    size_t mWriteQueueBytes{0};
+    bool mSendQueueOverflow{false};
     bool mWriting{false};
     bool mDelayedShutdown{false};
     bool mShutdownScheduled{false};
 
-    void recvMessage();
-    void sendMessage(xdr::msg_ptr&& xdrBytes) override;
+    medida::Histogram& mWriteBatchMessages;
+    medida::Histogram& mWriteBatchBytes;
+    medida::Histogram& mWriteQueueDepth;
+    medida::Histogram& mWriteQueueSize;
+    medida::Meter& mSendShedMeter;
+    medida::Meter& mDropQueueOverflowMeter;
+    medida::Histogram& mDecodeBatchMessages;
+    medida::Timer& mDecodeTimer;
+    medida::Timer& mDecodeWaitTimer;
+    medida::Timer& mDeliverTimer;
+    medida::Meter& mFloodPrefilteredMeter;
+
+    void recvMessage(uint8_t const* data, size_t size);
+    void queueMessage(MessageType type,
+                      EncodedMessagePtr const& encoded) override;
 
     void messageSender();
 
-    int getIncomingMsgLength();
+    int getIncomingMsgLength(uint8_t const* header);
     virtual void connected() override;
+    bool
+    authenticatesOnWorker() const override
+    {
+        return true;
+    }
     void startRead();
+    void processReadBuffer();
+    void decodeMessages();
+    static void decodeBatch(std::vector<uint8_t> const& frames,
+                            HmacSha256Key const& macKey, uint64_t macSequence,
+                            FloodFilter const& floodFilter,
+                            DecodedBatch& batch);
+    void decoded(DecodedBatch& batch);
+    void deliverMessages();
 
     void writeHandler(asio::error_code const& error,
                       std::size_t bytes_transferred) override;
-    void readHeaderHandler(asio::error_code const& error,
-                           std::size_t bytes_transferred) override;
-    void readBodyHandler(asio::error_code const& error,
-                         std::size_t bytes_transferred) override;
+    void writeHandler(asio::error_code const& error,
+                      std::size_t bytes_transferred,
+                      std::size_t messages_transferred);
+    void readHandler(asio::error_code const& error,
+                     std::size_t bytes_transferred) override;
     void shutdown();
 
+    friend class TCPPeerTests;
+
   public:
     typedef std::shared_ptr<TCPPeer> pointer;
 
@@ -70,5 +178,12 @@ class TCPPeer : public Peer
                       DropMode dropMode) override;
 
     std::string getIP() const override;
+
+    // Includes the messages being written.
+    size_t
+    getSendQueueBytes() const override
+    {
+        return mWriteQueueBytes;
+    }
 };
 }
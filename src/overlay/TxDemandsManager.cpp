@@ -0,0 +1,331 @@
+// Copyright 2019 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/TxDemandsManager.h"
+#include "crypto/Hex.h"
+#include "herder/Herder.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "overlay/Floodgate.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "util/Logging.h"
+#include <algorithm>
+#include <map>
+
+namespace stellar
+{
+
+TxDemandsManager::TxDemandsManager(Application& app, Floodgate& floodgate)
+    : mApp(app)
+    , mFloodgate(floodgate)
+    , mRetryTimer(app)
+    , mAdvertsReceived(app.getMetrics().NewMeter(
+          {"overlay", "flood", "advert-hashes"}, "hash"))
+    , mAdvertsKnown(app.getMetrics().NewMeter(
+          {"overlay", "flood", "advert-known"}, "hash"))
+    , mAdvertsIgnored(app.getMetrics().NewMeter(
+          {"overlay", "flood", "advert-ignored"}, "hash"))
+    , mDemandsSent(app.getMetrics().NewMeter(
+          {"overlay", "flood", "demand-sent"}, "hash"))
+    , mDemandsRetried(app.getMetrics().NewMeter(
+          {"overlay", "flood", "demand-retried"}, "hash"))
+    , mDemandsAbandoned(app.getMetrics().NewMeter(
+          {"overlay", "flood", "demand-abandoned"}, "hash"))
+    , mDemandsFulfilled(app.getMetrics().NewMeter(
+          {"overlay", "flood", "demand-fulfilled"}, "hash"))
+    , mDemandsUnfulfilled(app.getMetrics().NewMeter(
+          {"overlay", "flood", "demand-unfulfilled"}, "hash"))
+    , mDemandLatency(
+          app.getMetrics().NewTimer({"overlay", "flood", "demand-latency"}))
+{
+}
+
+void
+TxDemandsManager::advertised(Hash const& hash, StellarMessage const& msg,
+                             EncodedMessagePtr const& encoded)
+{
+    auto& advertised = mAdvertised[hash];
+    if (!advertised.mMessage)
+    {
+        advertised.mLedgerSeq = mApp.getHerder().getCurrentLedgerSeq();
+        advertised.mMessage = std::make_shared<StellarMessage const>(msg);
+        advertised.mEncoded = encoded;
+    }
+}
+
+void
+TxDemandsManager::recvFloodAdvert(FloodAdvert const& advert,
+                                  Peer::pointer peer)
+{
+    auto now = mApp.getClock().now();
+    auto peerID = peer->getPeerID();
+    std::vector<Hash> toDemand;
+    mAdvertsReceived.Mark(advert.txHashes.size());
+    for (auto const& hash : advert.txHashes)
+    {
+        if (mFloodgate.peerKnows(hash, peer))
+        {
+            mAdvertsKnown.Mark();
+            continue;
+        }
+        auto it = mDemands.find(hash);
+        if (it == mDemands.end())
+        {
+            if (mOutstanding.size() >= MAX_OUTSTANDING_DEMANDS)
+            {
+                mAdvertsIgnored.Mark();
+                continue;
+            }
+            it = mDemands.emplace(hash, Demand{}).first;
+            it->second.mLedgerSeq = mApp.getHerder().getCurrentLedgerSeq();
+        }
+        auto& demand = it->second;
+        if (demand.mReceived ||
+            demand.mAdvertisers.size() >= MAX_ADVERTISERS ||
+            std::any_of(demand.mAdvertisers.begin(),
+                        demand.mAdvertisers.end(),
+                        [&](Advertiser const& a) {
+                            return a.mPeerID == peerID;
+                        }))
+        {
+            continue;
+        }
+        auto& peerOutstanding = mOutstandingByPeer[peerID];
+        if (peerOutstanding >= MAX_DEMANDS_PER_PEER)
+        {
+            // Peers send what they advertise as soon as it is demanded, so
+            // this many still outstanding means hashes made up.
+            if (demand.mAdvertisers.empty())
+            {
+                mDemands.erase(it);
+            }
+            CLOG(INFO, "Overlay")
+                << "Dropping peer " << peer->toString()
+                << " with too many outstanding adverts";
+            peer->drop("too many outstanding adverts",
+                       Peer::DropDirection::WE_DROPPED_REMOTE,
+                       Peer::DropMode::IGNORE_WRITE_QUEUE);
+            break;
+        }
+        ++peerOutstanding;
+        mOutstanding.insert(hash);
+        demand.mAdvertisers.push_back({peer, peerID});
+        // Demanded straight away from the first to advertise it; from any
+        // others only if it has not come by the time retryDemands runs.
+        if (demand.mNextAdvertiser == 0)
+        {
+            demand.mNextAdvertiser = 1;
+            demand.mFirstDemanded = now;
+            demand.mLastDemanded = now;
+            toDemand.emplace_back(hash);
+        }
+    }
+    if (peer->isConnected())
+    {
+        sendDemands(peer, toDemand);
+    }
+    if (!mOutstanding.empty())
+    {
+        startRetryTimer();
+    }
+}
+
+void
+TxDemandsManager::recvFloodDemand(FloodDemand const& demand,
+                                  Peer::pointer peer)
+{
+    for (auto const& hash : demand.txHashes)
+    {
+        auto it = mAdvertised.find(hash);
+        if (it == mAdvertised.end())
+        {
+            // Forgotten since it was advertised.
+            mDemandsUnfulfilled.Mark();
+            continue;
+        }
+        mDemandsFulfilled.Mark();
+        peer->sendMessage(*it->second.mMessage, it->second.mEncoded);
+    }
+}
+
+std::vector<Peer::pointer>
+TxDemandsManager::recvTransaction(Hash const& index)
+{
+    std::vector<Peer::pointer> res;
+    if (mDemands.empty())
+    {
+        return res;
+    }
+    auto it = mDemands.find(index);
+    if (it == mDemands.end() || it->second.mReceived)
+    {
+        return res;
+    }
+    auto& demand = it->second;
+    demand.mReceived = true;
+    if (demand.mNextAdvertiser != 0)
+    {
+        mDemandLatency.Update(mApp.getClock().now() - demand.mFirstDemanded);
+    }
+    for (auto const& advertiser : demand.mAdvertisers)
+    {
+        if (auto p = advertiser.mPeer.lock())
+        {
+            res.emplace_back(p);
+        }
+    }
+    settle(demand);
+    mOutstanding.erase(index);
+    return res;
+}
+
+void
+TxDemandsManager::settle(Demand& demand)
+{
+    for (auto const& advertiser : demand.mAdvertisers)
+    {
+        auto it = mOutstandingByPeer.find(advertiser.mPeerID);
+        if (it != mOutstandingByPeer.end() && --it->second == 0)
+        {
+            mOutstandingByPeer.erase(it);
+        }
+    }
+    demand.mAdvertisers.clear();
+}
+
+void
+TxDemandsManager::sendDemands(Peer::pointer const& peer,
+                              std::vector<Hash> const& hashes)
+{
+    for (size_t i = 0; i < hashes.size(); i += TX_DEMAND_VECTOR_MAX_SIZE)
+    {
+        StellarMessage msg;
+        msg.type(FLOOD_DEMAND);
+        auto end = std::min(hashes.size(), i + TX_DEMAND_VECTOR_MAX_SIZE);
+        msg.floodDemand().txHashes.assign(hashes.begin() + i,
+                                          hashes.begin() + end);
+        mDemandsSent.Mark(end - i);
+        peer->sendMessage(msg);
+    }
+}
+
+void
+TxDemandsManager::startRetryTimer()
+{
+    if (mRetrying)
+    {
+        return;
+    }
+    mRetrying = true;
+    mRetryTimer.expires_from_now(
+        std::chrono::milliseconds(mApp.getConfig().FLOOD_DEMAND_TIMEOUT_MS));
+    mRetryTimer.async_wait(
+        [this]() {
+            mRetrying = false;
+            retryDemands();
+        },
+        VirtualTimer::onFailureNoop);
+}
+
+void
+TxDemandsManager::retryDemands()
+{
+    auto now = mApp.getClock().now();
+    auto timeout =
+        std::chrono::milliseconds(mApp.getConfig().FLOOD_DEMAND_TIMEOUT_MS);
+    std::map<Peer::pointer, std::vector<Hash>> toDemand;
+    bool waiting = false;
+    for (auto it = mOutstanding.begin(); it != mOutstanding.end();)
+    {
+        auto& demand = mDemands.at(*it);
+        if (now - demand.mLastDemanded < timeout)
+        {
+            waiting = true;
+            ++it;
+            continue;
+        }
+        Peer::pointer next;
+        while (!next && demand.mNextAdvertiser < demand.mAdvertisers.size())
+        {
+            next = demand.mAdvertisers[demand.mNextAdvertiser++].mPeer.lock();
+            if (next && !next->isAuthenticated())
+            {
+                next.reset();
+            }
+        }
+        if (next)
+        {
+            mDemandsRetried.Mark();
+            demand.mLastDemanded = now;
+            toDemand[next].emplace_back(*it);
+            waiting = true;
+            ++it;
+        }
+        else
+        {
+            // Demanded afresh if anyone advertises it again.
+            CLOG(DEBUG, "Overlay")
+                << "Giving up on demanded transaction " << hexAbbrev(*it);
+            mDemandsAbandoned.Mark();
+            settle(demand);
+            mDemands.erase(*it);
+            it = mOutstanding.erase(it);
+        }
+    }
+    for (auto const& peerHashes : toDemand)
+    {
+        sendDemands(peerHashes.first, peerHashes.second);
+    }
+    if (waiting)
+    {
+        startRetryTimer();
+    }
+}
+
+void
+TxDemandsManager::clearBelow(uint32_t currentLedger)
+{
+    // same leeway as Floodgate
+    for (auto it = mAdvertised.begin(); it != mAdvertised.end();)
+    {
+        if (it->second.mLedgerSeq + 10 < currentLedger)
+        {
+            it = mAdvertised.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    for (auto it = mDemands.begin(); it != mDemands.end();)
+    {
+        if (it->second.mLedgerSeq + 10 < currentLedger)
+        {
+            if (!it->second.mReceived)
+            {
+                settle(it->second);
+                mOutstanding.erase(it->first);
+            }
+            it = mDemands.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void
+TxDemandsManager::shutdown()
+{
+    mRetryTimer.cancel();
+    mRetrying = false;
+    mAdvertised.clear();
+    mDemands.clear();
+    mOutstanding.clear();
+    mOutstandingByPeer.clear();
+}
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+// Copyright 2019 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SecretKey.h"
+#include "overlay/Peer.h"
+#include "util/HashOfHash.h"
+#include "util/Timer.h"
+#include "xdr/Stellar-types.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace medida
+{
+class Meter;
+class Timer;
+}
+
+namespace stellar
+{
+
+class Application;
+class Floodgate;
+
+/**
+ * Pull-mode transaction flooding. Rather than being sent every transaction,
+ * a peer is sent batches of their hashes (FLOOD_ADVERT), and demands the
+ * transactions it has not seen yet (FLOOD_DEMAND).
+ *
+ * On the sending side, TxDemandsManager holds on to the transactions
+ * advertised, to send on demand; batching the hashes is up to each Peer.
+ *
+ * On the receiving side, it demands each transaction advertised from the
+ * first peer to advertise it. If that peer has not sent it within
+ * FLOOD_DEMAND_TIMEOUT_MS, it is demanded from the next peer to have
+ * advertised it, and so on, much as Tracker asks peers in turn; once no
+ * advertiser is left, it is given up on until advertised again.
+ *
+ * Transactions are identified by the hash of their TRANSACTION message, as
+ * in Floodgate, and forgotten with Floodgate's records as ledgers close.
+ *
+ * Hashes advertised cost us memory and demands until the transaction
+ * arrives, and anyone can make them up, so the number outstanding is
+ * bounded: a peer that has advertised more than MAX_DEMANDS_PER_PEER is
+ * dropped, and once MAX_OUTSTANDING_DEMANDS are outstanding in all, hashes
+ * not yet demanded are ignored.
+ */
+class TxDemandsManager
+{
+    struct Advertised
+    {
+        uint32_t mLedgerSeq;
+        std::shared_ptr<StellarMessage const> mMessage;
+        EncodedMessagePtr mEncoded;
+    };
+
+    struct Advertiser
+    {
+        std::weak_ptr<Peer> mPeer;
+        NodeID mPeerID;
+    };
+
+    struct Demand
+    {
+        uint32_t mLedgerSeq;
+        // Peers that advertised the transaction, in turn; those before
+        // mNextAdvertiser have been demanded it from.
+        std::vector<Advertiser> mAdvertisers;
+        size_t mNextAdvertiser{0};
+        VirtualClock::time_point mFirstDemanded;
+        VirtualClock::time_point mLastDemanded;
+        bool mReceived{false};
+    };
+
+    Application& mApp;
+    Floodgate& mFloodgate;
+    std::unordered_map<Hash, Advertised> mAdvertised;
+    std::unordered_map<Hash, Demand> mDemands;
+    // The demands neither received nor given up on yet.
+    std::unordered_set<Hash> mOutstanding;
+    // For each peer, how many of mOutstanding it advertised.
+    std::unordered_map<NodeID, size_t> mOutstandingByPeer;
+    VirtualTimer mRetryTimer;
+    bool mRetrying{false};
+
+    medida::Meter& mAdvertsReceived;
+    medida::Meter& mAdvertsKnown;
+    medida::Meter& mAdvertsIgnored;
+    medida::Meter& mDemandsSent;
+    medida::Meter& mDemandsRetried;
+    medida::Meter& mDemandsAbandoned;
+    medida::Meter& mDemandsFulfilled;
+    medida::Meter& mDemandsUnfulfilled;
+    medida::Timer& mDemandLatency;
+
+    // Demand `hashes` from `peer`, in as few messages as it takes.
+    void sendDemands(Peer::pointer const& peer,
+                     std::vector<Hash> const& hashes);
+    // Forget the advertisers of `demand`, no longer outstanding.
+    void settle(Demand& demand);
+    void startRetryTimer();
+    void retryDemands();
+
+  public:
+    static uint32_t const MAX_ADVERTISERS = 8;
+    static size_t const MAX_DEMANDS_PER_PEER = 4 * TX_ADVERT_VECTOR_MAX_SIZE;
+    static size_t const MAX_OUTSTANDING_DEMANDS = 50000;
+
+    TxDemandsManager(Application& app, Floodgate& floodgate);
+
+    // Keep `msg` to send on demand, `encoded` being its encoding and `hash`
+    // the hash of that.
+    void advertised(Hash const& hash, StellarMessage const& msg,
+                    EncodedMessagePtr const& encoded);
+
+    void recvFloodAdvert(FloodAdvert const& advert, Peer::pointer peer);
+    void recvFloodDemand(FloodDemand const& demand, Peer::pointer peer);
+
+    // Note that the transaction whose message hashes to `index` has been
+    // received, and return the other peers that advertised it, which have it
+    // too.
+    std::vector<Peer::pointer> recvTransaction(Hash const& index);
+
+    void clearBelow(uint32_t currentLedger);
+    void shutdown();
+};
+}
@@ -10,9 +10,13 @@
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/PeerDoor.h"
 #include "overlay/TCPPeer.h"
+#include "overlay/TxDemandsManager.h"
+#include "overlay/test/LoopbackPeer.h"
 #include "simulation/Simulation.h"
 #include "simulation/Topologies.h"
 #include "test/TestAccount.h"
@@ -198,6 +202,45 @@ TEST_CASE("Flooding", "[flood][overlay]")
                 test(injectTransaction, ackedTransactions);
             }
         }
+
+        SECTION("pull mode")
+        {
+            bool mixed = false;
+            auto pullCfgGen = [&](int cfgNum) {
+                Config cfg = cfgGen(cfgNum);
+                cfg.FLOOD_PULL_MODE = !mixed || cfgNum % 2 == 0;
+                return cfg;
+            };
+            auto demandsFulfilled = [&]() {
+                int64_t count = 0;
+                for (auto n : nodes)
+                {
+                    count += n->getMetrics()
+                                 .NewMeter({"overlay", "flood",
+                                            "demand-fulfilled"},
+                                           "hash")
+                                 .count();
+                }
+                return count;
+            };
+
+            SECTION("all nodes")
+            {
+                simulation =
+                    Topologies::core(4, .666f, Simulation::OVER_LOOPBACK,
+                                     networkID, pullCfgGen);
+                test(injectTransaction, ackedTransactions);
+                REQUIRE(demandsFulfilled() != 0);
+            }
+            SECTION("some nodes")
+            {
+                mixed = true;
+                simulation = Topologies::hierarchicalQuorumSimplified(
+                    5, 10, Simulation::OVER_TCP, networkID, pullCfgGen);
+                test(injectTransaction, ackedTransactions);
+                REQUIRE(demandsFulfilled() != 0);
+            }
+        }
     }
 
     SECTION("scp messages flooding")
@@ -340,4 +383,47 @@ TEST_CASE("Flooding", "[flood][overlay]")
         }
     }
 }
+
+TEST_CASE("outstanding flood demands are bounded", "[flood][overlay]")
+{
+    VirtualClock clock;
+    auto app1 = createTestApplication(clock, getTestConfig(0));
+    auto app2 = createTestApplication(clock, getTestConfig(1));
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getInitiator()->isAuthenticated());
+    REQUIRE(conn.getAcceptor()->isAuthenticated());
+
+    auto& demandsSent = app2->getMetrics().NewMeter(
+        {"overlay", "flood", "demand-sent"}, "hash");
+    auto sentBefore = demandsSent.count();
+
+    // Adverts full of hashes app1 has no transactions for, sent before app2
+    // can give up on any of them.
+    size_t const perPeer = TxDemandsManager::MAX_DEMANDS_PER_PEER;
+    size_t n = 0;
+    auto advertise = [&]() {
+        StellarMessage msg;
+        msg.type(FLOOD_ADVERT);
+        for (size_t i = 0; i < TX_ADVERT_VECTOR_MAX_SIZE; ++i)
+        {
+            msg.floodAdvert().txHashes.push_back(
+                sha256("advert " + std::to_string(n++)));
+        }
+        conn.getInitiator()->sendMessage(msg);
+    };
+    while (n < perPeer)
+    {
+        advertise();
+    }
+    testutil::crankSome(clock);
+    REQUIRE(conn.getAcceptor()->isConnected());
+    REQUIRE(demandsSent.count() == sentBefore + perPeer);
+
+    advertise();
+    testutil::crankSome(clock);
+    REQUIRE(!conn.getAcceptor()->isConnected());
+    REQUIRE(demandsSent.count() == sentBefore + perPeer);
+}
 }
@@ -44,7 +44,7 @@ LoopbackPeer::getAuthCert()
 }
 
 void
-LoopbackPeer::sendMessage(xdr::msg_ptr&& msg)
+LoopbackPeer::queueMessage(MessageType type, EncodedMessagePtr const& encoded)
 {
     if (mRemote.expired())
     {
@@ -61,7 +61,7 @@ LoopbackPeer::sendMessage(xdr::msg_ptr&& msg)
     }
 
     // CLOG(TRACE, "Overlay") << "LoopbackPeer queueing message";
-    mOutQueue.emplace_back(std::move(msg));
+    mOutQueue.emplace_back(frameMessage(type, encoded).toMsg());
     // Possibly flush some queued messages if queue's full.
     while (mOutQueue.size() > mMaxQueueDepth && !mCorked)
     {
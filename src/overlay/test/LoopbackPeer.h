@@ -52,7 +52,8 @@ class LoopbackPeer : public Peer
 
     Stats mStats;
 
-    void sendMessage(xdr::msg_ptr&& xdrBytes) override;
+    void queueMessage(MessageType type,
+                      EncodedMessagePtr const& encoded) override;
     AuthCert getAuthCert() override;
 
     void processInQueue();
@@ -6,8 +6,10 @@
 #include "main/ApplicationImpl.h"
 #include "main/Config.h"
 
+#include "crypto/SHA.h"
 #include "database/Database.h"
 #include "lib/catch.hpp"
+#include "overlay/FloodFilter.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/OverlayManagerImpl.h"
 #include "test/TestAccount.h"
@@ -16,7 +18,10 @@
 #include "test/test.h"
 #include "transactions/TransactionFrame.h"
 #include "util/Timer.h"
+#include "xdrpp/marshal.h"
 
+#include <cstring>
+#include <limits>
 #include <soci.h>
 
 using namespace stellar;
@@ -50,7 +55,7 @@ class PeerStub : public Peer
     {
     }
     virtual void
-    sendMessage(xdr::msg_ptr&& xdrBytes) override
+    queueMessage(MessageType, EncodedMessagePtr const&) override
     {
         sent++;
     }
@@ -253,13 +258,101 @@ class OverlayManagerTests
         pm.broadcastMessage(AtoC);
         std::vector<int> expected{1, 1, 0, 1, 1};
         REQUIRE(sentCounts(pm) == expected);
+        REQUIRE(pm.getPeersKnows(sha256(xdr::xdr_to_opaque(AtoC))).size() ==
+                5);
         pm.broadcastMessage(AtoC);
         REQUIRE(sentCounts(pm) == expected);
         StellarMessage CtoD = c.tx({payment(d, 10)})->toStellarMessage();
+        std::vector<Hash> hashes{sha256(xdr::xdr_to_opaque(AtoC)),
+                                 sha256(xdr::xdr_to_opaque(CtoD))};
+        REQUIRE(pm.getFloodFilter()->contains(hashes) ==
+                std::vector<bool>{true, false});
         pm.broadcastMessage(CtoD);
+        REQUIRE(pm.getFloodFilter()->contains(hashes) ==
+                std::vector<bool>{true, true});
         std::vector<int> expectedFinal{2, 2, 1, 2, 2};
         REQUIRE(sentCounts(pm) == expectedFinal);
     }
+
+    Floodgate&
+    floodgate()
+    {
+        return app->getOverlayManager().mFloodGate;
+    }
+
+    size_t
+    floodMapCapacity()
+    {
+        return floodgate().mFloodMap.size();
+    }
+
+    size_t
+    floodMapCount()
+    {
+        return floodgate().mFloodMapCount;
+    }
+
+    // A hash whose leading bytes, and so home entry in the flood map, are
+    // all `home`, told apart by its trailing bytes.
+    static Hash
+    collidingHash(uint8_t home, uint32_t n)
+    {
+        Hash h;
+        std::fill(h.begin(), h.end(), 0);
+        std::fill(h.begin(), h.begin() + 8, home);
+        std::memcpy(h.data() + h.size() - sizeof(n), &n, sizeof(n));
+        return h;
+    }
+
+    void
+    addRecordAt(Hash const& h, uint32_t ledgerSeq)
+    {
+        REQUIRE(floodgate().addRecord(h, nullptr));
+        floodgate().findRecord(h)->mLedgerSeq = ledgerSeq;
+    }
+
+    bool
+    hasRecord(Hash const& h)
+    {
+        return floodgate().findRecord(h) != nullptr;
+    }
+
+    // Every used entry can be reached from its home entry without passing
+    // an unused one, and is counted.
+    void
+    checkFloodMap()
+    {
+        auto& map = floodgate().mFloodMap;
+        size_t used = 0;
+        for (auto const& entry : map)
+        {
+            if (entry.mUsed)
+            {
+                ++used;
+                REQUIRE(floodgate().findRecord(entry.mHash) == &entry.mRecord);
+            }
+        }
+        REQUIRE(used == floodMapCount());
+        REQUIRE(used * 2 <= map.size());
+    }
+
+    std::shared_ptr<PeerStub>
+    addFloodPeer(unsigned short port)
+    {
+        auto peer = std::make_shared<PeerStub>(
+            *app, PeerBareAddress{"127.0.0.1", port});
+        floodgate().addPeer(peer);
+        return peer;
+    }
+
+    static StellarMessage
+    floodMessage(uint32_t n)
+    {
+        StellarMessage msg;
+        msg.type(GET_SCP_STATE);
+        msg.getSCPLedgerSeq() = n;
+        return msg;
+    }
 };
 
 TEST_CASE_METHOD(OverlayManagerTests, "storeConfigPeers() adds", "[overlay]")
@@ -283,4 +376,189 @@ TEST_CASE_METHOD(OverlayManagerTests, "broadcast() broadcasts", "[overlay]")
 {
     testBroadcast();
 }
+
+TEST_CASE_METHOD(OverlayManagerTests, "Floodgate grows past half full",
+                 "[overlay][flood]")
+{
+    auto capacity = floodMapCapacity();
+    std::vector<Hash> hashes;
+    // Half of them collide, and wrap around the end of the table.
+    for (uint32_t i = 0; i < capacity / 2; ++i)
+    {
+        hashes.emplace_back(
+            collidingHash(i % 2 ? 0xff : static_cast<uint8_t>(i), i));
+        addRecordAt(hashes.back(), 1);
+    }
+    REQUIRE(floodMapCapacity() == capacity);
+    REQUIRE(floodMapCount() == capacity / 2);
+    checkFloodMap();
+
+    hashes.emplace_back(collidingHash(0xff, capacity));
+    addRecordAt(hashes.back(), 1);
+    REQUIRE(floodMapCapacity() == capacity * 2);
+    REQUIRE(floodMapCount() == hashes.size());
+    checkFloodMap();
+    for (auto const& h : hashes)
+    {
+        REQUIRE(hasRecord(h));
+        REQUIRE_FALSE(floodgate().addRecord(h, nullptr));
+    }
+    REQUIRE(floodgate().getFilter()->contains(hashes) ==
+            std::vector<bool>(hashes.size(), true));
+    REQUIRE_FALSE(hasRecord(collidingHash(0xff, capacity + 1)));
+}
+
+TEST_CASE_METHOD(OverlayManagerTests, "Floodgate clearBelow shrinks",
+                 "[overlay][flood]")
+{
+    auto capacity = floodMapCapacity();
+
+    SECTION("probe chain survives removed entries")
+    {
+        // One chain, wrapping around the end of the table, where every
+        // other entry goes.
+        std::vector<Hash> kept, removed;
+        for (uint32_t i = 0; i < 10; ++i)
+        {
+            auto h = collidingHash(0xff, i);
+            addRecordAt(h, i % 2 ? 100 : 1);
+            (i % 2 ? kept : removed).emplace_back(h);
+        }
+        floodgate().clearBelow(100);
+        REQUIRE(floodMapCapacity() == capacity);
+        REQUIRE(floodMapCount() == kept.size());
+        checkFloodMap();
+        for (auto const& h : kept)
+        {
+            REQUIRE(hasRecord(h));
+        }
+        for (auto const& h : removed)
+        {
+            REQUIRE_FALSE(hasRecord(h));
+        }
+        REQUIRE(floodgate().getFilter()->contains(kept) ==
+                std::vector<bool>(kept.size(), true));
+        REQUIRE(floodgate().getFilter()->contains(removed) ==
+                std::vector<bool>(removed.size(), false));
+
+        // A removed hash is new again, and goes on the end of the chain.
+        REQUIRE(floodgate().addRecord(removed.front(), nullptr));
+        REQUIRE_FALSE(floodgate().addRecord(kept.back(), nullptr));
+        REQUIRE(floodMapCount() == kept.size() + 1);
+        checkFloodMap();
+    }
+
+    SECTION("table shrinks back once emptied")
+    {
+        std::vector<Hash> kept;
+        for (uint32_t i = 0; i < capacity * 2; ++i)
+        {
+            auto h = collidingHash(static_cast<uint8_t>(i), i);
+            addRecordAt(h, i < 5 ? 100 : 1);
+            if (i < 5)
+            {
+                kept.emplace_back(h);
+            }
+        }
+        REQUIRE(floodMapCapacity() == capacity * 4);
+        floodgate().clearBelow(100);
+        REQUIRE(floodMapCapacity() == capacity);
+        REQUIRE(floodMapCount() == kept.size());
+        checkFloodMap();
+        for (auto const& h : kept)
+        {
+            REQUIRE(hasRecord(h));
+        }
+    }
+
+    SECTION("table keeps room for what is kept")
+    {
+        for (uint32_t i = 0; i < capacity * 2; ++i)
+        {
+            addRecordAt(collidingHash(static_cast<uint8_t>(i), i), 100);
+        }
+        floodgate().clearBelow(100);
+        REQUIRE(floodMapCount() == capacity * 2);
+        REQUIRE(floodMapCapacity() == capacity * 8);
+        checkFloodMap();
+    }
+}
+
+TEST_CASE_METHOD(OverlayManagerTests, "Floodgate reuses peer slots",
+                 "[overlay][flood]")
+{
+    auto p0 = addFloodPeer(2000);
+    auto p1 = addFloodPeer(2001);
+    REQUIRE(p0->getFloodSlot() == 0);
+    REQUIRE(p1->getFloodSlot() == 1);
+
+    auto msg = floodMessage(1);
+    auto h = sha256(xdr::xdr_to_opaque(msg));
+    REQUIRE(floodgate().addRecord(msg, p0));
+    REQUIRE(floodgate().getPeersKnows(h) == std::set<Peer::pointer>{p0});
+
+    floodgate().removePeer(p0.get());
+    REQUIRE(p0->getFloodSlot() == std::numeric_limits<size_t>::max());
+    REQUIRE(floodgate().getPeersKnows(h).empty());
+
+    // The new peer takes the freed slot, but not what p0 was told.
+    auto p2 = addFloodPeer(2002);
+    REQUIRE(p2->getFloodSlot() == 0);
+    REQUIRE(floodgate().getPeersKnows(h).empty());
+    floodgate().broadcast(msg);
+    REQUIRE(p0->sent == 0);
+    REQUIRE(p1->sent == 1);
+    REQUIRE(p2->sent == 1);
+    REQUIRE(floodgate().getPeersKnows(h) ==
+            std::set<Peer::pointer>{p1, p2});
+
+    // Removing the last peer frees its slot for the next one too.
+    floodgate().removePeer(p1.get());
+    auto p3 = addFloodPeer(2003);
+    REQUIRE(p3->getFloodSlot() == 1);
+    floodgate().broadcast(msg);
+    REQUIRE(p2->sent == 1);
+    REQUIRE(p3->sent == 1);
+}
+
+TEST_CASE_METHOD(OverlayManagerTests, "Floodgate with more peers than slots",
+                 "[overlay][flood]")
+{
+    auto const peerCount = Floodgate::MAX_PEER_SLOTS + 10;
+    std::vector<std::shared_ptr<PeerStub>> peers;
+    for (size_t i = 0; i < peerCount; ++i)
+    {
+        auto port = static_cast<unsigned short>(2000 + i);
+        peers.emplace_back(addFloodPeer(port));
+        REQUIRE(peers.back()->getFloodSlot() == i);
+    }
+
+    // Peers past the last slot are never noted as told, so are sent the
+    // message every time it is broadcast; the others only once.
+    auto msg = floodMessage(1);
+    auto h = sha256(xdr::xdr_to_opaque(msg));
+    REQUIRE(floodgate().addRecord(msg, peers.back()));
+    floodgate().broadcast(msg);
+    floodgate().broadcast(msg);
+    for (size_t i = 0; i < peerCount; ++i)
+    {
+        REQUIRE(peers[i]->sent == (i < Floodgate::MAX_PEER_SLOTS ? 1 : 2));
+    }
+    REQUIRE(floodgate().getPeersKnows(h).size() == Floodgate::MAX_PEER_SLOTS);
+
+    // Freeing a slot below the limit lets the next peer be noted again.
+    floodgate().removePeer(peers[3].get());
+    auto extra = addFloodPeer(3000);
+    REQUIRE(extra->getFloodSlot() == 3);
+    floodgate().broadcast(msg);
+    REQUIRE(extra->sent == 1);
+    floodgate().broadcast(msg);
+    REQUIRE(extra->sent == 1);
+    REQUIRE(peers.back()->sent == 4);
+
+    floodgate().removePeer(peers.back().get());
+    REQUIRE(peers.back()->getFloodSlot() ==
+            std::numeric_limits<size_t>::max());
+    REQUIRE(floodgate().getPeersKnows(h).size() == Floodgate::MAX_PEER_SLOTS);
+}
 }
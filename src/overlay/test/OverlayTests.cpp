@@ -5,6 +5,7 @@
 #include "crypto/KeyUtils.h"
 #include "crypto/SecretKey.h"
 #include "lib/catch.hpp"
+#include "lib/json/json.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "overlay/BanManager.h"
@@ -79,6 +80,75 @@ TEST_CASE("loopback peer hello", "[overlay][connections]")
     REQUIRE(knowsAsInbound(*app2, *app1));
 }
 
+TEST_CASE("loopback peer stats", "[overlay][connections]")
+{
+    VirtualClock clock;
+    Config const& cfg1 = getTestConfig(0);
+    Config const& cfg2 = getTestConfig(1);
+    auto app1 = createTestApplication(clock, cfg1);
+    auto app2 = createTestApplication(clock, cfg2);
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getInitiator()->isAuthenticated());
+    REQUIRE(conn.getAcceptor()->isAuthenticated());
+
+    auto stats1 = conn.getInitiator()->getStats().toJson();
+    auto stats2 = conn.getAcceptor()->getStats().toJson();
+    for (auto const& type : {"HELLO", "AUTH"})
+    {
+        REQUIRE(stats1["messages"][type]["send_messages"].asUInt64() == 1);
+        REQUIRE(stats1["messages"][type]["recv_messages"].asUInt64() == 1);
+        REQUIRE(stats2["messages"][type]["send_messages"].asUInt64() == 1);
+        REQUIRE(stats2["messages"][type]["recv_messages"].asUInt64() == 1);
+        REQUIRE(stats1["messages"][type]["send_bytes"].asUInt64() > 0);
+        REQUIRE(stats2["messages"][type]["recv_bytes"].asUInt64() > 0);
+    }
+}
+
+TEST_CASE("loopback peer resumes session", "[overlay][connections]")
+{
+    VirtualClock clock;
+    Config const& cfg1 = getTestConfig(0);
+    Config const& cfg2 = getTestConfig(1);
+    auto app1 = createTestApplication(clock, cfg1);
+    auto app2 = createTestApplication(clock, cfg2);
+
+    auto& full1 = app1->getMetrics().NewMeter(
+        {"overlay", "handshake", "full"}, "session");
+    auto& resumed1 = app1->getMetrics().NewMeter(
+        {"overlay", "handshake", "resumed"}, "session");
+    auto& full2 = app2->getMetrics().NewMeter(
+        {"overlay", "handshake", "full"}, "session");
+    auto& resumed2 = app2->getMetrics().NewMeter(
+        {"overlay", "handshake", "resumed"}, "session");
+
+    {
+        LoopbackPeerConnection conn(*app1, *app2);
+        testutil::crankSome(clock);
+        REQUIRE(conn.getInitiator()->isAuthenticated());
+        REQUIRE(conn.getAcceptor()->isAuthenticated());
+        conn.getInitiator()->drop("test",
+                                  Peer::DropDirection::WE_DROPPED_REMOTE,
+                                  Peer::DropMode::IGNORE_WRITE_QUEUE);
+        testutil::crankSome(clock);
+    }
+    REQUIRE(full1.count() == 1);
+    REQUIRE(full2.count() == 1);
+    REQUIRE(resumed1.count() == 0);
+    REQUIRE(resumed2.count() == 0);
+
+    // Same certs, so no signature check or ECDH this time.
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getInitiator()->isAuthenticated());
+    REQUIRE(conn.getAcceptor()->isAuthenticated());
+    REQUIRE(full1.count() == 1);
+    REQUIRE(full2.count() == 1);
+    REQUIRE(resumed1.count() == 1);
+    REQUIRE(resumed2.count() == 1);
+}
+
 TEST_CASE("loopback peer with 0 port", "[overlay][connections]")
 {
     VirtualClock clock;
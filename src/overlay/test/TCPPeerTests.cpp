@@ -2,17 +2,26 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "herder/Herder.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/histogram.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/PeerBareAddress.h"
 #include "overlay/PeerDoor.h"
 #include "overlay/TCPPeer.h"
 #include "simulation/Simulation.h"
+#include "test/TestAccount.h"
+#include "test/TxTests.h"
 #include "test/test.h"
+#include "transactions/TransactionFrame.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
+#include "xdrpp/marshal.h"
+#include <future>
 
 namespace stellar
 {
@@ -20,8 +29,21 @@ namespace stellar
 TEST_CASE("TCPPeer can communicate", "[overlay]")
 {
     Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::ConfigGen cfgGen = nullptr;
+    SECTION("default")
+    {
+    }
+    SECTION("one message per crank")
+    {
+        cfgGen = [](int i) {
+            Config cfg = getTestConfig(i);
+            cfg.ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING = true;
+            cfg.PEER_MESSAGES_PER_CRANK = 1;
+            return cfg;
+        };
+    }
     Simulation::pointer s =
-        std::make_shared<Simulation>(Simulation::OVER_TCP, networkID);
+        std::make_shared<Simulation>(Simulation::OVER_TCP, networkID, cfgGen);
 
     auto v10SecretKey = SecretKey::fromSeed(sha256("v10"));
     auto v11SecretKey = SecretKey::fromSeed(sha256("v11"));
@@ -53,4 +75,438 @@ TEST_CASE("TCPPeer can communicate", "[overlay]")
     REQUIRE(p1->isAuthenticated());
     s->stopAllNodes();
 }
+
+class TCPPeerTests
+{
+  protected:
+    Simulation::pointer mSimulation;
+    Application::pointer mNode0;
+    Application::pointer mNode1;
+    // mNode0's connection to mNode1, and mNode1's to mNode0.
+    std::shared_ptr<TCPPeer> mPeer0;
+    std::shared_ptr<TCPPeer> mPeer1;
+
+    // Connects two nodes that only close ledgers when told to, so that the
+    // transactions the test sends stay queued where they arrive.
+    void
+    connect(std::function<void(Config&)> const& adjust = nullptr)
+    {
+        Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+        mSimulation = std::make_shared<Simulation>(
+            Simulation::OVER_TCP, networkID, [adjust](int i) {
+                Config cfg = getTestConfig(i);
+                cfg.MANUAL_CLOSE = true;
+                if (adjust)
+                {
+                    adjust(cfg);
+                }
+                return cfg;
+            });
+
+        auto v10SecretKey = SecretKey::fromSeed(sha256("v10"));
+        auto v11SecretKey = SecretKey::fromSeed(sha256("v11"));
+
+        SCPQuorumSet n0_qset;
+        n0_qset.threshold = 1;
+        n0_qset.validators.push_back(v10SecretKey.getPublicKey());
+        mNode0 = mSimulation->addNode(v10SecretKey, n0_qset);
+
+        SCPQuorumSet n1_qset;
+        n1_qset.threshold = 1;
+        n1_qset.validators.push_back(v11SecretKey.getPublicKey());
+        mNode1 = mSimulation->addNode(v11SecretKey, n1_qset);
+
+        mSimulation->addPendingConnection(v10SecretKey.getPublicKey(),
+                                          v11SecretKey.getPublicKey());
+        mSimulation->startAllNodes();
+        mSimulation->crankForAtLeast(std::chrono::seconds(1), false);
+
+        mPeer0 = std::static_pointer_cast<TCPPeer>(
+            mNode0->getOverlayManager().getConnectedPeer(
+                PeerBareAddress{"127.0.0.1", mNode1->getConfig().PEER_PORT}));
+        mPeer1 = std::static_pointer_cast<TCPPeer>(
+            mNode1->getOverlayManager().getConnectedPeer(
+                PeerBareAddress{"127.0.0.1", mNode0->getConfig().PEER_PORT}));
+        REQUIRE(mPeer0);
+        REQUIRE(mPeer1);
+        REQUIRE(mPeer0->isAuthenticated());
+        REQUIRE(mPeer1->isAuthenticated());
+    }
+
+    // `n` valid transactions from the root account, in sequence.
+    std::vector<StellarMessage>
+    transactions(size_t n)
+    {
+        auto root = TestAccount::createRoot(*mNode0);
+        std::vector<StellarMessage> msgs;
+        for (size_t i = 0; i < n; ++i)
+        {
+            auto dest = SecretKey::pseudoRandomForTesting();
+            auto tx = root.tx(
+                {txtest::createAccount(dest.getPublicKey(), 10000000)});
+            msgs.emplace_back(tx->toStellarMessage());
+        }
+        return msgs;
+    }
+
+    // The sequence number of the last of the root account's transactions
+    // that mNode1 has queued: those only queue in order, so this is as far
+    // as it has received them in order.
+    SequenceNumber
+    queuedSeq()
+    {
+        auto root = txtest::getRoot(mNode1->getNetworkID());
+        return mNode1->getHerder().getMaxSeqInPendingTxs(root.getPublicKey());
+    }
+
+    static SequenceNumber
+    seqOf(StellarMessage const& msg)
+    {
+        return msg.transaction().tx.seqNum;
+    }
+
+    // The frames mPeer0 would write for `msgs`, which take their sequence
+    // numbers, to be tampered with before writeFrames.
+    std::vector<xdr::msg_ptr>
+    frames(std::vector<StellarMessage> const& msgs)
+    {
+        std::vector<xdr::msg_ptr> res;
+        for (auto const& msg : msgs)
+        {
+            auto encoded = std::make_shared<xdr::opaque_vec<> const>(
+                xdr::xdr_to_opaque(msg));
+            res.emplace_back(
+                mPeer0->frameMessage(msg.type(), encoded).toMsg());
+        }
+        return res;
+    }
+
+    // Writes `frames` to mPeer0's socket in one go, so that mNode1 reads
+    // them, and so decodes them, together.
+    void
+    writeFrames(std::vector<xdr::msg_ptr> const& frames)
+    {
+        REQUIRE(!mPeer0->mWriting);
+        std::vector<uint8_t> bytes;
+        for (auto const& frame : frames)
+        {
+            bytes.insert(bytes.end(), frame->raw_data(),
+                         frame->raw_data() + frame->raw_size());
+        }
+        asio::write(mPeer0->mSocket->next_layer(), asio::buffer(bytes));
+    }
+
+    // Makes mPeer0 skip a sequence number, as if it had lost a frame.
+    void
+    skipSendSequence()
+    {
+        ++mPeer0->mSendMacSeq;
+    }
+
+    // Whether mPeer1 has a batch on a worker.
+    bool
+    decoding()
+    {
+        return mPeer1->mDecoding;
+    }
+
+    // Holds up mNode1's worker thread (connect with WORKER_THREADS = 1)
+    // until releaseWorker, and with it whatever batch is handed to it.
+    void
+    holdWorker()
+    {
+        mWorkerHeld = std::make_shared<std::promise<void>>();
+        auto released = mWorkerHeld->get_future().share();
+        mNode1->postOnBackgroundThread([released]() { released.wait(); },
+                                       "TCPPeerTests: hold worker");
+    }
+
+    void
+    releaseWorker()
+    {
+        if (mWorkerHeld)
+        {
+            mWorkerHeld->set_value();
+            mWorkerHeld.reset();
+        }
+    }
+
+    uint64_t
+    meterCount(Application& app, medida::MetricName const& name)
+    {
+        return app.getMetrics().NewMeter(name, "message").count();
+    }
+
+  private:
+    std::shared_ptr<std::promise<void>> mWorkerHeld;
+
+  public:
+    ~TCPPeerTests()
+    {
+        // The worker would otherwise never be joined.
+        releaseWorker();
+        if (mSimulation)
+        {
+            mSimulation->stopAllNodes();
+        }
+    }
+};
+
+TEST_CASE_METHOD(TCPPeerTests, "TCPPeer prefilters flooded duplicates",
+                 "[overlay]")
+{
+    connect();
+    auto msgs = transactions(1);
+    auto prefiltered = meterCount(*mNode1, {"overlay", "flood", "prefiltered"});
+
+    mPeer0->sendMessage(msgs[0]);
+    mSimulation->crankUntil([&]() { return queuedSeq() == seqOf(msgs[0]); },
+                            std::chrono::seconds(10), false);
+    REQUIRE(meterCount(*mNode1, {"overlay", "flood", "prefiltered"}) ==
+            prefiltered);
+
+    // Floodgate has it now, so the worker does not even decode it again.
+    mPeer0->sendMessage(msgs[0]);
+    mSimulation->crankUntil(
+        [&]() {
+            return meterCount(*mNode1, {"overlay", "flood", "prefiltered"}) ==
+                   prefiltered + 1;
+        },
+        std::chrono::seconds(10), false);
+    REQUIRE(mPeer1->isAuthenticated());
+    REQUIRE(queuedSeq() == seqOf(msgs[0]));
+}
+
+TEST_CASE_METHOD(TCPPeerTests, "TCPPeer drops on a bad message mid-batch",
+                 "[overlay]")
+{
+    connect();
+    auto msgs = transactions(3);
+    std::vector<xdr::msg_ptr> batch;
+
+    SECTION("bad MAC")
+    {
+        batch = frames(msgs);
+        // The last byte of the MAC.
+        batch[1]->raw_data()[batch[1]->raw_size() - 1] ^= 1;
+    }
+    SECTION("bad sequence number")
+    {
+        batch = frames({msgs[0]});
+        skipSendSequence();
+        auto rest = frames({msgs[1], msgs[2]});
+        batch.insert(batch.end(), rest.begin(), rest.end());
+    }
+    SECTION("corrupt XDR")
+    {
+        batch = frames(msgs);
+        // An unknown message type, after the record mark, v and sequence.
+        std::fill(batch[1]->raw_data() + 16, batch[1]->raw_data() + 20,
+                  char(0xff));
+    }
+
+    writeFrames(batch);
+    mSimulation->crankUntil(
+        [&]() { return mPeer1->getState() == Peer::CLOSING; },
+        std::chrono::seconds(10), false);
+
+    // What came before the bad message is delivered, and nothing after it.
+    REQUIRE(queuedSeq() == seqOf(msgs[0]));
+}
+
+TEST_CASE_METHOD(TCPPeerTests, "TCPPeer delivers in order across batches",
+                 "[overlay]")
+{
+    std::function<void(Config&)> adjust;
+    SECTION("default")
+    {
+    }
+    SECTION("one message per crank")
+    {
+        adjust = [](Config& cfg) { cfg.PEER_MESSAGES_PER_CRANK = 1; };
+    }
+    connect(adjust);
+
+    // More than fit in the read buffer, so that they are read, and decoded,
+    // in several batches, some split between two reads.
+    auto msgs = transactions(400);
+    auto& batches =
+        mNode1->getMetrics().NewHistogram({"overlay", "decode", "batch"});
+    auto before = batches.count();
+
+    for (auto const& msg : msgs)
+    {
+        mPeer0->sendMessage(msg);
+    }
+    mSimulation->crankUntil(
+        [&]() { return queuedSeq() == seqOf(msgs.back()); },
+        std::chrono::seconds(20), false);
+
+    REQUIRE(batches.count() >= before + 2);
+    REQUIRE(mPeer1->isAuthenticated());
+}
+
+TEST_CASE_METHOD(TCPPeerTests, "TCPPeer dropped while a batch is on a worker",
+                 "[overlay]")
+{
+    connect([](Config& cfg) { cfg.WORKER_THREADS = 1; });
+    auto msgs = transactions(3);
+
+    holdWorker();
+    for (auto const& msg : msgs)
+    {
+        mPeer0->sendMessage(msg);
+    }
+    mSimulation->crankUntil([&]() { return decoding(); },
+                            std::chrono::seconds(10), false);
+
+    SECTION("peer still around when the batch is back")
+    {
+        mPeer1->drop("test", Peer::DropDirection::WE_DROPPED_REMOTE,
+                     Peer::DropMode::IGNORE_WRITE_QUEUE);
+        releaseWorker();
+        mSimulation->crankUntil([&]() { return !decoding(); },
+                                std::chrono::seconds(10), false);
+    }
+    SECTION("peer gone when the batch is back")
+    {
+        std::weak_ptr<TCPPeer> weak = mPeer1;
+        mPeer1->drop("test", Peer::DropDirection::WE_DROPPED_REMOTE,
+                     Peer::DropMode::IGNORE_WRITE_QUEUE);
+        mPeer1.reset();
+        mSimulation->crankUntil([&]() { return weak.expired(); },
+                                std::chrono::seconds(10), false);
+        releaseWorker();
+        mSimulation->crankForAtLeast(std::chrono::seconds(1), false);
+    }
+
+    REQUIRE(queuedSeq() == 0);
+}
+
+TEST_CASE_METHOD(TCPPeerTests, "TCPPeer sends consensus messages first",
+                 "[overlay]")
+{
+    connect();
+    auto msgs = transactions(3);
+
+    // The first transaction is written straight away, and the others wait
+    // for it to be. An ERROR_MSG goes in the same queue as consensus
+    // messages, so overtakes them, and has mNode1 drop the peer as soon as
+    // it gets it.
+    REQUIRE(mPeer0->getSendQueueBytes() == 0);
+    for (auto const& msg : msgs)
+    {
+        mPeer0->sendMessage(msg);
+    }
+    StellarMessage error;
+    error.type(ERROR_MSG);
+    error.error().code = ERR_MISC;
+    error.error().msg = "test";
+    mPeer0->sendMessage(error);
+
+    mSimulation->crankUntil(
+        [&]() { return mPeer1->getState() == Peer::CLOSING; },
+        std::chrono::seconds(10), false);
+    REQUIRE(queuedSeq() == seqOf(msgs[0]));
+}
+
+TEST_CASE_METHOD(TCPPeerTests, "TCPPeer sheds what does not fit its queues",
+                 "[overlay]")
+{
+    connect([](Config& cfg) {
+        cfg.PEER_SEND_QUEUE_FETCH_BYTES = 1024;
+        cfg.PEER_SEND_QUEUE_FLOOD_BYTES = 1024;
+    });
+    auto msgs = transactions(20);
+    auto shed = meterCount(*mNode0, {"overlay", "send", "shed"});
+
+    // All sent before a crank, so only the first is being written, and no
+    // more than a few fit in the queue behind it.
+    REQUIRE(mPeer0->getSendQueueBytes() == 0);
+    for (auto const& msg : msgs)
+    {
+        mPeer0->sendMessage(msg);
+    }
+    auto floodShed = meterCount(*mNode0, {"overlay", "send", "shed"}) - shed;
+    REQUIRE(floodShed > 0);
+    REQUIRE(floodShed < msgs.size() - 1);
+
+    StellarMessage dontHave;
+    dontHave.type(DONT_HAVE);
+    dontHave.dontHave().type = TX_SET;
+    for (int i = 0; i < 40; ++i)
+    {
+        mPeer0->sendMessage(dontHave);
+    }
+    REQUIRE(meterCount(*mNode0, {"overlay", "send", "shed"}) >
+            shed + floodShed);
+
+    // What was not shed arrives, the shed transactions being the last.
+    auto lastSent = seqOf(msgs[msgs.size() - floodShed - 1]);
+    mSimulation->crankUntil([&]() { return queuedSeq() == lastSent; },
+                            std::chrono::seconds(10), false);
+    mSimulation->crankForAtLeast(std::chrono::seconds(1), false);
+    REQUIRE(queuedSeq() == lastSent);
+    REQUIRE(mPeer0->getSendQueueBytes() == 0);
+    REQUIRE(mPeer0->isAuthenticated());
+    REQUIRE(mPeer1->isAuthenticated());
+}
+
+TEST_CASE_METHOD(TCPPeerTests,
+                 "TCPPeer drops a peer whose consensus queue overflows",
+                 "[overlay]")
+{
+    connect([](Config& cfg) { cfg.PEER_SEND_QUEUE_SCP_BYTES = 4096; });
+    auto overflows =
+        meterCount(*mNode0, {"overlay", "drop", "queue-overflow"});
+
+    // mNode1 discards them, as it does not take part in consensus.
+    StellarMessage scp;
+    scp.type(SCP_MESSAGE);
+    for (int i = 0; i < 100; ++i)
+    {
+        mPeer0->sendMessage(scp);
+    }
+
+    // Dropped once, and only once the caller is done sending.
+    REQUIRE(meterCount(*mNode0, {"overlay", "drop", "queue-overflow"}) ==
+            overflows + 1);
+    REQUIRE(mPeer0->isAuthenticated());
+    mSimulation->crankUntil(
+        [&]() { return mPeer0->getState() == Peer::CLOSING; },
+        std::chrono::seconds(10), false);
+    REQUIRE(meterCount(*mNode0, {"overlay", "drop", "queue-overflow"}) ==
+            overflows + 1);
+}
+
+TEST_CASE_METHOD(TCPPeerTests, "TCPPeer writes out queued messages in batches",
+                 "[overlay]")
+{
+    connect();
+    // More than fit in two writes.
+    auto msgs = transactions(2500);
+    auto& batches = mNode0->getMetrics().NewHistogram(
+        {"overlay", "write", "batch-messages"});
+    auto before = batches.count();
+
+    REQUIRE(mPeer0->getSendQueueBytes() == 0);
+    for (auto const& msg : msgs)
+    {
+        mPeer0->sendMessage(msg);
+    }
+    REQUIRE(mPeer0->getSendQueueBytes() > MAX_WRITE_BATCH_SIZE);
+
+    mSimulation->crankUntil(
+        [&]() {
+            return queuedSeq() == seqOf(msgs.back()) &&
+                   mPeer0->getSendQueueBytes() == 0;
+        },
+        std::chrono::seconds(30), false);
+
+    // The first on its own, then the rest in a few writes.
+    auto writes = batches.count() - before;
+    REQUIRE(writes >= 3);
+    REQUIRE(writes < msgs.size() / 100);
+    REQUIRE(mPeer1->isAuthenticated());
+}
 }
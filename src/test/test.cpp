@@ -185,6 +185,8 @@ getTestConfig(int instanceNumber, Config::TestDbMode mode)
         thisConfig.REPORT_METRICS = gTestMetrics;
         // disable maintenance
         thisConfig.AUTOMATIC_MAINTENANCE_COUNT = 0;
+        // tests do not survive crashes anyway
+        thisConfig.DISABLE_XDR_FSYNC = true;
     }
     return *cfgs[instanceNumber];
 }
@@ -0,0 +1,164 @@
+// Copyright 2019 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/MappedFile.h"
+#include "util/Logging.h"
+#include <cerrno>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace stellar
+{
+
+namespace
+{
+// `error` is errno, or GetLastError() on Windows, read before any cleanup
+// that could overwrite it.
+void
+throwOpenError(std::string const& filename, std::string const& what, int error)
+{
+    std::string msg("failed to map file: ");
+    msg += filename;
+    msg += ", ";
+    msg += what;
+    msg += ", reason: ";
+    msg += std::to_string(error);
+    CLOG(ERROR, "Fs") << msg;
+    throw std::runtime_error(msg);
+}
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#ifdef _WIN32
+
+void
+MappedFile::open(std::string const& filename)
+{
+    close();
+    HANDLE file = ::CreateFileA(filename.c_str(), GENERIC_READ,
+                                FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                                OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        throwOpenError(filename, "open", static_cast<int>(::GetLastError()));
+    }
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file, &size))
+    {
+        int error = static_cast<int>(::GetLastError());
+        ::CloseHandle(file);
+        throwOpenError(filename, "size", error);
+    }
+    mFile = file;
+    mSize = static_cast<size_t>(size.QuadPart);
+    mOpen = true;
+    if (mSize == 0)
+    {
+        // Empty files cannot be mapped, and there is nothing to read anyway.
+        return;
+    }
+
+    mMapping = ::CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mMapping != NULL)
+    {
+        mData = static_cast<char const*>(
+            ::MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (mData == nullptr)
+    {
+        int error = static_cast<int>(::GetLastError());
+        close();
+        throwOpenError(filename, "map", error);
+    }
+}
+
+void
+MappedFile::close()
+{
+    if (mData)
+    {
+        ::UnmapViewOfFile(mData);
+    }
+    if (mMapping)
+    {
+        ::CloseHandle(mMapping);
+    }
+    if (mFile)
+    {
+        ::CloseHandle(mFile);
+    }
+    mData = nullptr;
+    mMapping = nullptr;
+    mFile = nullptr;
+    mSize = 0;
+    mOpen = false;
+}
+
+#else
+
+void
+MappedFile::open(std::string const& filename)
+{
+    close();
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throwOpenError(filename, "open", errno);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+        int error = errno;
+        ::close(fd);
+        throwOpenError(filename, "stat", error);
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void* data = nullptr;
+    if (size != 0)
+    {
+        // The mapping stays valid once the descriptor is closed.
+        data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            int error = errno;
+            ::close(fd);
+            throwOpenError(filename, "map", error);
+        }
+        // Only a hint, so failure is harmless.
+        ::madvise(data, size, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+
+    mData = static_cast<char const*>(data);
+    mSize = size;
+    mOpen = true;
+}
+
+void
+MappedFile::close()
+{
+    if (mData)
+    {
+        ::munmap(const_cast<char*>(mData), mSize);
+    }
+    mData = nullptr;
+    mSize = 0;
+    mOpen = false;
+}
+
+#endif
+}
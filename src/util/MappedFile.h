@@ -0,0 +1,60 @@
+#pragma once
+
+// Copyright 2019 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include <cstddef>
+#include <string>
+
+namespace stellar
+{
+
+/**
+ * Read-only memory mapping of a whole file, for reading it front to back
+ * without copying it through a stream buffer. The file must not be truncated
+ * while it is mapped, so this is only for files that never change once
+ * written, such as buckets and downloaded history files.
+ */
+class MappedFile : NonMovableOrCopyable
+{
+    bool mOpen{false};
+    char const* mData{nullptr};
+    size_t mSize{0};
+#ifdef _WIN32
+    void* mFile{nullptr};
+    void* mMapping{nullptr};
+#endif
+
+  public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    // Map `filename`, hinting to the kernel that it will be read
+    // sequentially. Throws if the file cannot be opened or mapped.
+    void open(std::string const& filename);
+
+    // Unmap the file, if any. Does nothing otherwise.
+    void close();
+
+    bool
+    isOpen() const
+    {
+        return mOpen;
+    }
+
+    // Start of the mapped file; nullptr if the file is empty.
+    char const*
+    data() const
+    {
+        return mData;
+    }
+
+    size_t
+    size() const
+    {
+        return mSize;
+    }
+};
+}
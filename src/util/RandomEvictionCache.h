@@ -55,6 +55,10 @@ class RandomEvictionCache : public NonMovableOrCopyable
     // Each cache keeps some counters just to monitor its performance.
     Counters mCounters;
 
+    // Source of the random choices; gRandomEngine unless the cache is used
+    // off the main thread.
+    std::default_random_engine& mRandom;
+
     // Randomly pick two elements and evict the less-recently-used one.
     void
     evictOne()
@@ -64,8 +68,9 @@ class RandomEvictionCache : public NonMovableOrCopyable
         {
             return;
         }
-        MapValueType*& vp1 = mValuePtrs.at(rand_uniform<size_t>(0, sz - 1));
-        MapValueType*& vp2 = mValuePtrs.at(rand_uniform<size_t>(0, sz - 1));
+        std::uniform_int_distribution<size_t> dist(0, sz - 1);
+        MapValueType*& vp1 = mValuePtrs.at(dist(mRandom));
+        MapValueType*& vp2 = mValuePtrs.at(dist(mRandom));
         MapValueType*& victim =
             (vp1->second.mLastAccess < vp2->second.mLastAccess ? vp1 : vp2);
         mValueMap.erase(victim->first);
@@ -75,7 +80,13 @@ class RandomEvictionCache : public NonMovableOrCopyable
     }
 
   public:
-    explicit RandomEvictionCache(size_t maxSize) : mMaxSize(maxSize)
+    explicit RandomEvictionCache(size_t maxSize)
+        : RandomEvictionCache(maxSize, gRandomEngine)
+    {
+    }
+
+    RandomEvictionCache(size_t maxSize, std::default_random_engine& random)
+        : mMaxSize(maxSize), mRandom(random)
     {
         mValueMap.reserve(maxSize + 1);
         mValuePtrs.reserve(maxSize + 1);
@@ -0,0 +1,381 @@
+// Copyright 2019 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/XDRStream.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace stellar
+{
+
+size_t const XDROutputFileStream::DEFAULT_BUFFER_SIZE = 256 * 1024;
+
+namespace
+{
+// O_DIRECT requires buffer addresses, lengths and file offsets to be
+// multiples of the device's logical block size; 4096 covers every device we
+// are likely to meet.
+size_t const BUFFER_ALIGNMENT = 4096;
+
+char*
+allocateBuffer(size_t size)
+{
+#ifdef _WIN32
+    void* p = _aligned_malloc(size, BUFFER_ALIGNMENT);
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, BUFFER_ALIGNMENT, size) != 0)
+    {
+        p = nullptr;
+    }
+#endif
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return static_cast<char*>(p);
+}
+
+void
+freeBuffer(char* p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+size_t
+roundUpBufferSize(size_t size)
+{
+    size = std::max(size, BUFFER_ALIGNMENT);
+    return (size + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+}
+
+int
+openForWriting(std::string const& filename, bool direct)
+{
+#ifdef _WIN32
+    (void)direct;
+    return ::_open(filename.c_str(),
+                   _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY,
+                   _S_IREAD | _S_IWRITE);
+#else
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+    if (direct)
+    {
+        flags |= O_DIRECT;
+    }
+#endif
+    return ::open(filename.c_str(), flags, 0644);
+#endif
+}
+
+// Turn page-cache bypass on or off for `fd`; returns whether that worked.
+bool
+setDirect(int fd, bool direct)
+{
+#if defined(O_DIRECT)
+    int flags = ::fcntl(fd, F_GETFL);
+    if (flags == -1)
+    {
+        return false;
+    }
+    flags = direct ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+    return ::fcntl(fd, F_SETFL, flags) == 0;
+#elif defined(F_NOCACHE)
+    return ::fcntl(fd, F_NOCACHE, direct ? 1 : 0) == 0;
+#else
+    (void)fd;
+    return !direct;
+#endif
+}
+
+bool
+syncData(int fd)
+{
+#if defined(_WIN32)
+    return ::_commit(fd) == 0;
+#elif defined(__APPLE__)
+    return ::fsync(fd) == 0;
+#else
+    return ::fdatasync(fd) == 0;
+#endif
+}
+
+bool
+closeFile(int fd)
+{
+#ifdef _WIN32
+    return ::_close(fd) == 0;
+#else
+    return ::close(fd) == 0;
+#endif
+}
+}
+
+XDROutputFileStream::XDROutputFileStream(bool fsyncOnClose, size_t bufferSize,
+                                         bool directIO)
+    : mFsyncOnClose(fsyncOnClose)
+    , mDirectIO(directIO)
+    , mBufferSize(roundUpBufferSize(bufferSize))
+    , mBuffer(nullptr, freeBuffer)
+{
+}
+
+XDROutputFileStream::~XDROutputFileStream()
+{
+    if (mFd == -1)
+    {
+        return;
+    }
+    // Like an ofstream, write out whatever is buffered; but there is no way
+    // to report failure from here, so callers that care must close().
+    try
+    {
+        flushBuffer();
+    }
+    catch (std::exception& e)
+    {
+        CLOG(ERROR, "Fs") << "failed to flush XDR file " << mFilename << ": "
+                          << e.what();
+    }
+    closeFile(mFd);
+}
+
+void
+XDROutputFileStream::open(std::string const& filename)
+{
+    int fd = -1;
+    bool direct = false;
+    if (mFd == -1)
+    {
+        if (mDirectIO)
+        {
+            fd = openForWriting(filename, true);
+#ifdef O_DIRECT
+            direct = fd != -1;
+#elif defined(F_NOCACHE)
+            direct = fd != -1 && setDirect(fd, true);
+#endif
+        }
+        // Some filesystems (tmpfs, for one) refuse O_DIRECT, in which case
+        // the file is written through the page cache after all.
+        if (fd == -1)
+        {
+            fd = openForWriting(filename, false);
+        }
+    }
+    else
+    {
+        errno = EBUSY;
+    }
+    if (fd == -1)
+    {
+        std::string msg("failed to open XDR file: ");
+        msg += filename;
+        msg += ", reason: ";
+        msg += std::to_string(errno);
+        CLOG(FATAL, "Fs") << msg;
+        throw std::runtime_error(msg);
+    }
+
+    if (!mBuffer)
+    {
+        mBuffer.reset(allocateBuffer(mBufferSize));
+    }
+    mFilename = filename;
+    mFd = fd;
+    mDirect = direct;
+    mBuffered = 0;
+}
+
+void
+XDROutputFileStream::close()
+{
+    if (mFd == -1)
+    {
+        errno = EBADF;
+        std::string msg("failed to close XDR file");
+        msg += ", reason: ";
+        msg += std::to_string(errno);
+        throw std::runtime_error(msg);
+    }
+
+    // Whatever fails, the descriptor is released and the first error is the
+    // one reported.
+    std::string error;
+    try
+    {
+        flushBuffer();
+    }
+    catch (std::ios_base::failure&)
+    {
+        error = errorMessage("write");
+    }
+    if (error.empty() && mFsyncOnClose && !syncData(mFd))
+    {
+        error = errorMessage("sync");
+    }
+    if (!closeFile(mFd) && error.empty())
+    {
+        error = errorMessage("close");
+    }
+    mFd = -1;
+    mBuffered = 0;
+
+    if (!error.empty())
+    {
+        CLOG(ERROR, "Fs") << error;
+        throw std::runtime_error(error);
+    }
+}
+
+void
+XDROutputFileStream::writeBytes(char const* data, size_t n, SHA256* hasher,
+                                size_t* bytesPut)
+{
+    if (mFd == -1)
+    {
+        throw std::ios_base::failure("no open XDR file to write to");
+    }
+    if (hasher)
+    {
+        hasher->add(ByteSlice(data, n));
+    }
+    commit(data, n);
+    if (bytesPut)
+    {
+        *bytesPut += n;
+    }
+}
+
+char*
+XDROutputFileStream::reserve(size_t n)
+{
+    if (mFd == -1)
+    {
+        throw std::ios_base::failure("no open XDR file to write to");
+    }
+    if (n <= mBufferSize - mBuffered)
+    {
+        return mBuffer.get() + mBuffered;
+    }
+    if (mSpill.size() < n)
+    {
+        mSpill.resize(n);
+    }
+    return mSpill.data();
+}
+
+void
+XDROutputFileStream::commit(char const* data, size_t n)
+{
+    char* buf = mBuffer.get();
+    if (data == buf + mBuffered)
+    {
+        // Encoded in place by writeOne.
+        mBuffered += n;
+        if (mBuffered == mBufferSize)
+        {
+            flushBuffer();
+        }
+        return;
+    }
+
+    // Encoded into mSpill: top up the buffer and write it out, as many
+    // times as it takes.
+    while (n != 0)
+    {
+        size_t chunk = std::min(n, mBufferSize - mBuffered);
+        std::memcpy(buf + mBuffered, data, chunk);
+        mBuffered += chunk;
+        data += chunk;
+        n -= chunk;
+        if (mBuffered == mBufferSize)
+        {
+            flushBuffer();
+        }
+    }
+}
+
+void
+XDROutputFileStream::flushBuffer()
+{
+    if (mBuffered != 0)
+    {
+        writeAll(mBuffer.get(), mBuffered);
+        mBuffered = 0;
+    }
+}
+
+void
+XDROutputFileStream::writeAll(char const* data, size_t n)
+{
+    while (n != 0)
+    {
+#ifdef _WIN32
+        unsigned int chunk =
+            static_cast<unsigned int>(std::min<size_t>(n, INT32_MAX));
+        int written = ::_write(mFd, data, chunk);
+#else
+        ssize_t written = ::write(mFd, data, n);
+#endif
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // O_DIRECT rejects the final, partial buffer (and would reject
+            // anything after a short write): write the rest through the page
+            // cache instead.
+            if (errno == EINVAL && mDirect && setDirect(mFd, false))
+            {
+                mDirect = false;
+                continue;
+            }
+            throwWriteError("write");
+        }
+        data += written;
+        n -= static_cast<size_t>(written);
+    }
+}
+
+std::string
+XDROutputFileStream::errorMessage(char const* what) const
+{
+    std::string msg("failed to ");
+    msg += what;
+    msg += " XDR file: ";
+    msg += mFilename;
+    msg += ", reason: ";
+    msg += std::to_string(errno);
+    return msg;
+}
+
+void
+XDROutputFileStream::throwWriteError(char const* what) const
+{
+    // Not logged here, so that errno survives for close() to report.
+    throw std::ios_base::failure(errorMessage(what));
+}
+}
@@ -8,9 +8,12 @@
 #include "crypto/SHA.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
+#include "util/MappedFile.h"
+#include "util/NonCopyable.h"
 #include "xdrpp/marshal.h"
 
 #include <fstream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -75,6 +78,16 @@ class XDRInputFileStream
         return mIn.tellg();
     }
 
+    void
+    seek(size_t pos)
+    {
+        mIn.clear();
+        if (!mIn.seekg(pos))
+        {
+            throw std::runtime_error("failed to seek in XDR file");
+        }
+    }
+
     template <typename T>
     bool
     readOne(T& out)
@@ -114,56 +127,187 @@ class XDRInputFileStream
     }
 };
 
-class XDROutputFileStream
+/**
+ * Drop-in replacement for XDRInputFileStream that maps the whole file into
+ * memory and decodes each object straight from the mapped pages, rather than
+ * reading every object through an ifstream into a buffer first. Only for files
+ * that do not change while being read (see MappedFile).
+ */
+class XDRMappedInputFileStream
 {
-    std::ofstream mOut;
-    std::vector<char> mBuf;
+    MappedFile mFile;
+    size_t mSizeLimit;
+    size_t mPos{0};
+    bool mEof{false};
 
   public:
-    XDROutputFileStream()
+    XDRMappedInputFileStream(unsigned int sizeLimit = 0)
+        : mSizeLimit{sizeLimit}
     {
-        mOut.exceptions(std::ifstream::failbit | std::ifstream::badbit);
     }
 
     void
     close()
     {
-        try
-        {
-            mOut.close();
-        }
-        catch (std::ios_base::failure&)
-        {
-            std::string msg("failed to close XDR file");
-            msg += ", reason: ";
-            msg += std::to_string(errno);
-            throw std::runtime_error(msg);
-        }
+        mFile.close();
+        mPos = 0;
+        mEof = false;
     }
 
     void
     open(std::string const& filename)
     {
-        try
+        mFile.open(filename);
+        mPos = 0;
+        mEof = false;
+    }
+
+    // Like ifstream::good(), this only turns false once a read has failed.
+    operator bool() const
+    {
+        return mFile.isOpen() && !mEof;
+    }
+
+    size_t
+    size() const
+    {
+        return mFile.size();
+    }
+
+    size_t
+    pos()
+    {
+        assert(mFile.isOpen());
+        return mPos;
+    }
+
+    void
+    seek(size_t pos)
+    {
+        if (!mFile.isOpen() || pos > mFile.size())
         {
-            mOut.open(filename, std::ofstream::binary | std::ofstream::trunc);
+            throw std::runtime_error("failed to seek in XDR file");
         }
-        catch (std::ios_base::failure&)
+        mPos = pos;
+        mEof = false;
+    }
+
+    template <typename T>
+    bool
+    readOne(T& out)
+    {
+        if (!*this || mFile.size() - mPos < 4)
         {
-            std::string msg("failed to open XDR file: ");
-            msg += filename;
-            msg += ", reason: ";
-            msg += std::to_string(errno);
-            CLOG(FATAL, "Fs") << msg;
-            throw std::runtime_error(msg);
+            mEof = true;
+            return false;
         }
+
+        // Read 4 bytes of size, big-endian, with XDR 'continuation' bit cleared
+        // (high bit of high byte).
+        auto szBuf = reinterpret_cast<uint8_t const*>(mFile.data() + mPos);
+        uint32_t sz = 0;
+        sz |= static_cast<uint8_t>(szBuf[0] & 0x7f);
+        sz <<= 8;
+        sz |= szBuf[1];
+        sz <<= 8;
+        sz |= szBuf[2];
+        sz <<= 8;
+        sz |= szBuf[3];
+        mPos += 4;
+
+        if (mSizeLimit != 0 && sz > mSizeLimit)
+        {
+            return false;
+        }
+        if (mFile.size() - mPos < sz)
+        {
+            mEof = true;
+            throw xdr::xdr_runtime_error("malformed XDR file");
+        }
+        // Every object is a multiple of 4 bytes long, so objects stay 4-byte
+        // aligned within the (page-aligned) mapping.
+        char const* start = mFile.data() + mPos;
+        xdr::xdr_get g(start, start + sz);
+        xdr::xdr_argpack_archive(g, out);
+        mPos += sz;
+        return true;
     }
+};
+
+/**
+ * Helper for writing a sequence of XDR objects to a file one at a time.
+ *
+ * Objects are encoded into a large user-space buffer that is handed to the
+ * kernel with write(2) only once it is full (and at close), so that writing a
+ * big file costs a few large writes rather than one per object. The buffer
+ * size and two further behaviours are chosen at construction:
+ *
+ *  - `fsyncOnClose`: close() does not return until the file contents are
+ *    durable (fdatasync), rather than leaving that to the kernel.
+ *  - `directIO`: the file is written with O_DIRECT where the platform and
+ *    filesystem support it, bypassing the page cache. Worth it for large
+ *    files that are not read back soon; silently ignored where unsupported.
+ */
+class XDROutputFileStream : NonMovableOrCopyable
+{
+  public:
+    static size_t const DEFAULT_BUFFER_SIZE;
+
+  private:
+    std::string mFilename;
+    int mFd{-1};
+    bool const mFsyncOnClose;
+    bool const mDirectIO;
+    bool mDirect{false};
+    size_t const mBufferSize;
+    std::unique_ptr<char, void (*)(char*)> mBuffer;
+    size_t mBuffered{0};
+    // Objects are staged here when they do not fit in what is left of
+    // mBuffer, since O_DIRECT needs every write but the last to be a whole
+    // (aligned) buffer.
+    std::vector<char> mSpill;
+
+    char* reserve(size_t n);
+    void commit(char const* data, size_t n);
+    void flushBuffer();
+    void writeAll(char const* data, size_t n);
+    std::string errorMessage(char const* what) const;
+    [[noreturn]] void throwWriteError(char const* what) const;
+
+  public:
+    XDROutputFileStream(bool fsyncOnClose = false,
+                        size_t bufferSize = DEFAULT_BUFFER_SIZE,
+                        bool directIO = false);
+    ~XDROutputFileStream();
+
+    // Write out what is buffered, make it durable if asked to at
+    // construction, and close the file. Throws std::runtime_error if there is
+    // no open file or any of this fails.
+    void close();
+
+    // Create or truncate `filename` for writing. Throws std::runtime_error if
+    // that fails or a file is already open.
+    void open(std::string const& filename);
 
     operator bool() const
     {
-        return mOut.good();
+        return mFd != -1;
+    }
+
+    // Whether writes actually bypass the page cache; only meaningful while
+    // open.
+    bool
+    isDirect() const
+    {
+        return mDirect;
     }
 
+    // Append `n` bytes holding objects already framed as writeOne frames
+    // them, such as (part of) another file written by an
+    // XDROutputFileStream.
+    void writeBytes(char const* data, size_t n, SHA256* hasher = nullptr,
+                    size_t* bytesPut = nullptr);
+
     template <typename T>
     void
     writeOne(T const& t, SHA256* hasher = nullptr, size_t* bytesPut = nullptr)
@@ -171,30 +315,24 @@ class XDROutputFileStream
         uint32_t sz = (uint32_t)xdr::xdr_size(t);
         assert(sz < 0x80000000);
 
-        if (mBuf.size() < sz + 4)
-        {
-            mBuf.resize(sz + 4);
-        }
+        // Throws std::ios_base::failure if there is no open file.
+        char* buf = reserve(sz + 4);
 
         // Write 4 bytes of size, big-endian, with XDR 'continuation' bit set on
         // high bit of high byte.
-        mBuf[0] = static_cast<char>((sz >> 24) & 0xFF) | '\x80';
-        mBuf[1] = static_cast<char>((sz >> 16) & 0xFF);
-        mBuf[2] = static_cast<char>((sz >> 8) & 0xFF);
-        mBuf[3] = static_cast<char>(sz & 0xFF);
+        buf[0] = static_cast<char>((sz >> 24) & 0xFF) | '\x80';
+        buf[1] = static_cast<char>((sz >> 16) & 0xFF);
+        buf[2] = static_cast<char>((sz >> 8) & 0xFF);
+        buf[3] = static_cast<char>(sz & 0xFF);
 
-        xdr::xdr_put p(mBuf.data() + 4, mBuf.data() + 4 + sz);
+        xdr::xdr_put p(buf + 4, buf + 4 + sz);
         xdr_argpack_archive(p, t);
 
-        // Note: most libraries implement ofstream::write by calling C function
-        // `fwrite`, which does not set errno, so there isn't much info about
-        // why the write failed.
-        mOut.write(mBuf.data(), sz + 4);
-
         if (hasher)
         {
-            hasher->add(ByteSlice(mBuf.data(), sz + 4));
+            hasher->add(ByteSlice(buf, sz + 4));
         }
+        commit(buf, sz + 4);
         if (bytesPut)
         {
             *bytesPut += (sz + 4);
@@ -5,7 +5,14 @@
 #include "bucket/Bucket.h"
 #include "ledger/test/LedgerTestUtils.h"
 #include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+#include "util/Logging.h"
+#include "util/TmpDir.h"
 #include "util/XDRStream.h"
+#include <chrono>
+#include <fstream>
 
 using namespace stellar;
 
@@ -37,3 +44,225 @@ TEST_CASE("XDROutputFileStream fail modes", "[xdrstream]")
         REQUIRE_THROWS_AS(out.close(), std::runtime_error);
     }
 }
+
+static std::vector<BucketEntry>
+writeBucketEntries(std::string const& filename, size_t n)
+{
+    auto entries = Bucket::convertToBucketEntry(
+        false, {}, LedgerTestUtils::generateValidLedgerEntries(n), {});
+    XDROutputFileStream out;
+    out.open(filename);
+    for (auto const& e : entries)
+    {
+        out.writeOne(e);
+    }
+    out.close();
+    return entries;
+}
+
+TEST_CASE("XDROutputFileStream buffering", "[xdrstream]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    auto tmpDir = app->getTmpDirManager().tmpDir("xdrstream");
+    auto filename = tmpDir.getName() + "/entries.xdr";
+    auto entries = Bucket::convertToBucketEntry(
+        false, {}, LedgerTestUtils::generateValidLedgerEntries(200), {});
+
+    auto check = [&](XDROutputFileStream& out) {
+        auto hasher = SHA256::create();
+        size_t bytes = 0;
+        out.open(filename);
+        for (auto const& e : entries)
+        {
+            out.writeOne(e, hasher.get(), &bytes);
+        }
+        out.close();
+        REQUIRE(!out);
+        REQUIRE(fs::size(filename) == bytes);
+
+        std::vector<char> buf(bytes);
+        {
+            std::ifstream in(filename, std::ifstream::binary);
+            in.read(buf.data(), buf.size());
+        }
+        REQUIRE(sha256(ByteSlice(buf.data(), buf.size())) == hasher->finish());
+
+        XDRInputFileStream in;
+        in.open(filename);
+        BucketEntry e;
+        size_t n = 0;
+        while (in.readOne(e))
+        {
+            REQUIRE(e == entries.at(n++));
+        }
+        REQUIRE(n == entries.size());
+    };
+
+    SECTION("default")
+    {
+        XDROutputFileStream out;
+        check(out);
+    }
+    SECTION("objects spanning buffers")
+    {
+        // Rounded up to 4096 bytes, so most entries straddle two buffers.
+        XDROutputFileStream out(false, 1);
+        check(out);
+    }
+    SECTION("fsync")
+    {
+        XDROutputFileStream out(true);
+        check(out);
+    }
+    SECTION("direct")
+    {
+        XDROutputFileStream out(true, 4096, true);
+        check(out);
+        // Reusable, whether or not the filesystem allowed O_DIRECT.
+        check(out);
+    }
+    SECTION("flushed on destruction")
+    {
+        {
+            XDROutputFileStream out;
+            out.open(filename);
+            out.writeOne(entries.at(0));
+        }
+        XDRInputFileStream in;
+        in.open(filename);
+        BucketEntry e;
+        REQUIRE(in.readOne(e));
+        REQUIRE(e == entries.at(0));
+    }
+}
+
+TEST_CASE("XDRMappedInputFileStream", "[xdrstream]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    auto tmpDir = app->getTmpDirManager().tmpDir("xdrstream");
+    auto filename = tmpDir.getName() + "/entries.xdr";
+
+    SECTION("reads what XDRInputFileStream reads")
+    {
+        auto entries = writeBucketEntries(filename, 100);
+        XDRInputFileStream in;
+        XDRMappedInputFileStream mapped;
+        in.open(filename);
+        mapped.open(filename);
+        REQUIRE(mapped.size() == in.size());
+
+        BucketEntry e1, e2;
+        size_t n = 0;
+        while (in.readOne(e1))
+        {
+            REQUIRE(mapped);
+            REQUIRE(mapped.readOne(e2));
+            REQUIRE(e2 == e1);
+            REQUIRE(e2 == entries.at(n++));
+            REQUIRE(mapped.pos() == in.pos());
+        }
+        REQUIRE(n == entries.size());
+        REQUIRE(mapped);
+        REQUIRE(!mapped.readOne(e2));
+        REQUIRE(!mapped);
+    }
+    SECTION("seek")
+    {
+        auto entries = writeBucketEntries(filename, 10);
+        XDRMappedInputFileStream mapped;
+        mapped.open(filename);
+        BucketEntry e;
+        REQUIRE(mapped.readOne(e));
+        auto second = mapped.pos();
+        while (mapped.readOne(e))
+        {
+        }
+        REQUIRE(!mapped);
+        mapped.seek(second);
+        REQUIRE(mapped);
+        REQUIRE(mapped.readOne(e));
+        REQUIRE(e == entries.at(1));
+        REQUIRE_THROWS_AS(mapped.seek(mapped.size() + 1), std::runtime_error);
+    }
+    SECTION("size limit")
+    {
+        writeBucketEntries(filename, 1);
+        XDRMappedInputFileStream mapped(4);
+        mapped.open(filename);
+        BucketEntry e;
+        REQUIRE(!mapped.readOne(e));
+    }
+    SECTION("empty file")
+    {
+        std::ofstream(filename).close();
+        XDRMappedInputFileStream mapped;
+        mapped.open(filename);
+        REQUIRE(mapped.size() == 0);
+        BucketEntry e;
+        REQUIRE(!mapped.readOne(e));
+    }
+    SECTION("truncated file")
+    {
+        writeBucketEntries(filename, 1);
+        auto size = fs::size(filename);
+        std::vector<char> buf(size);
+        {
+            std::ifstream in(filename, std::ifstream::binary);
+            in.read(buf.data(), buf.size());
+        }
+        {
+            std::ofstream out(filename, std::ofstream::binary |
+                                            std::ofstream::trunc);
+            out.write(buf.data(), buf.size() - 4);
+        }
+        XDRMappedInputFileStream mapped;
+        mapped.open(filename);
+        BucketEntry e;
+        REQUIRE_THROWS_AS(mapped.readOne(e), xdr::xdr_runtime_error);
+    }
+    SECTION("missing file")
+    {
+        XDRMappedInputFileStream mapped;
+        REQUIRE_THROWS_AS(mapped.open(filename), std::runtime_error);
+    }
+}
+
+TEST_CASE("XDR input stream benchmark", "[!hide][xdrstreambench]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    auto tmpDir = app->getTmpDirManager().tmpDir("xdrstream-bench");
+    auto filename = tmpDir.getName() + "/entries.xdr";
+    size_t const n = 1000000;
+    writeBucketEntries(filename, n);
+    auto bytes = fs::size(filename);
+
+    auto runTest = [&](std::string const& name, auto& in) {
+        auto start = std::chrono::steady_clock::now();
+        in.open(filename);
+        BucketEntry e;
+        size_t count = 0;
+        while (in && in.readOne(e))
+        {
+            ++count;
+        }
+        in.close();
+        REQUIRE(count == n);
+        std::chrono::duration<double> secs =
+            std::chrono::steady_clock::now() - start;
+        CLOG(INFO, "Bucket") << name << ": " << (n / secs.count())
+                             << " entries/sec, "
+                             << (bytes / secs.count() / 1024 / 1024)
+                             << " MiB/sec";
+    };
+
+    for (int i = 0; i < 3; ++i)
+    {
+        XDRInputFileStream in;
+        runTest("ifstream", in);
+        XDRMappedInputFileStream mapped;
+        runTest("mmap", mapped);
+    }
+}